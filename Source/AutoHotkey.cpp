@@ -110,6 +110,15 @@ int WINAPI WinMain (HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLin
 			if (   !(g_script.mIncludeLibraryFunctionsThenExit = fopen(__argv[i], "w"))   ) // Can't open the temp file.
 				return CRITICAL_ERROR;
 		}
+		else if (!stricmp(param, "/Benchmark")) // Run the script headless and write timings to the file that follows (see script_benchmark.cpp).
+		{
+			++i; // Consume the next parameter too, because it's associated with this one.
+			if (i >= __argc) // Missing the expected filename parameter.
+				return CRITICAL_ERROR;
+			if (   !(g_script.mBenchmarkFile = fopen(__argv[i], "w"))   )
+				return CRITICAL_ERROR;
+			g_script.mErrorStdOut = true; // There's nobody to dismiss an error dialog.
+		}
 #endif
 		else // since this is not a recognized switch, the end of the [Switches] section has been reached (by design).
 		{
@@ -168,12 +177,19 @@ int WINAPI WinMain (HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLin
 #ifdef AUTOHOTKEYSC
 	LineNumberType load_result = g_script.LoadFromFile();
 #else
+	LARGE_INTEGER load_start;
+	if (g_script.mBenchmarkFile)
+		QueryPerformanceCounter(&load_start);
 	LineNumberType load_result = g_script.LoadFromFile(script_filespec == NULL);
 #endif
 	if (load_result == LOADING_FAILED) // Error during load (was already displayed by the function call).
 		return CRITICAL_ERROR;  // Should return this value because PostQuitMessage() also uses it.
 	if (!load_result) // LoadFromFile() relies upon us to do this check.  No lines were loaded, so we're done.
 		return 0;
+#ifndef AUTOHOTKEYSC
+	if (g_script.mBenchmarkFile) // Skip single-instance handling, windows, hooks and the message loop entirely.
+		return g_script.RunBenchmarks(load_start);
+#endif
 
 	// Unless explicitly set to be non-SingleInstance via SINGLE_INSTANCE_OFF or a special kind of
 	// SingleInstance such as SINGLE_INSTANCE_REPLACE and SINGLE_INSTANCE_IGNORE, persistent scripts
@@ -530,9 +530,12 @@ BOOL CALLBACK EnumParentActUponAll(HWND aWnd, LPARAM lParam)
 			}
 
 			if (nCmdShow != SW_NONE)
+			{
 				ShowWindow(aWnd, nCmdShow);
+				WindowSnapshotDiscard(aWnd);
 				// DoWinDelay is not done here because our caller will do it once only, which
 				// seems best when there are a lot of windows being acted upon here.
+			}
 
 			// Now that this matching window has been acted upon (or avoided due to being hung),
 			// continue the enumeration to get the next candidate window:
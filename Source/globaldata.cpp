@@ -94,6 +94,15 @@ int g_MaxHistoryKeys = 40;
 // as the maximum memory size of a variable, including the string's zero terminator.
 // The chosen default seems big enough to be flexible, yet small enough to not be a problem on 99% of systems:
 VarSizeType g_MaxVarCapacity = 64 * 1024 * 1024;
+// Set by #FileAppendBuffer.  When the buffer size is zero (the default), FileAppend opens and closes
+// the file every time.  Otherwise, it keeps the file open and buffers its writes (see FileAppend()):
+size_t g_FileAppendBufferSize = 0;
+UINT g_FileAppendFlushInterval = 1000;
+bool g_FileAppendSync = false;
+UINT g_FileAppendTimerID = 0; // Nonzero if the timer exists.  See SET_FILE_APPEND_TIMER.
+// Set by #WinCacheTime.  When nonzero, WindowSearch reuses the title, class and PID it fetched for a window
+// for this many milliseconds (see WindowSnapshotGet()):
+DWORD g_WinCacheTime = 0;
 UCHAR g_MaxThreadsPerHotkey = 1;
 int g_MaxThreadsTotal = MAX_THREADS_DEFAULT;
 // On my system, the repeat-rate (which is probably set to XP's default) is such that between 20
@@ -107,6 +116,7 @@ bool g_MaxThreadsBuffer = false;  // This feature usually does more harm than go
 HotCriterionType g_HotCriterion = HOT_NO_CRITERION;
 char *g_HotWinTitle = ""; // In spite of the above being the primary indicator,
 char *g_HotWinText = "";  // these are initialized for maintainability.
+WindowCriteria *g_HotWinCriteria = NULL; // The above parsed in advance (NULL when there's no criterion).
 HotkeyCriterion *g_FirstHotCriterion = NULL, *g_LastHotCriterion = NULL;
 
 MenuTypeType g_MenuIsVisible = MENU_TYPE_NONE;
@@ -425,8 +435,11 @@ Action g_act[] =
 
 	, {"PixelGetColor", 3, 4, 4 H, {2, 3, 0}} // OutputVar, X-coord, Y-coord [, RGB]
 	, {"PixelSearch", 0, 9, 9 H, {3, 4, 5, 6, 7, 8, 0}} // OutputX, OutputY, left, top, right, bottom, Color, Variation [, RGB]
+	, {"PixelSearchAll", 6, 8, 8 H, {2, 3, 4, 5, 6, 7, 0}} // OutputVar, left, top, right, bottom, Color [, Variation, RGB]
 	, {"ImageSearch", 0, 7, 7 H, {3, 4, 5, 6, 0}} // OutputX, OutputY, left, top, right, bottom, ImageFile
+	, {"ImageSearchAll", 6, 7, 7 H, {2, 3, 4, 5, 7, 0}} // OutputVar, left, top, right, bottom, ImageFiles [, MaxPerImage]
 	// NOTE FOR THE ABOVE: 0 min args so that the output vars can be optional.
+	, {"ImageCacheClear", 0, 1, 1, NULL} // [ImageFile]
 
 	// See above for why minimum is 1 vs. 2:
 	, {"GroupAdd", 1, 6, 6, NULL} // Group name, WinTitle, WinText, Label, exclude-title/text
@@ -520,6 +533,7 @@ Action g_act[] =
 
 	, {"ExitApp", 0, 1, 1, {1, 0}}  // Optional exit-code. v1.0.48.01: Allow an expression like ACT_EXIT does.
 	, {"Shutdown", 1, 1, 1, {1, 0}} // Seems best to make the first param (the flag/code) mandatory.
+	, {"FileFlush", 0, 1, 1, NULL} // filename (all cached files if omitted).  See ACT_FILEFLUSH for why it's last.
 };
 // Below is the most maintainable way to determine the actual count?
 // Due to C++ lang. restrictions, can't easily make this a const because constants
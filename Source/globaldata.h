@@ -87,6 +87,11 @@ extern int g_nPausedThreads;
 extern int g_MaxHistoryKeys;
 
 extern VarSizeType g_MaxVarCapacity;
+extern size_t g_FileAppendBufferSize;
+extern UINT g_FileAppendFlushInterval;
+extern bool g_FileAppendSync;
+extern UINT g_FileAppendTimerID;
+extern DWORD g_WinCacheTime;
 extern UCHAR g_MaxThreadsPerHotkey;
 extern int g_MaxThreadsTotal;
 extern int g_MaxHotkeysPerInterval;
@@ -95,6 +100,7 @@ extern bool g_MaxThreadsBuffer;
 extern HotCriterionType g_HotCriterion;
 extern char *g_HotWinTitle;
 extern char *g_HotWinText;
+extern WindowCriteria *g_HotWinCriteria;
 extern HotkeyCriterion *g_FirstHotCriterion, *g_LastHotCriterion;
 
 extern MenuTypeType g_MenuIsVisible;
@@ -213,7 +219,7 @@ extern bool g_KeyHistoryToFile;
 
 enum OurTimers {TIMER_ID_MAIN = MAX_MSGBOXES + 2 // The first timers in the series are used by the MessageBoxes.  Start at +2 to give an extra margin of safety.
 	, TIMER_ID_UNINTERRUPTIBLE // Obsolete but kept as a a placeholder for backward compatibility, so that this and the other the timer-ID's stay the same, and so that obsolete IDs aren't reused for new things (in case anyone is interfacing these OnMessage() or with external applications).
-	, TIMER_ID_AUTOEXEC, TIMER_ID_INPUT, TIMER_ID_DEREF, TIMER_ID_REFRESH_INTERRUPTIBILITY};
+	, TIMER_ID_AUTOEXEC, TIMER_ID_INPUT, TIMER_ID_DEREF, TIMER_ID_REFRESH_INTERRUPTIBILITY, TIMER_ID_FILE_APPEND};
 
 // MUST MAKE main timer and uninterruptible timers associated with our main window so that
 // MainWindowProc() will be able to process them when it is called by the DispatchMessage()
@@ -280,6 +286,14 @@ if (!g_InputTimerExists)\
 #define SET_DEREF_TIMER(aTimeoutValue) g_DerefTimerExists = SetTimer(g_hWnd, TIMER_ID_DEREF, aTimeoutValue, DerefTimeout);
 #define LARGE_DEREF_BUF_SIZE (4*1024*1024)
 
+// Flushes the files cached by FileAppend shortly after they were written.  Unlike the deref timer,
+// this one is not reset by each write; otherwise a script that writes continuously would never flush.
+// When there is no main window (/Benchmark), SetTimer() ignores TIMER_ID_FILE_APPEND and returns an ID
+// of its own choosing, which must be the one given to KillTimer().  The ID is stored either way:
+#define SET_FILE_APPEND_TIMER \
+if (!g_FileAppendTimerID)\
+	g_FileAppendTimerID = SetTimer(g_hWnd, TIMER_ID_FILE_APPEND, g_FileAppendFlushInterval, FileAppendTimeout);
+
 #define KILL_MAIN_TIMER \
 if (g_MainTimerExists && KillTimer(g_hWnd, TIMER_ID_MAIN))\
 	g_MainTimerExists = false;
@@ -299,4 +313,8 @@ if (g_InputTimerExists && KillTimer(g_hWnd, TIMER_ID_INPUT))\
 if (g_DerefTimerExists && KillTimer(g_hWnd, TIMER_ID_DEREF))\
 	g_DerefTimerExists = false;
 
+#define KILL_FILE_APPEND_TIMER \
+if (g_FileAppendTimerID && KillTimer(g_hWnd, g_hWnd ? TIMER_ID_FILE_APPEND : g_FileAppendTimerID))\
+	g_FileAppendTimerID = 0;
+
 #endif
@@ -33,23 +33,24 @@ DWORD Hotkey::sJoyHotkeyCount = 0;
 
 
 
-HWND HotCriterionAllowsFiring(HotCriterionType aHotCriterion, char *aWinTitle, char *aWinText)
+HWND HotCriterionAllowsFiring(HotCriterionType aHotCriterion, WindowCriteria *aCriteria)
 // This is a global function because it's used by both hotkeys and hotstrings.
 // In addition to being called by the hook thread, this can now be called by the main thread.
 // That happens when a WM_HOTKEY message arrives that is non-hook (such as for Win9x).
 // Returns a non-NULL HWND if firing is allowed.  However, if it's a global criterion or
 // a "not-criterion" such as #IfWinNotActive, (HWND)1 is returned rather than a genuine HWND.
+// aCriteria was parsed by SetGlobalHotTitleText(), so nothing needs to be parsed here.
 {
 	HWND found_hwnd;
 	switch(aHotCriterion)
 	{
 	case HOT_IF_ACTIVE:
 	case HOT_IF_NOT_ACTIVE:
-		found_hwnd = WinActive(g_default, aWinTitle, aWinText, "", "", false); // Thread-safe.
+		found_hwnd = WinActive(g_default, *aCriteria); // Thread-safe.
 		break;
 	case HOT_IF_EXIST:
 	case HOT_IF_NOT_EXIST:
-		found_hwnd = WinExist(g_default, aWinTitle, aWinText, "", "", false, false); // Thread-safe.
+		found_hwnd = WinExist(g_default, *aCriteria); // Thread-safe.
 		break;
 	default: // HOT_NO_CRITERION (listed last because most callers avoids calling here by checking this value first).
 		return (HWND)1; // Always allow hotkey to fire.
@@ -70,6 +71,7 @@ ResultType SetGlobalHotTitleText(char *aWinTitle, char *aWinText)
 		g_HotCriterion = HOT_NO_CRITERION; // Don't allow blank title+text to avoid having it interpreted as the last-found-window.
 		g_HotWinTitle = ""; // Helps maintainability and some things might rely on it.
 		g_HotWinText = "";  //
+		g_HotWinCriteria = NULL;
 		return OK;
 	}
 
@@ -83,6 +85,7 @@ ResultType SetGlobalHotTitleText(char *aWinTitle, char *aWinText)
 			// Match found, so point to the existing memory.
 			g_HotWinTitle = cp->mHotWinTitle;
 			g_HotWinText = cp->mHotWinText;
+			g_HotWinCriteria = cp->mHotWinCriteria;
 			return OK;
 		}
 
@@ -105,9 +108,14 @@ ResultType SetGlobalHotTitleText(char *aWinTitle, char *aWinText)
 	}
 	else
 		cp->mHotWinText = "";
+	// Parse the criteria now so that the hook doesn't have to each time one of these hotkeys is pressed:
+	if (   !(cp->mHotWinCriteria = (WindowCriteria *)SimpleHeap::Malloc(sizeof(WindowCriteria)))
+		|| !cp->mHotWinCriteria->Compile(cp->mHotWinTitle, cp->mHotWinText)   )
+		return FAIL;
 
 	g_HotWinTitle = cp->mHotWinTitle;
 	g_HotWinText = cp->mHotWinText;
+	g_HotWinCriteria = cp->mHotWinCriteria;
 
 	// Update the linked list:
 	if (!g_FirstHotCriterion)
@@ -517,7 +525,7 @@ bool Hotkey::PrefixHasNoEnabledSuffixes(int aVKorSC, bool aIsSC)
 			if (   vp->mEnabled // This particular variant within its parent hotkey is enabled.
 				&& (!g_IsSuspended || vp->mJumpToLabel->IsExemptFromSuspend()) // This variant isn't suspended...
 				&& (!vp->mHotCriterion || HotCriterionAllowsFiring(vp->mHotCriterion
-					, vp->mHotWinTitle, vp->mHotWinText))   ) // ... and its critieria allow it to fire.
+					, vp->mHotWinCriteria))   ) // ... and its critieria allow it to fire.
 				return false; // At least one of this prefix's suffixes is eligible for firing.
 	}
 	// Since above didn't return, no hotkeys were found for this prefix that are capable of firing.
@@ -560,7 +568,7 @@ HotkeyVariant *Hotkey::CriterionAllowsFiring(HWND *aFoundHWND)
 		if (   vp->mEnabled // This particular variant within its parent hotkey is enabled.
 			&& (!g_IsSuspended || vp->mJumpToLabel->IsExemptFromSuspend()) // This variant isn't suspended...
 			&& (!vp->mHotCriterion || (found_hwnd = HotCriterionAllowsFiring(vp->mHotCriterion
-				, vp->mHotWinTitle, vp->mHotWinText)))   ) // ... and its critieria allow it to fire.
+				, vp->mHotWinCriteria)))   ) // ... and its critieria allow it to fire.
 		{
 			if (vp->mHotCriterion) // Since this is the first criteria hotkey, it takes precedence.
 				return vp;
@@ -1502,6 +1510,7 @@ HotkeyVariant *Hotkey::AddVariant(Label *aJumpToLabel, bool aSuffixHasTilde)
 	v.mHotCriterion = g_HotCriterion; // If this hotkey is an alt-tab one (mHookAction), this is stored but ignored until/unless the Hotkey command converts it into a non-alt-tab hotkey.
 	v.mHotWinTitle = g_HotWinTitle;
 	v.mHotWinText = g_HotWinText;  // The value of this and other globals used above can vary during load-time.
+	v.mHotWinCriteria = g_HotWinCriteria;
 	v.mEnabled = true;
 	if (aSuffixHasTilde)
 	{
@@ -2382,7 +2391,7 @@ Hotstring::Hotstring(Label *aJumpToLabel, char *aOptions, char *aHotstring, char
 	, mOmitEndChar(g_HSOmitEndChar), mSendRaw(aHasContinuationSection ? true : g_HSSendRaw)
 	, mEndCharRequired(g_HSEndCharRequired), mDetectWhenInsideWord(g_HSDetectWhenInsideWord), mDoReset(g_HSDoReset)
 	, mHotCriterion(g_HotCriterion)
-	, mHotWinTitle(g_HotWinTitle), mHotWinText(g_HotWinText)
+	, mHotWinTitle(g_HotWinTitle), mHotWinText(g_HotWinText), mHotWinCriteria(g_HotWinCriteria)
 	, mConstructedOK(false)
 {
 	// Insist on certain qualities so that they never need to be checked other than here:
@@ -59,7 +59,8 @@ enum HotkeyTypeEnum {HK_NORMAL, HK_KEYBD_HOOK, HK_MOUSE_HOOK, HK_BOTH_HOOKS, HK_
 
 typedef UCHAR HotCriterionType;
 enum HotCriterionEnum {HOT_NO_CRITERION, HOT_IF_ACTIVE, HOT_IF_NOT_ACTIVE, HOT_IF_EXIST, HOT_IF_NOT_EXIST}; // HOT_NO_CRITERION must be zero.
-HWND HotCriterionAllowsFiring(HotCriterionType aHotCriterion, char *aWinTitle, char *aWinText); // Used by hotkeys and hotstrings.
+class WindowCriteria; // Defined in window.h, which can't be included here.
+HWND HotCriterionAllowsFiring(HotCriterionType aHotCriterion, WindowCriteria *aCriteria); // Used by hotkeys and hotstrings.
 ResultType SetGlobalHotTitleText(char *aWinTitle, char *aWinText);
 
 
@@ -67,6 +68,7 @@ ResultType SetGlobalHotTitleText(char *aWinTitle, char *aWinText);
 struct HotkeyCriterion
 {
 	char *mHotWinTitle, *mHotWinText;
+	WindowCriteria *mHotWinCriteria; // The above parsed once rather than each time a hotkey is pressed.
 	HotkeyCriterion *mNextCriterion;
 };
 
@@ -77,6 +79,7 @@ struct HotkeyVariant
 	Label *mJumpToLabel;
 	DWORD mRunAgainTime;
 	char *mHotWinTitle, *mHotWinText;
+	WindowCriteria *mHotWinCriteria;
 	HotkeyVariant *mNextVariant;
 	int mPriority;
 	// Keep members that are less than 32-bit adjacent to each other to conserve memory in with the default
@@ -333,6 +336,7 @@ public:
 
 	Label *mJumpToLabel;
 	char *mString, *mReplacement, *mHotWinTitle, *mHotWinText;
+	WindowCriteria *mHotWinCriteria;
 	int mPriority, mKeyDelay;
 
 	// Keep members that are smaller than 32-bit adjacent with each other to conserve memory (due to 4-byte alignment).
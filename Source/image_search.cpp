@@ -0,0 +1,602 @@
+/*
+AutoHotkey
+
+Copyright 2003-2009 Chris Mallett (support@autohotkey.com)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+
+#include "stdafx.h" // pre-compiled headers
+#include "image_search.h"
+
+// SSE2 is used when the CPU supports it (see IsSSE2Available()).  Compilers that target x86 provide the
+// intrinsics even when they aren't told to generate SSE2 code on their own.
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+	#define IMAGE_SEARCH_SSE2
+	#include <emmintrin.h>
+#endif
+
+// Each pixel of the image has a "care" mask, which is 0 for pixels that match any color (transparent ones)
+// and IMAGE_SEARCH_RGB_BITS (or IMAGE_SEARCH_RGB16_BITS) for all others.  Only the RGB bits are compared
+// because the high-order byte of screen pixels isn't meaningful.  If either the screen or the image has
+// 16-bit color depth, only the bits that such a bitmap has are compared.
+#define IMAGE_SEARCH_RGB_BITS 0x00FFFFFF
+#define IMAGE_SEARCH_RGB16_BITS 0x00F8F8F8
+
+// In pyramid mode, the screen is searched at a resolution this many times lower first.  Images too small
+// for it are searched at half this, and so on.
+#define IMAGE_SEARCH_PYRAMID_BLOCK 4
+
+
+
+static bool IsSSE2Available()
+// Returns true if the CPU supports SSE2 and the OS preserves the XMM registers across task switches,
+// both of which IsProcessorFeaturePresent() checks.
+{
+	static int sAvailable = -1; // The result is cached since it never changes.
+	if (sAvailable == -1)
+	{
+		// Load it dynamically because it doesn't exist on Win95.
+		typedef BOOL (WINAPI *MyIsProcessorFeaturePresentType)(DWORD);
+		MyIsProcessorFeaturePresentType MyIsProcessorFeaturePresent = (MyIsProcessorFeaturePresentType)
+			GetProcAddress(GetModuleHandle("kernel32"), "IsProcessorFeaturePresent");
+		sAvailable = MyIsProcessorFeaturePresent && MyIsProcessorFeaturePresent(10); // 10 is PF_XMMI64_INSTRUCTIONS_AVAILABLE, which older SDKs don't define.
+	}
+	return sAvailable == 1;
+}
+
+
+
+static inline bool PixelMatches(COLORREF aScreen, COLORREF aImage, COLORREF aCare, int aVariation)
+// Returns true if each of aScreen's color components is within aVariation shades of aImage's (or
+// if aCare indicates a transparent pixel).  An aVariation of 0 means an exact match.  aImage must
+// already have been masked by aCare.
+{
+	if (!aCare)
+		return true;
+	aScreen &= aCare;
+	int diff;
+	for (int shift = 0; shift < 24; shift += 8)
+	{
+		diff = (int)((aScreen >> shift) & 0xFF) - (int)((aImage >> shift) & 0xFF);
+		if (diff > aVariation || diff < -aVariation)
+			return false;
+	}
+	return true;
+}
+
+
+
+#ifdef IMAGE_SEARCH_SSE2
+static inline __m128i PixelMismatches4(__m128i aScreen, __m128i aImage, __m128i aCare, __m128i aVariation)
+// The SSE2 equivalent of PixelMatches() for four pixels at once.  Returns a vector whose pixels are
+// non-zero where they don't match.  aVariation contains the variation in every byte.
+{
+	aScreen = _mm_and_si128(aScreen, aCare);
+	// The saturating subtractions yield the absolute difference of each byte, which then exceeds the
+	// variation only where the result of the second subtraction is non-zero:
+	__m128i diff = _mm_or_si128(_mm_subs_epu8(aScreen, aImage), _mm_subs_epu8(aImage, aScreen));
+	return _mm_subs_epu8(diff, aVariation);
+}
+#endif
+
+
+
+static bool CandidateMatches(LPCOLORREF aScreen, int aScreenWidth, LPCOLORREF aImage, LPCOLORREF aCare
+	, int aImageWidth, int aImageHeight, int aVariation, bool aUseSSE2)
+// Returns true if the aImageWidth x aImageHeight region of the screen whose upper-left pixel is aScreen
+// matches the image.  aImage's pixels must already have been masked by aCare.
+{
+	int x;
+	for (int y = 0; y < aImageHeight; ++y, aScreen += aScreenWidth, aImage += aImageWidth, aCare += aImageWidth)
+	{
+		x = 0;
+#ifdef IMAGE_SEARCH_SSE2
+		if (aUseSSE2)
+		{
+			__m128i variation = _mm_set1_epi8((char)aVariation);
+			for (; x + 4 <= aImageWidth; x += 4)
+			{
+				__m128i mismatches = PixelMismatches4(_mm_loadu_si128((__m128i *)(aScreen + x))
+					, _mm_loadu_si128((__m128i *)(aImage + x)), _mm_loadu_si128((__m128i *)(aCare + x)), variation);
+				if (_mm_movemask_epi8(_mm_cmpeq_epi32(mismatches, _mm_setzero_si128())) != 0xFFFF)
+					return false;
+			}
+		}
+#endif
+		for (; x < aImageWidth; ++x) // The remaining pixels of this row, or all of them if SSE2 isn't in use.
+			if (!PixelMatches(aScreen[x], aImage[x], aCare[x], aVariation))
+				return false;
+	}
+	return true;
+}
+
+
+
+// A template prepared for scanning one level of the search: either the screen itself or, in pyramid mode,
+// the screen reduced to the average of each block of pixels (see ImageSearchReduceScreen()).
+struct ImageSearchLevel
+{
+	LPCOLORREF image;      // The template's pixels, masked by care.
+	LPCOLORREF care;       // See IMAGE_SEARCH_RGB_BITS.
+	int width, height;
+	int variation;
+	int anchor_offset;     // The anchor's offset on the screen from the upper-left corner (see ScanRow()).
+	COLORREF anchor_pixel, anchor_care;
+};
+
+
+
+static void SetAnchor(ImageSearchLevel &aLevel, int aScreenWidth)
+// Rather than comparing the image's first pixel to each position (which is useless when that pixel is
+// transparent), the first pixel that isn't transparent is the "anchor".  Each row of the screen is scanned
+// for the anchor, which rules out nearly all positions with only one comparison each.  Only where the
+// anchor matches is the rest of the image compared.  If the whole image is transparent, every position
+// is a match.
+{
+	int i, pixel_count = aLevel.width * aLevel.height;
+	for (i = 0; i < pixel_count && !aLevel.care[i]; ++i);
+	if (i == pixel_count)
+	{
+		aLevel.anchor_offset = 0;
+		aLevel.anchor_pixel = aLevel.anchor_care = 0; // Matches any color.
+		return;
+	}
+	aLevel.anchor_offset = (i / aLevel.width) * aScreenWidth + i % aLevel.width;
+	aLevel.anchor_pixel = aLevel.image[i];
+	aLevel.anchor_care = aLevel.care[i];
+}
+
+
+
+static int ScanRow(LPCOLORREF aRow, int aScreenWidth, int aCandidateCount, ImageSearchLevel &aLevel
+	, bool aUseSSE2, int *aFound)
+// Tests the aCandidateCount positions of the image's upper-left corner that start at aRow (within a screen
+// of aScreenWidth pixels per row), from left to right.  Stores the offset from aRow of each position at
+// which the image matches into aFound, which must have room for aCandidateCount items.
+// Returns the number of positions found.
+{
+	LPCOLORREF anchor_row = aRow + aLevel.anchor_offset;
+	int x = 0, i, mask, found_count = 0;
+#ifdef IMAGE_SEARCH_SSE2
+	if (aUseSSE2)
+	{
+		__m128i pixel = _mm_set1_epi32((int)aLevel.anchor_pixel), pixel_care = _mm_set1_epi32((int)aLevel.anchor_care);
+		__m128i variation = _mm_set1_epi8((char)aLevel.variation), zero = _mm_setzero_si128();
+		for (; x + 4 <= aCandidateCount; x += 4)
+		{
+			// Each set bit of mask indicates a byte of a pixel that matches the anchor:
+			mask = _mm_movemask_epi8(_mm_cmpeq_epi32(PixelMismatches4(_mm_loadu_si128((__m128i *)(anchor_row + x))
+				, pixel, pixel_care, variation), zero));
+			for (i = 0; mask; ++i, mask >>= 4)
+				if ((mask & 0xF) && CandidateMatches(aRow + x + i, aScreenWidth, aLevel.image, aLevel.care
+					, aLevel.width, aLevel.height, aLevel.variation, true))
+					aFound[found_count++] = x + i;
+		}
+	}
+#endif
+	for (; x < aCandidateCount; ++x) // The remaining positions of this row, or all of them if SSE2 isn't in use.
+		if (PixelMatches(anchor_row[x], aLevel.anchor_pixel, aLevel.anchor_care, aLevel.variation)
+			&& CandidateMatches(aRow + x, aScreenWidth, aLevel.image, aLevel.care, aLevel.width, aLevel.height
+				, aLevel.variation, aUseSSE2))
+			aFound[found_count++] = x;
+	return found_count;
+}
+
+
+
+static inline COLORREF BlockAverage(LPCOLORREF aPixel, int aRowWidth, int aBlockSize, COLORREF aColorBits)
+// Returns the average of each color component of the aBlockSize x aBlockSize block of pixels whose
+// upper-left pixel is aPixel (rounded down), after masking each pixel by aColorBits.
+{
+	UINT r = 0, g = 0, b = 0;
+	COLORREF pixel;
+	for (int y = 0; y < aBlockSize; ++y, aPixel += aRowWidth)
+		for (int x = 0; x < aBlockSize; ++x)
+		{
+			pixel = aPixel[x] & aColorBits;
+			r += pixel & 0xFF;
+			g += (pixel >> 8) & 0xFF;
+			b += pixel >> 16;
+		}
+	int block_pixels = aBlockSize * aBlockSize;
+	return (r / block_pixels) | ((g / block_pixels) << 8) | ((b / block_pixels) << 16);
+}
+
+
+
+static void ImageSearchReduceScreen(LPCOLORREF aScreen, int aScreenWidth, LPCOLORREF aCoarse, int aCoarseWidth
+	, int aCoarseHeight, int aBlockSize, COLORREF aColorBits)
+// Sets each pixel of aCoarse to the average of the corresponding aBlockSize x aBlockSize block of aScreen.
+{
+	for (int y = 0; y < aCoarseHeight; ++y, aScreen += aScreenWidth * aBlockSize)
+		for (int x = 0; x < aCoarseWidth; ++x)
+			*aCoarse++ = BlockAverage(aScreen + x * aBlockSize, aScreenWidth, aBlockSize, aColorBits);
+}
+
+
+
+static void ImageSearchReduceImage(ImageSearchLevel &aFine, int aLeft, int aTop, int aBlockSize
+	, ImageSearchLevel &aCoarse)
+// Sets aCoarse's pixels to the averages of the blocks of aFine's pixels that start at column aLeft and row
+// aTop (any partial blocks at the right and bottom are left out).  A block is transparent if any of its
+// pixels are, since a transparent pixel's screen color can be anything.  aCoarse's image and care must
+// have room for the blocks.
+{
+	aCoarse.width = (aFine.width - aLeft) / aBlockSize;
+	aCoarse.height = (aFine.height - aTop) / aBlockSize;
+	aCoarse.variation = aFine.variation;
+	int bx, by, x, y, i = 0;
+	LPCOLORREF block_care;
+	for (by = 0; by < aCoarse.height; ++by)
+		for (bx = 0; bx < aCoarse.width; ++bx, ++i)
+		{
+			block_care = aFine.care + (aTop + by * aBlockSize) * aFine.width + aLeft + bx * aBlockSize;
+			aCoarse.care[i] = IMAGE_SEARCH_RGB_BITS; // Averages can have any value, even if the pixels are 16-bit.
+			for (y = 0; y < aBlockSize; ++y)
+				for (x = 0; x < aBlockSize; ++x)
+					if (!block_care[y * aFine.width + x])
+						aCoarse.care[i] = 0;
+			aCoarse.image[i] = aCoarse.care[i]
+				? BlockAverage(aFine.image + (block_care - aFine.care), aFine.width, aBlockSize, IMAGE_SEARCH_RGB_BITS)
+				: 0;
+		}
+}
+
+
+
+static int CompareInts(const void *a1, const void *a2)
+{
+	return *(int *)a1 - *(int *)a2;
+}
+
+
+
+int ImageSearchFind(LPCOLORREF aScreen, int aScreenWidth, int aScreenHeight, bool aScreenIs16bit
+	, ImageSearchTemplate &aImage, POINT *&aMatch, int aMaxMatches)
+// Searches aScreen (aScreenWidth x aScreenHeight pixels, top row first) for aImage, trying the possible
+// positions of its upper-left corner from left to right, then from top to bottom.  Stops after finding
+// aMaxMatches positions (0 means no limit).  Caller must have set aMatch to NULL; upon return, it's
+// either still NULL or a malloc'd array of the positions found, which caller must free (even upon failure).
+// Returns the number of positions found, or -1 if out of memory.
+// Transparent pixels (see ImageSearchTemplate) match any color.  Only the RGB bits of the pixels are
+// compared, so the caller needn't mask out the high-order byte of aScreen's pixels.
+{
+	if (aImage.width < 1 || aImage.height < 1 || aImage.width > aScreenWidth || aImage.height > aScreenHeight)
+		return 0;
+
+	// In pyramid mode, the screen and image are reduced to the averages of blocks of block_size x block_size
+	// pixels (see IMAGE_SEARCH_PYRAMID_BLOCK).  Smaller images aren't worth reducing, so they're searched
+	// as though pyramid mode were off.
+	int block_size = 0;
+	if (aImage.pyramid)
+		for (block_size = IMAGE_SEARCH_PYRAMID_BLOCK; block_size > 1; block_size /= 2)
+			if (aImage.width >= 2 * block_size - 1 && aImage.height >= 2 * block_size - 1) // See "phase" below.
+				break;
+	if (block_size < 2)
+		block_size = 0;
+
+	// Prepare the care mask (see IMAGE_SEARCH_RGB_BITS) and a copy of the image's pixels masked by it.
+	// The same allocation holds the buffers that ScanRow() stores found positions into and, in pyramid mode,
+	// the reduced images (which are at most the size of the image in total).
+	COLORREF color_bits = (aScreenIs16bit || aImage.is_16bit) ? IMAGE_SEARCH_RGB16_BITS : IMAGE_SEARCH_RGB_BITS;
+	COLORREF trans_color = (aImage.trans_color == CLR_NONE) ? CLR_NONE : aImage.trans_color & color_bits;
+	int image_pixel_count = aImage.width * aImage.height;
+	int candidate_count = aScreenWidth - aImage.width + 1; // The number of positions in each row.
+	LPCOLORREF care = (LPCOLORREF)malloc((block_size ? 4 : 2) * image_pixel_count * sizeof(COLORREF)
+		+ 2 * candidate_count * sizeof(int));
+	if (!care)
+		return -1;
+	ImageSearchLevel level;
+	level.care = care;
+	level.image = care + image_pixel_count;
+	level.width = aImage.width;
+	level.height = aImage.height;
+	level.variation = aImage.variation;
+	int *found = (int *)(level.image + image_pixel_count), *row_found = found + candidate_count;
+	int i;
+	for (i = 0; i < image_pixel_count; ++i)
+	{
+		level.image[i] = aImage.pixel[i] & color_bits;
+		if (aImage.mask && aImage.mask[i] || level.image[i] == trans_color) // This should be okay even if trans_color==CLR_NONE, since CLR_NONE should never occur naturally in the image.
+			level.care[i] = level.image[i] = 0;
+		else
+			level.care[i] = color_bits;
+	}
+	SetAnchor(level, aScreenWidth);
+
+	bool use_sse2 = IsSSE2Available();
+	int x, y, found_count, match_count = 0, match_size = 0;
+	POINT *new_match;
+	LPCOLORREF coarse_screen = NULL; // Used only in pyramid mode.
+	int coarse_width, coarse_height, phase_x, phase_y, left, top, coarse_left, coarse_right, row_found_count;
+
+	// The following macro records a match at column aCol of row y, then stops if the limit has been reached.
+	#define IMAGE_SEARCH_ADD_MATCH(aCol) \
+	{\
+		if (match_count == match_size)\
+		{\
+			match_size = match_size ? match_size * 2 : 16;\
+			if (aMaxMatches && match_size > aMaxMatches)\
+				match_size = aMaxMatches;\
+			if (   !(new_match = (POINT *)realloc(aMatch, match_size * sizeof(POINT)))   )\
+			{\
+				match_count = -1;\
+				goto end;\
+			}\
+			aMatch = new_match;\
+		}\
+		aMatch[match_count].x = (aCol);\
+		aMatch[match_count].y = y;\
+		if (++match_count == aMaxMatches)\
+			goto end;\
+	}
+
+	if (!block_size)
+	{
+		for (y = 0; y <= aScreenHeight - aImage.height; ++y)
+		{
+			found_count = ScanRow(aScreen + y * aScreenWidth, aScreenWidth, candidate_count, level, use_sse2, found);
+			for (i = 0; i < found_count; ++i)
+				IMAGE_SEARCH_ADD_MATCH(found[i])
+		}
+		goto end;
+	}
+
+	// Otherwise, pyramid mode.  Since every pixel of a matching position is within variation shades of the
+	// image's, so is the average of each block of them (rounding down both averages doesn't change that).
+	// Thus the positions at which the reduced image matches the reduced screen are the only ones that need
+	// to be compared at full resolution, and no matches can be missed.  The block grid is fixed on the
+	// screen, so a position whose column is "phase" pixels past a block boundary lines up with the blocks
+	// of the image that start (block_size - phase) % block_size pixels from its left edge.  There is one
+	// reduced image for each combination of horizontal and vertical phase.
+	coarse_width = aScreenWidth / block_size;
+	coarse_height = aScreenHeight / block_size;
+	if (   !(coarse_screen = (LPCOLORREF)malloc(coarse_width * coarse_height * sizeof(COLORREF)))   )
+	{
+		match_count = -1;
+		goto end;
+	}
+	ImageSearchReduceScreen(aScreen, aScreenWidth, coarse_screen, coarse_width, coarse_height, block_size, color_bits);
+
+	ImageSearchLevel coarse[IMAGE_SEARCH_PYRAMID_BLOCK * IMAGE_SEARCH_PYRAMID_BLOCK];
+	int coarse_pixel_count; // The most pixels a reduced image can have.
+	coarse_pixel_count = image_pixel_count / (block_size * block_size);
+	for (phase_y = 0, i = 0; phase_y < block_size; ++phase_y)
+		for (phase_x = 0; phase_x < block_size; ++phase_x, ++i)
+		{
+			coarse[i].care = (LPCOLORREF)(row_found + candidate_count) + 2 * i * coarse_pixel_count; // See malloc() above.
+			coarse[i].image = coarse[i].care + coarse_pixel_count;
+			ImageSearchReduceImage(level, (block_size - phase_x) % block_size, (block_size - phase_y) % block_size
+				, block_size, coarse[i]);
+			SetAnchor(coarse[i], coarse_width);
+		}
+
+	for (y = 0; y <= aScreenHeight - aImage.height; ++y)
+	{
+		// Find the positions in this row at which any of the reduced images matches, then compare the
+		// full image at each of them:
+		phase_y = y % block_size;
+		top = (block_size - phase_y) % block_size;
+		row_found_count = 0;
+		for (phase_x = 0; phase_x < block_size; ++phase_x)
+		{
+			left = (block_size - phase_x) % block_size;
+			// The range of blocks whose positions (minus left) lie within the row:
+			coarse_left = left ? 1 : 0;
+			coarse_right = (aScreenWidth - aImage.width + left) / block_size;
+			if (coarse_right < coarse_left)
+				continue;
+			ImageSearchLevel &coarse_level = coarse[phase_y * block_size + phase_x];
+			found_count = ScanRow(coarse_screen + ((y + top) / block_size) * coarse_width + coarse_left, coarse_width
+				, coarse_right - coarse_left + 1, coarse_level, use_sse2, found);
+			for (i = 0; i < found_count; ++i)
+			{
+				x = (coarse_left + found[i]) * block_size - left;
+				if (CandidateMatches(aScreen + y * aScreenWidth + x, aScreenWidth, level.image, level.care
+					, level.width, level.height, level.variation, use_sse2))
+					row_found[row_found_count++] = x;
+			}
+		}
+		// Each phase found its positions in order, but they're interleaved with those of the others:
+		if (row_found_count > 1)
+			qsort(row_found, row_found_count, sizeof(int), CompareInts);
+		for (i = 0; i < row_found_count; ++i)
+			IMAGE_SEARCH_ADD_MATCH(row_found[i])
+	}
+
+end:
+	free(coarse_screen); // free() handles NULL.
+	free(care);
+	return match_count;
+}
+
+
+
+// PixelSearch's color range.  A pixel matches if each of its bytes, after masking by bits, is between
+// the corresponding bytes of low and high.  The high-order byte of both low and high is zero, so that
+// byte of the pixel (which isn't meaningful) is ignored via bits.
+struct PixelSearchRange
+{
+	COLORREF bits, low, high;
+};
+
+
+
+static void PixelSearchSetRange(PixelSearchRange &aRange, COLORREF aColorRGB, int aVariation, bool aIs16bit)
+// Allow colors to vary within the spectrum of intensity, rather than having them wrap around (which
+// doesn't seem to make much sense).  For example, if the user specified a variation of 5, but the red
+// component of the color is only 0x01, red's low limit shouldn't go below zero, which would cause it
+// to wrap around to a very intense red color.  A variation of 0 means an exact match.
+{
+	// "On 16bit and 15 bit color the first 5 bits in each byte are valid (in 16bit there is an extra bit
+	// but i forgot for which color)."  So only those bits of both the screen and the color are compared.
+	aRange.bits = aIs16bit ? IMAGE_SEARCH_RGB16_BITS : IMAGE_SEARCH_RGB_BITS;
+	aColorRGB &= aRange.bits;
+	aRange.low = aRange.high = 0;
+	int component;
+	for (int shift = 0; shift < 24; shift += 8)
+	{
+		component = (aColorRGB >> shift) & 0xFF;
+		aRange.low |= (COLORREF)(component < aVariation ? 0 : component - aVariation) << shift;
+		aRange.high |= (COLORREF)(component + aVariation > 0xFF ? 0xFF : component + aVariation) << shift;
+	}
+}
+
+
+
+static inline bool PixelInRange(COLORREF aPixel, PixelSearchRange &aRange)
+{
+	aPixel &= aRange.bits;
+	BYTE component;
+	for (int shift = 0; shift < 24; shift += 8)
+	{
+		component = (BYTE)(aPixel >> shift);
+		if (component < (BYTE)(aRange.low >> shift) || component > (BYTE)(aRange.high >> shift))
+			return false;
+	}
+	return true;
+}
+
+
+
+#ifdef IMAGE_SEARCH_SSE2
+static inline UINT PixelMatchMask4(LPCOLORREF aPixel, __m128i aBits, __m128i aLow, __m128i aHigh)
+// The SSE2 equivalent of PixelInRange() for the four pixels starting at aPixel.  Each byte of a pixel is
+// within the range if subtracting the pixel from the low limit and the high limit from the pixel both
+// saturate to zero.  Each bit of the result corresponds to a byte, so all four of a pixel's bits are set
+// if it matches and none are set otherwise.
+{
+	__m128i pixel = _mm_and_si128(_mm_loadu_si128((__m128i *)aPixel), aBits);
+	return (UINT)_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_or_si128(_mm_subs_epu8(aLow, pixel)
+		, _mm_subs_epu8(pixel, aHigh)), _mm_setzero_si128()));
+}
+#endif
+
+
+
+static int PixelScan(LPCOLORREF aRow, int aFrom, int aTo, bool aWantMatch, PixelSearchRange &aRange, bool aUseSSE2)
+// Returns the index of the first pixel of aRow that matches aRange (or that doesn't, if aWantMatch is
+// false), checking from aFrom through aTo inclusive.  If aTo is less than aFrom, the pixels are checked
+// from right to left.  Returns -1 if there isn't one.
+{
+	int step = aTo < aFrom ? -1 : 1;
+	int x = aFrom;
+#ifdef IMAGE_SEARCH_SSE2
+	if (aUseSSE2)
+	{
+		// Check 8 pixels per iteration.  Each group of four bits of mask corresponds to a pixel (see
+		// PixelMatchMask4()), from left to right starting at the low-order bits.
+		__m128i bits = _mm_set1_epi32((int)aRange.bits), low = _mm_set1_epi32((int)aRange.low)
+			, high = _mm_set1_epi32((int)aRange.high);
+		UINT mask;
+		int i;
+		if (step > 0)
+		{
+			for (; x + 8 <= aTo + 1; x += 8)
+			{
+				mask = PixelMatchMask4(aRow + x, bits, low, high) | (PixelMatchMask4(aRow + x + 4, bits, low, high) << 16);
+				if (!aWantMatch)
+					mask = ~mask;
+				if (mask)
+				{
+					for (i = 0; !(mask & 0xF); ++i, mask >>= 4);
+					return x + i;
+				}
+			}
+		}
+		else
+		{
+			for (; x - 8 >= aTo - 1; x -= 8) // The pixels from x - 7 through x.
+			{
+				mask = PixelMatchMask4(aRow + x - 7, bits, low, high) | (PixelMatchMask4(aRow + x - 3, bits, low, high) << 16);
+				if (!aWantMatch)
+					mask = ~mask;
+				if (mask)
+				{
+					for (i = 0; !(mask & 0xF0000000); ++i, mask <<= 4);
+					return x - i;
+				}
+			}
+		}
+	}
+#endif
+	for (; x != aTo + step; x += step) // The remaining pixels, or all of them if SSE2 isn't in use.
+		if (PixelInRange(aRow[x], aRange) == aWantMatch)
+			return x;
+	return -1;
+}
+
+
+
+bool PixelSearchFind(LPCOLORREF aScreen, int aScreenWidth, int aScreenHeight, bool aScreenIs16bit
+	, COLORREF aColorRGB, int aVariation, bool aRightToLeft, bool aBottomToTop, POINT &aMatch)
+// Searches aScreen (aScreenWidth x aScreenHeight pixels, top row first) for the first pixel whose color
+// is within aVariation shades of aColorRGB, going through each row in the direction indicated by
+// aRightToLeft and through the rows in the direction indicated by aBottomToTop.  Returns true and sets
+// aMatch to the pixel's position if one is found.
+{
+	PixelSearchRange range;
+	PixelSearchSetRange(range, aColorRGB, aVariation, aScreenIs16bit);
+	bool use_sse2 = IsSSE2Available();
+	int x, y, last_x = aScreenWidth - 1;
+	for (y = aBottomToTop ? aScreenHeight - 1 : 0; y >= 0 && y < aScreenHeight; y += aBottomToTop ? -1 : 1)
+	{
+		x = aRightToLeft ? PixelScan(aScreen + y * aScreenWidth, last_x, 0, true, range, use_sse2)
+			: PixelScan(aScreen + y * aScreenWidth, 0, last_x, true, range, use_sse2);
+		if (x != -1)
+		{
+			aMatch.x = x;
+			aMatch.y = y;
+			return true;
+		}
+	}
+	return false;
+}
+
+
+
+int PixelSearchRuns(LPCOLORREF aScreen, int aScreenWidth, int aScreenHeight, bool aScreenIs16bit
+	, COLORREF aColorRGB, int aVariation, PixelSearchRun *&aRun)
+// Finds every pixel of aScreen that PixelSearchFind() would consider a match, and reports them as
+// horizontal runs of adjacent matching pixels, from left to right and then from top to bottom.  Caller
+// must have set aRun to NULL; upon return, it's either still NULL or a malloc'd array of the runs, which
+// caller must free (even upon failure).  Returns the number of runs, or -1 if out of memory.
+{
+	PixelSearchRange range;
+	PixelSearchSetRange(range, aColorRGB, aVariation, aScreenIs16bit);
+	bool use_sse2 = IsSSE2Available();
+	int x, end, y, last_x = aScreenWidth - 1, run_count = 0, run_size = 0;
+	LPCOLORREF row;
+	PixelSearchRun *new_run;
+	for (y = 0, row = aScreen; y < aScreenHeight; ++y, row += aScreenWidth)
+	{
+		for (x = 0; x < aScreenWidth; x = end)
+		{
+			if (   (x = PixelScan(row, x, last_x, true, range, use_sse2)) == -1   )
+				break; // No more matches in this row.
+			if (   (end = PixelScan(row, x, last_x, false, range, use_sse2)) == -1   )
+				end = aScreenWidth; // The run extends to the end of the row.
+			if (run_count == run_size)
+			{
+				run_size = run_size ? run_size * 2 : 256;
+				if (   !(new_run = (PixelSearchRun *)realloc(aRun, run_size * sizeof(PixelSearchRun)))   )
+					return -1;
+				aRun = new_run;
+			}
+			aRun[run_count].x = x;
+			aRun[run_count].y = y;
+			aRun[run_count].length = end - x;
+			++run_count;
+		}
+	}
+	return run_count;
+}
@@ -0,0 +1,50 @@
+/*
+AutoHotkey
+
+Copyright 2003-2009 Chris Mallett (support@autohotkey.com)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+
+#ifndef image_search_h
+#define image_search_h
+
+
+// NOTE: This module is separate from script2.cpp so that the matchers work only on plain pixel buffers
+// and don't depend on GDI or the screen.  This allows them to be built and timed on their own with
+// synthetic bitmaps.  ImageSearch and PixelSearch do the capturing and loading; this module does the
+// searching.
+
+struct ImageSearchTemplate
+{
+	LPCOLORREF pixel;     // The image's pixels (top row first), with the high-order byte of each set to zero.
+	LPCOLORREF mask;      // NULL, or an icon's AND-mask, in which non-zero pixels are transparent.
+	int width, height;
+	COLORREF trans_color; // Pixels of this color are transparent.  CLR_NONE if there isn't one.
+	int variation;        // The number of shades (0 to 255) each color component may vary by; 0 means exact.
+	bool is_16bit;        // The pixels came from a bitmap with 16-bit color depth.
+	bool pyramid;         // Search a reduced copy of the screen first (see ImageSearchFind()).
+};
+
+int ImageSearchFind(LPCOLORREF aScreen, int aScreenWidth, int aScreenHeight, bool aScreenIs16bit
+	, ImageSearchTemplate &aImage, POINT *&aMatch, int aMaxMatches);
+
+struct PixelSearchRun // A horizontal run of matching pixels found by PixelSearchRuns().
+{
+	int x, y, length;
+};
+
+bool PixelSearchFind(LPCOLORREF aScreen, int aScreenWidth, int aScreenHeight, bool aScreenIs16bit
+	, COLORREF aColorRGB, int aVariation, bool aRightToLeft, bool aBottomToTop, POINT &aMatch);
+int PixelSearchRuns(LPCOLORREF aScreen, int aScreenWidth, int aScreenHeight, bool aScreenIs16bit
+	, COLORREF aColorRGB, int aVariation, PixelSearchRun *&aRun);
+
+#endif
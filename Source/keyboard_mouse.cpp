@@ -92,6 +92,155 @@ void DisguiseWinAltIfNeeded(vk_type aVK)
 
 
 
+// SendInput and SendPlay keep the event arrays they build, since hotkeys and hotstrings typically send
+// the same literal text each time they fire.  Replaying a cached array skips parsing the string and the
+// calls to TextToVK() and SendKey() for each of its keys.  Only strings that produce nothing but
+// keystrokes and that don't change the persistent modifiers are cached (see send_cacheable in SendKeys()),
+// and everything else the array depends upon is part of the key.
+struct SendCacheItem
+{
+	char *keys; // The string as passed to SendKeys(), minus any {Blind} prefix.
+	bool send_raw, blind_mode;
+	SendModes send_mode;
+	HKL layout;
+	ResultType layout_has_altgr;
+	modLR_type mods_start, mods_persistent; // sEventModifiersLR and persistent_modifiers_for_this_SendKeys upon entry.
+	int key_delay, press_duration; // SendPlay's delays, which are put into the array (zero for SendInput).
+	void *events;
+	UINT event_count;
+	modLR_type mods_end; // sEventModifiersLR after the last event.
+	HookType hooks_to_remove;
+	KeyEventTypes prev_event_type; // sPrevEventType and sPrevVK after the last event.
+	vk_type prev_vk;
+	double build_time; // Milliseconds taken to build the array, which is the time saved by each reuse.
+	UINT last_used; // For discarding the least recently used item when the cache is full.
+};
+#define SEND_CACHE_SIZE 32
+static SendCacheItem sSendCache[SEND_CACHE_SIZE];
+static int sSendCacheCount = 0;
+static UINT sSendCacheUses = 0, sSendCacheHits = 0, sSendCacheMisses = 0;
+static double sSendCacheTimeSaved = 0;
+
+static void SendCacheRemove(int aIndex)
+{
+	free(sSendCache[aIndex].keys);
+	free(sSendCache[aIndex].events);
+	// Move the last item into the vacated slot to keep the array contiguous:
+	if (aIndex != --sSendCacheCount)
+		sSendCache[aIndex] = sSendCache[sSendCacheCount];
+}
+
+
+
+static void SendCacheSetKey(SendCacheItem &aItem, char *aKeys, bool aSendRaw, modLR_type aModsPersistent)
+// Sets the members of aItem that identify an array (except keys, which is set to aKeys without copying it)
+// from the state SendKeys() has set up for the array it's about to build.
+{
+	aItem.keys = aKeys;
+	aItem.send_raw = aSendRaw;
+	aItem.blind_mode = sInBlindMode;
+	aItem.send_mode = sSendMode;
+	aItem.layout = sTargetKeybdLayout;
+	aItem.layout_has_altgr = sTargetLayoutHasAltGr;
+	aItem.mods_start = sEventModifiersLR;
+	aItem.mods_persistent = aModsPersistent;
+	aItem.key_delay = sSendMode == SM_PLAY ? g->KeyDelayPlay : 0;
+	aItem.press_duration = sSendMode == SM_PLAY ? g->PressDurationPlay : 0;
+}
+
+
+
+static bool SendCacheReplay(char *aKeys, bool aSendRaw, modLR_type aModsPersistent)
+// If the array for aKeys is in the cache, this puts it into the event array (which the caller has just
+// initialized) and returns true.  Otherwise, it returns false so that the caller builds the array.
+{
+	SendCacheItem key;
+	SendCacheSetKey(key, aKeys, aSendRaw, aModsPersistent);
+	for (int i = 0; i < sSendCacheCount; ++i)
+	{
+		SendCacheItem &item = sSendCache[i];
+		if (   item.send_mode == key.send_mode && item.layout == key.layout && item.mods_start == key.mods_start
+			&& item.mods_persistent == key.mods_persistent && item.send_raw == key.send_raw
+			&& item.blind_mode == key.blind_mode && item.layout_has_altgr == key.layout_has_altgr
+			&& item.key_delay == key.key_delay && item.press_duration == key.press_duration
+			&& !strcmp(item.keys, aKeys)   )
+		{
+			++sSendCacheHits;
+			sSendCacheTimeSaved += item.build_time;
+			item.last_used = ++sSendCacheUses;
+			memcpy(sEventSI, item.events, item.event_count * (sSendMode == SM_INPUT ? sizeof(INPUT) : sizeof(PlaybackEvent)));
+			sEventCount = item.event_count;
+			sEventModifiersLR = item.mods_end;
+			sHooksToRemoveDuringSendInput = item.hooks_to_remove;
+			sPrevEventType = item.prev_event_type;
+			sPrevVK = item.prev_vk;
+			// Log the keystrokes the same as KeyEvent() did while building the array (it logs only SendInput's):
+			if (sSendMode == SM_INPUT && g_KeyHistory)
+				for (UINT e = 0; e < sEventCount; ++e)
+				{
+					KEYBDINPUT &ki = sEventSI[e].ki;
+					UpdateKeyEventHistory((ki.dwFlags & KEYEVENTF_KEYUP) != 0, (vk_type)ki.wVk
+						, (sc_type)((ki.dwFlags & KEYEVENTF_EXTENDEDKEY) ? ki.wScan | 0x100 : ki.wScan));
+				}
+			return true;
+		}
+	}
+	++sSendCacheMisses;
+	return false;
+}
+
+
+
+static void SendCacheAdd(char *aKeys, bool aSendRaw, modLR_type aModsStart, modLR_type aModsPersistent
+	, double aBuildTime)
+// Adds the array that was just built for aKeys to the cache.  aModsStart is the value sEventModifiersLR
+// had before the array was built.
+{
+	size_t events_size = sEventCount * (sSendMode == SM_INPUT ? sizeof(INPUT) : sizeof(PlaybackEvent));
+	char *keys;
+	void *events;
+	if (   !(keys = _strdup(aKeys))   )
+		return;
+	if (   !(events = malloc(events_size))   )
+	{
+		free(keys);
+		return;
+	}
+	memcpy(events, sEventSI, events_size);
+	if (sSendCacheCount == SEND_CACHE_SIZE) // Discard the least recently used item to make room.
+	{
+		int lru = 0;
+		for (int i = 1; i < sSendCacheCount; ++i)
+			if (sSendCache[i].last_used < sSendCache[lru].last_used)
+				lru = i;
+		SendCacheRemove(lru);
+	}
+	SendCacheItem &item = sSendCache[sSendCacheCount++];
+	SendCacheSetKey(item, keys, aSendRaw, aModsPersistent);
+	item.mods_start = aModsStart; // Override the value set above, since the array has changed sEventModifiersLR.
+	item.events = events;
+	item.event_count = sEventCount;
+	item.mods_end = sEventModifiersLR;
+	item.hooks_to_remove = sHooksToRemoveDuringSendInput;
+	item.prev_event_type = sPrevEventType;
+	item.prev_vk = sPrevVK;
+	item.build_time = aBuildTime;
+	item.last_used = ++sSendCacheUses;
+}
+
+
+
+void SendCacheGetCounts(UINT &aHits, UINT &aMisses, double &aTimeSaved)
+// Provides the /Benchmark switch with the number of Sends whose event array was found in the cache, the
+// number that had to build theirs, and the total milliseconds the hits would have spent building theirs.
+{
+	aHits = sSendCacheHits;
+	aMisses = sSendCacheMisses;
+	aTimeSaved = sSendCacheTimeSaved;
+}
+
+
+
 void SendKeys(char *aKeys, bool aSendRaw, SendModes aSendModeOrig, HWND aTargetWindow)
 // The aKeys string must be modifiable (not constant), since for performance reasons,
 // it's allowed to be temporarily altered by this function.  mThisHotkeyModifiersLR, if non-zero,
@@ -366,6 +515,28 @@ void SendKeys(char *aKeys, bool aSendRaw, SendModes aSendModeOrig, HWND aTargetW
 		InitEventArray(_alloca(mem_size), sMaxEvents, mods_current);
 	}
 
+	// Decide whether the array can be taken from the cache or put into it afterward.  The exclusion of
+	// Win-key hotkeys corresponds to SendKey()'s waiting for the Windows key to be released before an "L".
+	bool send_cacheable = sSendMode && GetCurrentThreadId() == g_MainThreadID && !g_os.IsWin9x() // Caller has ensured aTargetWindow==NULL for these modes.
+		&& !(sSendMode == SM_INPUT && !sInBlindMode && g_os.IsWinVistaOrLater()
+			&& (g_script.mThisHotkeyModifiersLR & (MOD_LWIN|MOD_RWIN))
+			&& (GetTickCount() - g_script.mThisHotkeyStartTime) < (DWORD)50);
+	char *keys_to_cache = aKeys;
+	bool send_raw_to_cache = aSendRaw;
+	modLR_type persistent_modifiers_to_cache = persistent_modifiers_for_this_SendKeys;
+	LARGE_INTEGER build_start;
+	if (send_cacheable)
+	{
+		if (SendCacheReplay(aKeys, aSendRaw, persistent_modifiers_for_this_SendKeys))
+		{
+			send_cacheable = false; // It's already cached.
+			sPrevEventModifierDown = 0; // As the loop below would have left it, since a cached array never presses down a modifier persistently.
+			aKeys += strlen(aKeys); // Skip the loop below.
+		}
+		else
+			QueryPerformanceCounter(&build_start);
+	}
+
 	bool blockinput_prev = g_BlockInput;
 	bool do_selective_blockinput = (g_BlockInputMode == TOGGLE_SEND || g_BlockInputMode == TOGGLE_SENDANDMOUSE)
 		&& !sSendMode && !aTargetWindow && g_os.IsWinNT4orLater();
@@ -455,6 +626,7 @@ void SendKeys(char *aKeys, bool aSendRaw, SendModes aSendModeOrig, HWND aTargetW
 
 				if (!strnicmp(aKeys, "Click", 5))
 				{
+					send_cacheable = false; // Mouse events depend on the position of the cursor.
 					*end_pos = '\0';  // Temporarily terminate the string here to omit the closing brace from consideration below.
 					ParseClickOptions(omit_leading_whitespace(aKeys + 5), click_x, click_y, vk
 						, event_type, repeat_count, move_offset);
@@ -535,6 +707,8 @@ void SendKeys(char *aKeys, bool aSendRaw, SendModes aSendModeOrig, HWND aTargetW
 					{
 						if (!aTargetWindow)
 						{
+							if (event_type != KEYDOWNANDUP) // {Shift down} and {Shift up} change the persistent modifiers.
+								send_cacheable = false;
 							if (event_type == KEYDOWN) // i.e. make {Shift down} have the same effect {ShiftDown}
 							{
 								this_event_modifier_down = vk;
@@ -574,6 +748,8 @@ void SendKeys(char *aKeys, bool aSendRaw, SendModes aSendModeOrig, HWND aTargetW
 					// behaves also, which is good.  Example: Send, {AltDown}!f  ; this will cause
 					// Alt to still be down after the command is over, even though F is modified
 					// by Alt.
+					if (IsMouseVK(vk)) // e.g. {LButton}
+						send_cacheable = false;
 					SendKey(vk, sc, mods_for_next_key, persistent_modifiers_for_this_SendKeys
 						, repeat_count, event_type, key_as_modifiersLR, aTargetWindow);
 				}
@@ -585,6 +761,7 @@ void SendKeys(char *aKeys, bool aSendRaw, SendModes aSendModeOrig, HWND aTargetW
 					// v1.0.43.07: Added check of event_type!=KEYUP, which causes something like Send { up} to
 					// do nothing if the curr. keyboard layout lacks such a key.  This is relied upon by remappings
 					// such as F1:: (i.e. a destination key that doesn't have a VK, at least in English).
+					send_cacheable = false; // For simplicity, since SendKeySpecial() is rarely needed.
 					if (!aTargetWindow && event_type != KEYUP) // In this mode, mods_for_next_key and event_type are ignored due to being unsupported.
 						SendKeySpecial(aKeys[0], repeat_count);
 					//else do nothing since it's there's no known way to send the keystokes.
@@ -595,6 +772,7 @@ void SendKeys(char *aKeys, bool aSendRaw, SendModes aSendModeOrig, HWND aTargetW
 				else if (vk = TextToSpecial(aKeys, (UINT)key_text_length, event_type
 					, persistent_modifiers_for_this_SendKeys, !aTargetWindow)) // Assign.
 				{
+					send_cacheable = false; // TextToSpecial() might have changed the persistent modifiers.
 					if (!aTargetWindow)
 					{
 						if (event_type == KEYDOWN)
@@ -622,6 +800,7 @@ void SendKeys(char *aKeys, bool aSendRaw, SendModes aSendModeOrig, HWND aTargetW
 
 				else if (key_text_length > 4 && !strnicmp(aKeys, "ASC ", 4) && !aTargetWindow) // {ASC nnnnn}
 				{
+					send_cacheable = false; // For simplicity, as with SendKeySpecial() above.
 					// Include the trailing space in "ASC " to increase uniqueness (selectivity).
 					// Also, sending the ASC sequence to window doesn't work, so don't even try:
 					SendASC(omit_leading_whitespace(aKeys + 3));
@@ -657,6 +836,7 @@ brace_case_end: // This label is used to simplify the code without sacrificing p
 			else // Try to send it by alternate means.
 			{
 				// v1.0.40: SendKeySpecial sends only keybd_event keystrokes, not ControlSend style keystrokes:
+				send_cacheable = false; // See similar section above.
 				if (!aTargetWindow) // In this mode, mods_for_next_key is ignored due to being unsupported.
 					SendKeySpecial(*aKeys, 1);
 				//else do nothing since there's no known way to send the keystokes.
@@ -665,6 +845,17 @@ brace_case_end: // This label is used to simplify the code without sacrificing p
 		}
 	} // for()
 
+	// Cache the array unless it's empty or outgrew the memory allocated above (rare, and not worth keeping):
+	if (send_cacheable && !sAbortArraySend && sEventCount > 0
+		&& sMaxEvents == (sSendMode == SM_INPUT ? MAX_INITIAL_EVENTS_SI : MAX_INITIAL_EVENTS_PB))
+	{
+		LARGE_INTEGER freq, build_end;
+		QueryPerformanceCounter(&build_end);
+		QueryPerformanceFrequency(&freq);
+		SendCacheAdd(keys_to_cache, send_raw_to_cache, mods_current, persistent_modifiers_to_cache
+			, (build_end.QuadPart - build_start.QuadPart) * 1000.0 / freq.QuadPart);
+	}
+
 	modLR_type mods_to_set;
 	if (sSendMode)
 	{
@@ -3748,12 +3939,58 @@ char *VKtoKeyName(vk_type aVK, sc_type aSC, char *aBuf, int aBufSize)
 
 
 
+// Key names are looked up via a hash table for each of g_key_to_vk and g_key_to_sc (rather than by
+// scanning the arrays) because TextToVK() is called for every {Name} in a Send string and for each
+// call to GetKeyState() with a key name.  Each non-zero item is 1 plus the position in the array of
+// a key name.  Collisions are resolved by probing the next item, so an item's key name must be
+// compared to confirm the match.  The tables are built upon first use rather than at compile time
+// since the order of the arrays matters to other functions (e.g. VKtoKeyName() reports the first name
+// of a VK), so they can't be sorted.
+#define KEY_NAME_TABLE_SIZE 512 // Must be a power of 2, and should be a few times the number of key names to keep probing short.
+static short sKeyToVKTable[KEY_NAME_TABLE_SIZE], sKeyToSCTable[KEY_NAME_TABLE_SIZE];
+static bool sKeyNameTablesBuilt = false;
+
+static UINT KeyNameHash(char *aText)
+// A case-insensitive FNV-1a hash, consistent with the stricmp() used to confirm matches.
+{
+	UINT hash = 2166136261U;
+	for (; *aText; ++aText)
+		hash = (hash ^ (UCHAR)(*aText >= 'A' && *aText <= 'Z' ? *aText + ('a' - 'A') : *aText)) * 16777619U;
+	return hash;
+}
+
+
+
+static void KeyNameTablesBuild()
+{
+	// Since each name is put into the first free item after its hash, a name that occurs more than once
+	// in an array is found at its first position, just as when the array was scanned.
+	int i;
+	UINT item;
+	for (i = 0; i < g_key_to_vk_count; ++i)
+	{
+		for (item = KeyNameHash(g_key_to_vk[i].key_name); sKeyToVKTable[item & (KEY_NAME_TABLE_SIZE - 1)]; ++item);
+		sKeyToVKTable[item & (KEY_NAME_TABLE_SIZE - 1)] = i + 1;
+	}
+	for (i = 0; i < g_key_to_sc_count; ++i)
+	{
+		for (item = KeyNameHash(g_key_to_sc[i].key_name); sKeyToSCTable[item & (KEY_NAME_TABLE_SIZE - 1)]; ++item);
+		sKeyToSCTable[item & (KEY_NAME_TABLE_SIZE - 1)] = i + 1;
+	}
+	sKeyNameTablesBuilt = true;
+}
+
+
+
 sc_type TextToSC(char *aText)
 {
 	if (!*aText) return 0;
-	for (int i = 0; i < g_key_to_sc_count; ++i)
-		if (!stricmp(g_key_to_sc[i].key_name, aText))
-			return g_key_to_sc[i].sc;
+	if (!sKeyNameTablesBuilt)
+		KeyNameTablesBuild();
+	int i;
+	for (UINT item = KeyNameHash(aText); i = sKeyToSCTable[item & (KEY_NAME_TABLE_SIZE - 1)]; ++item)
+		if (!stricmp(g_key_to_sc[i - 1].key_name, aText))
+			return g_key_to_sc[i - 1].sc;
 	// Do this only after the above, in case any valid key names ever start with SC:
 	if (toupper(*aText) == 'S' && toupper(*(aText + 1)) == 'C')
 		return (sc_type)strtol(aText + 2, NULL, 16);  // Convert from hex.
@@ -3781,9 +4018,12 @@ vk_type TextToVK(char *aText, modLR_type *pModifiersLR, bool aExcludeThoseHandle
 	if (aAllowExplicitVK && toupper(aText[0]) == 'V' && toupper(aText[1]) == 'K')
 		return (vk_type)strtol(aText + 2, NULL, 16);  // Convert from hex.
 
-	for (int i = 0; i < g_key_to_vk_count; ++i)
-		if (!stricmp(g_key_to_vk[i].key_name, aText))
-			return g_key_to_vk[i].vk;
+	if (!sKeyNameTablesBuilt)
+		KeyNameTablesBuild();
+	int i;
+	for (UINT item = KeyNameHash(aText); i = sKeyToVKTable[item & (KEY_NAME_TABLE_SIZE - 1)]; ++item) // See sKeyToVKTable.
+		if (!stricmp(g_key_to_vk[i - 1].key_name, aText))
+			return g_key_to_vk[i - 1].vk;
 
 	if (aExcludeThoseHandledByScanCode)
 		return 0; // Zero is not a valid virtual key, so it should be a safe failure indicator.
@@ -196,6 +196,7 @@ void SendKeys(char *aKeys, bool aSendRaw, SendModes aSendModeOrig, HWND aTargetW
 void SendKey(vk_type aVK, sc_type aSC, modLR_type aModifiersLR, modLR_type aModifiersLRPersistent
 	, int aRepeatCount, KeyEventTypes aEventType, modLR_type aKeyAsModifiersLR, HWND aTargetWindow
 	, int aX = COORD_UNSPECIFIED, int aY = COORD_UNSPECIFIED, bool aMoveOffset = false);
+void SendCacheGetCounts(UINT &aHits, UINT &aMisses, double &aTimeSaved);
 void SendKeySpecial(char aChar, int aRepeatCount);
 void SendASC(char *aAscii);
 
@@ -0,0 +1,223 @@
+/*
+AutoHotkey
+
+Copyright 2003-2009 Chris Mallett (support@autohotkey.com)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+
+// Times the matchers of ImageSearch and PixelSearch (image_search.cpp) on synthetic 3840x2160 "screens".
+// Unlike image.ahk, this needs no desktop.  Build it from this folder with:
+//     cl /O2 /I..\.. /Feimage_search_bench.exe image_search_bench.cpp ..\..\image_search.cpp
+// or on Linux with:
+//     g++ -O2 -msse2 -I../.. -include image_search_posix.h -o image_search_bench image_search_bench.cpp ../../image_search.cpp
+// It writes the same tab-delimited records as the /Benchmark switch (see README.txt) to stdout.
+
+#include "stdafx.h" // pre-compiled headers
+#include "image_search.h"
+
+#define BENCH_SCREEN_WIDTH 3840
+#define BENCH_SCREEN_HEIGHT 2160
+#define BENCH_IMAGE_SIZE 48
+#define BENCH_REPEAT 5
+
+static UINT sSeed = 1;
+
+static UINT BenchRandom()
+// A fixed generator (rather than rand()) so that every build searches the same pixels.
+{
+	sSeed = sSeed * 1103515245 + 12345;
+	return sSeed >> 8;
+}
+
+
+
+static double BenchSearch(LPCOLORREF aScreen, ImageSearchTemplate &aImage, int &aMatchCount)
+// Returns the average number of milliseconds taken to find every occurrence of aImage in aScreen.
+{
+	LARGE_INTEGER freq, start, end;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&start);
+	POINT *match;
+	for (int i = 0; i < BENCH_REPEAT; ++i)
+	{
+		match = NULL;
+		aMatchCount = ImageSearchFind(aScreen, BENCH_SCREEN_WIDTH, BENCH_SCREEN_HEIGHT, false, aImage, match, 0);
+		free(match);
+	}
+	QueryPerformanceCounter(&end);
+	return (end.QuadPart - start.QuadPart) * 1000.0 / freq.QuadPart / BENCH_REPEAT;
+}
+
+
+
+static bool BenchCase(char *aName, LPCOLORREF aScreen, ImageSearchTemplate &aImage)
+// Reports the time taken by both modes.  Returns false if they found a different number of matches.
+{
+	int match_count, pyramid_match_count;
+	aImage.pyramid = false;
+	printf("image\t%s\t%0.3f\n", aName, BenchSearch(aScreen, aImage, match_count));
+	aImage.pyramid = true;
+	printf("image\t%sPyramid\t%0.3f\n", aName, BenchSearch(aScreen, aImage, pyramid_match_count));
+	printf("count\t%sMatches\t%d.000\n", aName, match_count);
+	return match_count == pyramid_match_count;
+}
+
+
+
+static double BenchStart()
+{
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	return (double)now.QuadPart;
+}
+
+static double BenchElapsedMS(double aStart)
+{
+	LARGE_INTEGER freq, now;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+	return (now.QuadPart - aStart) * 1000.0 / freq.QuadPart;
+}
+
+
+
+static bool PixelSearchOldLoop(LPCOLORREF aScreen, int aPixelCount, COLORREF aColorRGB, int aVariation, int &aIndex)
+// The loops that fast-mode PixelSearch used before it called PixelSearchFind() (for 24/32-bit screens),
+// kept here as the baseline.
+{
+	int i;
+	if (aVariation < 1)
+	{
+		for (i = 0; i < aPixelCount; ++i)
+			if ((aScreen[i] & 0x00FFFFFF) == aColorRGB)
+				break;
+		aIndex = i;
+		return i < aPixelCount;
+	}
+	BYTE search_red = (BYTE)(aColorRGB >> 16), search_green = (BYTE)(aColorRGB >> 8), search_blue = (BYTE)aColorRGB;
+	BYTE red_low = (aVariation > search_red) ? 0 : search_red - aVariation;
+	BYTE green_low = (aVariation > search_green) ? 0 : search_green - aVariation;
+	BYTE blue_low = (aVariation > search_blue) ? 0 : search_blue - aVariation;
+	BYTE red_high = (aVariation > 0xFF - search_red) ? 0xFF : search_red + aVariation;
+	BYTE green_high = (aVariation > 0xFF - search_green) ? 0xFF : search_green + aVariation;
+	BYTE blue_high = (aVariation > 0xFF - search_blue) ? 0xFF : search_blue + aVariation;
+	BYTE red, green, blue;
+	for (i = 0; i < aPixelCount; ++i)
+	{
+		red = (BYTE)(aScreen[i] >> 16);
+		green = (BYTE)(aScreen[i] >> 8);
+		blue = (BYTE)aScreen[i];
+		if (red >= red_low && red <= red_high && green >= green_low && green <= green_high
+			&& blue >= blue_low && blue <= blue_high)
+			break;
+	}
+	aIndex = i;
+	return i < aPixelCount;
+}
+
+
+
+static bool BenchPixelCase(char *aName, LPCOLORREF aScreen, COLORREF aColorRGB, int aVariation)
+// Reports the time taken by the old loop and by PixelSearchFind() in each direction to find aColorRGB.
+// Returns false if they disagree.
+{
+	int i, index, old_index = -1;
+	bool old_found;
+	POINT match;
+	double start = BenchStart();
+	for (i = 0; i < BENCH_REPEAT; ++i)
+		old_found = PixelSearchOldLoop(aScreen, BENCH_SCREEN_WIDTH * BENCH_SCREEN_HEIGHT, aColorRGB, aVariation, old_index);
+	printf("pixel\t%sOldLoop\t%0.3f\n", aName, BenchElapsedMS(start) / BENCH_REPEAT);
+	bool ok = true, found;
+	for (int direction = 0; direction < 2; ++direction) // Left to right and top to bottom, then the reverse.
+	{
+		start = BenchStart();
+		for (i = 0; i < BENCH_REPEAT; ++i)
+			found = PixelSearchFind(aScreen, BENCH_SCREEN_WIDTH, BENCH_SCREEN_HEIGHT, false, aColorRGB, aVariation
+				, direction == 1, direction == 1, match);
+		printf("pixel\t%s%s\t%0.3f\n", aName, direction ? "Reverse" : "", BenchElapsedMS(start) / BENCH_REPEAT);
+		if (!direction)
+		{
+			index = match.y * BENCH_SCREEN_WIDTH + match.x;
+			ok = found == old_found && (!found || index == old_index);
+		}
+	}
+	PixelSearchRun *run;
+	int run_count;
+	start = BenchStart();
+	for (i = 0; i < BENCH_REPEAT; ++i)
+	{
+		run = NULL;
+		run_count = PixelSearchRuns(aScreen, BENCH_SCREEN_WIDTH, BENCH_SCREEN_HEIGHT, false, aColorRGB, aVariation, run);
+		free(run);
+	}
+	printf("pixel\t%sAllRuns\t%0.3f\n", aName, BenchElapsedMS(start) / BENCH_REPEAT);
+	printf("count\t%sRuns\t%d.000\n", aName, run_count);
+	return ok;
+}
+
+
+
+int main()
+{
+	int pixel_count = BENCH_SCREEN_WIDTH * BENCH_SCREEN_HEIGHT, i, x, y;
+	LPCOLORREF screen = (LPCOLORREF)malloc(pixel_count * sizeof(COLORREF));
+	COLORREF image_pixel[BENCH_IMAGE_SIZE * BENCH_IMAGE_SIZE];
+	if (!screen)
+		return 1;
+	ImageSearchTemplate image = {image_pixel, NULL, BENCH_IMAGE_SIZE, BENCH_IMAGE_SIZE, CLR_NONE, 0, false, false};
+	bool ok = true;
+
+	// Noise: every pixel is random, so the first pixel of the image rules out nearly every position.
+	// This is the best case for the normal search.
+	for (i = 0; i < pixel_count; ++i)
+		screen[i] = BenchRandom() & 0x00FFFFFF;
+	for (i = 0; i < BENCH_IMAGE_SIZE * BENCH_IMAGE_SIZE; ++i)
+		image_pixel[i] = BenchRandom() & 0x00FFFFFF;
+	ok = BenchCase("Noise", screen, image) && ok;
+
+	// Flat: a window background with a few dark dots, and an image of that background with a dot
+	// (in a different place) near its bottom.  Every position looks like a match until the dot, which is
+	// the worst case for the normal search.  The image is also placed in the middle of the screen.
+	for (i = 0; i < pixel_count; ++i)
+		screen[i] = (BenchRandom() % 997) ? 0xF0F0F0 : 0x202020;
+	for (i = 0; i < BENCH_IMAGE_SIZE * BENCH_IMAGE_SIZE; ++i)
+		image_pixel[i] = 0xF0F0F0;
+	image_pixel[(BENCH_IMAGE_SIZE - 3) * BENCH_IMAGE_SIZE + BENCH_IMAGE_SIZE / 2] = 0x0000FF;
+	for (y = 0; y < BENCH_IMAGE_SIZE; ++y)
+		for (x = 0; x < BENCH_IMAGE_SIZE; ++x)
+			screen[(BENCH_SCREEN_HEIGHT / 2 + y) * BENCH_SCREEN_WIDTH + BENCH_SCREEN_WIDTH / 2 + x]
+				= image_pixel[y * BENCH_IMAGE_SIZE + x];
+	ok = BenchCase("Flat", screen, image) && ok;
+
+	// Gradient: a smooth horizontal gradient searched with variation, so the first pixel of the image
+	// matches across a wide band of each row.
+	for (y = 0; y < BENCH_SCREEN_HEIGHT; ++y)
+		for (x = 0; x < BENCH_SCREEN_WIDTH; ++x)
+			screen[y * BENCH_SCREEN_WIDTH + x] = (x * 256 / BENCH_SCREEN_WIDTH) * 0x010101 ^ (BenchRandom() & 0x030303);
+	for (y = 0; y < BENCH_IMAGE_SIZE; ++y)
+		for (x = 0; x < BENCH_IMAGE_SIZE; ++x)
+			image_pixel[y * BENCH_IMAGE_SIZE + x] = y < BENCH_IMAGE_SIZE - 4 ? 0x808080 : 0xFF00FF;
+	image.variation = 40;
+	ok = BenchCase("GradientVariation", screen, image) && ok;
+
+	// PixelSearch for a color that isn't on the gradient (so that every pixel is checked), then for one
+	// that's in the middle of each row, near the bottom of the screen.
+	ok = BenchPixelCase("PixelAbsent", screen, 0x00FF00, 0) && ok;
+	ok = BenchPixelCase("PixelAbsentVariation", screen, 0x00FF00, 20) && ok;
+	for (x = BENCH_SCREEN_WIDTH / 2; x < BENCH_SCREEN_WIDTH / 2 + 40; ++x)
+		screen[(BENCH_SCREEN_HEIGHT - 10) * BENCH_SCREEN_WIDTH + x] = 0x00FF00;
+	ok = BenchPixelCase("PixelNearBottom", screen, 0x00FF00, 0) && ok;
+
+	free(screen);
+	return ok ? 0 : 1; // Nonzero if pyramid mode disagreed with the normal search or PixelSearchFind() with the old loop.
+}
@@ -0,0 +1,64 @@
+/*
+AutoHotkey
+
+Copyright 2003-2009 Chris Mallett (support@autohotkey.com)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+
+// The few Windows types and functions that image_search.cpp and image_search_bench.cpp use, so that they
+// can be built with g++ on Linux (see image_search_bench.cpp).  It's given to the compiler via -include
+// since stdafx.h only includes the Windows headers for Visual C++.
+
+#ifndef image_search_posix_h
+#define image_search_posix_h
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef unsigned int UINT, DWORD, COLORREF, *LPCOLORREF;
+typedef int BOOL;
+typedef unsigned char BYTE;
+typedef void *HMODULE;
+typedef long LONG;
+struct POINT { LONG x, y; };
+union LARGE_INTEGER { long long QuadPart; };
+
+#define WINAPI
+#define CLR_NONE 0xFFFFFFFFL
+
+static inline BOOL WINAPI PosixIsProcessorFeaturePresent(DWORD aFeature)
+{
+#ifdef __SSE2__
+	return aFeature == 10; // PF_XMMI64_INSTRUCTIONS_AVAILABLE (see IsSSE2Available()).
+#else
+	return 0;
+#endif
+}
+static inline HMODULE GetModuleHandle(const char *) { return NULL; }
+static inline void *GetProcAddress(HMODULE, const char *) { return (void *)PosixIsProcessorFeaturePresent; }
+
+static inline BOOL QueryPerformanceFrequency(LARGE_INTEGER *aFreq)
+{
+	aFreq->QuadPart = 1000000000;
+	return 1;
+}
+static inline BOOL QueryPerformanceCounter(LARGE_INTEGER *aCount)
+{
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	aCount->QuadPart = now.tv_sec * 1000000000LL + now.tv_nsec;
+	return 1;
+}
+
+#endif
@@ -37,7 +37,7 @@ static size_t g_CommentFlagLength = 1; // pre-calculated for performance
 
 
 Script::Script()
-	: mFirstLine(NULL), mLastLine(NULL), mCurrLine(NULL), mPlaceholderLabel(NULL), mLineCount(0)
+	: mFirstLine(NULL), mLastLine(NULL), mCurrLine(NULL), mPlaceholderLabel(NULL), mLineCount(0), mLineArenaSize(0)
 	, mThisHotkeyName(""), mPriorHotkeyName(""), mThisHotkeyStartTime(0), mPriorHotkeyStartTime(0)
 	, mEndChar(0), mThisHotkeyModifiersLR(0)
 	, mNextClipboardViewer(NULL), mOnClipboardChangeIsRunning(false), mOnClipboardChangeLabel(NULL)
@@ -56,7 +56,7 @@ Script::Script()
 #ifdef AUTOHOTKEYSC
 	, mCompiledHasCustomIcon(false)
 #else
-	, mIncludeLibraryFunctionsThenExit(NULL)
+	, mIncludeLibraryFunctionsThenExit(NULL), mBenchmarkFile(NULL)
 #endif
 	, mLinesExecutedThisCycle(0), mUninterruptedLineCountMax(1000), mUninterruptibleTime(15)
 	, mRunAsUser(NULL), mRunAsPass(NULL), mRunAsDomain(NULL)
@@ -861,6 +861,7 @@ void Script::TerminateApp(int aExitCode)
 // Note that g_script's destructor takes care of most other cleanup work, such as destroying
 // tray icons, menus, and unowned windows such as ToolTip.
 {
+	Line::FileAppendCacheFlush(NULL, true); // Write out any text buffered by #FileAppendBuffer.
 	// We call DestroyWindow() because MainWindowProc() has left that up to us.
 	// DestroyWindow() will cause MainWindowProc() to immediately receive and process the
 	// WM_DESTROY msg, which should in turn result in any child windows being destroyed
@@ -875,6 +876,872 @@ void Script::TerminateApp(int aExitCode)
 
 
 
+#ifndef AUTOHOTKEYSC
+static void ScriptCacheGetFileName(char *aBuf, size_t aBufSize, char *aExtension)
+// Builds the name of one of the cache files for the current script.  Each script gets its own files (in
+// the temp folder so that it works even for scripts in read-only folders) whose names are derived from
+// a hash of the script's full path.
+{
+	DWORD hash = 2166136261U; // FNV-1a.
+	for (char *cp = g_script.mFileSpec; *cp; ++cp)
+		hash = (hash ^ (UCHAR)toupper(*cp)) * 16777619U; // Case-insensitive like the file system.
+	char temp_dir[MAX_PATH];
+	if (!GetTempPath(sizeof(temp_dir), temp_dir))
+		*temp_dir = '\0';
+	snprintf(aBuf, aBufSize, "%sAutoHotkey_%08X.%s", temp_dir, hash, aExtension);
+}
+
+
+
+// The parse cache allows a script whose files haven't changed since its previous launch to skip most of
+// the work done by ParseAndAddLine() and ExpressionToPostfix().  For each line that LoadIncludedFile()
+// passes to ParseAndAddLine(), the cache holds the text of that line along with the args of each line
+// that AddLine() built from it (their text, derefs and the names of their variables) and the postfix
+// array of each expression arg.  Replaying a line consists of allocating those args and passing them to
+// AddLine(), which still does all of its usual validation and command-specific handling, so the script
+// ends up the same as if it had been parsed.  The rest of loading is unchanged: each file is still read
+// (which is also needed to hash it) so that its directives, labels, hotkeys and function definitions
+// can be processed, and PreparseBlocks() still resolves function calls (via the library if necessary).
+// A file's records are used only if its size, modification time and hash all match, and each record is
+// used only if the text of its line and the settings that affect parsing (e.g. #EscapeChar) also match.
+// Once a line doesn't match, the rest of that file is parsed normally.  Declarations inside functions
+// (global/local/static) are always parsed normally since they have effects beyond the lines they add.
+struct ParseCacheBuf // A growable buffer into which records are serialized.
+{
+	char *data;
+	size_t length, capacity;
+};
+
+struct ParseCacheFile // A file that has been loaded by this run.
+{
+	char *path;
+	DWORD size, hash;
+	FILETIME last_write;
+	ParseCacheBuf records; // This run's records for this file (see ParseAndAddLineCached()).
+	char *replay, *replay_end; // The cached records that haven't been replayed yet, or NULL if none.
+};
+
+struct ParseCacheBlock // The records of a file as loaded from the cache file.
+{
+	char *path;
+	DWORD size, hash;
+	FILETIME last_write;
+	char *records;
+	DWORD records_length;
+	bool is_used;
+};
+
+static char *sParseCacheContents = NULL; // The cache file, which must be kept until ParseCacheSave() since sParseCacheBlock points into it.
+static ParseCacheBlock *sParseCacheBlock = NULL;
+static int sParseCacheBlockCount = 0;
+static ParseCacheFile *sParseCacheFile = NULL;
+static int sParseCacheFileCount = 0, sParseCacheFileCapacity = 0;
+static int sParseCacheRecordFile = -1; // The file of the line that ParseAndAddLine() is parsing, or -1 if its lines aren't to be recorded.
+static int sParseCacheRecordLines; // How many lines AddLine() has added for the line that's being recorded.
+static bool sParseCacheRecordIsReplayable; // False if AddLine() found that a line's args alone don't determine how it's added.
+static int sParseCacheNoEnv = -1; // The #NoEnv setting the cached postfix arrays were built for, or -1 if there's no cache.
+static bool sParseCacheIsDirty = true; // Whether this run parsed something the cache file doesn't have.
+static bool sParseCacheCanSave = true; // False if this run's records are incomplete (i.e. out of memory).
+static UINT sParseCacheHits = 0, sParseCacheMisses = 0; // For the /Benchmark switch.
+#define PARSE_CACHE_HEADER "AutoHotkey parse cache v" NAME_VERSION "\n"
+#define PARSE_CACHE_HEADER_LENGTH (sizeof(PARSE_CACHE_HEADER) - 1)
+#define PARSE_CACHE_KEY_STATE_LENGTH 5 // See ParseAndAddLineCached().
+#define PARSE_CACHE_PURE_VAR 0x80 // Added to an arg's type to indicate that it's a variable with no derefs.
+
+
+
+static DWORD ParseCacheHash(char *aData, size_t aLength)
+{
+	DWORD hash = 2166136261U; // FNV-1a.
+	for (char *cp = aData, *end = aData + aLength; cp < end; ++cp)
+		hash = (hash ^ (UCHAR)*cp) * 16777619U;
+	return hash;
+}
+
+
+
+static void ParseCachePut(ParseCacheBuf &aBuf, void *aData, size_t aLength)
+// Appends aData to aBuf.  Upon failure, sParseCacheCanSave is set to false so that the cache isn't saved.
+{
+	if (aBuf.length + aLength > aBuf.capacity)
+	{
+		size_t new_capacity = aBuf.capacity ? aBuf.capacity * 2 : 64 * 1024;
+		while (new_capacity < aBuf.length + aLength)
+			new_capacity *= 2;
+		char *realloc_temp = (char *)realloc(aBuf.data, new_capacity);
+		if (!realloc_temp)
+		{
+			sParseCacheCanSave = false;
+			return;
+		}
+		aBuf.data = realloc_temp;
+		aBuf.capacity = new_capacity;
+	}
+	memcpy(aBuf.data + aBuf.length, aData, aLength);
+	aBuf.length += aLength;
+}
+
+
+
+static void ParseCachePutString(ParseCacheBuf &aBuf, char *aString, size_t aLength)
+// Since each string is the text of a line or part of it, its length always fits in a WORD.
+{
+	WORD length = (WORD)aLength;
+	ParseCachePut(aBuf, &length, sizeof(length));
+	ParseCachePut(aBuf, aString, aLength);
+}
+
+
+
+static bool ParseCacheGet(char *&aPos, char *aEnd, void *aData, size_t aLength)
+{
+	if ((size_t)(aEnd - aPos) < aLength)
+		return false;
+	memcpy(aData, aPos, aLength);
+	aPos += aLength;
+	return true;
+}
+
+
+
+static char *ParseCacheGetString(char *&aPos, char *aEnd, WORD &aLength)
+// Returns the address of the string within the buffer (it isn't terminated), or NULL if the data is truncated.
+{
+	if (!ParseCacheGet(aPos, aEnd, &aLength, sizeof(aLength)) || (size_t)(aEnd - aPos) < aLength)
+		return NULL;
+	char *string = aPos;
+	aPos += aLength;
+	return string;
+}
+
+
+
+static void ParseCacheRecordLine(Line &aLine, bool aIsReplayable)
+// Called by AddLine() for each line it adds while ParseAndAddLineCached() is recording, after the line's
+// args have been built but before anything else is done with them.  aIsReplayable is false if the line
+// can't be added from its args alone, in which case the line recorded by ParseAndAddLineCached() will be
+// parsed normally next time.  Since PreparseBlocks() hasn't built
+// their postfix arrays yet, the address of the line is recorded in their place; ParseCacheSave()
+// replaces it with the postfix arrays.  Variables are recorded by name since their addresses will differ
+// next time.  Those referenced by derefs don't need to be recorded since each deref's text is the name.
+{
+	ParseCacheBuf &buf = sParseCacheFile[sParseCacheRecordFile].records;
+	Line *line = &aLine;
+	ParseCachePut(buf, &line, sizeof(line));
+	DWORD length = 0;
+	size_t length_pos = buf.length;
+	ParseCachePut(buf, &length, sizeof(length)); // Placeholder, set below.
+	ParseCachePut(buf, &aLine.mActionType, sizeof(aLine.mActionType));
+	ParseCachePut(buf, &aLine.mArgc, sizeof(aLine.mArgc));
+	UCHAR type;
+	WORD deref_count, value;
+	for (int i = 0; i < aLine.mArgc; ++i)
+	{
+		ArgStruct &arg = aLine.mArg[i];
+		if (arg.type != ARG_TYPE_NORMAL && !*arg.text) // A pure variable, whose deref is really a Var*.  See AddLine().
+		{
+			type = arg.type | PARSE_CACHE_PURE_VAR;
+			ParseCachePut(buf, &type, sizeof(type));
+			ParseCachePutString(buf, ((Var *)arg.deref)->mName, strlen(((Var *)arg.deref)->mName));
+			continue;
+		}
+		type = arg.type;
+		ParseCachePut(buf, &type, sizeof(type));
+		ParseCachePut(buf, &arg.is_expression, sizeof(arg.is_expression));
+		ParseCachePutString(buf, arg.text, arg.length);
+		deref_count = 0;
+		if (arg.deref)
+			for (; arg.deref[deref_count].marker; ++deref_count);
+		ParseCachePut(buf, &deref_count, sizeof(deref_count));
+		for (DerefType *deref = arg.deref, *deref_end = deref + deref_count; deref < deref_end; ++deref)
+		{
+			value = (WORD)(deref->marker - arg.text);
+			ParseCachePut(buf, &value, sizeof(value));
+			ParseCachePut(buf, &deref->length, sizeof(deref->length));
+			ParseCachePut(buf, &deref->is_function, sizeof(deref->is_function));
+			ParseCachePut(buf, &deref->param_count, sizeof(deref->param_count));
+		}
+	}
+	length = (DWORD)(buf.length - length_pos - sizeof(length));
+	if (sParseCacheCanSave) // Otherwise, buf might not be large enough.
+		memcpy(buf.data + length_pos, &length, sizeof(length));
+	++sParseCacheRecordLines;
+	if (!aIsReplayable)
+		sParseCacheRecordIsReplayable = false;
+}
+
+
+
+static int ParseCacheFindDeref(ArgStruct &aArg, int aDerefCount, Var *aVar)
+{
+	for (int i = 0; i < aDerefCount; ++i)
+		if (!aArg.deref[i].is_function && aArg.deref[i].var == aVar)
+			return i;
+	return -1;
+}
+
+
+
+static bool ParseCachePutPostfix(ParseCacheBuf &aBuf, ArgStruct &aArg)
+// Appends aArg's postfix array (built by ExpressionToPostfix()) to aBuf.  Each token that refers to a
+// deref or another token is recorded as an index since the addresses will differ next time.  Returns
+// false if aArg has something this function doesn't know how to record, in which case the caller
+// records the arg as having no postfix array so that ExpressionToPostfix() will build it next time.
+{
+	int deref_count = 0;
+	if (aArg.deref)
+		for (; aArg.deref[deref_count].marker; ++deref_count);
+	ExprTokenType *token, *token2;
+	DerefType *deref, *deref2;
+	WORD value;
+	short index;
+	UCHAR flag;
+	for (token = aArg.postfix; token->symbol != SYM_INVALID; ++token);
+	value = (WORD)(token - aArg.postfix);
+	ParseCachePut(aBuf, &value, sizeof(value));
+	for (token = aArg.postfix; token->symbol != SYM_INVALID; ++token)
+	{
+		flag = (UCHAR)token->symbol;
+		ParseCachePut(aBuf, &flag, sizeof(flag));
+		index = token->circuit_token ? (short)(token->circuit_token - aArg.postfix) : -1;
+		ParseCachePut(aBuf, &index, sizeof(index));
+		switch (token->symbol)
+		{
+		case SYM_STRING:
+		case SYM_OPERAND:
+			ParseCachePutString(aBuf, token->marker, strlen(token->marker));
+			if (token->symbol == SYM_STRING)
+				break;
+			flag = token->buf != NULL; // Whether it has a pre-converted binary integer.
+			ParseCachePut(aBuf, &flag, sizeof(flag));
+			if (flag)
+				ParseCachePut(aBuf, token->buf, sizeof(__int64));
+			break;
+		case SYM_DYNAMIC:
+			flag = token->buf != NULL; // Whether it's a double-deref.  See ExpressionToPostfix().
+			ParseCachePut(aBuf, &flag, sizeof(flag));
+			if (flag)
+			{
+				ParseCachePutString(aBuf, token->buf, strlen(token->buf));
+				// The deref array of a double-deref is a copy of some of the arg's derefs, but with each
+				// marker pointing into buf instead.  Find where it was copied from:
+				DerefType *deref_new = (DerefType *)token->var, *deref_new_end;
+				for (deref_new_end = deref_new; deref_new_end->marker; ++deref_new_end);
+				for (index = 0; index + (deref_new_end - deref_new) <= deref_count; ++index)
+				{
+					for (deref = deref_new, deref2 = aArg.deref + index; deref < deref_new_end; ++deref, ++deref2)
+						if (deref->var != deref2->var || deref->is_function != deref2->is_function
+							|| deref->length != deref2->length || deref->param_count != deref2->param_count)
+							break;
+					if (deref == deref_new_end) // All of them matched.
+						break;
+				}
+				if (index + (deref_new_end - deref_new) > deref_count)
+					return false;
+				ParseCachePut(aBuf, &index, sizeof(index));
+				value = (WORD)(deref_new_end - deref_new);
+				ParseCachePut(aBuf, &value, sizeof(value));
+				for (deref = deref_new; deref < deref_new_end; ++deref)
+				{
+					value = (WORD)(deref->marker - token->buf);
+					ParseCachePut(aBuf, &value, sizeof(value));
+				}
+				ParseCachePut(aBuf, &deref_new_end->is_function, sizeof(deref_new_end->is_function));
+				break;
+			}
+			// Otherwise, it's a built-in or environment variable, which is recorded the same as SYM_VAR.
+		case SYM_VAR:
+			if (   (index = (short)ParseCacheFindDeref(aArg, deref_count, token->var)) == -1   )
+				return false;
+			ParseCachePut(aBuf, &index, sizeof(index));
+			// Record the type since ExpressionToPostfix() chose the symbol based on it:
+			flag = token->var->Type();
+			ParseCachePut(aBuf, &flag, sizeof(flag));
+			break;
+		case SYM_FUNC:
+			if (token->deref >= aArg.deref && token->deref < aArg.deref + deref_count)
+				index = (short)(token->deref - aArg.deref);
+			else // A dynamic function call, whose deref is the terminator of the preceding SYM_DYNAMIC's deref array.
+			{
+				for (token2 = aArg.postfix; token2 < token; ++token2)
+				{
+					if (token2->symbol != SYM_DYNAMIC || !token2->buf)
+						continue;
+					for (deref = (DerefType *)token2->var; deref->marker; ++deref);
+					if (deref == token->deref)
+						break;
+				}
+				if (token2 == token)
+					return false;
+				index = -1 - (short)(token2 - aArg.postfix);
+			}
+			ParseCachePut(aBuf, &index, sizeof(index));
+			break;
+		default:
+			if (IS_OPERAND(token->symbol)) // Something ExpressionToPostfix() doesn't currently produce, such as SYM_INTEGER.
+				return false;
+			// Otherwise, it's an operator, which has no data other than its symbol and circuit_token.
+		}
+	}
+	return true;
+}
+
+
+
+static ExprTokenType *ParseCacheGetPostfix(char *aPos, char *aEnd, ArgStruct &aArg)
+// Builds a postfix array for aArg from the data at aPos that was written by ParseCachePutPostfix().
+// Returns NULL if the data can't be used, in which case PreparseBlocks() builds the postfix array.
+{
+	int deref_count = 0;
+	if (aArg.deref)
+		for (; aArg.deref[deref_count].marker; ++deref_count);
+	WORD token_count, length;
+	short index;
+	UCHAR flag;
+	char *string;
+	DerefType *deref_new;
+	ExprTokenType *postfix;
+	if (!ParseCacheGet(aPos, aEnd, &token_count, sizeof(token_count))
+		|| !(postfix = (ExprTokenType *)SimpleHeap::Malloc((token_count + 1) * sizeof(ExprTokenType)))   )
+		return NULL;
+	for (int i = 0; i < token_count; ++i)
+	{
+		ExprTokenType &token = postfix[i];
+		if (!ParseCacheGet(aPos, aEnd, &flag, sizeof(flag)) || !ParseCacheGet(aPos, aEnd, &index, sizeof(index))
+			|| index >= token_count)
+			return NULL;
+		token.symbol = (SymbolType)flag;
+		token.circuit_token = index < 0 ? NULL : postfix + index;
+		switch (token.symbol)
+		{
+		case SYM_STRING:
+		case SYM_OPERAND:
+			if (   !(string = ParseCacheGetString(aPos, aEnd, length))
+				|| !(token.marker = SimpleHeap::Malloc(string, length))   )
+				return NULL;
+			if (token.symbol == SYM_STRING)
+				break;
+			if (!ParseCacheGet(aPos, aEnd, &flag, sizeof(flag)))
+				return NULL;
+			token.buf = NULL;
+			if (flag && (   !(token.buf = SimpleHeap::Malloc(sizeof(__int64)))
+				|| !ParseCacheGet(aPos, aEnd, token.buf, sizeof(__int64))   ))
+				return NULL;
+			break;
+		case SYM_DYNAMIC:
+			if (!ParseCacheGet(aPos, aEnd, &flag, sizeof(flag)))
+				return NULL;
+			if (flag) // A double-deref.
+			{
+				WORD count, offset;
+				if (   !(string = ParseCacheGetString(aPos, aEnd, length))
+					|| !(token.buf = SimpleHeap::Malloc(string, length))
+					|| !ParseCacheGet(aPos, aEnd, &index, sizeof(index))
+					|| !ParseCacheGet(aPos, aEnd, &count, sizeof(count))
+					|| !count || index < 0 || index + count > deref_count
+					|| !(deref_new = (DerefType *)SimpleHeap::Malloc((count + 1) * sizeof(DerefType)))   )
+					return NULL;
+				memcpy(deref_new, aArg.deref + index, count * sizeof(DerefType));
+				for (int j = 0; j < count; ++j)
+				{
+					if (!ParseCacheGet(aPos, aEnd, &offset, sizeof(offset)) || offset >= length)
+						return NULL;
+					deref_new[j].marker = token.buf + offset;
+				}
+				if (!ParseCacheGet(aPos, aEnd, &deref_new[count].is_function, sizeof(deref_new[count].is_function)))
+					return NULL;
+				deref_new[count].marker = NULL; // Terminate the array.
+				deref_new[count].func = NULL;
+				deref_new[count].param_count = deref_new->param_count; // See ExpressionToPostfix().
+				token.var = (Var *)deref_new;
+				break;
+			}
+			token.buf = NULL; // Indicate that it's not a double-deref.
+			// Otherwise, fall through to the SYM_VAR section to get the variable.
+		case SYM_VAR:
+			if (!ParseCacheGet(aPos, aEnd, &index, sizeof(index)) || !ParseCacheGet(aPos, aEnd, &flag, sizeof(flag))
+				|| index < 0 || index >= deref_count || aArg.deref[index].is_function)
+				return NULL;
+			token.var = aArg.deref[index].var;
+			if (token.var->Type() != flag) // The choice of symbol might not be the same this time.
+				return NULL;
+			break;
+		case SYM_FUNC:
+			if (!ParseCacheGet(aPos, aEnd, &index, sizeof(index)))
+				return NULL;
+			if (index >= 0)
+			{
+				if (index >= deref_count || !aArg.deref[index].is_function)
+					return NULL;
+				token.deref = aArg.deref + index;
+			}
+			else // The terminator of a preceding double-deref's array.  See ParseCachePutPostfix().
+			{
+				index = -1 - index;
+				if (index >= i || postfix[index].symbol != SYM_DYNAMIC || !postfix[index].buf)
+					return NULL;
+				for (token.deref = (DerefType *)postfix[index].var; token.deref->marker; ++token.deref);
+			}
+			break;
+		default:
+			if (IS_OPERAND(token.symbol) || token.symbol >= SYM_COUNT)
+				return NULL;
+		}
+	}
+	postfix[token_count].symbol = SYM_INVALID; // Special item to mark the end of the array.
+	return postfix;
+}
+
+
+
+static void ParseCacheLoad()
+// Reads the cache file with a single ReadFile().  Any problem with it (missing, corrupt or written by
+// a different version) simply leaves the cache empty, which causes all lines to be parsed normally.
+{
+	char cache_file[MAX_PATH];
+	ScriptCacheGetFileName(cache_file, sizeof(cache_file), "parsecache");
+	HANDLE hfile = CreateFile(cache_file, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (hfile == INVALID_HANDLE_VALUE)
+		return;
+	DWORD file_size = GetFileSize(hfile, NULL), bytes_read;
+	char *buf = NULL;
+	if (file_size != INVALID_FILE_SIZE && file_size > PARSE_CACHE_HEADER_LENGTH + sizeof(DWORD)
+		&& (buf = (char *)malloc(file_size)))
+	{
+		if (!ReadFile(hfile, buf, file_size, &bytes_read, NULL) || bytes_read != file_size)
+		{
+			free(buf);
+			buf = NULL;
+		}
+	}
+	CloseHandle(hfile);
+	if (!buf)
+		return;
+
+	// Format: the header (which includes the version since others might parse differently), a checksum
+	// of everything after it, the #NoEnv setting, and the number of files.  Then for each file: its
+	// path, size, modification time, hash, and the length of its records followed by the records.
+	char *pos = buf + PARSE_CACHE_HEADER_LENGTH, *end = buf + file_size, *path;
+	DWORD checksum, block_count;
+	UCHAR no_env;
+	WORD path_length;
+	if (   memcmp(buf, PARSE_CACHE_HEADER, PARSE_CACHE_HEADER_LENGTH)
+		|| !ParseCacheGet(pos, end, &checksum, sizeof(checksum))
+		|| checksum != ParseCacheHash(pos, end - pos) // The file is truncated or corrupt.
+		|| !ParseCacheGet(pos, end, &no_env, sizeof(no_env))
+		|| !ParseCacheGet(pos, end, &block_count, sizeof(block_count))
+		|| block_count > ABSOLUTE_MAX_SOURCE_FILES
+		|| block_count && !(sParseCacheBlock = (ParseCacheBlock *)malloc(block_count * sizeof(ParseCacheBlock)))   )
+	{
+		free(buf);
+		return;
+	}
+	for (; sParseCacheBlockCount < (int)block_count; ++sParseCacheBlockCount)
+	{
+		ParseCacheBlock &block = sParseCacheBlock[sParseCacheBlockCount];
+		if (   !(path = ParseCacheGetString(pos, end, path_length))
+			|| !path_length || path[path_length - 1] // The path must include its terminator.
+			|| !ParseCacheGet(pos, end, &block.size, sizeof(block.size))
+			|| !ParseCacheGet(pos, end, &block.last_write, sizeof(block.last_write))
+			|| !ParseCacheGet(pos, end, &block.hash, sizeof(block.hash))
+			|| !ParseCacheGet(pos, end, &block.records_length, sizeof(block.records_length))
+			|| (DWORD)(end - pos) < block.records_length   )
+			break;
+		block.path = path;
+		block.records = pos;
+		block.is_used = false;
+		pos += block.records_length;
+	}
+	if (sParseCacheBlockCount < (int)block_count) // The checksum matched, so this would be a bug in ParseCacheSave().
+	{
+		sParseCacheBlockCount = 0;
+		free(sParseCacheBlock);
+		sParseCacheBlock = NULL;
+		free(buf);
+		return;
+	}
+	sParseCacheContents = buf;
+	sParseCacheNoEnv = no_env;
+	sParseCacheIsDirty = false; // Until something is found to differ.
+}
+
+
+
+static int ParseCacheBeginFile(char *aPath, char *aData, DWORD aSize, FILETIME &aLastWrite)
+// Called by LoadIncludedFile() for each file it loads.  Returns the index of the file for use with
+// ParseAndAddLineCached(), or -1 if its lines shouldn't be recorded (i.e. out of memory).
+{
+	if (sParseCacheFileCount >= sParseCacheFileCapacity)
+	{
+		int new_capacity = sParseCacheFileCapacity ? sParseCacheFileCapacity * 2 : 16;
+		ParseCacheFile *realloc_temp = (ParseCacheFile *)realloc(sParseCacheFile, new_capacity * sizeof(ParseCacheFile));
+		if (!realloc_temp)
+		{
+			sParseCacheCanSave = false; // The cache would lack this file.
+			return -1;
+		}
+		sParseCacheFile = realloc_temp;
+		sParseCacheFileCapacity = new_capacity;
+	}
+	ParseCacheFile &file = sParseCacheFile[sParseCacheFileCount];
+	file.path = aPath;
+	file.size = aSize;
+	file.hash = ParseCacheHash(aData, aSize);
+	file.last_write = aLastWrite;
+	file.records.data = NULL;
+	file.records.length = file.records.capacity = 0;
+	file.replay = NULL;
+	// Find the cached copy of this file.  Since a file can be included more than once (#IncludeAgain),
+	// each block is used only once, in the same order as the file's inclusions:
+	for (int i = 0; i < sParseCacheBlockCount; ++i)
+	{
+		ParseCacheBlock &block = sParseCacheBlock[i];
+		if (block.is_used || lstrcmpi(block.path, aPath))
+			continue;
+		block.is_used = true;
+		if (block.size == file.size && block.hash == file.hash
+			&& !memcmp(&block.last_write, &file.last_write, sizeof(FILETIME)))
+		{
+			file.replay = block.records;
+			file.replay_end = block.records + block.records_length;
+		}
+		break;
+	}
+	if (!file.replay)
+		sParseCacheIsDirty = true; // So that the cache is updated even if this file has no lines to parse.
+	return sParseCacheFileCount++;
+}
+
+
+
+static void ParseCacheSave()
+// Called after the script has finished loading, at which time the postfix arrays of each recorded line
+// have been built by PreparseBlocks().  The cache is written only when this run parsed something that
+// it didn't have, so that an unchanged script never writes anything.  Either way, the memory used by
+// the cache is freed since it's no longer needed.
+{
+	int i;
+	for (i = 0; i < sParseCacheBlockCount; ++i)
+		if (!sParseCacheBlock[i].is_used) // A file that's no longer included.
+			sParseCacheIsDirty = true;
+	if (g_NoEnv != sParseCacheNoEnv) // The postfix arrays might differ.
+		sParseCacheIsDirty = true;
+	ParseCacheBuf out = {0};
+	char *pos, *end, *args;
+	DWORD length, key_length, records_length;
+	size_t records_length_pos;
+	int line_count;
+	UCHAR flag;
+	Line *line;
+	if (sParseCacheIsDirty && sParseCacheCanSave)
+	{
+		ParseCachePut(out, (void *)PARSE_CACHE_HEADER, PARSE_CACHE_HEADER_LENGTH);
+		length = 0;
+		ParseCachePut(out, &length, sizeof(length)); // Placeholder for the checksum.
+		flag = g_NoEnv;
+		ParseCachePut(out, &flag, sizeof(flag));
+		length = sParseCacheFileCount;
+		ParseCachePut(out, &length, sizeof(length));
+		for (i = 0; i < sParseCacheFileCount; ++i)
+		{
+			ParseCacheFile &file = sParseCacheFile[i];
+			ParseCachePutString(out, file.path, strlen(file.path) + 1); // +1 to include the terminator.
+			ParseCachePut(out, &file.size, sizeof(file.size));
+			ParseCachePut(out, &file.last_write, sizeof(file.last_write));
+			ParseCachePut(out, &file.hash, sizeof(file.hash));
+			records_length_pos = out.length;
+			ParseCachePut(out, &length, sizeof(length)); // Placeholder for the length of the records.
+			// Copy each record, replacing the address of each line with its postfix arrays (see
+			// ParseCacheRecordLine()).  The records were written by this run, so they needn't be checked.
+			for (pos = file.records.data, end = pos + file.records.length; pos < end;)
+			{
+				memcpy(&key_length, pos, sizeof(key_length));
+				memcpy(&line_count, pos + sizeof(key_length) + key_length, sizeof(line_count));
+				ParseCachePut(out, pos, sizeof(key_length) + key_length + sizeof(line_count));
+				pos += sizeof(key_length) + key_length + sizeof(line_count);
+				for (; line_count > 0; --line_count)
+				{
+					memcpy(&line, pos, sizeof(line));
+					memcpy(&length, pos + sizeof(line), sizeof(length));
+					args = pos + sizeof(line) + sizeof(length);
+					ParseCachePut(out, &length, sizeof(length));
+					ParseCachePut(out, args, length);
+					pos = args + length;
+					for (int a = 0; a < line->mArgc; ++a)
+					{
+						ArgStruct &arg = line->mArg[a];
+						size_t postfix_pos = out.length;
+						flag = arg.is_expression && arg.postfix;
+						ParseCachePut(out, &flag, sizeof(flag));
+						if (!flag)
+							continue;
+						ParseCachePut(out, &length, sizeof(length)); // Placeholder for the length of the postfix data.
+						if (!ParseCachePutPostfix(out, arg))
+						{
+							out.length = postfix_pos; // Discard the partial data.
+							flag = 0;
+							ParseCachePut(out, &flag, sizeof(flag));
+						}
+						else if (sParseCacheCanSave)
+						{
+							length = (DWORD)(out.length - postfix_pos - sizeof(flag) - sizeof(length));
+							memcpy(out.data + postfix_pos + sizeof(flag), &length, sizeof(length));
+						}
+					}
+				}
+			}
+			records_length = (DWORD)(out.length - records_length_pos - sizeof(records_length));
+			if (sParseCacheCanSave)
+				memcpy(out.data + records_length_pos, &records_length, sizeof(records_length));
+		}
+		if (sParseCacheCanSave)
+		{
+			length = ParseCacheHash(out.data + PARSE_CACHE_HEADER_LENGTH + sizeof(length)
+				, out.length - PARSE_CACHE_HEADER_LENGTH - sizeof(length));
+			memcpy(out.data + PARSE_CACHE_HEADER_LENGTH, &length, sizeof(length));
+			char cache_file[MAX_PATH];
+			ScriptCacheGetFileName(cache_file, sizeof(cache_file), "parsecache");
+			HANDLE hfile = CreateFile(cache_file, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+			if (hfile != INVALID_HANDLE_VALUE) // Otherwise, it's not an error because the cache is only an optimization.
+			{
+				if (!WriteFile(hfile, out.data, (DWORD)out.length, &length, NULL) || length != out.length)
+				{
+					CloseHandle(hfile);
+					DeleteFile(cache_file); // Don't leave a partial file, although the checksum would catch that.
+				}
+				else
+					CloseHandle(hfile);
+			}
+		}
+		free(out.data);
+	}
+	for (i = 0; i < sParseCacheFileCount; ++i)
+		free(sParseCacheFile[i].records.data);
+	free(sParseCacheFile);
+	sParseCacheFile = NULL;
+	sParseCacheFileCount = sParseCacheFileCapacity = 0;
+	free(sParseCacheBlock);
+	sParseCacheBlock = NULL;
+	sParseCacheBlockCount = 0;
+	free(sParseCacheContents);
+	sParseCacheContents = NULL;
+}
+
+
+
+void ParseCacheGetCounts(UINT &aHits, UINT &aMisses)
+// Provides the /Benchmark switch with the number of lines that were added from the parse cache and the
+// number that had to be parsed (not counting declarations, which are always parsed).
+{
+	aHits = sParseCacheHits;
+	aMisses = sParseCacheMisses;
+}
+
+
+
+ResultType Script::ParseCacheReplayLine(char *&aPos, char *aEnd)
+// Adds the line that was recorded at aPos by ParseCacheRecordLine() and ParseCacheSave(), then
+// advances aPos to the next line or record.  Returns OK or FAIL.
+{
+	DWORD length;
+	char *args_end, *text, *name;
+	ActionTypeType action_type;
+	ArgCountType argc;
+	UCHAR type;
+	WORD text_length, deref_count, offset;
+	ArgStruct *new_arg = NULL;
+	DerefType *deref;
+	Line *line;
+	int i;
+	if (!ParseCacheGet(aPos, aEnd, &length, sizeof(length)) || (DWORD)(aEnd - aPos) < length)
+		goto corrupt;
+	args_end = aPos + length;
+	if (!ParseCacheGet(aPos, args_end, &action_type, sizeof(action_type))
+		|| !ParseCacheGet(aPos, args_end, &argc, sizeof(argc))
+		|| action_type == ACT_INVALID || action_type >= g_ActionCount || argc > MAX_ARGS)
+		goto corrupt;
+	if (argc && !(new_arg = (ArgStruct *)SimpleHeap::Malloc(argc * sizeof(ArgStruct))))
+		return ScriptError(ERR_OUTOFMEM);
+	for (i = 0; i < argc; ++i)
+	{
+		ArgStruct &arg = new_arg[i];
+		if (!ParseCacheGet(aPos, args_end, &type, sizeof(type)))
+			goto corrupt;
+		arg.type = type & ~PARSE_CACHE_PURE_VAR;
+		arg.postfix = NULL;
+		if (type & PARSE_CACHE_PURE_VAR)
+		{
+			if (!(name = ParseCacheGetString(aPos, args_end, text_length)) || !text_length)
+				goto corrupt;
+			arg.is_expression = false;
+			arg.text = "";
+			arg.length = 0;
+			if (   !(arg.deref = (DerefType *)FindOrAddVar(name, text_length))   )
+				return FAIL; // It already displayed the error.
+			continue;
+		}
+		if (   !ParseCacheGet(aPos, args_end, &arg.is_expression, sizeof(arg.is_expression))
+			|| !(text = ParseCacheGetString(aPos, args_end, text_length))
+			|| !ParseCacheGet(aPos, args_end, &deref_count, sizeof(deref_count))
+			|| deref_count > MAX_DEREFS_PER_ARG   )
+			goto corrupt;
+		arg.length = text_length;
+		if (   !(arg.text = SimpleHeap::Malloc(text, text_length))   )
+			return FAIL; // It already displayed the error.
+		if (!deref_count)
+		{
+			arg.deref = NULL;
+			continue;
+		}
+		if (   !(arg.deref = (DerefType *)SimpleHeap::Malloc((deref_count + 1) * sizeof(DerefType)))   )
+			return ScriptError(ERR_OUTOFMEM);
+		for (deref = arg.deref; deref_count; --deref_count, ++deref)
+		{
+			if (   !ParseCacheGet(aPos, args_end, &offset, sizeof(offset))
+				|| !ParseCacheGet(aPos, args_end, &deref->length, sizeof(deref->length))
+				|| !ParseCacheGet(aPos, args_end, &deref->is_function, sizeof(deref->is_function))
+				|| !ParseCacheGet(aPos, args_end, &deref->param_count, sizeof(deref->param_count))
+				|| !deref->length || offset + deref->length > text_length   )
+				goto corrupt;
+			deref->marker = arg.text + offset;
+			if (deref->is_function)
+				deref->func = NULL; // Set by PreparseBlocks(), as usual.
+			else
+			{
+				// Look up the variable exactly as AddLine() or ParseDerefs() did: the text of the deref is
+				// either the name itself or the name enclosed in percent signs.
+				if (*deref->marker == g_DerefChar)
+				{
+					if (deref->length < 3)
+						goto corrupt;
+					deref->var = FindOrAddVar(deref->marker + 1, deref->length - 2);
+				}
+				else
+					deref->var = FindOrAddVar(deref->marker, deref->length);
+				if (!deref->var)
+					return FAIL; // It already displayed the error.
+			}
+		}
+		deref->marker = NULL; // Terminate the list of derefs.
+	}
+	if (aPos != args_end)
+		goto corrupt;
+
+	if (!AddLine(action_type, NULL, argc, NULL, new_arg))
+		return FAIL; // It already displayed the error.
+
+	// Now that AddLine() has done everything else, install the postfix arrays.  This isn't done for an
+	// arg that AddLine() didn't leave as an expression, which shouldn't happen since it's the same as
+	// last time.  PreparseBlocks() builds any that aren't installed here.
+	line = mLastLine;
+	for (i = 0; i < line->mArgc; ++i)
+	{
+		if (!ParseCacheGet(aPos, aEnd, &type, sizeof(type)))
+			goto corrupt;
+		if (!type) // No postfix array.
+			continue;
+		if (!ParseCacheGet(aPos, aEnd, &length, sizeof(length)) || (DWORD)(aEnd - aPos) < length)
+			goto corrupt;
+		if (line->mArg[i].is_expression)
+			line->mArg[i].postfix = ParseCacheGetPostfix(aPos, aPos + length, line->mArg[i]);
+		aPos += length;
+	}
+	return OK;
+
+corrupt:
+	// The checksum should prevent this, so it would be a bug in the cache code.  Since some lines might
+	// have been added already, loading can't continue.  Delete the cache so that the next launch works.
+	char cache_file[MAX_PATH];
+	ScriptCacheGetFileName(cache_file, sizeof(cache_file), "parsecache");
+	DeleteFile(cache_file);
+	return ScriptError("The parse cache is invalid, so it has been deleted.  Please run the script again.", cache_file);
+}
+#endif
+
+
+
+ResultType Script::ParseAndAddLineCached(int aCacheFile, char *aLineText, ActionTypeType aActionType)
+// Called by LoadIncludedFile() in place of ParseAndAddLine(aLineText, aActionType).  Adds the lines
+// recorded in the parse cache for aLineText if there are any, otherwise calls ParseAndAddLine().
+// Either way, the lines that were added are recorded for the next launch.  aCacheFile is the value
+// returned by ParseCacheBeginFile() for the file that contains the line.
+{
+#ifdef AUTOHOTKEYSC
+	return ParseAndAddLine(aLineText, aActionType);
+#else
+	if (aCacheFile < 0)
+		return ParseAndAddLine(aLineText, aActionType);
+	ParseCacheFile &file = sParseCacheFile[aCacheFile]; // Safe to keep since ParseAndAddLine() doesn't include files.
+	ParseCacheBuf &records = file.records;
+
+	// Each record begins with a key consisting of the settings that affect parsing and the line's text,
+	// then the number of lines that were added.  The line's text must be recorded before ParseAndAddLine()
+	// is called because it modifies the text.
+	char state[PARSE_CACHE_KEY_STATE_LENGTH] = {g_delimiter, g_DerefChar, g_EscapeChar, mIsAutoIt2, aActionType};
+	DWORD text_length = (DWORD)strlen(aLineText), key_length = sizeof(state) + text_length;
+	ParseCachePut(records, &key_length, sizeof(key_length));
+	ParseCachePut(records, state, sizeof(state));
+	ParseCachePut(records, aLineText, text_length);
+	size_t line_count_pos = records.length;
+	int line_count = 0;
+	ParseCachePut(records, &line_count, sizeof(line_count)); // Placeholder, set below.
+
+	// A line that must be parsed is recorded as having -1 lines.  This is always the case for a declaration
+	// (see ParseAndAddLine() for how it recognizes them; this is less strict since it's only an optimization).
+	bool is_declaration = g->CurrentFunc && (!strnicmp(aLineText, "Global", 6) || !strnicmp(aLineText, "Local", 5)
+		|| !strnicmp(aLineText, "Static", 6));
+
+	// See whether the next record of the cached copy of this file is for the same line:
+	int cached_line_count = 0;
+	char *pos = file.replay;
+	DWORD cached_key_length;
+	if (   pos
+		&& ParseCacheGet(pos, file.replay_end, &cached_key_length, sizeof(cached_key_length))
+		&& cached_key_length == key_length && (DWORD)(file.replay_end - pos) >= key_length
+		&& !memcmp(pos, state, sizeof(state)) && !memcmp(pos + sizeof(state), aLineText, text_length)
+		&& (pos += key_length, ParseCacheGet(pos, file.replay_end, &cached_line_count, sizeof(cached_line_count)))   )
+		file.replay = pos;
+	else
+		file.replay = NULL; // Parse the rest of this file normally, since the cache no longer corresponds to it.
+
+	ResultType result = OK;
+	sParseCacheRecordLines = 0;
+	sParseCacheRecordIsReplayable = !is_declaration;
+	if (!is_declaration) // Declarations aren't recorded since they will be parsed next time anyway.
+		sParseCacheRecordFile = aCacheFile; // Tell AddLine() to record each line it adds.
+	if (file.replay && cached_line_count != -1 && !is_declaration)
+	{
+		++sParseCacheHits;
+		for (; cached_line_count > 0 && result == OK; --cached_line_count)
+			result = ParseCacheReplayLine(file.replay, file.replay_end);
+	}
+	else
+	{
+		if (!file.replay)
+		{
+			sParseCacheIsDirty = true;
+			if (!is_declaration)
+				++sParseCacheMisses;
+		}
+		result = ParseAndAddLine(aLineText, aActionType);
+	}
+	sParseCacheRecordFile = -1;
+	if (sParseCacheRecordIsReplayable)
+		line_count = sParseCacheRecordLines;
+	else
+	{
+		line_count = -1;
+		if (records.length > line_count_pos) // Discard any lines that AddLine() recorded.
+			records.length = line_count_pos + sizeof(line_count);
+	}
+	if (sParseCacheCanSave) // Otherwise, records might not be large enough.
+		memcpy(records.data + line_count_pos, &line_count, sizeof(line_count));
+	return result;
+#endif
+}
+
+
+
 #ifdef AUTOHOTKEYSC
 LineNumberType Script::LoadFromFile()
 #else
@@ -969,6 +1836,9 @@ LineNumberType Script::LoadFromFile(bool aScriptWasNotspecified)
 	if (   !(mPlaceholderLabel = new Label(""))   ) // Not added to linked list since it's never looked up.
 		return LOADING_FAILED;
 
+#ifndef AUTOHOTKEYSC
+	ParseCacheLoad(); // Must be done prior to loading any files.
+#endif
 	// Load the main script file.  This will also load any files it includes with #Include.
 	if (   LoadIncludedFile(mFileSpec, false, false) != OK
 		|| !AddLine(ACT_EXIT) // Fix for v1.0.47.04: Add an Exit because otherwise, a script that ends in an IF-statement will crash in PreparseBlocks() because PreparseBlocks() expects every IF-statements mNextLine to be non-NULL (helps loading performance too).
@@ -978,6 +1848,8 @@ LineNumberType Script::LoadFromFile(bool aScriptWasNotspecified)
 	// That's why the above is done prior to adding the EXIT lines and other things below.
 
 #ifndef AUTOHOTKEYSC
+	LibCacheSave(); // Remember any newly resolved library functions for the next launch of this script.
+	ParseCacheSave(); // Same for any lines that had to be parsed.  Must be done after PreparseBlocks() built the postfix arrays.
 	if (mIncludeLibraryFunctionsThenExit)
 	{
 		fclose(mIncludeLibraryFunctionsThenExit);
@@ -1015,6 +1887,8 @@ LineNumberType Script::LoadFromFile(bool aScriptWasNotspecified)
 
 	if (!PreparseIfElse(mFirstLine))
 		return LOADING_FAILED; // Error was already displayed by the above calls.
+	if (!CompactLines()) // Must be done last because the above create and adjust the args' postfix arrays.
+		return LOADING_FAILED; // Error was already displayed by the above calls.
 
 	// Use FindOrAdd, not Add, because the user may already have added it simply by
 	// referring to it in the script:
@@ -1162,9 +2036,13 @@ ResultType Script::LoadIncludedFile(char *aFileSpec, bool aAllowDuplicateInclude
 	bool pending_function_has_brace;
 
 #ifndef AUTOHOTKEYSC
-	// Future: might be best to put a stat() or GetFileAttributes() in here for better handling.
-	FILE *fp = fopen(aFileSpec, "r");
-	if (!fp)
+	// Read the entire file into memory with a single ReadFile() rather than one fgets() per line.  This
+	// allows GetLine() to find the end of each line with memchr() (which the CRT implements with wide
+	// compares) and to copy the line with a single memcpy(), which substantially speeds up the loading
+	// of large scripts.  It also lets both the compiled and uncompiled modes share the same GetLine().
+	HANDLE hfile = CreateFile(aFileSpec, GENERIC_READ, FILE_SHARE_READ|FILE_SHARE_WRITE, NULL, OPEN_EXISTING
+		, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (hfile == INVALID_HANDLE_VALUE)
 	{
 		if (aIgnoreLoadFailure)
 			return OK;
@@ -1173,25 +2051,40 @@ ResultType Script::LoadIncludedFile(char *aFileSpec, bool aAllowDuplicateInclude
 		MsgBox(msg_text);
 		return FAIL;
 	}
-	// v1.0.40.11: Otherwise, check if the first three bytes of the file are the UTF-8 BOM marker (and if
+	DWORD bytes_read;
+	FILETIME last_write;
+	if (!GetFileTime(hfile, NULL, NULL, &last_write))
+		last_write.dwLowDateTime = last_write.dwHighDateTime = 0; // Rare, and the hash still protects the parse cache.
+	nDataSize = GetFileSize(hfile, NULL);
+	if (nDataSize == INVALID_FILE_SIZE || !(script_buf = (UCHAR *)malloc(nDataSize + 1))) // +1 so that an empty file still gets a non-NULL buffer.
+	{
+		CloseHandle(hfile);
+		return ScriptError(ERR_OUTOFMEM, aFileSpec);
+	}
+	if (!ReadFile(hfile, script_buf, nDataSize, &bytes_read, NULL))
+		bytes_read = 0; // Treat a read error like the old fgets() method did: as end-of-file.
+	CloseHandle(hfile);
+	nDataSize = bytes_read;
+	// The old text-mode fgets() method treated Ctrl-Z as end-of-file, so preserve that behavior:
+	UCHAR *ctrl_z = (UCHAR *)memchr(script_buf, 26, nDataSize);
+	if (ctrl_z)
+		nDataSize = (ULONG)(ctrl_z - script_buf);
+	UCHAR *script_buf_marker = script_buf;  // "marker" will track where we are in the mem. file as we read from it.
+	// v1.0.40.11: Check if the first three bytes of the file are the UTF-8 BOM marker (and if
 	// so omit them from further consideration).  Apps such as Notepad, WordPad, and Word all insert this
 	// marker if the file is saved in UTF-8 format.  This omits such markers from both the main script and
 	// any files it includes via #Include.
 	// NOTE: To save code size, any UTF-8 BOM bytes at the beginning of a compiled script have already been
 	// stripped out by the script compiler.  Thus, there is no need to check for them in the AUTOHOTKEYSC
 	// section further below.
-	if (fgets(buf, 4, fp)) // Success (the fourth character is the terminator).
-	{
-		if (strcmp(buf, "﻿"))  // UTF-8 BOM marker is NOT present.
-			rewind(fp);  // Go back to the beginning so that the first three bytes aren't omitted during loading.
-			// The code size of rewind() has been checked and it seems very tiny.
-	}
-	//else file read error or EOF, let a later section handle it.
+	if (nDataSize >= 3 && !memcmp(script_buf, "\xEF\xBB\xBF", 3))
+		script_buf_marker += 3;
 
 	// This is done only after the file has been successfully opened in case aIgnoreLoadFailure==true:
 	if (source_file_index > 0)
 		Line::sSourceFile[source_file_index] = SimpleHeap::Malloc(full_path);
 	//else the first file was already taken care of by another means.
+	int cache_file = ParseCacheBeginFile(Line::sSourceFile[source_file_index], (char *)script_buf, nDataSize, last_write);
 
 #else // Stand-alone mode (there are no include files in this mode since all of them were merged into the main script at the time of compiling).
 	HS_EXEArc_Read oRead;
@@ -1218,16 +2111,17 @@ ResultType Script::LoadIncludedFile(char *aFileSpec, bool aAllowDuplicateInclude
 	}
 	UCHAR *script_buf_marker = script_buf;  // "marker" will track where we are in the mem. file as we read from it.
 
-	// Must cast to int to avoid loss of negative values:
-	#define SCRIPT_BUF_SPACE_REMAINING ((int)(nDataSize - (script_buf_marker - script_buf)))
-	int script_buf_space_remaining, max_chars_to_read; // script_buf_space_remaining must be an int to detect negatives.
-
 	// AutoIt3: We have the data in RAW BINARY FORM, the script is a text file, so
 	// this means that instead of a newline character, there may also be carridge
 	// returns 0x0d 0x0a (\r\n)
 	HS_EXEArc_Read *fp = &oRead;  // To help consolidate the code below.
+	int cache_file = -1; // Compiled scripts have no parse cache.
 #endif
 
+	// Must cast to int to avoid loss of negative values:
+	#define SCRIPT_BUF_SPACE_REMAINING ((int)(nDataSize - (script_buf_marker - script_buf)))
+	int script_buf_space_remaining, max_chars_to_read; // script_buf_space_remaining must be an int to detect negatives.
+
 	++Line::sSourceFileCount;
 
 	// File is now open, read lines from it.
@@ -1267,16 +2161,15 @@ ResultType Script::LoadIncludedFile(char *aFileSpec, bool aAllowDuplicateInclude
 	// -1 (MAX_UINT in this case) to compensate for the fact that there is a comment containing
 	// the version number added to the top of each compiled script:
 	LineNumberType phys_line_number = -1;
-	// For compiled scripts, limit the number of characters to read to however many remain in the memory
-	// file or the size of the buffer, whichever is less.
+#else
+	LineNumberType phys_line_number = 0;
+#endif
+	// Limit the number of characters to read to however many remain in the memory file or the size
+	// of the buffer, whichever is less.
 	script_buf_space_remaining = SCRIPT_BUF_SPACE_REMAINING;  // Resolve macro only once, for performance.
 	max_chars_to_read = (LINE_SIZE - 1 < script_buf_space_remaining) ? LINE_SIZE - 1
 		: script_buf_space_remaining;
 	buf_length = GetLine(buf, max_chars_to_read, 0, script_buf_marker);
-#else
-	LineNumberType phys_line_number = 0;
-	buf_length = GetLine(buf, LINE_SIZE - 1, 0, fp);
-#endif
 
 	if (in_comment_section = !strncmp(buf, "/*", 2))
 	{
@@ -1314,15 +2207,11 @@ ResultType Script::LoadIncludedFile(char *aFileSpec, bool aAllowDuplicateInclude
 		{
 			// This increment relies on the fact that this loop always has at least one iteration:
 			++phys_line_number; // Tracks phys. line number in *this* file (independent of any recursion caused by #Include).
-#ifdef AUTOHOTKEYSC
 			// See similar section above for comments about the following:
 			script_buf_space_remaining = SCRIPT_BUF_SPACE_REMAINING;  // Resolve macro only once, for performance.
 			max_chars_to_read = (LINE_SIZE - 1 < script_buf_space_remaining) ? LINE_SIZE - 1
 				: script_buf_space_remaining;
 			next_buf_length = GetLine(next_buf, max_chars_to_read, in_continuation_section, script_buf_marker);
-#else
-			next_buf_length = GetLine(next_buf, LINE_SIZE - 1, in_continuation_section, fp);
-#endif
 			if (next_buf_length && next_buf_length != -1) // Prevents infinite loop when file ends with an unclosed "/*" section.  Compare directly to -1 since length is unsigned.
 			{
 				if (in_comment_section) // Look for the uncomment-flag.
@@ -1773,7 +2662,7 @@ ResultType Script::LoadIncludedFile(char *aFileSpec, bool aAllowDuplicateInclude
 			}
 			else // It's a function call on a line by itself, such as fn(x). It can't be if(..) because another section checked that.
 			{
-				if (!ParseAndAddLine(pending_function, ACT_EXPRESSION))
+				if (!ParseAndAddLineCached(cache_file, pending_function, ACT_EXPRESSION))
 					return CloseAndReturnFail(fp, script_buf);
 				mCurrLine = NULL; // Prevents showing misleading vicinity lines if the line after a function call is a syntax error.
 			}
@@ -2053,7 +2942,7 @@ examine_line:
 					// But do put in the Return regardless, in case this label is ever jumped to
 					// via Goto/Gosub:
 					if (   !(hook_action = Hotkey::ConvertAltTab(hotkey_flag, false))   )
-						if (!ParseAndAddLine(hotkey_flag, IsFunction(hotkey_flag) ? ACT_EXPRESSION : ACT_INVALID)) // It can't be a function definition vs. call since it's a single-line hotkey.
+						if (!ParseAndAddLineCached(cache_file, hotkey_flag, IsFunction(hotkey_flag) ? ACT_EXPRESSION : ACT_INVALID)) // It can't be a function definition vs. call since it's a single-line hotkey.
 							return CloseAndReturnFail(fp, script_buf);
 				// Also add a Return that's implicit for a single-line hotkey.  This is also
 				// done for auto-replace hotstrings in case gosub/goto is ever used to jump
@@ -2225,14 +3114,14 @@ examine_line:
 				if (   *(action_end = omit_leading_whitespace(buf + 1))   )  // There is an action to the right of the '{'.
 				{
 					mCurrLine = NULL;  // To signify that we're in transition, trying to load a new one.
-					if (!ParseAndAddLine(action_end, IsFunction(action_end) ? ACT_EXPRESSION : ACT_INVALID)) // If it's a function, it must be a call vs. a definition because a function can't be defined on the same line as an open-brace.
+					if (!ParseAndAddLineCached(cache_file, action_end, IsFunction(action_end) ? ACT_EXPRESSION : ACT_INVALID)) // If it's a function, it must be a call vs. a definition because a function can't be defined on the same line as an open-brace.
 						return CloseAndReturnFail(fp, script_buf);
 				}
 				// Otherwise, there was either no same-line action or the same-line action was successfully added,
 				// so do nothing.
 			}
 			else
-				if (!ParseAndAddLine(buf))
+				if (!ParseAndAddLineCached(cache_file, buf))
 					return CloseAndReturnFail(fp, script_buf);
 		}
 		else // This line is an ELSE, possibly with another command immediately after it (on the same line).
@@ -2247,7 +3136,7 @@ examine_line:
 			action_end = omit_leading_whitespace(action_end); // Now action_end is the word after the ELSE.
 			if (*action_end == g_delimiter) // Allow "else, action"
 				action_end = omit_leading_whitespace(action_end + 1);
-			if (*action_end && !ParseAndAddLine(action_end, IsFunction(action_end) ? ACT_EXPRESSION : ACT_INVALID)) // If it's a function, it must be a call vs. a definition because a function can't be defined on the same line as an Else.
+			if (*action_end && !ParseAndAddLineCached(cache_file, action_end, IsFunction(action_end) ? ACT_EXPRESSION : ACT_INVALID)) // If it's a function, it must be a call vs. a definition because a function can't be defined on the same line as an Else.
 				return CloseAndReturnFail(fp, script_buf);
 			// Otherwise, there was either no same-line action or the same-line action was successfully added,
 			// so do nothing.
@@ -2362,16 +3251,14 @@ continue_main_loop: // This method is used in lieu of "continue" for performance
 		// alternatives due to the use of "continue" in some places above.
 		saved_line_number = mCombinedLineNumber;
 		mCombinedLineNumber = pending_function_line_number; // Done so that any syntax errors that occur during the calls below will report the correct line number.
-		if (!ParseAndAddLine(pending_function, ACT_EXPRESSION)) // Must be function call vs. definition since otherwise the above would have detected the opening brace beneath it and already cleared pending_function.
+		if (!ParseAndAddLineCached(cache_file, pending_function, ACT_EXPRESSION)) // Must be function call vs. definition since otherwise the above would have detected the opening brace beneath it and already cleared pending_function.
 			return CloseAndReturnFail(fp, script_buf);
 		mCombinedLineNumber = saved_line_number;
 	}
 
-#ifdef AUTOHOTKEYSC
 	free(script_buf); // AutoIt3: Close the archive and free the file in memory.
-	oRead.Close();    //
-#else
-	fclose(fp);
+#ifdef AUTOHOTKEYSC
+	oRead.Close();
 #endif
 	return OK;
 }
@@ -2387,68 +3274,38 @@ inline ResultType Script::CloseAndReturnFailFunc(HS_EXEArc_Read *fp, UCHAR *aBuf
 	return FAIL;
 }
 #else
-inline ResultType Script::CloseAndReturnFailFunc(FILE *fp)
+inline ResultType Script::CloseAndReturnFailFunc(UCHAR *aBuf)
 {
-	fclose(fp);
+	free(aBuf);
 	return FAIL;
 }
 #endif
 
 
 
-#ifdef AUTOHOTKEYSC
 size_t Script::GetLine(char *aBuf, int aMaxCharsToRead, int aInContinuationSection, UCHAR *&aMemFile) // last param = reference to pointer
-#else
-size_t Script::GetLine(char *aBuf, int aMaxCharsToRead, int aInContinuationSection, FILE *fp)
-#endif
 {
 	size_t aBuf_length = 0;
-#ifdef AUTOHOTKEYSC
 	if (!aBuf || !aMemFile) return -1;
 	if (aMaxCharsToRead < 1) return -1; // We're signaling to caller that the end of the memory file has been reached.
-	// Otherwise, continue reading characters from the memory file until either a newline is
-	// reached or aMaxCharsToRead have been read:
-	// Track "i" separately from aBuf_length because we want to read beyond the bounds of the memory file.
-	int i;
-	for (i = 0; i < aMaxCharsToRead; ++i)
-	{
-		if (aMemFile[i] == '\n')
-		{
-			// The end of this line has been reached.  Don't copy this char into the target buffer.
-			// In addition, if the previous char was '\r', remove it from the target buffer:
-			if (aBuf_length > 0 && aBuf[aBuf_length - 1] == '\r')
-				aBuf[--aBuf_length] = '\0';
-			++i; // i.e. so that aMemFile will be adjusted to omit this newline char.
-			break;
-		}
-		else
-			aBuf[aBuf_length++] = aMemFile[i];
-	}
-	// We either read aMaxCharsToRead or reached the end of the line (as indicated by the newline char).
-	// In the former case, aMemFile might now be changed to be a position outside the bounds of the
-	// memory area, which the caller will reflect back to us during the next call as a 0 value for
+	// Otherwise, copy characters from the memory file until either a newline is reached or
+	// aMaxCharsToRead have been copied.  memchr() is used to find the newline because it's much
+	// faster than examining one char at a time (the CRT's version compares a word at a time).
+	UCHAR *newline = (UCHAR *)memchr(aMemFile, '\n', aMaxCharsToRead);
+	aBuf_length = newline ? newline - aMemFile : aMaxCharsToRead;
+	memcpy(aBuf, aMemFile, aBuf_length);
+	// If a newline was found, adjust aMemFile to omit it.  Otherwise, aMaxCharsToRead were read, in
+	// which case aMemFile might now be changed to be a position outside the bounds of the memory
+	// area, which the caller will reflect back to us during the next call as a 0 value for
 	// aMaxCharsToRead, which we then signal to the caller (above) as the end of the file):
-	aMemFile += i; // Update this value for use by the caller.
+	aMemFile += newline ? aBuf_length + 1 : aBuf_length;
+	// Don't copy the newline char into the target buffer.  In addition, if the previous char was '\r',
+	// remove it from the target buffer (the final line of the file might end in '\r' too):
+	if (aBuf_length > 0 && aBuf[aBuf_length - 1] == '\r')
+		--aBuf_length;
 	// Terminate the buffer (the caller has already ensured that there's room for the terminator
 	// via its value of aMaxCharsToRead):
 	aBuf[aBuf_length] = '\0';
-#else
-	if (!aBuf || !fp) return -1;
-	if (aMaxCharsToRead < 1) return 0;
-	if (feof(fp)) return -1; // Previous call to this function probably already read the last line.
-	if (fgets(aBuf, aMaxCharsToRead, fp) == NULL) // end-of-file or error
-	{
-		*aBuf = '\0';  // Reset since on error, contents added by fgets() are indeterminate.
-		return -1;
-	}
-	aBuf_length = strlen(aBuf);
-	if (!aBuf_length)
-		return 0;
-	if (aBuf[aBuf_length-1] == '\n')
-		aBuf[--aBuf_length] = '\0';
-	if (aBuf[aBuf_length-1] == '\r')  // In case there are any, e.g. a Macintosh or Unix file?
-		aBuf[--aBuf_length] = '\0';
-#endif
 
 	if (aInContinuationSection)
 	{
@@ -2718,6 +3575,7 @@ inline ResultType Script::IsDirective(char *aBuf)
 			g_HotCriterion = HOT_NO_CRITERION; // Indicate that no criteria are in effect for subsequent hotkeys.
 			g_HotWinTitle = ""; // Helps maintainability and some things might rely on it.
 			g_HotWinText = "";  //
+			g_HotWinCriteria = NULL;
 			return CONDITION_TRUE;
 		}
 		char *hot_win_title = parameter, *hot_win_text; // Set default for title; text is determined later.
@@ -2902,6 +3760,33 @@ inline ResultType Script::IsDirective(char *aBuf)
 		}
 		return CONDITION_TRUE;
 	}
+	if (IS_DIRECTIVE_MATCH("#FileAppendBuffer")) // #FileAppendBuffer [SizeInKB, FlushIntervalInMs, Sync]
+	{
+		g_FileAppendBufferSize = 64 * 1024; // Set default for when the size is omitted.
+		if (parameter)
+		{
+			if (value = ATOI(parameter)) // Zero or omitted means the default.
+				g_FileAppendBufferSize = (value < 1 ? 1 : (value > 65536 ? 65536 : value)) * 1024;
+			char *cp;
+			if (cp = strchr(parameter, g_delimiter))
+			{
+				if (value = ATOI(omit_leading_whitespace(++cp)))
+					g_FileAppendFlushInterval = value < 10 ? 10 : value; // See SET_MAIN_TIMER for why 10.
+				if (cp = strchr(cp, g_delimiter))
+					g_FileAppendSync = ATOI(omit_leading_whitespace(cp + 1)) != 0;
+			}
+		}
+		return CONDITION_TRUE;
+	}
+	if (IS_DIRECTIVE_MATCH("#WinCacheTime")) // #WinCacheTime Milliseconds
+	{
+		if (parameter)
+		{
+			value = ATOI(parameter);
+			g_WinCacheTime = value < 0 ? 0 : (value > 60000 ? 60000 : value);
+		}
+		return CONDITION_TRUE;
+	}
 	if (IS_DIRECTIVE_MATCH("#KeyHistory"))
 	{
 		if (parameter)
@@ -4652,11 +5537,14 @@ bool LegacyArgIsExpression(char *aArgText, char *aArgMap)
 
 
 
-ResultType Script::AddLine(ActionTypeType aActionType, char *aArg[], ArgCountType aArgc, char *aArgMap[])
+ResultType Script::AddLine(ActionTypeType aActionType, char *aArg[], ArgCountType aArgc, char *aArgMap[]
+	, ArgStruct *aBuiltArg)
 // aArg must be a collection of pointers to memory areas that are modifiable, and there
 // must be at least aArgc number of pointers in the aArg array.  In v1.0.40, a caller (namely
 // the "macro expansion" for remappings such as "a::b") is allowed to pass a non-NULL value for
 // aArg but a NULL value for aArgMap.
+// If aBuiltArg isn't NULL, it's an array of aArgc args that were already built the same way as
+// the section below builds them (see ParseCacheReplayLine()), in which case aArg and aArgMap are ignored.
 // Returns OK or FAIL.
 {
 #ifdef _DEBUG
@@ -4691,6 +5579,12 @@ ResultType Script::AddLine(ActionTypeType aActionType, char *aArg[], ArgCountTyp
 	//////////////////////////////////////////////////////////
 	if (!aArgc)
 		new_arg = NULL;  // Just need an empty array in this case.
+	else if (aBuiltArg)
+	{
+		new_arg = aBuiltArg;
+		if (aActionType == ACT_TRANSFORM && aArgc > 1) // Needed by the syntax checker further below.
+			trans_cmd = Line::ConvertTransformCmd(new_arg[1].text);
+	}
 	else
 	{
 		if (   !(new_arg = (ArgStruct *)SimpleHeap::Malloc(aArgc * sizeof(ArgStruct)))   )
@@ -4708,6 +5602,7 @@ ResultType Script::AddLine(ActionTypeType aActionType, char *aArg[], ArgCountTyp
 			this_aArgMap = aArgMap ? aArgMap[i] : NULL; // Same.
 			ArgStruct &this_new_arg = new_arg[i];       // Same.
 			this_new_arg.is_expression = false;         // Set default early, for maintainability.
+			this_new_arg.postfix = NULL;                // PreparseBlocks() relies on this to know which ones still need to be built.
 
 			if (aActionType == ACT_TRANSFORM)
 			{
@@ -5268,6 +6163,13 @@ ResultType Script::AddLine(ActionTypeType aActionType, char *aArg[], ArgCountTyp
 	// This must be done after the above:
 	mLastLine = the_new_line;
 	mCurrLine = the_new_line;  // To help error reporting.
+#ifndef AUTOHOTKEYSC
+	if (sParseCacheRecordFile != -1) // Must be done before the section below alters anything.
+		// Since the section below relies on trans_cmd, which was derived from the original text of
+		// arg #2, this line can't be replayed if its current text would yield something else:
+		ParseCacheRecordLine(line, aActionType != ACT_TRANSFORM || aArgc < 2 || aBuiltArg
+			|| Line::ConvertTransformCmd(new_arg[1].text) == trans_cmd);
+#endif
 
 	///////////////////////////////////////////////////////////////////
 	// Do any post-add validation & handling for specific action types.
@@ -5699,6 +6601,24 @@ ResultType Script::AddLine(ActionTypeType aActionType, char *aArg[], ArgCountTyp
 		}
 		break;
 
+	case ACT_PIXELSEARCHALL:
+		if (!*new_raw_arg2 || !*new_raw_arg3 || !*new_raw_arg4 || !*NEW_RAW_ARG5 || !*NEW_RAW_ARG6)
+			return ScriptError("Parameters 2 through 6 must not be blank.");
+		if (*NEW_RAW_ARG7 && !line.ArgHasDeref(7))
+		{
+			value = ATOI(NEW_RAW_ARG7);
+			if (value < 0 || value > 255)
+				return ScriptError(ERR_PARAM7_INVALID, NEW_RAW_ARG7);
+		}
+		break;
+
+	case ACT_IMAGESEARCHALL:
+		if (!*new_raw_arg2 || !*new_raw_arg3 || !*new_raw_arg4 || !*NEW_RAW_ARG5 || !*NEW_RAW_ARG6)
+			return ScriptError("Parameters 2 through 6 must not be blank.");
+		if (*NEW_RAW_ARG7 && !line.ArgHasDeref(7) && ATOI(NEW_RAW_ARG7) < 0)
+			return ScriptError(ERR_PARAM7_INVALID, NEW_RAW_ARG7);
+		break;
+
 	case ACT_COORDMODE:
 		if (*new_raw_arg1 && !line.ArgHasDeref(1) && !line.ConvertCoordModeAttrib(new_raw_arg1))
 			return ScriptError(ERR_PARAM1_INVALID, new_raw_arg1);
@@ -6687,49 +7607,361 @@ ResultType Script::DefineFunc(char *aBuf, Var *aFuncExceptionVar[])
 		}
 		else // This parameter does not have a default value specified.
 		{
-			if (param_must_have_default)
-				return ScriptError("Parameter default required.", this_param.var->mName);
-			++func.mMinParams;
+			if (param_must_have_default)
+				return ScriptError("Parameter default required.", this_param.var->mName);
+			++func.mMinParams;
+		}
+		++param_count;
+
+		if (*param_start != ',' && *param_start != ')') // Something like "fn(a, b c)" (missing comma) would cause this.
+			return ScriptError(ERR_MISSING_COMMA, aBuf); // Reporting aBuf vs. param_start seems more informative since Vicinity isn't shown.
+		if (*param_start == ',')
+		{
+			param_start = omit_leading_whitespace(param_start + 1);
+			if (*param_start == ')') // If *param_start is ',' it will be caught as an error by the next iteration.
+				return ScriptError(ERR_BLANK_PARAM, aBuf); // Reporting aBuf vs. param_start seems more informative since Vicinity isn't shown.
+		}
+		//else it's ')', in which case the next iteration will handle it.
+		// Above has ensured that param_start now points to the next parameter, or ')' if none.
+	} // for() each formal parameter.
+
+	if (param_count)
+	{
+		// Allocate memory only for the actual number of parameters actually present.
+		size_t size = param_count * sizeof(param[0]);
+		if (   !(func.mParam = (FuncParam *)SimpleHeap::Malloc(size))   )
+			return ScriptError(ERR_OUTOFMEM);
+		func.mParamCount = param_count;
+		memcpy(func.mParam, param, size);
+	}
+	//else leave func.mParam/mParamCount set to their NULL/0 defaults.
+
+	// Indicate success:
+	mFuncExceptionVar = aFuncExceptionVar; // Give mFuncExceptionVar its address, to be used for any var declarations inside this function's body.
+	mFuncExceptionVarCount = 0;  // Reset in preparation of declarations that appear beneath this function's definition.
+	return OK;
+}
+
+
+
+#ifndef AUTOHOTKEYSC
+struct FuncLibrary
+{
+	char *path;
+	DWORD length;
+	FILETIME last_write; // Of the directory itself.  Used to validate the library cache (see LibCacheLoad()).
+	char **index;        // Sorted array of the naked filenames of all *.ahk files in the directory (see LibIndexBuild()).
+	int index_count;     // Number of items in index, or -1 if it hasn't been built yet (or couldn't be).
+};
+
+#define FUNC_LIB_EXT ".ahk"
+#define FUNC_LIB_EXT_LENGTH 4
+#define FUNC_USER_LIB "\\AutoHotkey\\Lib\\" // Needs leading and trailing backslash.
+#define FUNC_USER_LIB_LENGTH 16
+#define FUNC_STD_LIB "Lib\\" // Needs trailing but not leading backslash.
+#define FUNC_STD_LIB_LENGTH 4
+
+#define FUNC_LIB_COUNT 2
+static FuncLibrary sLib[FUNC_LIB_COUNT] = {0};
+
+// The library cache remembers which library file provided each auto-included function so that subsequent
+// launches of the same script can include those files directly rather than probing the file system for
+// each candidate name.  Which file a given function name resolves to depends only on which files exist in
+// the library directories, so the cache is validated by the last-write time of each directory (which changes
+// whenever a file is added to, removed from, or renamed within it) rather than by the script's own files.
+// For the same reason, the cache also holds the index of each directory (see LibIndexBuild()) so that a
+// function that isn't in the cache yet can be looked up without enumerating the directory again.
+struct LibCacheItem
+{
+	char *func_name;
+	char *file_name; // The naked filename (without extension), which differs from func_name for the LibName_ prefix method.
+	int lib_index;   // Index into sLib[].
+};
+static LibCacheItem *sLibCache = NULL;
+static int sLibCacheCount = 0, sLibCacheCapacity = 0;
+static bool sLibCacheIsDirty = false; // Whether this run resolved or indexed something the cache file doesn't know about.
+static UINT sLibCacheHits = 0, sLibCacheMisses = 0, sLibIndexBuilds = 0; // For the /Benchmark switch.
+#define LIB_CACHE_HEADER "AutoHotkey library cache v" NAME_VERSION
+
+
+
+static int LibIndexCompare(const void *a1, const void *a2)
+{
+	return stricmp(*(char **)a1, *(char **)a2);
+}
+
+
+
+static bool LibIndexAdd(char **&aIndex, int &aCount, int &aCapacity, char *aName, size_t aNameLength)
+// Appends a naked filename to an index that's being built.  Returns false if out of memory.
+{
+	if (aCount >= aCapacity)
+	{
+		int new_capacity = aCapacity ? aCapacity * 2 : 64;
+		char **realloc_temp = (char **)realloc(aIndex, new_capacity * sizeof(char *));
+		if (!realloc_temp)
+			return false;
+		aIndex = realloc_temp;
+		aCapacity = new_capacity;
+	}
+	if (   !(aIndex[aCount] = SimpleHeap::Malloc(aName, aNameLength))   )
+		return false;
+	++aCount;
+	return true;
+}
+
+
+
+static void LibIndexBuild(FuncLibrary &aLib)
+// Enumerates the library directory once so that each candidate filename can be looked up in memory
+// rather than by calling GetFileAttributes() for each one.  This matters for scripts that call many
+// library functions since each one might otherwise cost up to four probes (two names in two libraries).
+// If anything goes wrong, aLib.index_count is left at -1 so that callers fall back to probing.
+// The index is saved in the library cache, so this is needed only once per change to the directory.
+{
+	aLib.index = NULL;
+	aLib.index_count = -1;
+	if (aLib.length >= MAX_PATH - 1 - FUNC_LIB_EXT_LENGTH)
+		return;
+	++sLibIndexBuilds;
+	strcpy(aLib.path + aLib.length, "*" FUNC_LIB_EXT);
+	WIN32_FIND_DATA find_data;
+	HANDLE file_search = FindFirstFile(aLib.path, &find_data);
+	aLib.path[aLib.length] = '\0'; // Undo the above.
+	if (file_search == INVALID_HANDLE_VALUE)
+	{
+		if (GetLastError() == ERROR_FILE_NOT_FOUND) // Directory exists but contains no library files.
+			aLib.index_count = 0;
+		return;
+	}
+	int capacity = 0, count = 0;
+	char **index = NULL;
+	size_t name_length;
+	bool is_complete = false;
+	do
+	{
+		if (find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+			continue;
+		// The pattern can also match longer extensions such as ".ahkx" via their 8.3 short names,
+		// so ensure the extension is exactly the one that's wanted:
+		name_length = strlen(find_data.cFileName);
+		if (name_length <= FUNC_LIB_EXT_LENGTH || stricmp(find_data.cFileName + name_length - FUNC_LIB_EXT_LENGTH, FUNC_LIB_EXT))
+			continue;
+		if (!LibIndexAdd(index, count, capacity, find_data.cFileName, name_length - FUNC_LIB_EXT_LENGTH))
+			goto end_of_search;
+	} while (FindNextFile(file_search, &find_data));
+	is_complete = (GetLastError() == ERROR_NO_MORE_FILES); // Must be checked before calling anything else.
+end_of_search:
+	FindClose(file_search);
+	if (!is_complete) // Out of memory or some other problem.  An incomplete index would cause files to be missed.
+	{
+		free(index);
+		return;
+	}
+	qsort((void *)index, count, sizeof(char *), LibIndexCompare);
+	aLib.index = index; // This array is kept for the lifetime of the program since it's small.
+	aLib.index_count = count;
+	sLibCacheIsDirty = true; // Save the index so that the next launch doesn't have to enumerate the directory.
+}
+
+
+
+static bool LibIndexContains(FuncLibrary &aLib, char *aNakedFilename)
+{
+	int left = 0, right = aLib.index_count - 1, middle, result;
+	while (left <= right)
+	{
+		middle = left + ((right - left) >> 1);
+		if (   !(result = stricmp(aNakedFilename, aLib.index[middle]))   )
+			return true;
+		if (result < 0)
+			right = middle - 1;
+		else
+			left = middle + 1;
+	}
+	return false;
+}
+
+
+
+static bool LibCacheAdd(char *aFuncName, size_t aFuncNameLength, char *aFileName, size_t aFileNameLength, int aLibIndex)
+{
+	if (sLibCacheCount >= sLibCacheCapacity)
+	{
+		int new_capacity = sLibCacheCapacity ? sLibCacheCapacity * 2 : 64;
+		LibCacheItem *realloc_temp = (LibCacheItem *)realloc(sLibCache, new_capacity * sizeof(LibCacheItem));
+		if (!realloc_temp)
+			return false; // The cache is only an optimization, so callers ignore failure.
+		sLibCache = realloc_temp;
+		sLibCacheCapacity = new_capacity;
+	}
+	LibCacheItem &item = sLibCache[sLibCacheCount];
+	if (   !(item.func_name = SimpleHeap::Malloc(aFuncName, aFuncNameLength))
+		|| !(item.file_name = SimpleHeap::Malloc(aFileName, aFileNameLength))   )
+		return false;
+	item.lib_index = aLibIndex;
+	++sLibCacheCount;
+	return true;
+}
+
+
+
+static LibCacheItem *LibCacheFind(char *aFuncName, size_t aFuncNameLength)
+{
+	for (int i = 0; i < sLibCacheCount; ++i)
+		if (!strlicmp(aFuncName, sLibCache[i].func_name, (UINT)aFuncNameLength))
+			return sLibCache + i;
+	return NULL;
+}
+
+
+
+static void LibCacheLoad()
+// Caller must have already initialized sLib[].  Any problem with the cache file (missing, corrupt,
+// or stale) simply leaves the cache empty, which causes all lookups to fall back to probing.
+{
+	char cache_file[MAX_PATH];
+	ScriptCacheGetFileName(cache_file, sizeof(cache_file), "libcache");
+	HANDLE hfile = CreateFile(cache_file, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (hfile == INVALID_HANDLE_VALUE)
+		return;
+	DWORD file_size = GetFileSize(hfile, NULL), bytes_read;
+	char *buf = NULL;
+	// Read the whole file in one call since it's small.  The 1 MB limit guards against garbage:
+	if (file_size != INVALID_FILE_SIZE && file_size < 1024*1024 && (buf = (char *)malloc(file_size + 1)))
+	{
+		if (ReadFile(hfile, buf, file_size, &bytes_read, NULL) && bytes_read == file_size)
+			buf[file_size] = '\0';
+		else
+		{
+			free(buf);
+			buf = NULL;
 		}
-		++param_count;
+	}
+	CloseHandle(hfile);
+	if (!buf)
+		return;
 
-		if (*param_start != ',' && *param_start != ')') // Something like "fn(a, b c)" (missing comma) would cause this.
-			return ScriptError(ERR_MISSING_COMMA, aBuf); // Reporting aBuf vs. param_start seems more informative since Vicinity isn't shown.
-		if (*param_start == ',')
+	// Format: a header line, then one "D" line per library directory (in sLib[] order), one "F" line
+	// per cached function, and for each directory whose index was built, an "I" line followed by one
+	// "N" line per name in the index.  Fields are tab-delimited since tabs can't occur in paths.
+	char *line, *next_line, *field[4];
+	int line_number, field_count, lib_index = 0, cached_lib_index;
+	char **index[FUNC_LIB_COUNT] = {NULL};
+	int index_count[FUNC_LIB_COUNT], index_capacity[FUNC_LIB_COUNT] = {0};
+	for (cached_lib_index = 0; cached_lib_index < FUNC_LIB_COUNT; ++cached_lib_index)
+		index_count[cached_lib_index] = -1; // No index for this library unless an "I" line is found.
+	bool is_valid = true;
+	for (line = buf, line_number = 0; is_valid && line && *line; line = next_line, ++line_number)
+	{
+		if (next_line = strchr(line, '\n'))
+			*next_line++ = '\0';
+		for (field_count = 0, field[0] = line; field_count < 3 && (field[field_count + 1] = strchr(field[field_count], '\t')); )
+			*field[++field_count]++ = '\0';
+		++field_count;
+		if (!line_number)
+			is_valid = !strcmp(line, LIB_CACHE_HEADER); // Different versions might resolve names differently.
+		else if (*line == 'D' && field_count == 3)
+			// The library must be at the same location as before and unchanged since the cache was written.
+			// A disabled library (directory didn't exist) is recorded with an empty path and zero time.
+			is_valid = lib_index < FUNC_LIB_COUNT && !lstrcmpi(field[2], sLib[lib_index].path)
+				&& (unsigned __int64)ATOI64(field[1]) == *(unsigned __int64 *)&sLib[lib_index].last_write
+				&& ++lib_index; // Relies on short-circuit boolean order.
+		else if (*line == 'F' && field_count == 4 && lib_index == FUNC_LIB_COUNT && *field[1] && *field[2])
+		{
+			cached_lib_index = ATOI(field[3]);
+			if (cached_lib_index < 0 || cached_lib_index >= FUNC_LIB_COUNT || !*sLib[cached_lib_index].path)
+				is_valid = false;
+			else
+				LibCacheAdd(field[1], strlen(field[1]), field[2], strlen(field[2]), cached_lib_index);
+		}
+		else if ((*line == 'I' && field_count == 2 || *line == 'N' && field_count == 3 && *field[2])
+			&& lib_index == FUNC_LIB_COUNT)
 		{
-			param_start = omit_leading_whitespace(param_start + 1);
-			if (*param_start == ')') // If *param_start is ',' it will be caught as an error by the next iteration.
-				return ScriptError(ERR_BLANK_PARAM, aBuf); // Reporting aBuf vs. param_start seems more informative since Vicinity isn't shown.
+			cached_lib_index = ATOI(field[1]);
+			if (cached_lib_index < 0 || cached_lib_index >= FUNC_LIB_COUNT || !*sLib[cached_lib_index].path)
+				is_valid = false;
+			else if (*line == 'I')
+			{
+				if (index_count[cached_lib_index] != -1) // Duplicate.
+					is_valid = false;
+				else
+					index_count[cached_lib_index] = 0;
+			}
+			else // Since an "N" line must come after its library's "I" line, the index must have been started.
+				is_valid = index_count[cached_lib_index] != -1
+					&& LibIndexAdd(index[cached_lib_index], index_count[cached_lib_index], index_capacity[cached_lib_index]
+						, field[2], strlen(field[2]));
 		}
-		//else it's ')', in which case the next iteration will handle it.
-		// Above has ensured that param_start now points to the next parameter, or ')' if none.
-	} // for() each formal parameter.
-
-	if (param_count)
+		else
+			is_valid = false;
+	}
+	free(buf);
+	if (!is_valid || lib_index != FUNC_LIB_COUNT)
 	{
-		// Allocate memory only for the actual number of parameters actually present.
-		size_t size = param_count * sizeof(param[0]);
-		if (   !(func.mParam = (FuncParam *)SimpleHeap::Malloc(size))   )
-			return ScriptError(ERR_OUTOFMEM);
-		func.mParamCount = param_count;
-		memcpy(func.mParam, param, size);
+		sLibCacheCount = 0; // Discard anything that was loaded.  The cache will be rewritten at the end of loading.
+		for (cached_lib_index = 0; cached_lib_index < FUNC_LIB_COUNT; ++cached_lib_index)
+			free(index[cached_lib_index]);
+		return;
 	}
-	//else leave func.mParam/mParamCount set to their NULL/0 defaults.
+	for (cached_lib_index = 0; cached_lib_index < FUNC_LIB_COUNT; ++cached_lib_index)
+	{
+		if (index_count[cached_lib_index] == -1) // The index wasn't built by the run that wrote the cache.
+			continue;
+		// The names were saved in sorted order, but sort them anyway since LibIndexContains() would
+		// silently miss names if the file had been edited:
+		qsort((void *)index[cached_lib_index], index_count[cached_lib_index], sizeof(char *), LibIndexCompare);
+		sLib[cached_lib_index].index = index[cached_lib_index];
+		sLib[cached_lib_index].index_count = index_count[cached_lib_index];
+	}
+}
 
-	// Indicate success:
-	mFuncExceptionVar = aFuncExceptionVar; // Give mFuncExceptionVar its address, to be used for any var declarations inside this function's body.
-	mFuncExceptionVarCount = 0;  // Reset in preparation of declarations that appear beneath this function's definition.
-	return OK;
+
+
+void Script::LibCacheSave()
+// Called after the script has finished loading.  Writes the cache only when this run resolved a library
+// function or built a directory index that the cache didn't already have, so that unchanged scripts
+// never write anything.
+{
+	if (!sLibCacheIsDirty)
+		return;
+	sLibCacheIsDirty = false;
+	char cache_file[MAX_PATH];
+	ScriptCacheGetFileName(cache_file, sizeof(cache_file), "libcache");
+	FILE *fp = fopen(cache_file, "w");
+	if (!fp)
+		return; // Not an error because the cache is only an optimization.
+	fputs(LIB_CACHE_HEADER "\n", fp);
+	int i;
+	for (i = 0; i < FUNC_LIB_COUNT; ++i)
+		// Write only the directory since FindFuncInLibrary() appends each candidate filename to path:
+		fprintf(fp, "D\t%I64u\t%.*s\n", *(unsigned __int64 *)&sLib[i].last_write, (int)sLib[i].length, sLib[i].path);
+	for (i = 0; i < sLibCacheCount; ++i)
+		fprintf(fp, "F\t%s\t%s\t%d\n", sLibCache[i].func_name, sLibCache[i].file_name, sLibCache[i].lib_index);
+	for (i = 0; i < FUNC_LIB_COUNT; ++i)
+	{
+		if (sLib[i].index_count == -1) // No index was built or loaded for this library.
+			continue;
+		fprintf(fp, "I\t%d\n", i);
+		for (int j = 0; j < sLib[i].index_count; ++j)
+			fprintf(fp, "N\t%d\t%s\n", i, sLib[i].index[j]);
+	}
+	fclose(fp);
 }
 
 
 
-#ifndef AUTOHOTKEYSC
-struct FuncLibrary
+void LibCacheGetCounts(UINT &aHits, UINT &aMisses, UINT &aIndexBuilds)
+// Provides the /Benchmark switch with the number of library functions that were found via the library
+// cache, the number that had to be searched for, and the number of library directories that had to be
+// enumerated, so that a warm start can be confirmed to use the cache.
 {
-	char *path;
-	DWORD length;
-};
+	aHits = sLibCacheHits;
+	aMisses = sLibCacheMisses;
+	aIndexBuilds = sLibIndexBuilds;
+}
+
+
 
 Func *Script::FindFuncInLibrary(char *aFuncName, size_t aFuncNameLength, bool &aErrorWasShown)
 // Caller must ensure that aFuncName doesn't already exist as a defined function.
@@ -6738,19 +7970,9 @@ Func *Script::FindFuncInLibrary(char *aFuncName, size_t aFuncNameLength, bool &a
 	aErrorWasShown = false; // Set default for this output parameter.
 
 	int i;
-	char *char_after_last_backslash, *terminate_here;
+	char *char_after_last_backslash;
 	DWORD attr;
 
-	#define FUNC_LIB_EXT ".ahk"
-	#define FUNC_LIB_EXT_LENGTH 4
-	#define FUNC_USER_LIB "\\AutoHotkey\\Lib\\" // Needs leading and trailing backslash.
-	#define FUNC_USER_LIB_LENGTH 16
-	#define FUNC_STD_LIB "Lib\\" // Needs trailing but not leading backslash.
-	#define FUNC_STD_LIB_LENGTH 4
-
-	#define FUNC_LIB_COUNT 2
-	static FuncLibrary sLib[FUNC_LIB_COUNT] = {0};
-
 	if (!sLib[0].path) // Allocate & discover paths only upon first use because many scripts won't use anything from the library. This saves a bit of memory and performance.
 	{
 		for (i = 0; i < FUNC_LIB_COUNT; ++i)
@@ -6787,21 +8009,57 @@ Func *Script::FindFuncInLibrary(char *aFuncName, size_t aFuncNameLength, bool &a
 			this_lib->length = 0;   //
 		}
 
+		WIN32_FILE_ATTRIBUTE_DATA lib_attr;
 		for (i = 0; i < FUNC_LIB_COUNT; ++i)
 		{
-			attr = GetFileAttributes(sLib[i].path); // Seems to accept directories that have a trailing backslash, which is good because it simplifies the code.
-			if (attr == 0xFFFFFFFF || !(attr & FILE_ATTRIBUTE_DIRECTORY)) // Directory doesn't exist or it's a file vs. directory. Relies on short-circuit boolean order.
+			// GetFileAttributesEx() seems to accept directories that have a trailing backslash, which is good because
+			// it simplifies the code.  It also provides the directory's last-write time for the library cache.
+			if (!*sLib[i].path
+				|| !GetFileAttributesEx(sLib[i].path, GetFileExInfoStandard, &lib_attr)
+				|| !(lib_attr.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) // Directory doesn't exist or it's a file vs. directory. Relies on short-circuit boolean order.
 			{
 				*sLib[i].path = '\0'; // Mark this library as disabled.
 				sLib[i].length = 0;   //
+				sLib[i].last_write.dwLowDateTime = sLib[i].last_write.dwHighDateTime = 0;
 			}
+			else
+				sLib[i].last_write = lib_attr.ftLastWriteTime;
+			sLib[i].index_count = -1; // Indicate that there's no index yet (see LibIndexBuild()).
 		}
+
+		LibCacheLoad(); // Must be done only after sLib[] has been fully initialized.
 	}
 	// Above must ensure that all sLib[].path elements are non-NULL (but they can be "" to indicate "no library").
 
 	if (!aFuncNameLength) // Caller didn't specify, so use the entire string.
 		aFuncNameLength = strlen(aFuncName);
 
+	LibCacheItem *cache_item;
+	if (cache_item = LibCacheFind(aFuncName, aFuncNameLength))
+	{
+		// A prior run of this script found this function's file and none of the library directories have
+		// changed since then, so include that file directly rather than probing for it.
+		FuncLibrary &lib = sLib[cache_item->lib_index];
+		size_t file_name_length = strlen(cache_item->file_name);
+		if (lib.length + file_name_length < MAX_PATH-FUNC_LIB_EXT_LENGTH) // Should always be true due to how the cache was built.
+		{
+			++sLibCacheHits;
+			strcpy(lib.path + lib.length, cache_item->file_name);
+			strcpy(lib.path + lib.length + file_name_length, FUNC_LIB_EXT);
+			return IncludeLibraryFile(lib.path, lib.length, aFuncName, aFuncNameLength, aErrorWasShown);
+		}
+	}
+
+	++sLibCacheMisses;
+	static bool sLibIndexWasBuilt = false;
+	if (!sLibIndexWasBuilt) // Done only upon first cache miss because the cache usually makes the index unnecessary.
+	{
+		sLibIndexWasBuilt = true;
+		for (i = 0; i < FUNC_LIB_COUNT; ++i)
+			if (*sLib[i].path && sLib[i].index_count == -1) // Library isn't disabled and its index wasn't loaded from the cache.
+				LibIndexBuild(sLib[i]);
+	}
+
 	char *dest, *first_underscore, class_name_buf[MAX_VAR_NAME_LENGTH + 1];
 	char *naked_filename = aFuncName;               // Set up for the first iteration.
 	size_t naked_filename_length = aFuncNameLength; //
@@ -6818,51 +8076,28 @@ Func *Script::FindFuncInLibrary(char *aFuncName, size_t aFuncNameLength, bool &a
 			dest = (char *)memcpy(sLib[i].path + sLib[i].length, naked_filename, naked_filename_length); // Append the filename to the library path.
 			strcpy(dest + naked_filename_length, FUNC_LIB_EXT); // Append the file extension.
 
-			attr = GetFileAttributes(sLib[i].path); // Testing confirms that GetFileAttributes() doesn't support wildcards; which is good because we want filenames containing question marks to be "not found" rather than being treated as a match-pattern.
-			if (attr == 0xFFFFFFFF || (attr & FILE_ATTRIBUTE_DIRECTORY)) // File doesn't exist or it's a directory. Relies on short-circuit boolean order.
-				continue;
-
-			// Since above didn't "continue", a file exists whose name matches that of the requested function.
-			// Before loading/including that file, set the working directory to its folder so that if it uses
-			// #Include, it will be able to use more convenient/intuitive relative paths.  This is similar to
-			// the "#Include DirName" feature.
-			// Call SetWorkingDir() vs. SetCurrentDirectory() so that it succeeds even for a root drive like
-			// C: that lacks a backslash (see SetWorkingDir() for details).
-			terminate_here = sLib[i].path + sLib[i].length - 1; // The trailing backslash in the full-path-name to this library.
-			*terminate_here = '\0'; // Temporarily terminate it for use with SetWorkingDir().
-			SetWorkingDir(sLib[i].path); // See similar section in the #Include directive.
-			*terminate_here = '\\'; // Undo the termination.
-
-			if (!LoadIncludedFile(sLib[i].path, false, false)) // Fix for v1.0.47.05: Pass false for allow-dupe because otherwise, it's possible for a stdlib file to attempt to include itself (especially via the LibNamePrefix_ method) and thus give a misleading "duplicate function" vs. "func does not exist" error message.  Obsolete: For performance, pass true for allow-dupe so that it doesn't have to check for a duplicate file (seems too rare to worry about duplicates since by definition, the function doesn't yet exist so it's file shouldn't yet be included).
-			{
-				aErrorWasShown = true; // Above has just displayed its error (e.g. syntax error in a line, failed to open the include file, etc).  So override the default set earlier.
-				return NULL;
+			if (sLib[i].index_count != -1) // Index is available, so use it rather than probing the file system.
+			{
+				*(dest + naked_filename_length) = '\0'; // Temporarily remove the extension since the index contains naked filenames.
+				bool found = LibIndexContains(sLib[i], dest);
+				*(dest + naked_filename_length) = *FUNC_LIB_EXT; // Restore the extension.
+				if (!found)
+					continue;
 			}
-
-			if (mIncludeLibraryFunctionsThenExit)
+			else
 			{
-				// For each included library-file, write out two #Include lines:
-				// 1) Use #Include in its "change working directory" mode so that any explicit #include directives
-				//    or FileInstalls inside the library file itself will work consistently and properly.
-				// 2) Use #IncludeAgain (to improve performance since no dupe-checking is needed) to include
-				//    the library file itself.
-				// We don't directly append library files onto the main script here because:
-				// 1) ahk2exe needs to be able to see and act upon FileInstall and #Include lines (i.e. library files
-				//    might contain #Include even though it's rare).
-				// 2) #IncludeAgain and #Include directives that bring in fragments rather than entire functions or
-				//    subroutines wouldn't work properly if we resolved such includes in AutoHotkey.exe because they
-				//    wouldn't be properly interleaved/asynchronous, but instead brought out of their library file
-				//    and deposited separately/synchronously into the temp-include file by some new logic at the
-				//    AutoHotkey.exe's code for the #Include directive.
-				// 3) ahk2exe prefers to omit comments from included files to minimize size of compiled scripts.
-				fprintf(mIncludeLibraryFunctionsThenExit, "#Include %-0.*s\n#IncludeAgain %s\n"
-					, sLib[i].length, sLib[i].path, sLib[i].path);
-				// Now continue on normally so that our caller can continue looking for syntax errors.
+				attr = GetFileAttributes(sLib[i].path); // Testing confirms that GetFileAttributes() doesn't support wildcards; which is good because we want filenames containing question marks to be "not found" rather than being treated as a match-pattern.
+				if (attr == 0xFFFFFFFF || (attr & FILE_ATTRIBUTE_DIRECTORY)) // File doesn't exist or it's a directory. Relies on short-circuit boolean order.
+					continue;
 			}
 
+			// Since above didn't "continue", a file exists whose name matches that of the requested function.
+			if (LibCacheAdd(aFuncName, aFuncNameLength, naked_filename, naked_filename_length, i))
+				sLibCacheIsDirty = true;
+
 			// Now that a matching filename has been found, it seems best to stop searching here even if that
 			// file doesn't actually contain the requested function.  This helps library authors catch bugs/typos.
-			return FindFunc(aFuncName, aFuncNameLength);
+			return IncludeLibraryFile(sLib[i].path, sLib[i].length, aFuncName, aFuncNameLength, aErrorWasShown);
 		} // for() each library directory.
 
 		// Now that the first iteration is done, set up for the second one that searches by class/prefix.
@@ -6885,6 +8120,54 @@ Func *Script::FindFuncInLibrary(char *aFuncName, size_t aFuncNameLength, bool &a
 	// Since above didn't return, no match found in any library.
 	return NULL;
 }
+
+
+
+Func *Script::IncludeLibraryFile(char *aFilePath, DWORD aLibPathLength, char *aFuncName, size_t aFuncNameLength
+	, bool &aErrorWasShown)
+// Helper for FindFuncInLibrary().  aFilePath is the full path of the library file that's expected to
+// contain aFuncName, and aLibPathLength is the length of the part of it that's the library directory
+// (including the trailing backslash).
+{
+	// Before loading/including that file, set the working directory to its folder so that if it uses
+	// #Include, it will be able to use more convenient/intuitive relative paths.  This is similar to
+	// the "#Include DirName" feature.
+	// Call SetWorkingDir() vs. SetCurrentDirectory() so that it succeeds even for a root drive like
+	// C: that lacks a backslash (see SetWorkingDir() for details).
+	char *terminate_here = aFilePath + aLibPathLength - 1; // The trailing backslash in the full-path-name to this library.
+	*terminate_here = '\0'; // Temporarily terminate it for use with SetWorkingDir().
+	SetWorkingDir(aFilePath); // See similar section in the #Include directive.
+	*terminate_here = '\\'; // Undo the termination.
+
+	if (!LoadIncludedFile(aFilePath, false, false)) // Fix for v1.0.47.05: Pass false for allow-dupe because otherwise, it's possible for a stdlib file to attempt to include itself (especially via the LibNamePrefix_ method) and thus give a misleading "duplicate function" vs. "func does not exist" error message.  Obsolete: For performance, pass true for allow-dupe so that it doesn't have to check for a duplicate file (seems too rare to worry about duplicates since by definition, the function doesn't yet exist so it's file shouldn't yet be included).
+	{
+		aErrorWasShown = true; // Above has just displayed its error (e.g. syntax error in a line, failed to open the include file, etc).  So override the default set earlier.
+		return NULL;
+	}
+
+	if (mIncludeLibraryFunctionsThenExit)
+	{
+		// For each included library-file, write out two #Include lines:
+		// 1) Use #Include in its "change working directory" mode so that any explicit #include directives
+		//    or FileInstalls inside the library file itself will work consistently and properly.
+		// 2) Use #IncludeAgain (to improve performance since no dupe-checking is needed) to include
+		//    the library file itself.
+		// We don't directly append library files onto the main script here because:
+		// 1) ahk2exe needs to be able to see and act upon FileInstall and #Include lines (i.e. library files
+		//    might contain #Include even though it's rare).
+		// 2) #IncludeAgain and #Include directives that bring in fragments rather than entire functions or
+		//    subroutines wouldn't work properly if we resolved such includes in AutoHotkey.exe because they
+		//    wouldn't be properly interleaved/asynchronous, but instead brought out of their library file
+		//    and deposited separately/synchronously into the temp-include file by some new logic at the
+		//    AutoHotkey.exe's code for the #Include directive.
+		// 3) ahk2exe prefers to omit comments from included files to minimize size of compiled scripts.
+		fprintf(mIncludeLibraryFunctionsThenExit, "#Include %-0.*s\n#IncludeAgain %s\n"
+			, aLibPathLength, aFilePath, aFilePath);
+		// Now continue on normally so that our caller can continue looking for syntax errors.
+	}
+
+	return FindFunc(aFuncName, aFuncNameLength);
+}
 #endif
 
 
@@ -7092,7 +8375,7 @@ Func *Script::FindFunc(char *aFuncName, size_t aFuncNameLength)
 	{
 		bif = BIF_RegEx;
 		min_params = 2;
-		max_params = 6;
+		max_params = 7;
 	}
 	else if (!stricmp(func_name, "GetKeyState"))
 	{
@@ -8441,6 +9724,10 @@ Line *Script::PreparseBlocks(Line *aStartingLine, bool aFindBlockEnd, Line *aPar
 				}
 			} // for each deref of this arg
 			} // if (this_arg.deref)
+#ifndef AUTOHOTKEYSC
+			if (this_arg.postfix && g_NoEnv == sParseCacheNoEnv) // It was installed from the parse cache by ParseCacheReplayLine().
+				continue;
+#endif
 			if (!line->ExpressionToPostfix(this_arg)) // At this stage, this_arg.is_expression is known to be true. Doing this here, after the script has been loaded, might improve the compactness/adjacent-ness of the compiled expressions in memory, which might improve performance due to CPU caching.
 			{
 				abort = true; // So that the caller doesn't also report an error.
@@ -8557,6 +9844,122 @@ Line *Script::PreparseBlocks(Line *aStartingLine, bool aFindBlockEnd, Line *aPar
 
 
 
+#define LINE_ARENA_ALIGN(aSize) (((aSize) + 7) & ~(size_t)7) // 8-byte alignment is required by ExprTokenType's __int64 and double members.
+
+ResultType Script::CompactLines()
+// Called after the script has been fully loaded and preparsed.  Each line's ArgStruct array, deref
+// arrays, and postfix arrays were allocated separately as the script was parsed (the postfix arrays
+// much later, by PreparseBlocks), so the data of a given line is typically scattered among that of many
+// other lines.  This moves all of it into a single block in the same order as the lines themselves so that
+// executing consecutive lines (e.g. the body of a function, loop or label) touches consecutive memory.
+// The Line objects themselves aren't moved because pointers to them are kept in too many places (labels,
+// functions, mRelatedLine, mParentLine, etc.)  Similarly, each arg's text isn't moved because markers into
+// it are kept in several places.  The old copies are simply abandoned since SimpleHeap memory can't be freed.
+{
+	Line *line;
+	ArgStruct *arg;
+	DerefType *deref;
+	ExprTokenType *token;
+	int i;
+	size_t size = 0;
+
+	// PASS #1: Determine how much memory is needed.
+	for (line = mFirstLine; line; line = line->mNextLine)
+	{
+		if (!line->mArgc)
+			continue;
+		size += LINE_ARENA_ALIGN(line->mArgc * sizeof(ArgStruct));
+		for (i = 0; i < line->mArgc; ++i)
+		{
+			arg = line->mArg + i;
+			if (arg->type != ARG_TYPE_NORMAL) // For these, deref is really a Var*.  See VAR().
+				continue;
+			if (arg->deref)
+			{
+				for (deref = arg->deref; deref->marker; ++deref);
+				size += LINE_ARENA_ALIGN((deref - arg->deref + 1) * sizeof(DerefType)); // +1 for the terminator.
+			}
+			if (!arg->is_expression) // Any postfix is a cached binary integer (or uninitialized), so leave it as-is.
+				continue;
+			for (token = arg->postfix; token->symbol != SYM_INVALID; ++token)
+				if (token->symbol == SYM_OPERAND && token->buf)
+					size += sizeof(__int64);
+			size += LINE_ARENA_ALIGN((token - arg->postfix + 1) * sizeof(ExprTokenType)); // +1 for the terminator.
+		}
+	}
+	if (!size)
+		return OK;
+
+	// Use malloc() vs. SimpleHeap because the size is typically much larger than SimpleHeap's block size.
+	// This block is never freed since the lines refer to it for the lifetime of the program.
+	char *arena = (char *)malloc(size + 7); // +7 to allow for alignment.
+	if (!arena)
+		return ScriptError(ERR_OUTOFMEM);
+	mLineArenaSize = size;
+	arena = (char *)LINE_ARENA_ALIGN((size_t)arena);
+
+	// PASS #2: Move each line's data into the arena.  For each arg, the deref array and the postfix array
+	// are placed right after each other so that evaluating an expression touches as few cache lines as possible.
+	DerefType *old_deref, *old_deref_end;
+	ExprTokenType *old_postfix, *new_postfix;
+	size_t item_count;
+	for (line = mFirstLine; line; line = line->mNextLine)
+	{
+		if (!line->mArgc)
+			continue;
+		arg = (ArgStruct *)memcpy(arena, line->mArg, line->mArgc * sizeof(ArgStruct));
+		line->mArg = arg;
+		arena += LINE_ARENA_ALIGN(line->mArgc * sizeof(ArgStruct));
+		for (i = 0; i < line->mArgc; ++i, ++arg)
+		{
+			if (arg->type != ARG_TYPE_NORMAL)
+				continue;
+			old_deref = old_deref_end = arg->deref;
+			if (old_deref)
+			{
+				for (; old_deref_end->marker; ++old_deref_end);
+				item_count = old_deref_end - old_deref + 1; // +1 for the terminator.
+				arg->deref = (DerefType *)memcpy(arena, old_deref, item_count * sizeof(DerefType));
+				arena += LINE_ARENA_ALIGN(item_count * sizeof(DerefType));
+			}
+			if (!arg->is_expression)
+				continue;
+			old_postfix = arg->postfix;
+			for (token = old_postfix; token->symbol != SYM_INVALID; ++token);
+			item_count = token - old_postfix + 1; // +1 for the terminator.
+			new_postfix = arg->postfix = (ExprTokenType *)memcpy(arena, old_postfix, item_count * sizeof(ExprTokenType));
+			arena += LINE_ARENA_ALIGN(item_count * sizeof(ExprTokenType));
+			// Adjust any pointers that refer to items that were just moved:
+			for (token = new_postfix; token->symbol != SYM_INVALID; ++token)
+			{
+				if (token->circuit_token)
+					token->circuit_token = new_postfix + (token->circuit_token - old_postfix);
+				switch (token->symbol)
+				{
+				case SYM_FUNC:
+					// Only adjust those that point into this arg's deref array.  The SYM_FUNC of a dynamic
+					// function call instead points into the separate deref array of its SYM_DYNAMIC, which
+					// wasn't moved (and must remain shared with that SYM_DYNAMIC).
+					if (token->deref >= old_deref && token->deref < old_deref_end)
+						token->deref = arg->deref + (token->deref - old_deref);
+					break;
+				case SYM_OPERAND:
+					if (token->buf) // Pre-converted binary integer (see ExpressionToPostfix()).
+					{
+						*(__int64 *)arena = *(__int64 *)token->buf;
+						token->buf = arena;
+						arena += sizeof(__int64);
+					}
+					break;
+				}
+			}
+		}
+	}
+	return OK;
+}
+
+
+
 Line *Script::PreparseIfElse(Line *aStartingLine, ExecUntilMode aMode, AttributeType aLoopTypeFile
 	, AttributeType aLoopTypeReg, AttributeType aLoopTypeRead, AttributeType aLoopTypeParse)
 // Zero is the default for aMode, otherwise:
@@ -9877,10 +11280,47 @@ int Line::sLogNext = 0;  // Start at the first element.
 char *Line::sDerefBuf = NULL;  // Buffer to hold the values of any args that need to be dereferenced.
 size_t Line::sDerefBufSize = 0;
 int Line::sLargeDerefBufs = 0; // Keeps track of how many large bufs exist on the call-stack, for the purpose of determining when to stop the buffer-freeing timer.
+size_t Line::sDerefBufPrivatizedSize = 0;
+size_t Line::sDerefBufPeakSize = 0;
 char *Line::sArgDeref[MAX_ARGS]; // No init needed.
 Var *Line::sArgVar[MAX_ARGS]; // Same.
 
 
+// Pool of deref buffers that were released by DEPRIVATIZE_S_DEREF_BUF or replaced by a larger one in
+// ExpandArgs().  Without it, each line that calls a user-defined function whose body needs a deref buffer
+// of its own would malloc() a new one and free() it when the line finishes.  Only the smaller sizes are
+// kept because those are what nearly all lines use; larger ones are rare enough that malloc() is fine.
+// Each size has its own LIFO stack, so a buffer released by a given level of recursion or thread
+// interruption is typically reacquired by that same level the next time.
+#define DEREF_BUF_POOL_SIZES 4 // i.e. sizes of 1 through 4 times DEREF_BUF_EXPAND_INCREMENT.
+#define DEREF_BUF_POOL_DEPTH 8 // Max buffers kept of each size, which caps the pool at 1.25 MB.
+static char *sDerefBufPool[DEREF_BUF_POOL_SIZES][DEREF_BUF_POOL_DEPTH];
+static int sDerefBufPoolCount[DEREF_BUF_POOL_SIZES];
+
+char *Line::DerefBufAcquire(size_t aSize)
+// Returns a buffer of aSize bytes (which is a multiple of DEREF_BUF_EXPAND_INCREMENT), or NULL if out
+// of memory.  Caller is responsible for giving it back via DerefBufRelease() or free().
+{
+	size_t size_index = aSize / DEREF_BUF_EXPAND_INCREMENT - 1;
+	if (size_index < DEREF_BUF_POOL_SIZES && sDerefBufPoolCount[size_index])
+		return sDerefBufPool[size_index][--sDerefBufPoolCount[size_index]];
+	return (char *)malloc(aSize);
+}
+
+
+
+void Line::DerefBufRelease(char *aBuf, size_t aSize)
+{
+	size_t size_index = aSize / DEREF_BUF_EXPAND_INCREMENT - 1;
+	if (   !(aSize % DEREF_BUF_EXPAND_INCREMENT) // ExpandExpression() sometimes creates buffers of other sizes.
+		&& size_index < DEREF_BUF_POOL_SIZES && sDerefBufPoolCount[size_index] < DEREF_BUF_POOL_DEPTH   )
+		sDerefBufPool[size_index][sDerefBufPoolCount[size_index]++] = aBuf;
+	else
+		free(aBuf);
+}
+
+
+
 void Line::FreeDerefBufIfLarge()
 {
 	if (sDerefBufSize > LARGE_DEREF_BUF_SIZE)
@@ -10450,6 +11890,7 @@ ResultType Line::ExecUntil(ExecUntilMode aMode, char **apReturnValue, Line **apJ
 				break;
 			case ATTR_LOOP_READ_FILE:
 				FILE *read_file;
+				FileAppendCacheRelease(ARG2); // Write out any text buffered by #FileAppendBuffer so that it gets read too.
 				if (*ARG2 && (read_file = fopen(ARG2, "r"))) // v1.0.47: Added check for "" to avoid debug-assertion failure while in debug mode (maybe it's bad to to open file "" in release mode too).
 				{
 					result = line->PerformLoopReadFile(apReturnValue, continue_main_loop, jump_to_line, read_file, ARG3);
@@ -11174,6 +12615,228 @@ ResultType Line::PerformLoopWhile(char **apReturnValue, bool &aContinueMainLoop,
 
 
 
+static bool LoopFilePrefetchPush(LoopFilePrefetchStruct &aPrefetch, WIN32_FIND_DATA &aItem)
+// Called by the worker thread to queue an item for the loop, waiting for a free slot if necessary.
+// Returns false if the loop has ended, in which case the worker should abandon the walk.
+{
+	WaitForSingleObject(aPrefetch.mSlotFree, INFINITE);
+	if (aPrefetch.mStop)
+		return false;
+	memcpy(aPrefetch.mItem + aPrefetch.mTail, &aItem, sizeof(WIN32_FIND_DATA));
+	if (++aPrefetch.mTail == LOOP_FILE_PREFETCH_SIZE)
+		aPrefetch.mTail = 0;
+	aPrefetch.mIsDrained = false;
+	ReleaseSemaphore(aPrefetch.mSlotFilled, 1, NULL);
+	return true;
+}
+
+
+
+static bool LoopFilePrefetchDrain(LoopFilePrefetchStruct &aPrefetch)
+// Called by the worker thread before it lists a folder's subfolders.  Waits until the loop body has
+// finished with every item queued so far, since the body might create, delete or rename subfolders.
+// This is done by queuing a barrier item, which the loop acknowledges when it reaches it rather than
+// running the body for it.  Returns false if the loop has ended.
+{
+	if (aPrefetch.mIsDrained) // Nothing was queued since the last barrier, so there's no need to wait.
+		return !aPrefetch.mStop;
+	WIN32_FIND_DATA barrier;
+	*barrier.cFileName = '\0';
+	barrier.dwFileAttributes = LOOP_FILE_PREFETCH_BARRIER;
+	if (!LoopFilePrefetchPush(aPrefetch, barrier))
+		return false;
+	WaitForSingleObject(aPrefetch.mDrained, INFINITE);
+	aPrefetch.mIsDrained = true;
+	return !aPrefetch.mStop;
+}
+
+
+
+static bool LoopFilePrefetchWalk(LoopFilePrefetchStruct &aPrefetch, size_t aDirLength)
+// Queues the matching items in the folder whose path is the first aDirLength characters of
+// aPrefetch.mPath (including its trailing backslash), then recurses into each of its subfolders.
+// This is the same order and filtering as the recursion in PerformLoopFilePattern().  Each search
+// for subfolders is begun or continued only after the loop body has finished with every item queued
+// before it (see LoopFilePrefetchDrain()), so the subfolders visited are the same as if the loop had
+// walked the tree itself.  However, the items of a single folder are listed ahead of the body, so
+// if the body alters the folder whose items it's being given, whether it sees those changes can
+// differ (as it can without the worker, since FindNextFile() doesn't guarantee either).
+// Returns false if the walk was abandoned.
+{
+	WIN32_FIND_DATA current_file;
+	char *append_pos = aPrefetch.mPath + aDirLength;
+	memcpy(append_pos, aPrefetch.mNakedPattern, aPrefetch.mNakedPatternLength + 1); // Caller has ensured it fits.
+	HANDLE file_search = FindFirstFile(aPrefetch.mPath, &current_file);
+	if (file_search != INVALID_HANDLE_VALUE)
+	{
+		do
+		{
+			if (Line::FileIsFilteredOut(current_file, aPrefetch.mFileLoopMode, aPrefetch.mPath, aDirLength))
+				continue;
+			if (!LoopFilePrefetchPush(aPrefetch, current_file))
+			{
+				FindClose(file_search);
+				return false;
+			}
+		} while (!aPrefetch.mStop && FindNextFile(file_search, &current_file));
+		FindClose(file_search);
+	}
+
+	// Now recurse into all subfolders.  See PerformLoopFilePattern() for comments about the length checks.
+	if (aDirLength > MAX_PATH - 4)
+		return true;
+	if (!LoopFilePrefetchDrain(aPrefetch))
+		return false;
+	strcpy(append_pos, "*.*");
+	if (   (file_search = FindFirstFile(aPrefetch.mPath, &current_file)) == INVALID_HANDLE_VALUE   )
+		return true;
+	size_t name_length, path_and_pattern_length = aDirLength + aPrefetch.mNakedPatternLength;
+	do
+	{
+		if (!(current_file.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+			|| current_file.cFileName[0] == '.' && (!current_file.cFileName[1]      // Relies on short-circuit boolean order.
+				|| current_file.cFileName[1] == '.' && !current_file.cFileName[2])  //
+			|| path_and_pattern_length + (name_length = strlen(current_file.cFileName)) > MAX_PATH - 2)
+			continue;
+		// Overwriting the part of mPath after append_pos is okay because file_search no longer needs it.
+		memcpy(append_pos, current_file.cFileName, name_length);
+		append_pos[name_length] = '\\';
+		if (!LoopFilePrefetchWalk(aPrefetch, aDirLength + name_length + 1) // Relies on short-circuit boolean order.
+			|| !LoopFilePrefetchDrain(aPrefetch)) // The body might have altered this folder's subfolders meanwhile.
+		{
+			FindClose(file_search);
+			return false;
+		}
+	} while (!aPrefetch.mStop && FindNextFile(file_search, &current_file));
+	FindClose(file_search);
+	return !aPrefetch.mStop;
+}
+
+
+
+static DWORD WINAPI LoopFilePrefetchThread(LPVOID aPrefetch)
+// Like the hook thread, this thread must call only Win32 functions and C-library functions that are
+// thread-safe in the single-threaded library, such as memcpy() and strlen().  See AddRemoveHooks().
+{
+	LoopFilePrefetchStruct &prefetch = *(LoopFilePrefetchStruct *)aPrefetch;
+	if (LoopFilePrefetchWalk(prefetch, strlen(prefetch.mPath) - prefetch.mNakedPatternLength))
+	{
+		WIN32_FIND_DATA end_marker;
+		*end_marker.cFileName = '\0';
+		end_marker.dwFileAttributes = 0; // i.e. not LOOP_FILE_PREFETCH_BARRIER.
+		LoopFilePrefetchPush(prefetch, end_marker);
+	}
+	return 0;
+}
+
+
+
+static LoopFilePrefetchStruct *LoopFilePrefetchStart(char *aFilePattern, FileLoopModeType aFileLoopMode)
+// Starts a worker thread that walks the tree described by aFilePattern.
+// Returns NULL if the loop should walk the tree itself instead.  That is done for relative paths
+// because the loop body could change the working directory, which would affect the worker at an
+// unpredictable point in its walk.  It's also done if there's no memory or the thread can't be created.
+{
+	if (   !(aFilePattern[1] == ':' && aFilePattern[2] == '\\' // e.g. C:\...
+		|| aFilePattern[0] == '\\' && aFilePattern[1] == '\\') // UNC path.
+		|| strlen(aFilePattern) >= MAX_PATH   ) // Let the caller handle this rare case the same way as before.
+		return NULL;
+	LoopFilePrefetchStruct *prefetch = (LoopFilePrefetchStruct *)malloc(sizeof(LoopFilePrefetchStruct));
+	if (!prefetch)
+		return NULL;
+	strcpy(prefetch->mPath, aFilePattern);
+	strcpy(prefetch->mNakedPattern, strrchr(aFilePattern, '\\') + 1); // An absolute path always has a backslash.
+	prefetch->mNakedPatternLength = strlen(prefetch->mNakedPattern);
+	prefetch->mFileLoopMode = aFileLoopMode;
+	prefetch->mHead = prefetch->mTail = 0;
+	prefetch->mIsDrained = true;
+	prefetch->mStop = false;
+	// The maximum counts have room for one extra release, which LoopFilePrefetchEnd() uses to wake the worker:
+	prefetch->mSlotFree = CreateSemaphore(NULL, LOOP_FILE_PREFETCH_SIZE, LOOP_FILE_PREFETCH_SIZE + 1, NULL);
+	prefetch->mSlotFilled = CreateSemaphore(NULL, 0, LOOP_FILE_PREFETCH_SIZE + 1, NULL);
+	prefetch->mDrained = CreateEvent(NULL, FALSE, FALSE, NULL); // Auto-reset.
+	DWORD thread_id;
+	if (prefetch->mSlotFree && prefetch->mSlotFilled && prefetch->mDrained // Stack is kept small as for the hook thread; it grows automatically if needed.
+		&& (prefetch->mThread = CreateThread(NULL, 8*1024, LoopFilePrefetchThread, prefetch, 0, &thread_id))) // Win9x: Last parameter cannot be NULL.
+		return prefetch;
+	if (prefetch->mSlotFree)
+		CloseHandle(prefetch->mSlotFree);
+	if (prefetch->mSlotFilled)
+		CloseHandle(prefetch->mSlotFilled);
+	if (prefetch->mDrained)
+		CloseHandle(prefetch->mDrained);
+	free(prefetch);
+	return NULL;
+}
+
+
+
+static void LoopFilePrefetchEnd(LoopFilePrefetchStruct *aPrefetch)
+// Stops the worker (in case the loop ended early via break, return, goto, etc.) and frees everything.
+{
+	aPrefetch->mStop = true;
+	ReleaseSemaphore(aPrefetch->mSlotFree, 1, NULL); // Wake the worker in case it's waiting for a free slot.
+	SetEvent(aPrefetch->mDrained); // Or in case it's waiting in LoopFilePrefetchDrain().
+	WaitForSingleObject(aPrefetch->mThread, INFINITE);
+	CloseHandle(aPrefetch->mThread);
+	CloseHandle(aPrefetch->mSlotFree);
+	CloseHandle(aPrefetch->mSlotFilled);
+	CloseHandle(aPrefetch->mDrained);
+	free(aPrefetch);
+}
+
+
+
+ResultType Line::PerformLoopFilePrefetch(char **apReturnValue, bool &aContinueMainLoop, Line *&aJumpToLine
+	, LoopFilePrefetchStruct &aPrefetch)
+// Runs the body of a recursive file-loop once for each item queued by the worker thread.
+// See PerformLoopFilePattern() for comments about the handling of the body's result.
+{
+	WIN32_FIND_DATA current_file; // The slot itself can't be used because the worker would reuse it while the body runs.
+	ResultType result;
+	Line *jump_to_line;
+	global_struct &g = *::g; // Primarily for performance in this case.
+
+	for (;; ++g.mLoopIteration)
+	{
+		for (;;) // Get the next item.
+		{
+			WaitForSingleObject(aPrefetch.mSlotFilled, INFINITE);
+			memcpy(&current_file, aPrefetch.mItem + aPrefetch.mHead, sizeof(WIN32_FIND_DATA));
+			if (++aPrefetch.mHead == LOOP_FILE_PREFETCH_SIZE)
+				aPrefetch.mHead = 0;
+			ReleaseSemaphore(aPrefetch.mSlotFree, 1, NULL);
+			if (*current_file.cFileName || current_file.dwFileAttributes != LOOP_FILE_PREFETCH_BARRIER)
+				break;
+			// Otherwise, the body has finished with every item before this one, so let the worker go on.
+			SetEvent(aPrefetch.mDrained);
+		}
+		if (!*current_file.cFileName) // End of the walk.
+			break;
+
+		g.mLoopFile = &current_file;
+		if (mNextLine->mActionType == ACT_BLOCK_BEGIN)
+			do
+				result = mNextLine->mNextLine->ExecUntil(UNTIL_BLOCK_END, apReturnValue, &jump_to_line);
+			while (jump_to_line == mNextLine);
+		else
+			result = mNextLine->ExecUntil(ONLY_ONE_LINE, apReturnValue, &jump_to_line);
+		if (result != OK && result != LOOP_CONTINUE)
+			return result;
+		if (jump_to_line)
+		{
+			if (jump_to_line == this)
+				aContinueMainLoop = true;
+			else
+				aJumpToLine = jump_to_line;
+			break;
+		}
+	}
+	return OK;
+}
+
+
+
 ResultType Line::PerformLoopFilePattern(char **apReturnValue, bool &aContinueMainLoop, Line *&aJumpToLine
 	, FileLoopModeType aFileLoopMode, bool aRecurseSubfolders, char *aFilePattern)
 // Note: Even if aFilePattern is just a directory (i.e. with not wildcard pattern), it seems best
@@ -11181,6 +12844,16 @@ ResultType Line::PerformLoopFilePattern(char **apReturnValue, bool &aContinueMai
 // to conditionally resolve to various things at runtime.  In other words, it's valid to have
 // only a single directory be the target of the loop.
 {
+	// A recursive loop lets a worker thread walk the tree so that the directory I/O overlaps with the
+	// execution of the loop body (see LoopFilePrefetchStart() for when this isn't done):
+	LoopFilePrefetchStruct *prefetch;
+	if (aRecurseSubfolders && (prefetch = LoopFilePrefetchStart(aFilePattern, aFileLoopMode)))
+	{
+		ResultType result = PerformLoopFilePrefetch(apReturnValue, aContinueMainLoop, aJumpToLine, *prefetch);
+		LoopFilePrefetchEnd(prefetch);
+		return result;
+	}
+
 	// Make a local copy of the path given in aFilePattern because as the lines of
 	// the loop are executed, the deref buffer (which is what aFilePattern might
 	// point to if we were called from ExecUntil()) may be overwritten --
@@ -11579,6 +13252,31 @@ ResultType Line::PerformLoopParse(char **apReturnValue, bool &aContinueMainLoop,
 
 
 
+static inline char *CsvFindChar(char *aPos, char *aEnd, char aChar)
+// Returns the position of the first aChar in the range aPos to aEnd (exclusive), or aEnd if there is none.
+// Rather than comparing each character, this examines four at a time: XORing a word with four copies of
+// aChar turns each matching byte into zero, and (x - 0x01010101) & ~x & 0x80808080 then sets the high bit
+// of each zero byte.  Only bytes above the lowest zero byte can be flagged falsely, so the lowest flag is
+// always a real match.
+{
+	for (; aPos < aEnd && ((size_t)aPos & 3); ++aPos) // Advance to a word boundary.
+		if (*aPos == aChar)
+			return aPos;
+	DWORD pattern = (UCHAR)aChar * 0x01010101, word, mask;
+	for (; aPos + 4 <= aEnd; aPos += 4)
+	{
+		word = *(DWORD *)aPos ^ pattern;
+		if (mask = (word - 0x01010101) & ~word & 0x80808080)
+			return aPos + ((mask & 0x8080) ? ((mask & 0x80) ? 0 : 1) : ((mask & 0x800000) ? 2 : 3)); // Little-endian: the lowest byte comes first.
+	}
+	for (; aPos < aEnd; ++aPos)
+		if (*aPos == aChar)
+			return aPos;
+	return aEnd;
+}
+
+
+
 ResultType Line::PerformLoopParseCSV(char **apReturnValue, bool &aContinueMainLoop, Line *&aJumpToLine)
 // This function is similar to PerformLoopParse() so the two should be maintained together.
 // See PerformLoopParse() for comments about the below (comments have been mostly stripped
@@ -11601,20 +13299,22 @@ ResultType Line::PerformLoopParseCSV(char **apReturnValue, bool &aContinueMainLo
 			return LineError(ERR_OUTOFMEM, FAIL, ARG2);
 		stack_buf = NULL; // For comparison purposes later below.
 	}
-	strcpy(buf, ARG2); // Make the copy.
+	strcpy(buf, ARG2); // Make the copy.  The loop body might change the input variable, so it's needed.
+	char *buf_end = buf + strlen(buf); // Not space_needed-1 in case ARG2 contains a binary zero.
 
 	char omit_list[512];
 	strlcpy(omit_list, ARG4, sizeof(omit_list));
 
 	ResultType result;
 	Line *jump_to_line;
-	char *field, *field_end, saved_char;
+	char *field, *field_end, *text_end, *src, saved_char;
 	size_t field_length;
-	bool field_is_enclosed_in_quotes;
 	global_struct &g = *::g; // Primarily for performance in this case.
 
 	for (field = buf;;)
 	{
+		// Find the end of the field.  field_end is the position of the delimiting comma or closing quote
+		// (or buf_end), and text_end is where the field's text ends once its escaped quotes are unquoted.
 		if (*field == '"')
 		{
 			// For each field, check if the optional leading double-quote is present.  If it is,
@@ -11622,48 +13322,42 @@ ResultType Line::PerformLoopParseCSV(char **apReturnValue, bool &aContinueMainLo
 			// the that field.  This assumes that a field containing escaped double-quote is
 			// always contained in double quotes, which is how Excel does it.  For example:
 			// """string with escaped quotes""" resolves to a literal quoted string:
-			field_is_enclosed_in_quotes = true;
 			++field;
-		}
-		else
-			field_is_enclosed_in_quotes = false;
-
-		for (field_end = field;;)
-		{
-			if (   !(field_end = strchr(field_end, field_is_enclosed_in_quotes ? '"' : ','))   )
-			{
-				// This is the last field in the string, so set field_end to the position of
-				// the zero terminator instead:
-				field_end = field + strlen(field);
-				break;
-			}
-			if (field_is_enclosed_in_quotes)
+			field_end = CsvFindChar(field, buf_end, '"');
+			if (field_end < buf_end && field_end[1] == '"') // A pair of quotes: the field has to be unquoted.
 			{
-				// The quote discovered above marks the end of the string if it isn't followed
-				// by another quote.  But if it is a pair of quotes, replace it with a single
-				// literal double-quote and then keep searching for the real ending quote:
-				if (field_end[1] == '"')  // A pair of quotes was encountered.
+				// Replace each pair with a single quote by moving the text between the pairs down, which
+				// touches only this field (rather than moving the rest of the input for each pair):
+				for (text_end = field_end + 1, src = field_end + 2;;) // The first quote of the pair is kept.
 				{
-					memmove(field_end, field_end + 1, strlen(field_end + 1) + 1); // +1 to include terminator.
-					++field_end; // Skip over the literal double quote that we just produced.
-					continue; // Keep looking for the "real" ending quote.
+					field_end = CsvFindChar(src, buf_end, '"');
+					memmove(text_end, src, field_end - src);
+					text_end += field_end - src;
+					if (field_end < buf_end && field_end[1] == '"') // Another pair.
+					{
+						*text_end++ = '"';
+						src = field_end + 2;
+					}
+					else // The closing quote or the end of the input.
+						break;
 				}
-				// Otherwise, this quote marks the end of the field, so just fall through and break.
 			}
-			// else field is not enclosed in quotes, so the comma discovered above must be a delimiter.
-			break;
+			else
+				text_end = field_end;
 		}
+		else
+			text_end = field_end = CsvFindChar(field, buf_end, ',');
 
 		saved_char = *field_end; // This can be the terminator, a comma, or a double-quote.
-		*field_end = '\0';  // Terminate here so that GetLoopField() will see the correct substring.
+		*text_end = '\0';  // Terminate here so that GetLoopField() will see the correct substring.
 
 		if (*omit_list && *field)
 		{
 			// Process the omit list.
-			field = omit_leading_any(field, omit_list, field_end - field);
+			field = omit_leading_any(field, omit_list, text_end - field);
 			if (*field) // i.e. the above didn't remove all the chars due to them all being in the omit-list.
 			{
-				field_length = omit_trailing_any(field, omit_list, field_end - 1);
+				field_length = omit_trailing_any(field, omit_list, text_end - 1);
 				field[field_length] = '\0';  // Terminate here, but don't update field_end, since we need its pos.
 			}
 		}
@@ -11700,10 +13394,10 @@ ResultType Line::PerformLoopParseCSV(char **apReturnValue, bool &aContinueMainLo
 		else // saved_char must be a double-quote char.
 		{
 			field = field_end + 1;
-			if (!*field) // No more fields occur after this one.
+			if (field == buf_end) // No more fields occur after this one.
 				break;
 			// Find the next comma, which must be a real delimiter since we're in between fields:
-			if (   !(field = strchr(field, ','))   ) // No more fields.
+			if (   (field = CsvFindChar(field, buf_end, ',')) == buf_end   ) // No more fields.
 				break;
 			// Set it to be the first character of the next field, which might be a double-quote
 			// or another comma (if the field is empty).
@@ -12208,8 +13902,14 @@ __forceinline ResultType Line::Perform() // As of 2/9/2009, __forceinline() redu
 	case ACT_PIXELSEARCH:
 		// ArgToInt() works on ARG7 (the color) because any valid BGR or RGB color has 0x00 in the high order byte:
 		return PixelSearch(ArgToInt(3), ArgToInt(4), ArgToInt(5), ArgToInt(6), ArgToInt(7), ArgToInt(8), ARG9, false);
+	case ACT_PIXELSEARCHALL:
+		return PixelSearchAll(ArgToInt(2), ArgToInt(3), ArgToInt(4), ArgToInt(5), ArgToInt(6), ArgToInt(7), ARG8);
 	case ACT_IMAGESEARCH:
 		return ImageSearch(ArgToInt(3), ArgToInt(4), ArgToInt(5), ArgToInt(6), ARG7);
+	case ACT_IMAGESEARCHALL:
+		return ImageSearchAll(ArgToInt(2), ArgToInt(3), ArgToInt(4), ArgToInt(5), ARG6, ArgToInt(7));
+	case ACT_IMAGECACHECLEAR:
+		return ImageCacheClear(ARG1);
 	case ACT_PIXELGETCOLOR:
 		return PixelGetColor(ArgToInt(2), ArgToInt(3), ARG4);
 
@@ -12696,6 +14396,8 @@ __forceinline ResultType Line::Perform() // As of 2/9/2009, __forceinline() redu
 		// a reference to a variable that's blank):
 		return FileAppend(ARG2, ARG1, (mArgc < 2) ? g.mLoopReadFile : NULL);
 
+	case ACT_FILEFLUSH:
+		return g_ErrorLevel->Assign(FileAppendCacheFlush(*ARG1 ? ARG1 : NULL, true) ? ERRORLEVEL_NONE : ERRORLEVEL_ERROR);
 	case ACT_FILEREAD:
 		return FileRead(ARG2);
 
@@ -12706,6 +14408,7 @@ __forceinline ResultType Line::Perform() // As of 2/9/2009, __forceinline() redu
 		return FileDelete();
 
 	case ACT_FILERECYCLE:
+		FileAppendCacheRelease(ARG1);
 		return FileRecycle(ARG1);
 
 	case ACT_FILERECYCLEEMPTY:
@@ -12716,6 +14419,10 @@ __forceinline ResultType Line::Perform() // As of 2/9/2009, __forceinline() redu
 
 	case ACT_FILECOPY:
 	{
+		// Files kept open by #FileAppendBuffer are flushed and closed so that their full contents get copied
+		// and so that the destination can be overwritten.  The same is done for the commands below:
+		FileAppendCacheRelease(ARG1);
+		FileAppendCacheRelease(ARG2);
 		int error_count = Util_CopyFile(ARG1, ARG2, ArgToInt(3) == 1, false);
 		if (!error_count)
 			return g_ErrorLevel->Assign(ERRORLEVEL_NONE);
@@ -12724,10 +14431,14 @@ __forceinline ResultType Line::Perform() // As of 2/9/2009, __forceinline() redu
 		return g_ErrorLevel->Assign(error_count);
 	}
 	case ACT_FILEMOVE:
+		FileAppendCacheRelease(ARG1);
+		FileAppendCacheRelease(ARG2);
 		return g_ErrorLevel->Assign(Util_CopyFile(ARG1, ARG2, ArgToInt(3) == 1, true));
 	case ACT_FILECOPYDIR:
+		FileAppendCacheRelease(NULL); // Any cached file might be inside the directory.
 		return g_ErrorLevel->Assign(Util_CopyDir(ARG1, ARG2, ArgToInt(3) == 1) ? ERRORLEVEL_NONE : ERRORLEVEL_ERROR);
 	case ACT_FILEMOVEDIR:
+		FileAppendCacheRelease(NULL);
 		if (toupper(*ARG3) == 'R')
 		{
 			// Perform a simple rename instead, which prevents the operation from being only partially
@@ -12745,6 +14456,7 @@ __forceinline ResultType Line::Perform() // As of 2/9/2009, __forceinline() redu
 	case ACT_FILEREMOVEDIR:
 		if (!*ARG1) // Consider an attempt to create or remove a blank dir to be an error.
 			return g_ErrorLevel->Assign(ERRORLEVEL_ERROR);
+		FileAppendCacheRelease(NULL);
 		return g_ErrorLevel->Assign(Util_RemoveDir(ARG1, ArgToInt(2) == 1) ? ERRORLEVEL_NONE : ERRORLEVEL_ERROR);
 
 	case ACT_FILEGETATTRIB:
@@ -12752,14 +14464,18 @@ __forceinline ResultType Line::Perform() // As of 2/9/2009, __forceinline() redu
 		#define USE_FILE_LOOP_FILE_IF_ARG_BLANK(arg) (*arg ? arg : (g.mLoopFile ? g.mLoopFile->cFileName : ""))
 		return FileGetAttrib(USE_FILE_LOOP_FILE_IF_ARG_BLANK(ARG2));
 	case ACT_FILESETATTRIB:
+		FileAppendCacheRelease(USE_FILE_LOOP_FILE_IF_ARG_BLANK(ARG2));
 		FileSetAttrib(ARG1, USE_FILE_LOOP_FILE_IF_ARG_BLANK(ARG2), ConvertLoopMode(ARG3), ArgToInt(4) == 1);
 		return OK; // Always return OK since ErrorLevel will indicate if there was a problem.
 	case ACT_FILEGETTIME:
+		FileAppendCacheRelease(USE_FILE_LOOP_FILE_IF_ARG_BLANK(ARG2)); // Flushing updates the file's modification time.
 		return FileGetTime(USE_FILE_LOOP_FILE_IF_ARG_BLANK(ARG2), *ARG3);
 	case ACT_FILESETTIME:
+		FileAppendCacheRelease(USE_FILE_LOOP_FILE_IF_ARG_BLANK(ARG2)); // Otherwise, a later flush would overwrite the time set here.
 		FileSetTime(ARG1, USE_FILE_LOOP_FILE_IF_ARG_BLANK(ARG2), *ARG3, ConvertLoopMode(ARG4), ArgToInt(5) == 1);
 		return OK; // Always return OK since ErrorLevel will indicate if there was a problem.
 	case ACT_FILEGETSIZE:
+		FileAppendCacheRelease(USE_FILE_LOOP_FILE_IF_ARG_BLANK(ARG2));
 		return FileGetSize(USE_FILE_LOOP_FILE_IF_ARG_BLANK(ARG2), ARG3);
 	case ACT_FILEGETVERSION:
 		return FileGetVersion(USE_FILE_LOOP_FILE_IF_ARG_BLANK(ARG2));
@@ -13701,7 +15417,7 @@ ResultType Line::LineError(char *aErrorText, ResultType aErrorType, char *aExtra
 	if (!aExtraInfo)
 		aExtraInfo = "";
 
-	if (g_script.mErrorStdOut && !g_script.mIsReadyToExecute) // i.e. runtime errors are always displayed via dialog.
+	if (ERRORS_GO_TO_STDOUT) // i.e. runtime errors are always displayed via dialog (except in headless benchmark mode).
 	{
 		// JdeB said:
 		// Just tested it in Textpad, Crimson and Scite. they all recognise the output and jump
@@ -13785,7 +15501,7 @@ ResultType Script::ScriptError(char *aErrorText, char *aExtraInfo) //, ResultTyp
 	if (!aExtraInfo) // In case the caller explicitly called it with NULL.
 		aExtraInfo = "";
 
-	if (g_script.mErrorStdOut && !g_script.mIsReadyToExecute) // i.e. runtime errors are always displayed via dialog.
+	if (ERRORS_GO_TO_STDOUT) // i.e. runtime errors are always displayed via dialog (except in headless benchmark mode).
 	{
 		// See LineError() for details.
 		printf(STD_ERROR_FORMAT, Line::sSourceFile[mCurrFileIndex], mCombinedLineNumber, aErrorText);
@@ -13904,6 +15620,7 @@ char *Script::ListKeyHistory(char *aBuf, int aBufSize) // aBufSize should be an
 		"\r\nInterrupted threads: %d%s"
 		"\r\nPaused threads: %d of %d (%d layers)"
 		"\r\nModifiers (GetKeyState() now) = %s"
+		"\r\nDeref buffers: %u KB in use, %u KB peak"
 		"\r\n"
 		, win_title
 		//, SimpleHeap::GetBlockCount()
@@ -13915,7 +15632,8 @@ char *Script::ListKeyHistory(char *aBuf, int aBufSize) // aBufSize should be an
 		, g_nThreads > 1 ? " (preempted: they will resume when the current thread finishes)" : ""
 		, g_nPausedThreads - (g_array[0].IsPaused && !mAutoExecSectionIsRunning)  // Historically thread #0 isn't counted as a paused thread unless the auto-exec section is running but paused.
 		, g_nThreads, g_nLayersNeedingTimer
-		, ModifiersLRToText(GetModifierLRState(true), LRtext));
+		, ModifiersLRToText(GetModifierLRState(true), LRtext)
+		, (UINT)((Line::sDerefBufPrivatizedSize + Line::sDerefBufSize) / 1024), (UINT)(Line::sDerefBufPeakSize / 1024));
 	GetHookStatus(aBuf, BUF_SPACE_REMAINING);
 	aBuf += strlen(aBuf); // Adjust for what GetHookStatus() wrote to the buffer.
 	return aBuf + snprintf(aBuf, BUF_SPACE_REMAINING, g_KeyHistory ? "\r\nPress [F5] to refresh."
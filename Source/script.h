@@ -192,6 +192,14 @@ enum CommandIDs {CONTROL_ID_FIRST = IDCANCEL + 1
 #define ERR_MOUSE_SPEED "Mouse speed must be between 0 and " MAX_MOUSE_SPEED_STR "."
 #define ERR_VAR_IS_READONLY "Not allowed as an output variable."
 
+// Whether LineError() and ScriptError() should write to stdout rather than display a dialog.  A headless
+// benchmark run has nobody to dismiss a dialog, so it uses stdout for runtime errors too:
+#ifdef AUTOHOTKEYSC
+	#define ERRORS_GO_TO_STDOUT (g_script.mErrorStdOut && !g_script.mIsReadyToExecute)
+#else
+	#define ERRORS_GO_TO_STDOUT (g_script.mErrorStdOut && (!g_script.mIsReadyToExecute || g_script.mBenchmarkFile))
+#endif
+
 //----------------------------------------------------------------------------------
 
 void DoIncrementalMouseMove(int aX1, int aY1, int aX2, int aY2, int aSpeed);
@@ -274,6 +282,7 @@ ResultType InputBox(Var *aOutputVar, char *aTitle, char *aText, bool aHideInput
 BOOL CALLBACK InputBoxProc(HWND hWndDlg, UINT uMsg, WPARAM wParam, LPARAM lParam);
 VOID CALLBACK InputBoxTimeout(HWND hWnd, UINT uMsg, UINT idEvent, DWORD dwTime);
 VOID CALLBACK DerefTimeout(HWND hWnd, UINT uMsg, UINT idEvent, DWORD dwTime);
+VOID CALLBACK FileAppendTimeout(HWND hWnd, UINT uMsg, UINT idEvent, DWORD dwTime);
 BOOL CALLBACK EnumChildFindSeqNum(HWND aWnd, LPARAM lParam);
 BOOL CALLBACK EnumChildFindPoint(HWND aWnd, LPARAM lParam);
 BOOL CALLBACK EnumChildGetControlList(HWND aWnd, LPARAM lParam);
@@ -387,6 +396,25 @@ struct LoopReadFileStruct
 	}
 };
 
+struct LoopFilePrefetchStruct
+// Shared between a recursive file-loop (the consumer) and the worker thread that walks the folder tree
+// ahead of it (the producer).  The worker fills mItem[] as a ring buffer; the two semaphores count the
+// free and filled slots, so neither side ever touches a slot the other is using.
+{
+	#define LOOP_FILE_PREFETCH_SIZE 256 // Bounded so that the worker stays close to the loop (the loop body might be altering the tree).
+	#define LOOP_FILE_PREFETCH_BARRIER 0xFFFFFFFF // The dwFileAttributes of an item that isn't the end (see LoopFilePrefetchDrain()).
+	WIN32_FIND_DATA mItem[LOOP_FILE_PREFETCH_SIZE]; // An item with an empty cFileName marks the end of the walk or a barrier.
+	int mHead, mTail;       // Used only by the consumer and producer, respectively.
+	bool mIsDrained;        // Used only by the producer: whether the consumer has finished with every item queued so far.
+	HANDLE mSlotFree, mSlotFilled, mDrained, mThread;
+	volatile bool mStop;    // Set by the consumer to make the worker abandon the walk.
+	FileLoopModeType mFileLoopMode;
+	char mPath[MAX_PATH];   // The worker's current folder (with trailing backslash) followed by the pattern.
+	char mNakedPattern[MAX_PATH];
+	size_t mNakedPatternLength;
+};
+
+
 
 typedef UCHAR ArgCountType;
 #define MAX_ARGS 20   // Maximum number of args used by any command.
@@ -519,6 +547,8 @@ private:
 		, __int64 aIterationLimit, bool aIsInfinite);
 	ResultType Line::PerformLoopFilePattern(char **apReturnValue, bool &aContinueMainLoop, Line *&aJumpToLine
 		, FileLoopModeType aFileLoopMode, bool aRecurseSubfolders, char *aFilePattern);
+	ResultType PerformLoopFilePrefetch(char **apReturnValue, bool &aContinueMainLoop, Line *&aJumpToLine
+		, LoopFilePrefetchStruct &aPrefetch);
 	ResultType PerformLoopReg(char **apReturnValue, bool &aContinueMainLoop, Line *&aJumpToLine
 		, FileLoopModeType aFileLoopMode, bool aRecurseSubfolders, HKEY aRootKeyType, HKEY aRootKey, char *aRegSubkey);
 	ResultType PerformLoopParse(char **apReturnValue, bool &aContinueMainLoop, Line *&aJumpToLine);
@@ -650,7 +680,11 @@ private:
 	ResultType SysGet(char *aCmd, char *aValue);
 	ResultType PixelSearch(int aLeft, int aTop, int aRight, int aBottom, COLORREF aColorBGR, int aVariation
 		, char *aOptions, bool aIsPixelGetColor);
+	ResultType PixelSearchAll(int aLeft, int aTop, int aRight, int aBottom, COLORREF aColorBGR, int aVariation
+		, char *aOptions);
 	ResultType ImageSearch(int aLeft, int aTop, int aRight, int aBottom, char *aImageFile);
+	ResultType ImageSearchAll(int aLeft, int aTop, int aRight, int aBottom, char *aImageFiles, int aMaxPerImage);
+	ResultType ImageCacheClear(char *aImageFile);
 	ResultType PixelGetColor(int aX, int aY, char *aOptions);
 
 	static ResultType SetToggleState(vk_type aVK, ToggleValueType &ForceLock, char *aToggleText);
@@ -668,16 +702,19 @@ public:
 	#define PRIVATIZE_S_DEREF_BUF \
 		char *our_deref_buf = Line::sDerefBuf;\
 		size_t our_deref_buf_size = Line::sDerefBufSize;\
+		size_t our_deref_buf_size_orig = our_deref_buf_size; /* Caller might change the other one. */\
+		Line::sDerefBufPrivatizedSize += our_deref_buf_size;\
 		SET_S_DEREF_BUF(NULL, 0) // For detecting whether ExpandExpression() caused a new buffer to be created.
 
 	#define DEPRIVATIZE_S_DEREF_BUF \
+		Line::sDerefBufPrivatizedSize -= our_deref_buf_size_orig;\
 		if (our_deref_buf)\
 		{\
 			if (Line::sDerefBuf)\
 			{\
-				free(Line::sDerefBuf);\
 				if (Line::sDerefBufSize > LARGE_DEREF_BUF_SIZE)\
 					--Line::sLargeDerefBufs;\
+				Line::DerefBufRelease(Line::sDerefBuf, Line::sDerefBufSize);\
 			}\
 			SET_S_DEREF_BUF(our_deref_buf, our_deref_buf_size);\
 		}
@@ -687,6 +724,11 @@ public:
 	static char *sDerefBuf;  // Buffer to hold the values of any args that need to be dereferenced.
 	static size_t sDerefBufSize;
 	static int sLargeDerefBufs;
+	static size_t sDerefBufPrivatizedSize; // Total size of the deref buffers set aside by PRIVATIZE_S_DEREF_BUF on the call stack.
+	static size_t sDerefBufPeakSize; // The largest that sDerefBufPrivatizedSize + sDerefBufSize has ever been.  Shown by KeyHistory.
+
+	static char *DerefBufAcquire(size_t aSize);
+	static void DerefBufRelease(char *aBuf, size_t aSize);
 
 	// Static because only one line can be Expanded at a time (not to mention the fact that we
 	// wouldn't want the size of each line to be expanded by this size):
@@ -892,6 +934,8 @@ public:
 
 	static bool FileIsFilteredOut(WIN32_FIND_DATA &aCurrentFile, FileLoopModeType aFileLoopMode
 		, char *aFilePath, size_t aFilePathLength);
+	static bool FileAppendCacheFlush(char *aFilespec, bool aClose);
+	static void FileAppendCacheRelease(char *aFilePattern);
 
 	Label *GetJumpTarget(bool aIsDereferenced);
 	Label *IsJumpValid(Label &aTargetLabel);
@@ -966,7 +1010,9 @@ public:
 			case ACT_CONTROLGETPOS:
 			case ACT_PIXELGETCOLOR:
 			case ACT_PIXELSEARCH:
+			case ACT_PIXELSEARCHALL:
 			case ACT_IMAGESEARCH:
+			case ACT_IMAGESEARCHALL:
 			case ACT_INPUT:
 			case ACT_FORMATTIME:
 				return ARG_TYPE_OUTPUT_VAR;
@@ -2366,6 +2412,7 @@ private:
 	friend class Hotkey;
 	Line *mFirstLine, *mLastLine;     // The first and last lines in the linked list.
 	UINT mLineCount;                  // The number of lines.
+	size_t mLineArenaSize;            // Size of the block into which CompactLines() moved the lines' args.
 	Label *mFirstLabel, *mLastLabel;  // The first and last labels in the linked list.
 	Func *mFirstFunc, *mLastFunc;     // The first and last functions in the linked list.
 	Var **mVar, **mLazyVar; // Array of pointers-to-variable, allocated upon first use and later expanded as needed.
@@ -2393,12 +2440,11 @@ private:
 #ifdef AUTOHOTKEYSC
 	#define CloseAndReturnFail(fp, aBuf) CloseAndReturnFailFunc(fp, aBuf)
 	ResultType CloseAndReturnFailFunc(HS_EXEArc_Read *fp, UCHAR *aBuf);
-	size_t GetLine(char *aBuf, int aMaxCharsToRead, int aInContinuationSection, UCHAR *&aMemFile);
 #else
-	#define CloseAndReturnFail(fp, aBuf) CloseAndReturnFailFunc(fp)
-	ResultType CloseAndReturnFailFunc(FILE *fp);
-	size_t GetLine(char *aBuf, int aMaxCharsToRead, int aInContinuationSection, FILE *fp);
+	#define CloseAndReturnFail(fp, aBuf) CloseAndReturnFailFunc(aBuf)
+	ResultType CloseAndReturnFailFunc(UCHAR *aBuf);
 #endif
+	size_t GetLine(char *aBuf, int aMaxCharsToRead, int aInContinuationSection, UCHAR *&aMemFile);
 	ResultType IsDirective(char *aBuf);
 
 	ResultType ParseAndAddLine(char *aLineText, ActionTypeType aActionType = ACT_INVALID
@@ -2409,7 +2455,12 @@ private:
 	static ActionTypeType ConvertActionType(char *aActionTypeString);
 	static ActionTypeType ConvertOldActionType(char *aActionTypeString);
 	ResultType AddLabel(char *aLabelName, bool aAllowDupe);
-	ResultType AddLine(ActionTypeType aActionType, char *aArg[] = NULL, ArgCountType aArgc = 0, char *aArgMap[] = NULL);
+	ResultType ParseAndAddLineCached(int aCacheFile, char *aLineText, ActionTypeType aActionType = ACT_INVALID);
+#ifndef AUTOHOTKEYSC
+	ResultType ParseCacheReplayLine(char *&aPos, char *aEnd);
+#endif
+	ResultType AddLine(ActionTypeType aActionType, char *aArg[] = NULL, ArgCountType aArgc = 0, char *aArgMap[] = NULL
+		, ArgStruct *aBuiltArg = NULL);
 
 	// These aren't in the Line class because I think they're easier to implement
 	// if aStartingLine is allowed to be NULL (for recursive calls).  If they
@@ -2419,6 +2470,7 @@ private:
 	Line *PreparseIfElse(Line *aStartingLine, ExecUntilMode aMode = NORMAL_MODE, AttributeType aLoopTypeFile = ATTR_NONE
 		, AttributeType aLoopTypeReg = ATTR_NONE, AttributeType aLoopTypeRead = ATTR_NONE
 		, AttributeType aLoopTypeParse = ATTR_NONE);
+	ResultType CompactLines();
 
 public:
 	Line *mCurrLine;     // Seems better to make this public than make Line our friend.
@@ -2455,6 +2507,9 @@ public:
 	bool mCompiledHasCustomIcon; // Whether the compiled script uses a custom icon.
 #else
 	FILE *mIncludeLibraryFunctionsThenExit;
+	FILE *mBenchmarkFile; // Non-NULL when the /Benchmark switch is in effect (see script_benchmark.cpp).
+	#define BENCHMARK_LABEL_PREFIX "Bench_"
+	#define BENCHMARK_LABEL_PREFIX_LENGTH 6
 #endif
 	__int64 mLinesExecutedThisCycle; // Use 64-bit to match the type of g->LinesPerCycle
 	int mUninterruptedLineCountMax; // 32-bit for performance (since huge values seem unnecessary here).
@@ -2483,6 +2538,10 @@ public:
 	ResultType Reload(bool aDisplayErrors);
 	ResultType ExitApp(ExitReasons aExitReason, char *aBuf = NULL, int ExitCode = 0);
 	void TerminateApp(int aExitCode);
+#ifndef AUTOHOTKEYSC
+	int RunBenchmarks(LARGE_INTEGER &aLoadStart);
+	void BenchmarkReport(char *aKind, char *aName, double aValue);
+#endif
 #ifdef AUTOHOTKEYSC
 	LineNumberType LoadFromFile();
 #else
@@ -2495,6 +2554,9 @@ public:
 	ResultType DefineFunc(char *aBuf, Var *aFuncExceptionVar[]);
 #ifndef AUTOHOTKEYSC
 	Func *FindFuncInLibrary(char *aFuncName, size_t aFuncNameLength, bool &aErrorWasShown);
+	Func *IncludeLibraryFile(char *aFilePath, DWORD aLibPathLength, char *aFuncName, size_t aFuncNameLength
+		, bool &aErrorWasShown);
+	void LibCacheSave();
 #endif
 	Func *FindFunc(char *aFuncName, size_t aFuncNameLength = 0);
 	Func *AddFunc(char *aFuncName, size_t aFuncNameLength, bool aIsBuiltIn);
@@ -2722,6 +2784,13 @@ char *TokenToString(ExprTokenType &aToken, char *aBuf = NULL);
 ResultType TokenToDoubleOrInt64(ExprTokenType &aToken);
 
 char *RegExMatch(char *aHaystack, char *aNeedleRegEx);
+struct BoundRegEx; // Opaque to all but script2.cpp, so that other files don't need pcre.h.
+BoundRegEx *RegExBind(char *aRegEx);
+char *RegExMatch(char *aHaystack, BoundRegEx *aRegEx);
+int RegExCacheGetInfo(int aIndex, char *&aRegEx, char *&aTier);
+void ImageCacheGetCounts(UINT &aHits, UINT &aMisses);
+void LibCacheGetCounts(UINT &aHits, UINT &aMisses, UINT &aIndexBuilds);
+void ParseCacheGetCounts(UINT &aHits, UINT &aMisses);
 void SetWorkingDir(char *aNewDir);
 int ConvertJoy(char *aBuf, int *aJoystickID = NULL, bool aAllowOnlyButtons = false);
 bool ScriptGetKeyState(vk_type aVK, KeyStateTypes aKeyStateType);
@@ -17,11 +17,13 @@ GNU General Public License for more details.
 #include "stdafx.h" // pre-compiled headers
 #include <olectl.h> // for OleLoadPicture()
 #include <winioctl.h> // For PREVENT_MEDIA_REMOVAL and CD lock/unlock.
+#include <io.h> // For _commit() in FileAppend's cache.
 #include "qmath.h" // Used by Transform() [math.h incurs 2k larger code size just for ceil() & floor()]
 #include "mt19937ar-cok.h" // for sorting in random order
 #include "script.h"
 #include "window.h" // for IF_USE_FOREGROUND_WINDOW
 #include "application.h" // for MsgSleep()
+#include "image_search.h" // for ImageSearchFind() and PixelSearchFind()
 #include "resources\resource.h"  // For InputBox.
 
 #define PCRE_STATIC             // For RegEx. PCRE_STATIC tells PCRE to declare its functions for normal, static
@@ -1689,6 +1691,7 @@ ResultType Line::PerformShowWindow(ActionTypeType aActionType, char *aTitle, cha
 		//else
 		//	ShowWindowAsync(target_window, nCmdShow);
 //PostMessage(target_window, WM_SYSCOMMAND, SC_MINIMIZE, 0);
+		WindowSnapshotDiscard(target_window); // See WinSetTitle().
 		DoWinDelay;
 	}
 	return OK;  // Return success for all the above cases.
@@ -1817,8 +1820,16 @@ ResultType Line::PerformWait()
 		}
 	}
 
+	// For the WinWait commands, search for the window only when a window event says it might have changed
+	// (see WindowEventWatch).  The destructor removes the event hooks when this is the last watch to use them.
+	bool is_window_wait = mActionType == ACT_WINWAIT || mActionType == ACT_WINWAITCLOSE
+		|| mActionType == ACT_WINWAITACTIVE || mActionType == ACT_WINWAITNOTACTIVE;
+	WindowEventWatch window_watch(is_window_wait && WindowEventWatch::CriteriaAreEventDriven(SAVED_ARG1, SAVED_ARG2, SAVED_ARG5));
+
 	for (start_time = GetTickCount();;) // start_time is initialized unconditionally for use with v1.0.30.02's new logging feature further below.
 	{ // Always do the first iteration so that at least one check is done.
+		if (is_window_wait && !window_watch.IsCheckDue())
+			goto sleep_or_time_out; // No window has changed since the last check.
 		switch(mActionType)
 		{
 		case ACT_WINWAIT:
@@ -1901,6 +1912,7 @@ ResultType Line::PerformWait()
 			break;
 		}
 
+sleep_or_time_out:
 		// Must cast to int or any negative result will be lost due to DWORD type:
 		if (wait_indefinitely || (int)(sleep_duration - (GetTickCount() - start_time)) > SLEEP_INTERVAL_HALF)
 		{
@@ -3343,6 +3355,7 @@ ResultType Line::WinSetTitle(char *aTitle, char *aText, char *aNewTitle, char *a
 	if (!target_window)
 		return OK;
 	SetWindowText(target_window, aNewTitle);
+	WindowSnapshotDiscard(target_window); // Don't wait for the name-change event, which arrives only when messages are next checked.
 	return OK;
 }
 
@@ -4151,6 +4164,50 @@ end:
 
 
 
+static LPCOLORREF CaptureScreen(HDC aHdc, int aLeft, int aTop, int aRight, int aBottom
+	, LONG &aWidth, LONG &aHeight, bool &aIs16bit)
+// Returns the pixels currently visible on the screen within the specified rectangle (in screen
+// coordinates), which the caller must free.  Returns NULL upon failure.
+{
+	// Some explanation for the method below is contained in this quote from the newsgroups:
+	// "you shouldn't really be getting the current bitmap from the GetDC DC. This might
+	// have weird effects like returning the entire screen or not working. Create yourself
+	// a memory DC first of the correct size. Then BitBlt into it and then GetDIBits on
+	// that instead. This way, the provider of the DC (the video driver) can make sure that
+	// the correct pixels are copied across."
+
+	// Create an empty bitmap to hold all the pixels currently visible on the screen that lie within the search area:
+	int search_width = aRight - aLeft + 1;
+	int search_height = aBottom - aTop + 1;
+	LPCOLORREF screen_pixel = NULL;
+	HBITMAP hbitmap_screen = NULL;
+	HGDIOBJ sdc_orig_select = NULL;
+	HDC sdc;
+	if (   !(sdc = CreateCompatibleDC(aHdc))   )
+		return NULL;
+	if (   !(hbitmap_screen = CreateCompatibleBitmap(aHdc, search_width, search_height))   )
+		goto end;
+
+	if (   !(sdc_orig_select = SelectObject(sdc, hbitmap_screen))   )
+		goto end;
+
+	// Copy the pixels in the search-area of the screen into the DC to be searched:
+	if (   !(BitBlt(sdc, 0, 0, search_width, search_height, aHdc, aLeft, aTop, SRCCOPY))   )
+		goto end;
+
+	screen_pixel = getbits(hbitmap_screen, sdc, aWidth, aHeight, aIs16bit);
+
+end:
+	if (sdc_orig_select) // i.e. the original call to SelectObject() didn't fail.
+		SelectObject(sdc, sdc_orig_select); // Probably necessary to prevent memory leak.
+	DeleteDC(sdc);
+	if (hbitmap_screen)
+		DeleteObject(hbitmap_screen);
+	return screen_pixel;
+}
+
+
+
 ResultType Line::PixelSearch(int aLeft, int aTop, int aRight, int aBottom, COLORREF aColorBGR
 	, int aVariation, char *aOptions, bool aIsPixelGetColor)
 // Caller has ensured that aColor is in BGR format unless caller passed true for aUseRGB, in which case
@@ -4217,145 +4274,56 @@ ResultType Line::PixelSearch(int aLeft, int aTop, int aRight, int aBottom, COLOR
 	if (!hdc)
 		return OK;  // Let ErrorLevel tell the story.
 
-	bool found = false; // Must init here for use by "goto fast_end" and for use by both fast and slow modes.
+	// If the caller gives us inverted X or Y coordinates, conduct the search in reverse order.
+	// This feature was requested; it was put into effect for v1.0.25.06.
+	bool right_to_left = aLeft > aRight;
+	bool bottom_to_top = aTop > aBottom;
+	bool found = false;
 
 	if (fast_mode)
 	{
-		// From this point on, "goto fast_end" will assume hdc is non-NULL but that the below might still be NULL.
-		// Therefore, all of the following must be initialized so that the "fast_end" label can detect them:
-		HDC sdc = NULL;
-		HBITMAP hbitmap_screen = NULL;
-		LPCOLORREF screen_pixel = NULL;
-		HGDIOBJ sdc_orig_select = NULL;
-
-		// Some explanation for the method below is contained in this quote from the newsgroups:
-		// "you shouldn't really be getting the current bitmap from the GetDC DC. This might
-		// have weird effects like returning the entire screen or not working. Create yourself
-		// a memory DC first of the correct size. Then BitBlt into it and then GetDIBits on
-		// that instead. This way, the provider of the DC (the video driver) can make sure that
-		// the correct pixels are copied across."
-
-		// Create an empty bitmap to hold all the pixels currently visible on the screen (within the search area):
-		int search_width = aRight - aLeft + 1;
-		int search_height = aBottom - aTop + 1;
-		if (   !(sdc = CreateCompatibleDC(hdc)) || !(hbitmap_screen = CreateCompatibleBitmap(hdc, search_width, search_height))   )
-			goto fast_end;
-
-		if (   !(sdc_orig_select = SelectObject(sdc, hbitmap_screen))   )
-			goto fast_end;
-
-		// Copy the pixels in the search-area of the screen into the DC to be searched:
-		if (   !(BitBlt(sdc, 0, 0, search_width, search_height, hdc, aLeft, aTop, SRCCOPY))   )
-			goto fast_end;
-
+		// The screen is captured from the upper-left corner of the search area regardless of the direction
+		// of the search:
+		int left = right_to_left ? aRight : aLeft, top = bottom_to_top ? aBottom : aTop;
 		LONG screen_width, screen_height;
 		bool screen_is_16bit;
-		if (   !(screen_pixel = getbits(hbitmap_screen, sdc, screen_width, screen_height, screen_is_16bit))   )
-			goto fast_end;
-
-		// Concerning 0xF8F8F8F8: "On 16bit and 15 bit color the first 5 bits in each byte are valid
-		// (in 16bit there is an extra bit but i forgot for which color). And this will explain the
-		// second problem [in the test script], since GetPixel even in 16bit will return some "valid"
-		// data in the last 3bits of each byte."
-		register int i;
-		LONG screen_pixel_count = screen_width * screen_height;
-		if (screen_is_16bit)
-			for (i = 0; i < screen_pixel_count; ++i)
-				screen_pixel[i] &= 0xF8F8F8F8;
+		LPCOLORREF screen_pixel = CaptureScreen(hdc, left, top, right_to_left ? aLeft : aRight
+			, bottom_to_top ? aTop : aBottom, screen_width, screen_height, screen_is_16bit);
+		ReleaseDC(NULL, hdc);
+		if (!screen_pixel)
+			return OK; // Let ErrorLevel tell the story.
 
+		POINT match;
 		if (aIsPixelGetColor)
 		{
-			COLORREF color = screen_pixel[0] & 0x00FFFFFF; // See other 0x00FFFFFF below for explanation.
+			// Note that screen pixels sometimes have a non-zero high-order byte.  That's why bit-and with
+			// 0x00FFFFFF is done.  Concerning 0xF8F8F8: "On 16bit and 15 bit color the first 5 bits in each
+			// byte are valid", so the others are omitted in that case (see PixelSearchSetRange()).
+			COLORREF color = screen_pixel[0] & (screen_is_16bit ? 0x00F8F8F8 : 0x00FFFFFF);
 			char buf[32];
 			sprintf(buf, "0x%06X", use_rgb ? color : rgb_to_bgr(color));
 			output_var_x->Assign(buf); // Caller has ensured that first output_var (x) won't be NULL in this mode.
 			found = true; // ErrorLevel will be set to 0 further below.
 		}
-		else if (aVariation < 1) // Caller wants an exact match on one particular color.
-		{
-			if (screen_is_16bit)
-				aColorRGB &= 0xF8F8F8F8;
-			for (i = 0; i < screen_pixel_count; ++i)
-			{
-				// Note that screen pixels sometimes have a non-zero high-order byte.  That's why
-				// bit-and with 0x00FFFFFF is done.  Otherwise, Redish/orangish colors are not properly
-				// found:
-				if ((screen_pixel[i] & 0x00FFFFFF) == aColorRGB)
-				{
-					found = true;
-					break;
-				}
-			}
-		}
 		else
-		{
-			// It seems more appropriate to do the 16-bit conversion prior to SET_COLOR_RANGE,
-			// rather than applying 0xF8 to each of the high/low values individually.
-			if (screen_is_16bit)
-			{
-				search_red &= 0xF8;
-				search_green &= 0xF8;
-				search_blue &= 0xF8;
-			}
-
-#define SET_COLOR_RANGE \
-{\
-	red_low = (aVariation > search_red) ? 0 : search_red - aVariation;\
-	green_low = (aVariation > search_green) ? 0 : search_green - aVariation;\
-	blue_low = (aVariation > search_blue) ? 0 : search_blue - aVariation;\
-	red_high = (aVariation > 0xFF - search_red) ? 0xFF : search_red + aVariation;\
-	green_high = (aVariation > 0xFF - search_green) ? 0xFF : search_green + aVariation;\
-	blue_high = (aVariation > 0xFF - search_blue) ? 0xFF : search_blue + aVariation;\
-}
-			
-			SET_COLOR_RANGE
-
-			for (i = 0; i < screen_pixel_count; ++i)
-			{
-				// Note that screen pixels sometimes have a non-zero high-order byte.  But it doesn't
-				// matter with the below approach, since that byte is not checked in the comparison.
-				pixel = screen_pixel[i];
-				red = GetBValue(pixel);   // Because pixel is in RGB vs. BGR format, red is retrieved with
-				green = GetGValue(pixel); // GetBValue() and blue is retrieved with GetRValue().
-				blue = GetRValue(pixel);
-				if (red >= red_low && red <= red_high
-					&& green >= green_low && green <= green_high
-					&& blue >= blue_low && blue <= blue_high)
-				{
-					found = true;
-					break;
-				}
-			}
-		}
-		if (!found) // Must override ErrorLevel to its new value prior to the label below.
-			g_ErrorLevel->Assign(ERRORLEVEL_ERROR); // "1" indicates search completed okay, but didn't find it.
-
-fast_end:
-		// If found==false when execution reaches here, ErrorLevel is already set to the right value, so just
-		// clean up then return.
-		ReleaseDC(NULL, hdc);
-		if (sdc)
-		{
-			if (sdc_orig_select) // i.e. the original call to SelectObject() didn't fail.
-				SelectObject(sdc, sdc_orig_select); // Probably necessary to prevent memory leak.
-			DeleteDC(sdc);
-		}
-		if (hbitmap_screen)
-			DeleteObject(hbitmap_screen);
-		if (screen_pixel)
-			free(screen_pixel);
+			// Search the rows in the order indicated by the coordinates.  This used to be done by a loop here
+			// for each of exact and variation mode, but it's now done by image_search.cpp, which works only on
+			// the pixel buffer.
+			found = PixelSearchFind(screen_pixel, screen_width, screen_height, screen_is_16bit, aColorRGB, aVariation
+				, right_to_left, bottom_to_top, match);
+		free(screen_pixel);
 
-		if (!found) // Let ErrorLevel, which is either "1" or "2" as set earlier, tell the story.
-			return OK;
+		if (!found)
+			return g_ErrorLevel->Assign(ERRORLEVEL_ERROR); // "1" indicates search completed okay, but didn't find it.
 
 		// Otherwise, success.  Calculate xpos and ypos of where the match was found and adjust
 		// coords to make them relative to the position of the target window (rect will contain
 		// zeroes if this doesn't need to be done):
 		if (!aIsPixelGetColor)
 		{
-			if (output_var_x && !output_var_x->Assign((aLeft + i%screen_width) - rect.left))
+			if (output_var_x && !output_var_x->Assign((left + match.x) - rect.left))
 				return FAIL;
-			if (output_var_y && !output_var_y->Assign((aTop + i/screen_width) - rect.top))
+			if (output_var_y && !output_var_y->Assign((top + match.y) - rect.top))
 				return FAIL;
 		}
 
@@ -4369,14 +4337,18 @@ fast_end:
 	// In addition, there is doubt that the fast mode works in all the screen color depths, games,
 	// and other circumstances that the slow mode is known to work in.
 
-	// If the caller gives us inverted X or Y coordinates, conduct the search in reverse order.
-	// This feature was requested; it was put into effect for v1.0.25.06.
-	bool right_to_left = aLeft > aRight;
-	bool bottom_to_top = aTop > aBottom;
+	// The search is done column by column, in the direction indicated by the coordinates (see above).
 	register int xpos, ypos;
 
 	if (aVariation > 0)
-		SET_COLOR_RANGE
+	{
+		red_low = (aVariation > search_red) ? 0 : search_red - aVariation;
+		green_low = (aVariation > search_green) ? 0 : search_green - aVariation;
+		blue_low = (aVariation > search_blue) ? 0 : search_blue - aVariation;
+		red_high = (aVariation > 0xFF - search_red) ? 0xFF : search_red + aVariation;
+		green_high = (aVariation > 0xFF - search_green) ? 0xFF : search_green + aVariation;
+		blue_high = (aVariation > 0xFF - search_blue) ? 0xFF : search_blue + aVariation;
+	}
 
 	for (xpos = aLeft  // It starts at aLeft even if right_to_left is true.
 		; (right_to_left ? (xpos >= aRight) : (xpos <= aRight)) // Verified correct.
@@ -4432,21 +4404,20 @@ fast_end:
 
 
 
-ResultType Line::ImageSearch(int aLeft, int aTop, int aRight, int aBottom, char *aImageFile)
-// Author: ImageSearch was created by Aurelian Maga.
+ResultType Line::PixelSearchAll(int aLeft, int aTop, int aRight, int aBottom, COLORREF aColorBGR
+	, int aVariation, char *aOptions)
+// Like fast-mode PixelSearch, but finds every pixel in the region that matches.  Since matching pixels
+// tend to be adjacent (e.g. a button or a line of text), the output variable receives one line for each
+// horizontal run of them, consisting of the X and Y of its leftmost pixel and its length, separated by
+// commas.  The runs are listed from left to right, then from top to bottom, regardless of the order of
+// the coordinates.
 {
-	// Many of the following sections are similar to those in PixelSearch(), so they should be
-	// maintained together.
-	Var *output_var_x = ARGVAR1;  // Ok if NULL. RAW wouldn't be safe because load-time validation actually
-	Var *output_var_y = ARGVAR2;  // requires a minimum of zero parameters so that the output-vars can be optional. Also:
-	// Load-time validation has ensured that these are valid output variables (e.g. not built-in vars).
+	Var &output_var = *OUTPUT_VAR;
+	COLORREF color_rgb = strcasestr(aOptions, "RGB") ? aColorBGR : rgb_to_bgr(aColorBGR); // See PixelSearch().
 
-	// Set default results, both ErrorLevel and output variables, in case of early return:
-	g_ErrorLevel->Assign(ERRORLEVEL_ERROR2);  // 2 means error other than "image not found".
-	if (output_var_x)
-		output_var_x->Assign();  // Init to empty string regardless of whether we succeed here.
-	if (output_var_y)
-		output_var_y->Assign(); // Same.
+	// Set default results, both ErrorLevel and output variable, in case of early return:
+	g_ErrorLevel->Assign(ERRORLEVEL_ERROR2);  // 2 means error other than "color not found".
+	output_var.Assign();
 
 	RECT rect = {0}; // Set default (for CoordMode == "screen").
 	if (!(g->CoordMode & COORD_MODE_PIXEL)) // Using relative vs. screen coordinates.
@@ -4458,80 +4429,64 @@ ResultType Line::ImageSearch(int aLeft, int aTop, int aRight, int aBottom, char
 		aRight  += rect.left;  // Add left vs. right because we're adjusting based on the position of the window.
 		aBottom += rect.top;   // Same.
 	}
+	int left = min(aLeft, aRight), top = min(aTop, aBottom);
 
-	// Options are done as asterisk+option to permit future expansion.
-	// Set defaults to be possibly overridden by any specified options:
-	int aVariation = 0;  // This is named aVariation vs. variation for use with the SET_COLOR_RANGE macro.
-	COLORREF trans_color = CLR_NONE; // The default must be a value that can't occur naturally in an image.
-	int icon_number = 0; // Zero means "load icon or bitmap (doesn't matter)".
-	int width = 0, height = 0;
-	// For icons, override the default to be 16x16 because that is what is sought 99% of the time.
-	// This new default can be overridden by explicitly specifying w0 h0:
-	char *cp = strrchr(aImageFile, '.');
-	if (cp)
+	if (aVariation < 0)
+		aVariation = 0;
+	if (aVariation > 255)
+		aVariation = 255;
+
+	HDC hdc = GetDC(NULL);
+	if (!hdc)
+		return OK; // Let ErrorLevel tell the story.
+	LONG screen_width, screen_height;
+	bool screen_is_16bit;
+	LPCOLORREF screen_pixel = CaptureScreen(hdc, left, top, max(aLeft, aRight), max(aTop, aBottom)
+		, screen_width, screen_height, screen_is_16bit);
+	ReleaseDC(NULL, hdc);
+	if (!screen_pixel)
+		return OK; // Let ErrorLevel tell the story.
+
+	PixelSearchRun *run = NULL;
+	int run_count = PixelSearchRuns(screen_pixel, screen_width, screen_height, screen_is_16bit, color_rgb, aVariation, run);
+	free(screen_pixel);
+	if (run_count < 1)
 	{
-		++cp;
-		if (!(stricmp(cp, "ico") && stricmp(cp, "exe") && stricmp(cp, "dll")))
-			width = GetSystemMetrics(SM_CXSMICON), height = GetSystemMetrics(SM_CYSMICON);
+		free(run); // free() handles NULL.
+		if (!run_count)
+			g_ErrorLevel->Assign(ERRORLEVEL_ERROR); // "1" indicates search completed okay, but didn't find any.
+		return OK; // Let ErrorLevel tell the story.
 	}
 
-	char color_name[32], *dp;
-	cp = omit_leading_whitespace(aImageFile); // But don't alter aImageFile yet in case it contains literal whitespace we want to retain.
-	while (*cp == '*')
+	// Each line is at most 3 numbers (up to 11 characters each), 2 commas and a linefeed:
+	char *result = (char *)malloc(run_count * 36 + 1);
+	if (!result)
 	{
-		++cp;
-		switch (toupper(*cp))
-		{
-		case 'W': width = ATOI(cp + 1); break;
-		case 'H': height = ATOI(cp + 1); break;
-		default:
-			if (!strnicmp(cp, "Icon", 4))
-			{
-				cp += 4;  // Now it's the character after the word.
-				icon_number = ATOI(cp); // LoadPicture() correctly handles any negative value.
-			}
-			else if (!strnicmp(cp, "Trans", 5))
-			{
-				cp += 5;  // Now it's the character after the word.
-				// Isolate the color name/number for ColorNameToBGR():
-				strlcpy(color_name, cp, sizeof(color_name));
-				if (dp = StrChrAny(color_name, " \t")) // Find space or tab, if any.
-					*dp = '\0';
-				// Fix for v1.0.44.10: Treat trans_color as containing an RGB value (not BGR) so that it matches
-				// the documented behavior.  In older versions, a specified color like "TransYellow" was wrong in
-				// every way (inverted) and a specified numeric color like "Trans0xFFFFAA" was treated as BGR vs. RGB.
-				trans_color = ColorNameToBGR(color_name);
-				if (trans_color == CLR_NONE) // A matching color name was not found, so assume it's in hex format.
-					// It seems strtol() automatically handles the optional leading "0x" if present:
-					trans_color = strtol(color_name, NULL, 16);
-					// if color_name did not contain something hex-numeric, black (0x00) will be assumed,
-					// which seems okay given how rare such a problem would be.
-				else
-					trans_color = bgr_to_rgb(trans_color); // v1.0.44.10: See fix/comment above.
-
-			}
-			else // Assume it's a number since that's the only other asterisk-option.
-			{
-				aVariation = ATOI(cp); // Seems okay to support hex via ATOI because the space after the number is documented as being mandatory.
-				if (aVariation < 0)
-					aVariation = 0;
-				if (aVariation > 255)
-					aVariation = 255;
-				// Note: because it's possible for filenames to start with a space (even though Explorer itself
-				// won't let you create them that way), allow exactly one space between end of option and the
-				// filename itself:
-			}
-		} // switch()
-		if (   !(cp = StrChrAny(cp, " \t"))   ) // Find the first space or tab after the option.
-			return OK; // Bad option/format.  Let ErrorLevel tell the story.
-		// Now it's the space or tab (if there is one) after the option letter.  Advance by exactly one character
-		// because only one space or tab is considered the delimiter.  Any others are considered to be part of the
-		// filename (though some or all OSes might simply ignore them or tolerate them as first-try match criteria).
-		aImageFile = ++cp; // This should now point to another asterisk or the filename itself.
-		// Above also serves to reset the filename to omit the option string whenever at least one asterisk-option is present.
-		cp = omit_leading_whitespace(cp); // This is done to make it more tolerant of having more than one space/tab between options.
+		free(run);
+		return OK; // Let ErrorLevel tell the story.
 	}
+	size_t result_length = 0;
+	for (int i = 0; i < run_count; ++i)
+		result_length += sprintf(result + result_length, "%d,%d,%d\n", (left + run[i].x) - rect.left
+			, (top + run[i].y) - rect.top, run[i].length); // See PixelSearch() for comments about rect.
+	free(run);
+	result[--result_length] = '\0'; // Omit the last linefeed, as other commands that produce lists do.
+	ResultType result_to_return = output_var.Assign(result, (VarSizeType)result_length);
+	free(result);
+	if (result_to_return == OK)
+		g_ErrorLevel->Assign(ERRORLEVEL_NONE); // Indicate success.
+	return result_to_return;
+}
+
 
+
+static bool ImageSearchDecode(char *aFilespec, int aWidth, int aHeight, int aIconNumber, HDC aHdc
+	, ImageSearchTemplate &aImage)
+// Loads the pixels of the specified image into aImage (all its members except trans_color and variation).
+// Returns false upon failure, in which case aImage's pixels needn't be freed.  Otherwise, the caller must
+// free them via ImageSearchFree().
+// Author: ImageSearch was created by Aurelian Maga.
+{
 	// Update: Transparency is now supported in icons by using the icon's mask.  In addition, an attempt
 	// is made to support transparency in GIF, PNG, and possibly TIF files via the *Trans option, which
 	// assumes that one color in the image is transparent.  In GIFs not loaded via GDIPlus, the transparent
@@ -4545,7 +4500,7 @@ ResultType Line::ImageSearch(int aLeft, int aTop, int aRight, int aBottom, char
 	// So currently, only BMP and GIF seem to work reliably, though some of the other GDIPlus-supported
 	// formats might work too.
 	int image_type;
-	HBITMAP hbitmap_image = LoadPicture(aImageFile, width, height, image_type, icon_number, false);
+	HBITMAP hbitmap_image = LoadPicture(aFilespec, aWidth, aHeight, image_type, aIconNumber, false);
 	// The comment marked OBSOLETE below is no longer true because the elimination of the high-byte via
 	// 0x00FFFFFF seems to have fixed it.  But "true" is still not passed because that should increase
 	// consistency when GIF/BMP/ICO files are used by a script on both Win9x and other OSs (since the
@@ -4554,26 +4509,11 @@ ResultType Line::ImageSearch(int aLeft, int aTop, int aRight, int aBottom, char
 	// by the search.  In other words, nothing works.  Obsolete comment: Pass "true" so that an attempt
 	// will be made to load icons as bitmaps if GDIPlus is available.
 	if (!hbitmap_image)
-		return OK; // Let ErrorLevel tell the story.
-
-	HDC hdc = GetDC(NULL);
-	if (!hdc)
-	{
-		DeleteObject(hbitmap_image);
-		return OK; // Let ErrorLevel tell the story.
-	}
+		return false;
 
-	// From this point on, "goto end" will assume hdc and hbitmap_image are non-NULL, but that the below
-	// might still be NULL.  Therefore, all of the following must be initialized so that the "end"
-	// label can detect them:
-	HDC sdc = NULL;
-	HBITMAP hbitmap_screen = NULL;
-	LPCOLORREF image_pixel = NULL, screen_pixel = NULL, image_mask = NULL;
-	HGDIOBJ sdc_orig_select = NULL;
-	bool found = false; // Must init here for use by "goto end".
-    
-	bool image_is_16bit;
+	aImage.pixel = aImage.mask = NULL;
 	LONG image_width, image_height;
+	bool image_is_16bit;
 
 	if (image_type == IMAGE_ICON)
 	{
@@ -4586,261 +4526,511 @@ ResultType Line::ImageSearch(int aLeft, int aTop, int aRight, int aBottom, char
 			// okay to get all the pixels given the rarity of monochrome icons.  This scenario should be
 			// handled properly because: 1) the variables image_height and image_width will be overridden
 			// further below with the correct icon dimensions; 2) Only the first half of the pixels within
-			// the image_mask array will actually be referenced by the transparency checker in the loops,
+			// the mask array will actually be referenced by the transparency checker in the loops,
 			// and that first half is the AND-mask, which is the transparency part that is needed.  The
 			// second half, the XOR part, is not needed and thus ignored.  Also note that if width/height
 			// required the icon to be scaled, LoadPicture() has already done that directly to the icon,
 			// so ii.hbmMask should already be scaled to match the size of the bitmap created later below.
-			image_mask = getbits(ii.hbmMask, hdc, image_width, image_height, image_is_16bit, 1);
+			aImage.mask = getbits(ii.hbmMask, aHdc, image_width, image_height, image_is_16bit, 1);
 			DeleteObject(ii.hbmColor); // DeleteObject() probably handles NULL okay since few MSDN/other examples ever check for NULL.
 			DeleteObject(ii.hbmMask);
 		}
 		if (   !(hbitmap_image = IconToBitmap((HICON)hbitmap_image, true))   )
-			return OK; // Let ErrorLevel tell the story.
+		{
+			free(aImage.mask); // free() handles NULL.
+			return false;
+		}
 	}
 
-	if (   !(image_pixel = getbits(hbitmap_image, hdc, image_width, image_height, image_is_16bit))   )
-		goto end;
-
-	// Create an empty bitmap to hold all the pixels currently visible on the screen that lie within the search area:
-	int search_width = aRight - aLeft + 1;
-	int search_height = aBottom - aTop + 1;
-	if (   !(sdc = CreateCompatibleDC(hdc)) || !(hbitmap_screen = CreateCompatibleBitmap(hdc, search_width, search_height))   )
-		goto end;
-
-	if (   !(sdc_orig_select = SelectObject(sdc, hbitmap_screen))   )
-		goto end;
-
-	// Copy the pixels in the search-area of the screen into the DC to be searched:
-	if (   !(BitBlt(sdc, 0, 0, search_width, search_height, hdc, aLeft, aTop, SRCCOPY))   )
-		goto end;
-
-	LONG screen_width, screen_height;
-	bool screen_is_16bit;
-	if (   !(screen_pixel = getbits(hbitmap_screen, sdc, screen_width, screen_height, screen_is_16bit))   )
-		goto end;
-
-	LONG image_pixel_count = image_width * image_height;
-	LONG screen_pixel_count = screen_width * screen_height;
-	int i, j, k, x, y; // Declaring as "register" makes no performance difference with current compiler, so let the compiler choose which should be registers.
-
-	// If either is 16-bit, convert *both* to the 16-bit-compatible 32-bit format:
-	if (image_is_16bit || screen_is_16bit)
+	aImage.pixel = getbits(hbitmap_image, aHdc, image_width, image_height, image_is_16bit);
+	DeleteObject(hbitmap_image);
+	if (!aImage.pixel)
 	{
-		if (trans_color != CLR_NONE)
-			trans_color &= 0x00F8F8F8; // Convert indicated trans-color to be compatible with the conversion below.
-		for (i = 0; i < screen_pixel_count; ++i)
-			screen_pixel[i] &= 0x00F8F8F8; // Highest order byte must be masked to zero for consistency with use of 0x00FFFFFF below.
-		for (i = 0; i < image_pixel_count; ++i)
-			image_pixel[i] &= 0x00F8F8F8;  // Same.
+		free(aImage.mask);
+		return false;
 	}
+	aImage.width = image_width;
+	aImage.height = image_height;
+	aImage.is_16bit = image_is_16bit;
 
+	// Only the low-order 24 bits of the image's pixels are meaningful.  Masking out the others is also what
+	// allows them to be compared to trans_color.  Since this is done only when the image is loaded, searches
+	// that find it in the cache don't redo it.  If either the image or the screen has 16-bit color depth,
+	// ImageSearchFind() additionally masks out the bits that such bitmaps lack (this used to be done here).
 	// v1.0.44.03: The below is now done even for variation>0 mode so its results are consistent with those of
 	// non-variation mode.  This is relied upon by variation=0 mode but now also by the following line in the
 	// variation>0 section:
 	//     || image_pixel[j] == trans_color
 	// Without this change, there are cases where variation=0 would find a match but a higher variation
 	// (for the same search) wouldn't. 
-	for (i = 0; i < image_pixel_count; ++i)
-		image_pixel[i] &= 0x00FFFFFF;
-
-	// Search the specified region for the first occurrence of the image:
-	if (aVariation < 1) // Caller wants an exact match.
-	{
-		// Concerning the following use of 0x00FFFFFF, the use of 0x00F8F8F8 above is related (both have high order byte 00).
-		// The following needs to be done only when shades-of-variation mode isn't in effect because
-		// shades-of-variation mode ignores the high-order byte due to its use of macros such as GetRValue().
-		// This transformation incurs about a 15% performance decrease (percentage is fairly constant since
-		// it is proportional to the search-region size, which tends to be much larger than the search-image and
-		// is therefore the primary determination of how long the loops take). But it definitely helps find images
-		// more successfully in some cases.  For example, if a PNG file is displayed in a GUI window, this
-		// transformation allows certain bitmap search-images to be found via variation==0 when they otherwise
-		// would require variation==1 (possibly the variation==1 success is just a side-effect of it
-		// ignoring the high-order byte -- maybe a much higher variation would be needed if the high
-		// order byte were also subject to the same shades-of-variation analysis as the other three bytes [RGB]).
-		for (i = 0; i < screen_pixel_count; ++i)
-			screen_pixel[i] &= 0x00FFFFFF;
-
-		for (i = 0; i < screen_pixel_count; ++i)
-		{
-			// Unlike the variation-loop, the following one uses a first-pixel optimization to boost performance
-			// by about 10% because it's only 3 extra comparisons and exact-match mode is probably used more often.
-			// Before even checking whether the other adjacent pixels in the region match the image, ensure
-			// the image does not extend past the right or bottom edges of the current part of the search region.
-			// This is done for performance but more importantly to prevent partial matches at the edges of the
-			// search region from being considered complete matches.
-			// The following check is ordered for short-circuit performance.  In addition, image_mask, if
-			// non-NULL, is used to determine which pixels are transparent within the image and thus should
-			// match any color on the screen.
-			if ((screen_pixel[i] == image_pixel[0] // A screen pixel has been found that matches the image's first pixel.
-				|| image_mask && image_mask[0]     // Or: It's an icon's transparent pixel, which matches any color.
-				|| image_pixel[0] == trans_color)  // This should be okay even if trans_color==CLR_NONE, since CLR_NONE should never occur naturally in the image.
-				&& image_height <= screen_height - i/screen_width // Image is short enough to fit in the remaining rows of the search region.
-				&& image_width <= screen_width - i%screen_width)  // Image is narrow enough not to exceed the right-side boundary of the search region.
-			{
-				// Check if this candidate region -- which is a subset of the search region whose height and width
-				// matches that of the image -- is a pixel-for-pixel match of the image.
-				for (found = true, x = 0, y = 0, j = 0, k = i; j < image_pixel_count; ++j)
-				{
-					if (!(found = (screen_pixel[k] == image_pixel[j] // At least one pixel doesn't match, so this candidate is discarded.
-						|| image_mask && image_mask[j]      // Or: It's an icon's transparent pixel, which matches any color.
-						|| image_pixel[j] == trans_color))) // This should be okay even if trans_color==CLR_NONE, since CLR none should never occur naturally in the image.
-						break;
-					if (++x < image_width) // We're still within the same row of the image, so just move on to the next screen pixel.
-						++k;
-					else // We're starting a new row of the image.
-					{
-						x = 0; // Return to the leftmost column of the image.
-						++y;   // Move one row downward in the image.
-						// Move to the next row within the current-candiate region (not the entire search region).
-						// This is done by moving vertically downward from "i" (which is the upper-left pixel of the
-						// current-candidate region) by "y" rows.
-						k = i + y*screen_width; // Verified correct.
-					}
-				}
-				if (found) // Complete match found.
-					break;
-			}
-		}
-	}
-	else // Allow colors to vary by aVariation shades; i.e. approximate match is okay.
-	{
-		// The following section is part of the first-pixel-check optimization that improves performance by
-		// 15% or more depending on where and whether a match is found.  This section and one the follows
-		// later is commented out to reduce code size.
-		// Set high/low range for the first pixel of the image since it is the pixel most often checked
-		// (i.e. for performance).
-		//BYTE search_red1 = GetBValue(image_pixel[0]);  // Because it's RGB vs. BGR, the B value is fetched, not R (though it doesn't matter as long as everything is internally consistent here).
-		//BYTE search_green1 = GetGValue(image_pixel[0]);
-		//BYTE search_blue1 = GetRValue(image_pixel[0]); // Same comment as above.
-		//BYTE red_low1 = (aVariation > search_red1) ? 0 : search_red1 - aVariation;
-		//BYTE green_low1 = (aVariation > search_green1) ? 0 : search_green1 - aVariation;
-		//BYTE blue_low1 = (aVariation > search_blue1) ? 0 : search_blue1 - aVariation;
-		//BYTE red_high1 = (aVariation > 0xFF - search_red1) ? 0xFF : search_red1 + aVariation;
-		//BYTE green_high1 = (aVariation > 0xFF - search_green1) ? 0xFF : search_green1 + aVariation;
-		//BYTE blue_high1 = (aVariation > 0xFF - search_blue1) ? 0xFF : search_blue1 + aVariation;
-		// Above relies on the fact that the 16-bit conversion higher above was already done because like
-		// in PixelSearch, it seems more appropriate to do the 16-bit conversion prior to setting the range
-		// of high and low colors (vs. than applying 0xF8 to each of the high/low values individually).
-
-		BYTE red, green, blue;
-		BYTE search_red, search_green, search_blue;
-		BYTE red_low, green_low, blue_low, red_high, green_high, blue_high;
-
-		// The following loop is very similar to its counterpart above that finds an exact match, so maintain
-		// them together and see above for more detailed comments about it.
-		for (i = 0; i < screen_pixel_count; ++i)
-		{
-			// The following is commented out to trade code size reduction for performance (see comment above).
-			//red = GetBValue(screen_pixel[i]);   // Because it's RGB vs. BGR, the B value is fetched, not R (though it doesn't matter as long as everything is internally consistent here).
-			//green = GetGValue(screen_pixel[i]);
-			//blue = GetRValue(screen_pixel[i]);
-			//if ((red >= red_low1 && red <= red_high1
-			//	&& green >= green_low1 && green <= green_high1
-			//	&& blue >= blue_low1 && blue <= blue_high1 // All three color components are a match, so this screen pixel matches the image's first pixel.
-			//		|| image_mask && image_mask[0]         // Or: It's an icon's transparent pixel, which matches any color.
-			//		|| image_pixel[0] == trans_color)      // This should be okay even if trans_color==CLR_NONE, since CLR none should never occur naturally in the image.
-			//	&& image_height <= screen_height - i/screen_width // Image is short enough to fit in the remaining rows of the search region.
-			//	&& image_width <= screen_width - i%screen_width)  // Image is narrow enough not to exceed the right-side boundary of the search region.
-			
-			// Instead of the above, only this abbreviated check is done:
-			if (image_height <= screen_height - i/screen_width    // Image is short enough to fit in the remaining rows of the search region.
-				&& image_width <= screen_width - i%screen_width)  // Image is narrow enough not to exceed the right-side boundary of the search region.
-			{
-				// Since the first pixel is a match, check the other pixels.
-				for (found = true, x = 0, y = 0, j = 0, k = i; j < image_pixel_count; ++j)
-				{
-   					search_red = GetBValue(image_pixel[j]);
-	   				search_green = GetGValue(image_pixel[j]);
-		   			search_blue = GetRValue(image_pixel[j]);
-					SET_COLOR_RANGE
-   					red = GetBValue(screen_pixel[k]);
-	   				green = GetGValue(screen_pixel[k]);
-		   			blue = GetRValue(screen_pixel[k]);
-
-					if (!(found = red >= red_low && red <= red_high
-						&& green >= green_low && green <= green_high
-                        && blue >= blue_low && blue <= blue_high
-							|| image_mask && image_mask[j]     // Or: It's an icon's transparent pixel, which matches any color.
-							|| image_pixel[j] == trans_color)) // This should be okay even if trans_color==CLR_NONE, since CLR_NONE should never occur naturally in the image.
-						break; // At least one pixel doesn't match, so this candidate is discarded.
-					if (++x < image_width) // We're still within the same row of the image, so just move on to the next screen pixel.
-						++k;
-					else // We're starting a new row of the image.
-					{
-						x = 0; // Return to the leftmost column of the image.
-						++y;   // Move one row downward in the image.
-						k = i + y*screen_width; // Verified correct.
-					}
-				}
-				if (found) // Complete match found.
-					break;
-			}
-		}
-	}
-
-	if (!found) // Must override ErrorLevel to its new value prior to the label below.
-		g_ErrorLevel->Assign(ERRORLEVEL_ERROR); // "1" indicates search completed okay, but didn't find it.
-
-end:
-	// If found==false when execution reaches here, ErrorLevel is already set to the right value, so just
-	// clean up then return.
-	ReleaseDC(NULL, hdc);
-	DeleteObject(hbitmap_image);
-	if (sdc)
-	{
-		if (sdc_orig_select) // i.e. the original call to SelectObject() didn't fail.
-			SelectObject(sdc, sdc_orig_select); // Probably necessary to prevent memory leak.
-		DeleteDC(sdc);
-	}
-	if (hbitmap_screen)
-		DeleteObject(hbitmap_screen);
-	if (image_pixel)
-		free(image_pixel);
-	if (image_mask)
-		free(image_mask);
-	if (screen_pixel)
-		free(screen_pixel);
+	for (int i = 0, image_pixel_count = image_width * image_height; i < image_pixel_count; ++i)
+		aImage.pixel[i] &= 0x00FFFFFF;
+	return true;
+}
 
-	if (!found) // Let ErrorLevel, which is either "1" or "2" as set earlier, tell the story.
-		return OK;
 
-	// Otherwise, success.  Calculate xpos and ypos of where the match was found and adjust
-	// coords to make them relative to the position of the target window (rect will contain
-	// zeroes if this doesn't need to be done):
-	if (output_var_x && !output_var_x->Assign((aLeft + i%screen_width) - rect.left))
-		return FAIL;
-	if (output_var_y && !output_var_y->Assign((aTop + i/screen_width) - rect.top))
-		return FAIL;
 
-	return g_ErrorLevel->Assign(ERRORLEVEL_NONE); // Indicate success.
+static void ImageSearchFree(ImageSearchTemplate &aImage)
+{
+	free(aImage.pixel);
+	free(aImage.mask); // free() handles NULL.
 }
 
 
 
-/////////////////
-// Main Window //
-/////////////////
+// ImageSearch and ImageSearchAll keep the images they load in memory, since they're typically searched
+// for repeatedly (e.g. on every pass of a loop).  This skips loading and decoding the file each time.
+// An image is identified by its full path, the size it was loaded at and its icon number.  The file's
+// last-write time is checked upon each use so that an image that changed on disk is loaded again.  So is
+// the screen's color depth, since the image's pixels are converted to match it (e.g. 16-bit) when loaded.
+struct ImageCacheItem
+{
+	char *filespec; // The full path, or as specified if that can't be determined.
+	int width, height, icon_number; // As specified by the script (i.e. before the image was loaded).
+	FILETIME last_write;
+	int screen_bits_per_pixel; // The screen's color depth when the image was loaded.
+	ImageSearchTemplate image; // Everything but trans_color and variation, which don't affect loading.
+	UINT last_used; // For discarding the least recently used item when the cache is full.
+};
+#define IMAGE_CACHE_SIZE 32
+static ImageCacheItem sImageCache[IMAGE_CACHE_SIZE];
+static int sImageCacheCount = 0;
+static UINT sImageCacheUses = 0, sImageCacheHits = 0, sImageCacheMisses = 0;
 
-LRESULT CALLBACK MainWindowProc(HWND hWnd, UINT iMsg, WPARAM wParam, LPARAM lParam)
+static void ImageCacheRemove(int aIndex)
 {
-	int i;
-	DWORD dwTemp;
+	free(sImageCache[aIndex].filespec);
+	ImageSearchFree(sImageCache[aIndex].image);
+	// Move the last item into the vacated slot to keep the array contiguous:
+	if (aIndex != --sImageCacheCount)
+		sImageCache[aIndex] = sImageCache[sImageCacheCount];
+}
 
-	// Detect Explorer crashes so that tray icon can be recreated.  I think this only works on Win98
-	// and beyond, since the feature was never properly implemented in Win95:
-	static UINT WM_TASKBARCREATED = RegisterWindowMessage("TaskbarCreated");
 
-	// See GuiWindowProc() for details about this first section:
-	LRESULT msg_reply;
-	if (g_MsgMonitorCount // Count is checked here to avoid function-call overhead.
-		&& (!g->CalledByIsDialogMessageOrDispatch || g->CalledByIsDialogMessageOrDispatchMsg != iMsg) // v1.0.44.11: If called by IsDialog or Dispatch but they changed the message number, check if the script is monitoring that new number.
-		&& MsgMonitor(hWnd, iMsg, wParam, lParam, NULL, msg_reply))
-		return msg_reply; // MsgMonitor has returned "true", indicating that this message should be omitted from further processing.
-	g->CalledByIsDialogMessageOrDispatch = false; // v1.0.40.01.
 
-	TRANSLATE_AHK_MSG(iMsg, wParam)
-	
+static bool ImageCacheGet(char *aFilespec, int aWidth, int aHeight, int aIconNumber, HDC aHdc
+	, ImageSearchTemplate &aImage)
+// Sets aImage's pixels and dimensions to those of the specified image, loading it first if it isn't in
+// the cache.  Returns false upon failure.  The caller must not free the pixels, which remain valid until
+// the next call to this function or to ImageCacheClear().
+{
+	char full_path[MAX_PATH], *filespec = aFilespec, *filename_marker;
+	if (GetFullPathName(aFilespec, sizeof(full_path), full_path, &filename_marker))
+		filespec = full_path;
+	// Get the file's last-write time.  It's left zero if the file can't be found (e.g. an icon specified as
+	// "shell32.dll", which LoadPicture() finds via the search path), in which case the image is cached
+	// for as long as the name stays the same.
+	FILETIME last_write = {0};
+	WIN32_FIND_DATA find_data;
+	HANDLE file_search = FindFirstFile(filespec, &find_data);
+	if (file_search != INVALID_HANDLE_VALUE)
+	{
+		last_write = find_data.ftLastWriteTime;
+		FindClose(file_search);
+	}
+	int screen_bits_per_pixel = GetDeviceCaps(aHdc, BITSPIXEL);
+
+	int i, lru = 0;
+	for (i = 0; i < sImageCacheCount; ++i)
+	{
+		ImageCacheItem &item = sImageCache[i];
+		if (item.width == aWidth && item.height == aHeight && item.icon_number == aIconNumber
+			&& !stricmp(item.filespec, filespec))
+		{
+			if (CompareFileTime(&item.last_write, &last_write) // The file changed, so discard the old image.
+				|| item.screen_bits_per_pixel != screen_bits_per_pixel) // Same if the screen's color depth changed.
+			{
+				ImageCacheRemove(i);
+				break;
+			}
+			++sImageCacheHits;
+			item.last_used = ++sImageCacheUses;
+			aImage.pixel = item.image.pixel;
+			aImage.mask = item.image.mask;
+			aImage.width = item.image.width;
+			aImage.height = item.image.height;
+			aImage.is_16bit = item.image.is_16bit;
+			return true;
+		}
+		if (item.last_used < sImageCache[lru].last_used)
+			lru = i;
+	}
+
+	++sImageCacheMisses;
+	ImageSearchTemplate image;
+	if (!ImageSearchDecode(aFilespec, aWidth, aHeight, aIconNumber, aHdc, image)) // aFilespec vs. filespec to load it exactly as before.
+		return false;
+	if (   !(filespec = _strdup(filespec))   )
+	{
+		ImageSearchFree(image);
+		return false;
+	}
+	if (sImageCacheCount == IMAGE_CACHE_SIZE) // Discard the least recently used item to make room.
+		ImageCacheRemove(lru);
+	ImageCacheItem &item = sImageCache[sImageCacheCount++];
+	item.filespec = filespec;
+	item.width = aWidth;
+	item.height = aHeight;
+	item.icon_number = aIconNumber;
+	item.last_write = last_write;
+	item.screen_bits_per_pixel = screen_bits_per_pixel;
+	item.image = image;
+	item.last_used = ++sImageCacheUses;
+	aImage.pixel = image.pixel;
+	aImage.mask = image.mask;
+	aImage.width = image.width;
+	aImage.height = image.height;
+	aImage.is_16bit = image.is_16bit;
+	return true;
+}
+
+
+
+void ImageCacheGetCounts(UINT &aHits, UINT &aMisses)
+// Provides the /Benchmark switch with the number of times an image was found in the cache and the
+// number of times it had to be loaded.
+{
+	aHits = sImageCacheHits;
+	aMisses = sImageCacheMisses;
+}
+
+
+
+static char *ImageSearchParseOptions(char *aImageFile, int &aVariation, COLORREF &aTransColor, bool &aPyramid
+	, int &aIconNumber, int &aWidth, int &aHeight)
+// Parses the asterisk-options that precede the filename in aImageFile (the ImageFile parameter of
+// ImageSearch).  Returns the filename, or NULL if an option is invalid.
+{
+	// Options are done as asterisk+option to permit future expansion.
+	// Set defaults to be possibly overridden by any specified options:
+	int variation = 0;
+	COLORREF trans_color = CLR_NONE; // The default must be a value that can't occur naturally in an image.
+	bool pyramid = false;
+	int icon_number = 0; // Zero means "load icon or bitmap (doesn't matter)".
+	int width = 0, height = 0;
+	// For icons, override the default to be 16x16 because that is what is sought 99% of the time.
+	// This new default can be overridden by explicitly specifying w0 h0:
+	char *cp = strrchr(aImageFile, '.');
+	if (cp)
+	{
+		++cp;
+		if (!(stricmp(cp, "ico") && stricmp(cp, "exe") && stricmp(cp, "dll")))
+			width = GetSystemMetrics(SM_CXSMICON), height = GetSystemMetrics(SM_CYSMICON);
+	}
+
+	char color_name[32], *dp;
+	cp = omit_leading_whitespace(aImageFile); // But don't alter aImageFile yet in case it contains literal whitespace we want to retain.
+	while (*cp == '*')
+	{
+		++cp;
+		switch (toupper(*cp))
+		{
+		case 'W': width = ATOI(cp + 1); break;
+		case 'H': height = ATOI(cp + 1); break;
+		default:
+			if (!strnicmp(cp, "Icon", 4))
+			{
+				cp += 4;  // Now it's the character after the word.
+				icon_number = ATOI(cp); // LoadPicture() correctly handles any negative value.
+			}
+			else if (!strnicmp(cp, "Trans", 5))
+			{
+				cp += 5;  // Now it's the character after the word.
+				// Isolate the color name/number for ColorNameToBGR():
+				strlcpy(color_name, cp, sizeof(color_name));
+				if (dp = StrChrAny(color_name, " \t")) // Find space or tab, if any.
+					*dp = '\0';
+				// Fix for v1.0.44.10: Treat trans_color as containing an RGB value (not BGR) so that it matches
+				// the documented behavior.  In older versions, a specified color like "TransYellow" was wrong in
+				// every way (inverted) and a specified numeric color like "Trans0xFFFFAA" was treated as BGR vs. RGB.
+				trans_color = ColorNameToBGR(color_name);
+				if (trans_color == CLR_NONE) // A matching color name was not found, so assume it's in hex format.
+					// It seems strtol() automatically handles the optional leading "0x" if present:
+					trans_color = strtol(color_name, NULL, 16);
+					// if color_name did not contain something hex-numeric, black (0x00) will be assumed,
+					// which seems okay given how rare such a problem would be.
+				else
+					trans_color = bgr_to_rgb(trans_color); // v1.0.44.10: See fix/comment above.
+
+			}
+			else if (!strnicmp(cp, "Pyramid", 7)) // Search a reduced copy of the screen first, which is faster for large images and regions.
+				pyramid = true;
+			else // Assume it's a number since that's the only other asterisk-option.
+			{
+				variation = ATOI(cp); // Seems okay to support hex via ATOI because the space after the number is documented as being mandatory.
+				if (variation < 0)
+					variation = 0;
+				if (variation > 255)
+					variation = 255;
+				// Note: because it's possible for filenames to start with a space (even though Explorer itself
+				// won't let you create them that way), allow exactly one space between end of option and the
+				// filename itself:
+			}
+		} // switch()
+		if (   !(cp = StrChrAny(cp, " \t"))   ) // Find the first space or tab after the option.
+			return NULL; // Bad option/format.
+		// Now it's the space or tab (if there is one) after the option letter.  Advance by exactly one character
+		// because only one space or tab is considered the delimiter.  Any others are considered to be part of the
+		// filename (though some or all OSes might simply ignore them or tolerate them as first-try match criteria).
+		aImageFile = ++cp; // This should now point to another asterisk or the filename itself.
+		// Above also serves to reset the filename to omit the option string whenever at least one asterisk-option is present.
+		cp = omit_leading_whitespace(cp); // This is done to make it more tolerant of having more than one space/tab between options.
+	}
+
+	aVariation = variation;
+	aTransColor = trans_color;
+	aPyramid = pyramid;
+	aIconNumber = icon_number;
+	aWidth = width;
+	aHeight = height;
+	return aImageFile;
+}
+
+
+
+static bool ImageSearchLoad(char *aImageFile, HDC aHdc, ImageSearchTemplate &aImage)
+// Sets aImage to the image that ImageSearch is to find, which is aImageFile preceded by any asterisk-options.
+// Returns false upon failure.  The image's pixels belong to the cache (see ImageCacheGet()).
+{
+	int icon_number, width, height;
+	if (   !(aImageFile = ImageSearchParseOptions(aImageFile, aImage.variation, aImage.trans_color, aImage.pyramid
+		, icon_number, width, height))   )
+		return false;
+	return ImageCacheGet(aImageFile, width, height, icon_number, aHdc, aImage);
+}
+
+
+
+ResultType Line::ImageCacheClear(char *aImageFile)
+// Removes the specified image from the cache of images loaded by ImageSearch (regardless of which size
+// or icon number it was loaded with), or all images if aImageFile is blank.  Any asterisk-options in
+// aImageFile are ignored, so the same string as was given to ImageSearch can be used.
+{
+	int i, removed_count = 0;
+	if (!*aImageFile)
+	{
+		removed_count = sImageCacheCount;
+		while (sImageCacheCount)
+			ImageCacheRemove(sImageCacheCount - 1);
+	}
+	else
+	{
+		int variation, icon_number, width, height;
+		COLORREF trans_color;
+		bool pyramid;
+		char full_path[MAX_PATH], *filename_marker;
+		if (   !(aImageFile = ImageSearchParseOptions(aImageFile, variation, trans_color, pyramid, icon_number, width, height))   )
+			return g_ErrorLevel->Assign(ERRORLEVEL_ERROR);
+		if (GetFullPathName(aImageFile, sizeof(full_path), full_path, &filename_marker))
+			aImageFile = full_path;
+		for (i = sImageCacheCount - 1; i >= 0; --i) // Backward because ImageCacheRemove() moves the last item.
+		{
+			if (!stricmp(sImageCache[i].filespec, aImageFile))
+			{
+				ImageCacheRemove(i);
+				++removed_count;
+			}
+		}
+	}
+	return g_ErrorLevel->Assign(removed_count ? ERRORLEVEL_NONE : ERRORLEVEL_ERROR); // 1 indicates there was nothing to remove.
+}
+
+
+
+ResultType Line::ImageSearch(int aLeft, int aTop, int aRight, int aBottom, char *aImageFile)
+// Author: ImageSearch was created by Aurelian Maga.
+{
+	// Many of the following sections are similar to those in PixelSearch(), so they should be
+	// maintained together.
+	Var *output_var_x = ARGVAR1;  // Ok if NULL. RAW wouldn't be safe because load-time validation actually
+	Var *output_var_y = ARGVAR2;  // requires a minimum of zero parameters so that the output-vars can be optional. Also:
+	// Load-time validation has ensured that these are valid output variables (e.g. not built-in vars).
+
+	// Set default results, both ErrorLevel and output variables, in case of early return:
+	g_ErrorLevel->Assign(ERRORLEVEL_ERROR2);  // 2 means error other than "image not found".
+	if (output_var_x)
+		output_var_x->Assign();  // Init to empty string regardless of whether we succeed here.
+	if (output_var_y)
+		output_var_y->Assign(); // Same.
+
+	RECT rect = {0}; // Set default (for CoordMode == "screen").
+	if (!(g->CoordMode & COORD_MODE_PIXEL)) // Using relative vs. screen coordinates.
+	{
+		if (!GetWindowRect(GetForegroundWindow(), &rect))
+			return OK; // Let ErrorLevel tell the story.
+		aLeft   += rect.left;
+		aTop    += rect.top;
+		aRight  += rect.left;  // Add left vs. right because we're adjusting based on the position of the window.
+		aBottom += rect.top;   // Same.
+	}
+
+	HDC hdc = GetDC(NULL);
+	if (!hdc)
+		return OK; // Let ErrorLevel tell the story.
+
+	ImageSearchTemplate image;
+	if (!ImageSearchLoad(aImageFile, hdc, image))
+	{
+		ReleaseDC(NULL, hdc);
+		return OK; // Let ErrorLevel tell the story.
+	}
+
+	LONG screen_width, screen_height;
+	bool screen_is_16bit;
+	LPCOLORREF screen_pixel = CaptureScreen(hdc, aLeft, aTop, aRight, aBottom, screen_width, screen_height, screen_is_16bit);
+	ReleaseDC(NULL, hdc);
+
+	// Search the specified region for the first occurrence of the image.  This used to be done by a pair of
+	// loops here (one for exact matches and one for variation), but it's now done by image_search.cpp, which
+	// works only on the pixel buffers.
+	POINT *match = NULL;
+	int match_count = screen_pixel
+		? ImageSearchFind(screen_pixel, screen_width, screen_height, screen_is_16bit, image, match, 1)
+		: -1; // Leave ErrorLevel set to 2.
+	free(screen_pixel); // free() handles NULL.
+	if (match_count < 1)
+	{
+		free(match);
+		if (!match_count)
+			g_ErrorLevel->Assign(ERRORLEVEL_ERROR); // "1" indicates search completed okay, but didn't find it.
+		return OK; // Let ErrorLevel, which is either "1" or "2" as set earlier, tell the story.
+	}
+	int x = match->x, y = match->y;
+	free(match);
+
+	// Otherwise, success.  Calculate xpos and ypos of where the match was found and adjust
+	// coords to make them relative to the position of the target window (rect will contain
+	// zeroes if this doesn't need to be done):
+	if (output_var_x && !output_var_x->Assign((aLeft + x) - rect.left))
+		return FAIL;
+	if (output_var_y && !output_var_y->Assign((aTop + y) - rect.top))
+		return FAIL;
+
+	return g_ErrorLevel->Assign(ERRORLEVEL_NONE); // Indicate success.
+}
+
+
+
+ResultType Line::ImageSearchAll(int aLeft, int aTop, int aRight, int aBottom, char *aImageFiles, int aMaxPerImage)
+// Like ImageSearch, but searches for each of the |-delimited images in aImageFiles within a single capture
+// of the screen, and finds every position at which each occurs (or up to aMaxPerImage of them, if it's
+// greater than zero).  The output variable receives one line per match, each consisting of the image's
+// number (its position in aImageFiles, starting at 1), X and Y, separated by commas.
+{
+	Var &output_var = *OUTPUT_VAR;
+
+	// Set default results, both ErrorLevel and output variable, in case of early return:
+	g_ErrorLevel->Assign(ERRORLEVEL_ERROR2);  // 2 means error other than "image not found".
+	output_var.Assign();
+
+	RECT rect = {0}; // Set default (for CoordMode == "screen").
+	if (!(g->CoordMode & COORD_MODE_PIXEL)) // Using relative vs. screen coordinates.
+	{
+		if (!GetWindowRect(GetForegroundWindow(), &rect))
+			return OK; // Let ErrorLevel tell the story.
+		aLeft   += rect.left;
+		aTop    += rect.top;
+		aRight  += rect.left;  // Add left vs. right because we're adjusting based on the position of the window.
+		aBottom += rect.top;   // Same.
+	}
+
+	HDC hdc = GetDC(NULL);
+	if (!hdc)
+		return OK; // Let ErrorLevel tell the story.
+
+	LONG screen_width, screen_height;
+	bool screen_is_16bit;
+	LPCOLORREF screen_pixel = CaptureScreen(hdc, aLeft, aTop, aRight, aBottom, screen_width, screen_height, screen_is_16bit);
+	if (!screen_pixel)
+	{
+		ReleaseDC(NULL, hdc);
+		return OK; // Let ErrorLevel tell the story.
+	}
+
+	// Search for each image in turn, appending its matches to result:
+	char image_file[MAX_PATH * 2], *cp, *next, *result = NULL, *new_result;
+	size_t result_length = 0, result_size = 0;
+	ImageSearchTemplate image;
+	POINT *match;
+	int i, match_count, image_number;
+	ResultType result_to_return = OK;
+	for (cp = aImageFiles, image_number = 1; ; cp = next + 1, ++image_number)
+	{
+		if (   !(next = strchr(cp, '|'))   )
+			next = cp + strlen(cp);
+		cp = omit_leading_whitespace(cp); // Allow spaces around each "|", e.g. "a.bmp | b.bmp".
+		strlcpy(image_file, cp, min((size_t)(next - cp) + 1, sizeof(image_file))); // Filenames can't contain '|', so no escaping is needed.
+		rtrim(image_file);
+		if (!ImageSearchLoad(image_file, hdc, image))
+			goto end; // Leave ErrorLevel set to 2.
+		match = NULL;
+		if (   (match_count = ImageSearchFind(screen_pixel, screen_width, screen_height, screen_is_16bit, image
+			, match, aMaxPerImage)) == -1   )
+		{
+			free(match);
+			goto end;
+		}
+		// Each line is at most 3 numbers (up to 11 characters each), 2 commas and a linefeed:
+		if (result_length + match_count * 36 + 1 > result_size)
+		{
+			result_size = (result_length + match_count * 36 + 1) * 2;
+			if (   !(new_result = (char *)realloc(result, result_size))   )
+			{
+				free(match);
+				goto end;
+			}
+			result = new_result;
+		}
+		for (i = 0; i < match_count; ++i)
+			result_length += sprintf(result + result_length, "%d,%d,%d\n", image_number
+				, (aLeft + match[i].x) - rect.left, (aTop + match[i].y) - rect.top); // See ImageSearch() for comments about rect.
+		free(match);
+		if (!*next)
+			break;
+	}
+
+	if (result_length) // Omit the last linefeed, as other commands that produce lists do.
+	{
+		result[--result_length] = '\0';
+		if (   !(result_to_return = output_var.Assign(result, (VarSizeType)result_length))   )
+			goto end;
+		g_ErrorLevel->Assign(ERRORLEVEL_NONE); // Indicate success.
+	}
+	else
+		g_ErrorLevel->Assign(ERRORLEVEL_ERROR); // "1" indicates search completed okay, but didn't find any.
+
+end:
+	ReleaseDC(NULL, hdc);
+	free(screen_pixel);
+	free(result); // free() handles NULL.
+	return result_to_return;
+}
+
+
+
+/////////////////
+// Main Window //
+/////////////////
+
+LRESULT CALLBACK MainWindowProc(HWND hWnd, UINT iMsg, WPARAM wParam, LPARAM lParam)
+{
+	int i;
+	DWORD dwTemp;
+
+	// Detect Explorer crashes so that tray icon can be recreated.  I think this only works on Win98
+	// and beyond, since the feature was never properly implemented in Win95:
+	static UINT WM_TASKBARCREATED = RegisterWindowMessage("TaskbarCreated");
+
+	// See GuiWindowProc() for details about this first section:
+	LRESULT msg_reply;
+	if (g_MsgMonitorCount // Count is checked here to avoid function-call overhead.
+		&& (!g->CalledByIsDialogMessageOrDispatch || g->CalledByIsDialogMessageOrDispatchMsg != iMsg) // v1.0.44.11: If called by IsDialog or Dispatch but they changed the message number, check if the script is monitoring that new number.
+		&& MsgMonitor(hWnd, iMsg, wParam, lParam, NULL, msg_reply))
+		return msg_reply; // MsgMonitor has returned "true", indicating that this message should be omitted from further processing.
+	g->CalledByIsDialogMessageOrDispatch = false; // v1.0.40.01.
+
+	TRANSLATE_AHK_MSG(iMsg, wParam)
+	
 	switch (iMsg)
 	{
 	case WM_COMMAND:
@@ -8701,6 +8891,8 @@ ResultType Line::FileRead(char *aFilespec)
 		}
 	} // for()
 
+	FileAppendCacheRelease(aFilespec); // Any text of it still buffered by #FileAppendBuffer must be read too.
+
 	// It seems more flexible to allow other processes to read and write the file while we're reading it.
 	// For example, this allows the file to be appended to during the read operation, which could be
 	// desirable, especially it's a very large log file that would take a long time to read.
@@ -8782,54 +8974,371 @@ ResultType Line::FileRead(char *aFilespec)
 
 
 
-ResultType Line::FileReadLine(char *aFilespec, char *aLineNumber)
-// Returns OK or FAIL.  Will almost always return OK because if an error occurs,
-// the script's ErrorLevel variable will be set accordingly.  However, if some
-// kind of unexpected and more serious error occurs, such as variable-out-of-memory,
-// that will cause FAIL to be returned.
+struct LineIndexType
+// An index of where each line of a file starts, so that FileReadLine can seek directly to any line.
 {
-	Var &output_var = *OUTPUT_VAR; // Fix for v1.0.45.01: Must be resolved and saved before MsgSleep() (LONG_OPERATION) because that allows some other thread to interrupt and overwrite sArgVar[].
+	char mFilespec[MAX_PATH]; // Full path so that SetWorkingDir doesn't affect the matching.
+	__int64 mFileSize;        // mFileSize and mLastWrite tell whether the file has changed since the index
+	FILETIME mLastWrite;      // was built.
+	__int64 *mOffset;         // mOffset[i] is where line i+1 starts.  mOffset[mLineCount] is where the last line ends.
+	size_t mLineCount;
+	UINT mLastUsed;           // Used to discard the least recently used index when the cache is full.
+};
+#define LINE_INDEX_CACHE_SIZE 4
+static LineIndexType sLineIndex[LINE_INDEX_CACHE_SIZE];
+static int sLineIndexCount = 0;
+static UINT sLineIndexUseCount = 0;
+
+
+
+static bool LineIndexBuild(HANDLE aFile, LineIndexType &aIndex)
+// Reads aFile from the top in one pass and sets aIndex.mOffset and mLineCount.  The lines are the same
+// ones that fgets() would return in text mode with FileReadLine's buffer size: \r\n counts as one
+// character, a line longer than the buffer is split into more than one, and Ctrl-Z ends the file.
+// Returns false if out of memory or the file couldn't be read.
+{
+	#define LINE_INDEX_MAX_CHARS (READ_FILE_LINE_SIZE - 2) // The longest "line" fgets() returns (see FileReadLine()).
+	size_t capacity = 1024, count = 0, chars = 0;
+	__int64 *offset, *new_offset;
+	if (   !(offset = (__int64 *)malloc(capacity * sizeof(__int64)))   )
+		return false;
+	offset[0] = 0;
+
+	// Ends the current line at aEndPos, which is also where the next line starts:
+	#define LINE_INDEX_END_LINE(aEndPos) \
+	{\
+		if (++count == capacity)\
+		{\
+			if (   !(new_offset = (__int64 *)realloc(offset, (capacity *= 2) * sizeof(__int64)))   )\
+				goto fail;\
+			offset = new_offset;\
+		}\
+		offset[count] = (aEndPos);\
+		chars = 0;\
+	}
+	#define LINE_INDEX_ADD_CHAR(aEndPos) \
+	{\
+		if (++chars == LINE_INDEX_MAX_CHARS)\
+			LINE_INDEX_END_LINE(aEndPos)\
+	}
+
+	LONG_OPERATION_INIT
+	char buf[READ_FILE_LINE_SIZE];
+	DWORD i, bytes_read;
+	__int64 pos = 0, end_pos; // pos is the file position of buf[0].
+	bool pending_cr = false;  // Whether the previous byte was a \r not yet known to be part of a \r\n.
+	for (;;)
+	{
+		if (!ReadFile(aFile, buf, sizeof(buf), &bytes_read, NULL))
+			goto fail;
+		if (!bytes_read)
+			break;
+		for (i = 0; i < bytes_read; ++i)
+		{
+			if (pending_cr)
+			{
+				pending_cr = false;
+				if (buf[i] == '\n') // \r\n is a single newline character in text mode.
+				{
+					LINE_INDEX_END_LINE(pos + i + 1)
+					continue;
+				}
+				LINE_INDEX_ADD_CHAR(pos + i) // A lone \r is an ordinary character.
+			}
+			switch (buf[i])
+			{
+			case 26: // Ctrl-Z: text mode treats it as the end of the file.
+				end_pos = pos + i;
+				goto end_of_file;
+			case '\r':
+				pending_cr = true;
+				break;
+			case '\n':
+				LINE_INDEX_END_LINE(pos + i + 1)
+				break;
+			default:
+				LINE_INDEX_ADD_CHAR(pos + i + 1)
+			}
+		}
+		pos += bytes_read;
+		LONG_OPERATION_UPDATE
+	}
+	end_pos = pos;
+	if (pending_cr)
+		LINE_INDEX_ADD_CHAR(end_pos)
+end_of_file:
+	if (chars) // The last line has no newline.
+		LINE_INDEX_END_LINE(end_pos)
+	aIndex.mOffset = offset;
+	aIndex.mLineCount = count;
+	return true;
+fail:
+	free(offset);
+	return false;
+	#undef LINE_INDEX_ADD_CHAR
+	#undef LINE_INDEX_END_LINE
+}
+
+
+
+static LineIndexType *LineIndexAdd(LineIndexType &aIndex)
+// Puts aIndex into the cache in place of any older index of the same file, discarding the least
+// recently used index if the cache is full.  Returns the cached copy.
+{
+	int i;
+	for (i = 0; i < sLineIndexCount; ++i)
+		if (!stricmp(sLineIndex[i].mFilespec, aIndex.mFilespec))
+			break;
+	if (i < sLineIndexCount) // Found an outdated index of the same file.
+		free(sLineIndex[i].mOffset);
+	else if (sLineIndexCount < LINE_INDEX_CACHE_SIZE)
+		++sLineIndexCount;
+	else
+	{
+		int lru = 0;
+		for (i = 1; i < sLineIndexCount; ++i)
+			if (sLineIndex[i].mLastUsed < sLineIndex[lru].mLastUsed)
+				lru = i;
+		free(sLineIndex[i = lru].mOffset);
+	}
+	sLineIndex[i] = aIndex;
+	return sLineIndex + i;
+}
+
+
+
+ResultType Line::FileReadLine(char *aFilespec, char *aLineNumber)
+// Returns OK or FAIL.  Will almost always return OK because if an error occurs,
+// the script's ErrorLevel variable will be set accordingly.  However, if some
+// kind of unexpected and more serious error occurs, such as variable-out-of-memory,
+// that will cause FAIL to be returned.
+// Rather than reading the file from the top every time, this uses an index of where each line starts
+// (see LineIndexBuild()), which is kept for subsequent calls until the file's size or modification
+// time changes.  This makes a loop that reads each line of a large file by number O(N) instead of O(N^2).
+{
+	Var &output_var = *OUTPUT_VAR; // Fix for v1.0.45.01: Must be resolved and saved before MsgSleep() (LONG_OPERATION) because that allows some other thread to interrupt and overwrite sArgVar[].
 
 	g_ErrorLevel->Assign(ERRORLEVEL_ERROR); // Set default ErrorLevel.
 	__int64 line_number = ATOI64(aLineNumber);
 	if (line_number < 1)
 		return OK;  // Return OK because g_ErrorLevel tells the story.
-	FILE *fp = fopen(aFilespec, "r");
-	if (!fp)
-		return OK;  // Return OK because g_ErrorLevel tells the story.
-
-	// Remember that once the first call to MsgSleep() is done, a new hotkey subroutine
-	// may fire and suspend what we're doing here.  Such a subroutine might also overwrite
-	// the values our params, some of which may be in the deref buffer.  So be sure not
-	// to refer to those strings once MsgSleep() has been done, below.  Alternatively,
-	// a copy of such params can be made using our own stack space.
 
-	LONG_OPERATION_INIT
+	// Remember that once the first call to MsgSleep() is done (by LineIndexBuild()), a new hotkey
+	// subroutine may fire and suspend what we're doing here.  Such a subroutine might also overwrite
+	// the values our params, some of which may be in the deref buffer.  So aFilespec is resolved
+	// into our own buffer beforehand.  The interrupting subroutine might also use FileReadLine, which
+	// is why the index is built separately and only then put into the cache.
+	LineIndexType index, *found = NULL;
+	char *unused;
+	DWORD length = GetFullPathName(aFilespec, sizeof(index.mFilespec), index.mFilespec, &unused);
+	if (!length || length >= sizeof(index.mFilespec))
+		return OK;  // Return OK because g_ErrorLevel tells the story.
+	FileAppendCacheRelease(index.mFilespec); // Also keeps the index from being built from a partly written file.
+	// Share mode is the same as fopen()'s so that files being written by other programs can be read:
+	HANDLE hfile = CreateFile(index.mFilespec, GENERIC_READ, FILE_SHARE_READ|FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (hfile == INVALID_HANDLE_VALUE)
+		return OK;
+	DWORD size_high, size_low = GetFileSize(hfile, &size_high);
+	if (size_low == INVALID_FILE_SIZE && GetLastError() != NO_ERROR || !GetFileTime(hfile, NULL, NULL, &index.mLastWrite))
+	{
+		CloseHandle(hfile);
+		return OK;
+	}
+	index.mFileSize = ((__int64)size_high << 32) | size_low;
 
-	char buf[READ_FILE_LINE_SIZE];
-	for (__int64 i = 0; i < line_number; ++i)
+	for (int i = 0; i < sLineIndexCount; ++i)
+		if (!stricmp(sLineIndex[i].mFilespec, index.mFilespec))
+		{
+			if (sLineIndex[i].mFileSize == index.mFileSize && !CompareFileTime(&sLineIndex[i].mLastWrite, &index.mLastWrite))
+				found = sLineIndex + i;
+			//else the file has changed, so the index is rebuilt below and replaces this one.
+			break;
+		}
+	if (!found)
 	{
-		if (fgets(buf, sizeof(buf) - 1, fp) == NULL) // end-of-file or error
+		if (!LineIndexBuild(hfile, index))
 		{
-			fclose(fp);
-			return OK;  // Return OK because g_ErrorLevel tells the story.
+			CloseHandle(hfile);
+			return OK;
 		}
-		LONG_OPERATION_UPDATE
+		found = LineIndexAdd(index);
+	}
+	found->mLastUsed = ++sLineIndexUseCount;
+
+	if ((unsigned __int64)line_number > found->mLineCount)
+	{
+		CloseHandle(hfile);
+		return OK;  // Return OK because g_ErrorLevel tells the story.
+	}
+	// Read the line's bytes.  A line never spans more than twice the size of fgets()'s buffer
+	// (i.e. when every character is a \r\n), so this allocation is bounded:
+	__int64 line_start = found->mOffset[line_number - 1];
+	DWORD bytes_to_read = (DWORD)(found->mOffset[line_number] - line_start), bytes_read;
+	LONG start_high = (LONG)(line_start >> 32);
+	char *buf = (char *)malloc(bytes_to_read + 1);
+	if (!buf
+		|| SetFilePointer(hfile, (LONG)line_start, &start_high, FILE_BEGIN) == INVALID_SET_FILE_POINTER && GetLastError() != NO_ERROR
+		|| !ReadFile(hfile, buf, bytes_to_read, &bytes_read, NULL))
+	{
+		free(buf);
+		CloseHandle(hfile);
+		return OK;
 	}
-	fclose(fp);
+	CloseHandle(hfile);
 
-	size_t buf_length = strlen(buf);
+	// Translate the line the same way text mode would (\r\n to \n), then remove the trailing newline.
+	// bytes_read might be less than expected if the file was truncated since it was checked above.
+	size_t buf_length = 0;
+	for (DWORD j = 0; j < bytes_read; ++j)
+		if (buf[j] != '\r' || j + 1 == bytes_read || buf[j + 1] != '\n')
+			buf[buf_length++] = buf[j];
+	buf[buf_length] = '\0';
+	buf_length = strlen(buf); // Like fgets(), anything after a binary zero is ignored.
 	if (buf_length && buf[buf_length - 1] == '\n') // Remove any trailing newline for the user.
 		buf[--buf_length] = '\0';
+	ResultType result;
 	if (!buf_length)
+		result = output_var.Assign(); // Explicitly call it this way so that it won't free the memory.
+	else
+		result = output_var.Assign(buf, (VarSizeType)buf_length);
+	free(buf);
+	if (!result)
+		return FAIL;
+	return g_ErrorLevel->Assign(ERRORLEVEL_NONE); // Indicate success.
+}
+
+
+
+struct FileAppendCacheItem
+{
+	char mFilespec[MAX_PATH]; // Full path so that SetWorkingDir doesn't affect the matching.
+	FILE *mFile;
+	bool mIsBinary;
+	UINT mLastUsed; // Used to close the least recently used file when the cache is full.
+};
+#define FILE_APPEND_CACHE_SIZE 8
+static FileAppendCacheItem sFileAppendCache[FILE_APPEND_CACHE_SIZE];
+static int sFileAppendCacheCount = 0;
+static UINT sFileAppendCacheUseCount = 0;
+
+
+
+static bool FileAppendCacheFlushItem(FileAppendCacheItem &aItem, bool aClose)
+// Returns true unless the write (or the #FileAppendBuffer sync) failed.
+{
+	bool success = !fflush(aItem.mFile);
+	if (success && g_FileAppendSync) // Also make the OS write the data to disk.
+		success = !_commit(_fileno(aItem.mFile));
+	if (aClose && fclose(aItem.mFile))
+		success = false;
+	return success;
+}
+
+
+
+static FILE *FileAppendCacheOpen(char *aFilespec, bool aIsBinary)
+// Returns the cached file for aFilespec, opening it (and evicting another file if the cache is full)
+// if necessary.  Returns NULL if the file can't be opened, in which case the caller should fall back
+// to the normal method, which will report the failure.
+{
+	char full_path[MAX_PATH], *unused;
+	DWORD length = GetFullPathName(aFilespec, sizeof(full_path), full_path, &unused);
+	if (!length || length >= sizeof(full_path))
+		return NULL;
+
+	int i;
+	for (i = 0; i < sFileAppendCacheCount; ++i)
+		if (!stricmp(sFileAppendCache[i].mFilespec, full_path))
+			break;
+	if (i < sFileAppendCacheCount) // Found.
 	{
-		if (!output_var.Assign()) // Explicitly call it this way so that it won't free the memory.
-			return FAIL;
+		if (sFileAppendCache[i].mIsBinary == aIsBinary)
+		{
+			sFileAppendCache[i].mLastUsed = ++sFileAppendCacheUseCount;
+			return sFileAppendCache[i].mFile;
+		}
+		// Otherwise, the file has to be reopened in the other mode.  Closing it first writes out
+		// what was already buffered, so the order of the text in the file is kept.
+		FileAppendCacheFlushItem(sFileAppendCache[i], true);
+	}
+	else if (sFileAppendCacheCount == FILE_APPEND_CACHE_SIZE) // Cache is full, so close the least recently used file.
+	{
+		int lru = 0;
+		for (i = 1; i < sFileAppendCacheCount; ++i)
+			if (sFileAppendCache[i].mLastUsed < sFileAppendCache[lru].mLastUsed)
+				lru = i;
+		FileAppendCacheFlushItem(sFileAppendCache[i = lru], true);
 	}
 	else
-		if (!output_var.Assign(buf, (VarSizeType)buf_length))
-			return FAIL;
-	return g_ErrorLevel->Assign(ERRORLEVEL_NONE); // Indicate success.
+		i = sFileAppendCacheCount++;
+
+	FileAppendCacheItem &item = sFileAppendCache[i];
+	if (   !(item.mFile = fopen(full_path, aIsBinary ? "ab" : "a"))   )
+	{
+		item = sFileAppendCache[--sFileAppendCacheCount]; // Remove the slot by moving the last item into it.
+		return NULL;
+	}
+	// The stream's buffer does the coalescing: the CRT writes it out whenever it fills up.
+	setvbuf(item.mFile, NULL, _IOFBF, g_FileAppendBufferSize);
+	strcpy(item.mFilespec, full_path);
+	item.mIsBinary = aIsBinary;
+	item.mLastUsed = ++sFileAppendCacheUseCount;
+	return item.mFile;
+}
+
+
+
+bool Line::FileAppendCacheFlush(char *aFilespec, bool aClose)
+// Writes out the buffered text of the cached file aFilespec, or of all cached files if aFilespec is NULL.
+// If aClose is true, the files are also closed so that they can be deleted, moved, etc.
+// Returns false if any of the writes failed.
+{
+	char full_path[MAX_PATH], *unused;
+	if (aFilespec)
+	{
+		if (*aFilespec == '*') // Allow the binary-mode prefix used by FileAppend.
+			++aFilespec;
+		DWORD length = GetFullPathName(aFilespec, sizeof(full_path), full_path, &unused);
+		if (!length || length >= sizeof(full_path))
+			return true; // Such a file can't be in the cache.
+	}
+	bool success = true;
+	for (int i = 0; i < sFileAppendCacheCount;)
+	{
+		if (aFilespec && stricmp(sFileAppendCache[i].mFilespec, full_path))
+		{
+			++i;
+			continue;
+		}
+		if (!FileAppendCacheFlushItem(sFileAppendCache[i], aClose))
+			success = false;
+		if (aClose)
+			sFileAppendCache[i] = sFileAppendCache[--sFileAppendCacheCount]; // Move the last item into this slot, then check this slot again.
+		else
+			++i;
+	}
+	if (!aFilespec || !sFileAppendCacheCount) // Nothing is left unflushed.
+		KILL_FILE_APPEND_TIMER
+	return success;
+}
+
+
+
+void Line::FileAppendCacheRelease(char *aFilePattern)
+// Called by the commands that read, delete, move, etc. files so that they never see a file cached by
+// #FileAppendBuffer with its text still unwritten, nor fail because FileAppend still has it open.
+// A pattern containing wildcards (or a NULL one, for the directory commands) releases all cached files.
+{
+	if (!sFileAppendCacheCount)
+		return;
+	FileAppendCacheFlush(!aFilePattern || StrChrAny(aFilePattern, "?*") ? NULL : aFilePattern, true);
+}
+
+
+
+VOID CALLBACK FileAppendTimeout(HWND hWnd, UINT uMsg, UINT idEvent, DWORD dwTime)
+{
+	Line::FileAppendCacheFlush(NULL, false); // It will also kill the timer.  The files are kept open for subsequent writes.
 }
 
 
@@ -8882,6 +9391,8 @@ ResultType Line::FileAppend(char *aFilespec, char *aBuf, LoopReadFileStruct *aCu
 				// 1) Duplicate clipboard formats not making sense (i.e. two CF_TEXT formats would cause the
 				//    first to be overwritten by the second when restoring to clipboard).
 				// 2) There is a 4-byte zero terminator at the end of the file.
+				if (sFileAppendCacheCount) // Close it in case it's cached, so that earlier text isn't written after this.
+					FileAppendCacheFlush(aFilespec, true);
 				if (   !(fp = fopen(aFilespec, "wb"))   ) // Overwrite.
 					return g_ErrorLevel->Assign(ERRORLEVEL_ERROR);
 				g_ErrorLevel->Assign(fwrite(ARGVAR1->Contents(), ARGVAR1->Length() + 1, 1, fp)
@@ -8911,6 +9422,26 @@ ResultType Line::FileAppend(char *aFilespec, char *aBuf, LoopReadFileStruct *aCu
 	//    file-modification time when no actual text will be appended).
 	if (!file_was_already_open)
 	{
+		// When #FileAppendBuffer is in effect, keep the file open and let the text accumulate in its
+		// buffer.  It's written out when the buffer fills, by the timer, by FileFlush, or upon exit.
+		// This doesn't apply to the output file of a file-reading loop, which is already kept open.
+		// Nor does it apply to empty text, which is written the same way as without buffering since the
+		// script is probably doing it to create the file or update its modification time.  Writing
+		// nothing to a file that's already open and cached wouldn't do either.
+		if (g_FileAppendBufferSize && !aCurrentReadFile)
+		{
+			if (!*aBuf)
+			{
+				if (sFileAppendCacheCount) // Close it in case it's cached, so that its earlier text is written first.
+					FileAppendCacheFlush(aFilespec, true);
+			}
+			else if (fp = FileAppendCacheOpen(aFilespec, open_as_binary))
+			{
+				g_ErrorLevel->Assign(fputs(aBuf, fp) ? ERRORLEVEL_ERROR : ERRORLEVEL_NONE); // fputs() returns 0 on success.
+				SET_FILE_APPEND_TIMER
+				return OK;
+			}
+		}
 		// Open the output file (if one was specified).  Unlike the input file, this is not
 		// a critical error if it fails.  We want it to be non-critical so that FileAppend
 		// commands in the body of the loop will set ErrorLevel to indicate the problem:
@@ -9096,6 +9627,8 @@ ResultType Line::FileDelete()
 	if (!*aFilePattern)
 		return OK;  // Let ErrorLevel indicate an error, since this is probably not what the user intended.
 
+	FileAppendCacheRelease(aFilePattern); // Otherwise, a file kept open by #FileAppendBuffer couldn't be deleted.
+
 	if (!StrChrAny(aFilePattern, "?*"))
 	{
 		if (DeleteFile(aFilePattern))
@@ -12390,112 +12923,138 @@ void BIF_InStr(ExprTokenType &aResultToken, ExprTokenType *aParam[], int aParamC
 
 
 
-pcre *get_compiled_regex(char *aRegEx, bool &aGetPositionsNotSubstrings, pcre_extra *&aExtra
-	, ExprTokenType *aResultToken)
-// Returns the compiled RegEx, or NULL on failure.
-// This function is called by things other than built-in functions so it should be kept general-purpose.
-// Upon failure, if aResultToken!=NULL:
-//   - ErrorLevel is set to a descriptive string other than "0".
-//   - *aResultToken is set up to contain an empty string.
-// Upon success, the following output parameters are set based on the options that were specified:
-//    aGetPositionsNotSubstrings
-//    aExtra
-//    (but it doesn't change ErrorLevel on success, not even if aResultToken!=NULL)
+struct RegExPrefilter // A cached RegEx's fast tier (see RegExExec()).
 {
-	// While reading from or writing to the cache, don't allow another thread entry.  This is because
-	// that thread (or this one) might write to the cache while the other one is reading/writing, which
-	// could cause loss of data integrity (the hook thread can enter here via #IfWin & SetTitleMatchMode RegEx).
-	// Together, Enter/LeaveCriticalSection reduce performance by only 1.4% in the tightest possible script
-	// loop that hits the first cache entry every time.  So that's the worst case except when there's an actual
-	// collision, in which case performance suffers more because internally, EnterCriticalSection() does a
-	// wait/semaphore operation, which is more costly.
-	// Finally, the code size of all critical-section features together is less than 512 bytes (uncompressed),
-	// so like performance, that's not a concern either.
-	EnterCriticalSection(&g_CriticalRegExCache); // Request ownership of the critical section. If another thread already owns it, this thread will block until the other thread finishes.
+	int length; // 0 means the RegEx is executed by PCRE alone.
+	char prefix[32]; // The literal text that every match begins with (not terminated).
+};
 
-	// SET UP THE CACHE.
-	// This is a very crude cache for linear search. Of course, hashing would be better in the sense that it
-	// would allow the cache to get much larger while still being fast (I believe PHP caches up to 4096 items).
-	// Binary search might not be such a good idea in this case due to the time required to find the right spot
-	// to insert a new cache item (however, items aren't inserted often, so it might perform quite well until
-	// the cache contained thousands of RegEx's, which is unlikely to ever happen in most scripts).
-	struct pcre_cache_entry
-	{
-		// For simplicity (and thus performance), the entire RegEx pattern including its options is cached
-		// is stored in re_raw and that entire string becomes the RegEx's unique identifier for the purpose
-		// of finding an entry in the cache.  Technically, this isn't optimal because some options like Study
-		// and aGetPositionsNotSubstrings don't alter the nature of the compiled RegEx.  However, the CPU time
-		// required to strip off some options prior to doing a cache search seems likely to offset much of the
-		// cache's benefit.  So for this reason, as well as rarity and code size issues, this policy seems best.
-		char *re_raw;      // The RegEx's literal string pattern such as "abc.*123".
-		pcre *re_compiled; // The RegEx in compiled form.
-		pcre_extra *extra; // NULL unless a study() was done (and NULL even then if study() didn't find anything).
-		// int pcre_options; // Not currently needed in the cache since options are implicitly inside re_compiled.
-		bool get_positions_not_substrings;
-	};
+// THE CACHE used by get_compiled_regex().
+// This is a very crude cache for linear search. Of course, hashing would be better in the sense that it
+// would allow the cache to get much larger while still being fast (I believe PHP caches up to 4096 items).
+// Binary search might not be such a good idea in this case due to the time required to find the right spot
+// to insert a new cache item (however, items aren't inserted often, so it might perform quite well until
+// the cache contained thousands of RegEx's, which is unlikely to ever happen in most scripts).
+struct pcre_cache_entry
+{
+	// For simplicity (and thus performance), the entire RegEx pattern including its options is cached
+	// is stored in re_raw and that entire string becomes the RegEx's unique identifier for the purpose
+	// of finding an entry in the cache.  Technically, this isn't optimal because some options like Study
+	// and aGetPositionsNotSubstrings don't alter the nature of the compiled RegEx.  However, the CPU time
+	// required to strip off some options prior to doing a cache search seems likely to offset much of the
+	// cache's benefit.  So for this reason, as well as rarity and code size issues, this policy seems best.
+	char *re_raw;      // The RegEx's literal string pattern such as "abc.*123".
+	pcre *re_compiled; // The RegEx in compiled form.
+	pcre_extra *extra; // NULL unless a study() was done (and NULL even then if study() didn't find anything).
+	// int pcre_options; // Not currently needed in the cache since options are implicitly inside re_compiled.
+	bool get_positions_not_substrings;
+	int use_count;             // The number of times the RegEx has been looked up, which is how hot patterns are recognized.
+	int pattern_offset;        // The position in re_raw of the pattern itself (i.e. after the options).
+	RegExPrefilter prefilter;  // The fast tier, if the RegEx has been promoted to it (i.e. prefilter.length > 0).
+};
 
-	#define PCRE_CACHE_SIZE 100 // Going too high would be counterproductive due to the slowness of linear search (and also the memory utilization of so many compiled RegEx's).
-	static pcre_cache_entry sCache[PCRE_CACHE_SIZE] = {{0}};
-	static int sLastInsert, sLastFound = -1; // -1 indicates "cache empty".
-	int insert_pos; // v1.0.45.03: This is used to avoid updating sLastInsert until an insert actually occurs (it might not occur if a compile error occurs in the regex, or something else stops it early).
+#define PCRE_CACHE_SIZE 100 // Going too high would be counterproductive due to the slowness of linear search (and also the memory utilization of so many compiled RegEx's).
+static pcre_cache_entry sRegExCache[PCRE_CACHE_SIZE] = {{0}}; // Protected by g_CriticalRegExCache.
+#define REGEX_HOT_USES 10 // The number of uses after which a RegEx is considered hot enough to analyze for the fast tier.
 
-	// CHECK IF THIS REGEX IS ALREADY IN THE CACHE.
-	if (sLastFound == -1) // Cache is empty, so insert this RegEx at the first position.
-		insert_pos = 0;  // A section further below will change sLastFound to be 0.
-	else
+static int RegExLiteralPrefix(char *aPattern, int aOptions, char *aBuf, int aBufSize)
+// Stores in aBuf the literal text that every match of aPattern must begin with, and returns its length
+// (0 if there isn't any, in which case the RegEx stays in the PCRE-only tier).  aBuf is not terminated.
+// This is deliberately conservative: anything it doesn't fully understand ends the prefix.
+{
+	// Caseless and extended mode change the meaning of literal text.  An anchored RegEx is only ever tried
+	// at the starting position, so there's nothing to skip ahead to.
+	if (aOptions & (PCRE_CASELESS | PCRE_EXTENDED | PCRE_ANCHORED))
+		return 0;
+	// A top-level alternative could begin with anything.  For simplicity, any '|' at all disqualifies the
+	// pattern, even one that's escaped or inside a subpattern.
+	if (strchr(aPattern, '|'))
+		return 0;
+	int length = 0;
+	char c, *cp;
+	for (cp = aPattern; length < aBufSize; aBuf[length++] = c)
 	{
-		// Search the cache to see if it contains the caller-specified RegEx in compiled form.
-		// First check if the last-found item is a match, since often it will be (such as cases
-		// where a script-loop executes only one RegEx, and also for SetTitleMatchMode RegEx).
-		if (!strcmp(aRegEx, sCache[sLastFound].re_raw)) // Match found (case sensitive).
-			goto match_found; // And no need to update sLastFound because it's already set right.
+		if (*cp == '\\')
+		{
+			// A backslash followed by a non-alphanumeric character is that character literally.  Anything
+			// else (\d, \b, \Q, backreferences, etc.) ends the prefix.
+			c = cp[1];
+			if (!c || c >= '0' && c <= '9' || c >= 'a' && c <= 'z' || c >= 'A' && c <= 'Z')
+				break;
+			cp += 2;
+		}
+		else
+		{
+			c = *cp;
+			if (!c || strchr("^$.[()*+?{", c))
+				break;
+			++cp;
+		}
+		if (*cp && strchr("*+?{", *cp)) // The character just found is quantified, so it might be absent or repeated.
+			break;
+	}
+	return length;
+}
 
-		// Since above didn't find a match, search outward in both directions from the last-found match.
-		// A bidirectional search is done because consecutively-called regex's tend to be adjacent to each other
-		// in the array, so performance is improved on average (since most of the time when repeating a previously
-		// executed regex, that regex will already be in the cache -- so optimizing the finding behavior is
-		// more important than optimizing the never-found-because-not-cached behavior).
-		bool go_right;
-		int i, item_to_check, left, right;
-		int last_populated_item = (sCache[PCRE_CACHE_SIZE-1].re_compiled) // When the array is full...
-			? PCRE_CACHE_SIZE - 1  // ...all items must be checked except the one already done earlier.
-			: sLastInsert;         // ...else only the items actually populated need to be checked.
 
-		for (go_right = true, left = sLastFound, right = sLastFound, i = 0
-			; i < last_populated_item  // This limits it to exactly the number of items remaining to be checked.
-			; ++i, go_right = !go_right)
+
+static int RegExExec(pcre *aRE, pcre_extra *aExtra, RegExPrefilter &aPrefilter, char *aHaystack, int aLength
+	, int aStartingOffset, int aOptions, int *aOffset, int aOffsetCount)
+// Same as pcre_exec() except that if the RegEx has been promoted to the prefilter tier, the haystack
+// is first scanned for the RegEx's literal prefix via memchr() (which the CRT implements a word at a
+// time) and memcmp().  PCRE is then started at the first occurrence, or skipped entirely if there is
+// none.  This is much faster than PCRE's own scan for the first character because PCRE has to enter
+// the matcher at each occurrence of that character.
+{
+	if (aPrefilter.length)
+	{
+		char *pos = aHaystack + aStartingOffset;
+		char *last = aHaystack + aLength - aPrefilter.length; // The last position at which the prefix could occur.
+		if (aOptions & PCRE_ANCHORED) // A match can only start at aStartingOffset.
 		{
-			if (go_right) // Proceed rightward in the array.
-			{
-				right = (right == last_populated_item) ? 0 : right + 1; // Increment or wrap around back to the left side.
-				item_to_check = right;
-			}
-			else // Proceed leftward.
-			{
-				left = (left == 0) ? last_populated_item : left - 1; // Decrement or wrap around back to the right side.
-				item_to_check = left;
-			}
-			if (!strcmp(aRegEx, sCache[item_to_check].re_raw)) // Match found (case sensitive).
+			if (pos > last || memcmp(pos, aPrefilter.prefix, aPrefilter.length))
+				return PCRE_ERROR_NOMATCH;
+		}
+		else
+		{
+			for (;; ++pos)
 			{
-				sLastFound = item_to_check;
-				goto match_found;
+				if (pos > last || !(pos = (char *)memchr(pos, *aPrefilter.prefix, last - pos + 1)))
+					return PCRE_ERROR_NOMATCH;
+				if (!memcmp(pos + 1, aPrefilter.prefix + 1, aPrefilter.length - 1))
+					break;
 			}
+			aStartingOffset = (int)(pos - aHaystack);
 		}
-
-		// Since above didn't goto, no match was found nor is one possible.  So just indicate the insert position
-		// for where this RegEx will be put into the cache.
-		// The following formula is for both cache-full and cache-partially-full.  When the cache is full,
-		// it might not be the best possible formula; but it seems pretty good because it takes a round-robin
-		// approach to overwriting/discarding old cache entries.  A discarded entry might have just been
-		// used -- or even be sLastFound itself -- but on average, this approach seems pretty good because a
-		// script loop that uses 50 unique RegEx's will quickly stabilize in the cache so that all 50 of them
-		// stay compiled/cached until the loop ends.
-		insert_pos = (sLastInsert == PCRE_CACHE_SIZE-1) ? 0 : sLastInsert + 1; // Formula works for both full and partially-full array.
 	}
-	// Since the above didn't goto:
-	// - This RegEx isn't yet in the cache.  So compile it and put it in the cache, then return it to caller.
-	// - Above is responsible for having set insert_pos to the cache position where the new RegEx will be stored.
+	return pcre_exec(aRE, aExtra, aHaystack, aLength, aStartingOffset, aOptions, aOffset, aOffsetCount);
+}
+
+
+
+int RegExCacheGetInfo(int aIndex, char *&aRegEx, char *&aTier)
+// Provides the /Benchmark switch with the contents of the RegEx cache.  Returns the number of times
+// the cache entry at aIndex has been used, or -1 if aIndex is beyond the end of the cache.
+// aRegEx and aTier are set to NULL for an empty entry.
+{
+	if (aIndex >= PCRE_CACHE_SIZE)
+		return -1;
+	EnterCriticalSection(&g_CriticalRegExCache);
+	pcre_cache_entry &entry = sRegExCache[aIndex];
+	aRegEx = entry.re_raw; // Caller uses it before any further RegEx could be compiled.
+	aTier = !entry.re_compiled ? NULL : entry.prefilter.length ? "prefilter" : "pcre";
+	int use_count = entry.use_count;
+	LeaveCriticalSection(&g_CriticalRegExCache);
+	return use_count;
+}
+
+
 
+static char *RegExParseOptions(char *aRegEx, int &aOptions, bool &aGetPositionsNotSubstrings, bool &aStudy)
+// Parses the options (if any) at the beginning of aRegEx, such as the "im" in "im)abc", and returns
+// the address of the pattern itself.  If there are no options or they're invalid, aRegEx is returned
+// and the output parameters are set to their defaults.
+{
 	// The following macro is for maintainability, to enforce the definition of "default" in multiple places.
 	// PCRE_NEWLINE_CRLF is the default in AutoHotkey rather than PCRE_NEWLINE_LF because *multiline* haystacks
 	// that scripts will use are expected to come from:
@@ -12507,15 +13066,13 @@ pcre *get_compiled_regex(char *aRegEx, bool &aGetPositionsNotSubstrings, pcre_ex
 	//      from GUI controls, but in such case `n is much more common than `r`n.
 	#define SET_DEFAULT_PCRE_OPTIONS \
 	{\
-		pcre_options = PCRE_NEWLINE_CRLF;\
+		aOptions = PCRE_NEWLINE_CRLF;\
 		aGetPositionsNotSubstrings = false;\
-		do_study = false;\
+		aStudy = false;\
 	}
 	#define PCRE_NEWLINE_BITS (PCRE_NEWLINE_CRLF | PCRE_NEWLINE_ANY) // Covers all bits that are used for newline options.
 
 	// SET DEFAULT OPTIONS:
-	int pcre_options;
-	long long do_study;
 	SET_DEFAULT_PCRE_OPTIONS
 
 	// PARSE THE OPTIONS (if any).
@@ -12524,17 +13081,17 @@ pcre *get_compiled_regex(char *aRegEx, bool &aGetPositionsNotSubstrings, pcre_ex
 	{
 		switch(*pat)
 		{
-		case 'i': pcre_options |= PCRE_CASELESS;  break;  // Perl-compatible options.
-		case 'm': pcre_options |= PCRE_MULTILINE; break;  //
-		case 's': pcre_options |= PCRE_DOTALL;    break;  //
-		case 'x': pcre_options |= PCRE_EXTENDED;  break;  //
-		case 'A': pcre_options |= PCRE_ANCHORED;  break;      // PCRE-specific options (uppercase used by convention, even internally by PCRE itself).
-		case 'D': pcre_options |= PCRE_DOLLAR_ENDONLY; break; //
-		case 'J': pcre_options |= PCRE_DUPNAMES;       break; //
-		case 'U': pcre_options |= PCRE_UNGREEDY;       break; //
-		case 'X': pcre_options |= PCRE_EXTRA;          break; //
-		case '\a':pcre_options = (pcre_options & ~PCRE_NEWLINE_BITS) | PCRE_NEWLINE_ANY; break; // v1.0.46.06: alert/bell (i.e. `a) is used for PCRE_NEWLINE_ANY.
-		case '\n':pcre_options = (pcre_options & ~PCRE_NEWLINE_BITS) | PCRE_NEWLINE_LF; break; // See below.
+		case 'i': aOptions |= PCRE_CASELESS;  break;  // Perl-compatible options.
+		case 'm': aOptions |= PCRE_MULTILINE; break;  //
+		case 's': aOptions |= PCRE_DOTALL;    break;  //
+		case 'x': aOptions |= PCRE_EXTENDED;  break;  //
+		case 'A': aOptions |= PCRE_ANCHORED;  break;      // PCRE-specific options (uppercase used by convention, even internally by PCRE itself).
+		case 'D': aOptions |= PCRE_DOLLAR_ENDONLY; break; //
+		case 'J': aOptions |= PCRE_DUPNAMES;       break; //
+		case 'U': aOptions |= PCRE_UNGREEDY;       break; //
+		case 'X': aOptions |= PCRE_EXTRA;          break; //
+		case '\a':aOptions = (aOptions & ~PCRE_NEWLINE_BITS) | PCRE_NEWLINE_ANY; break; // v1.0.46.06: alert/bell (i.e. `a) is used for PCRE_NEWLINE_ANY.
+		case '\n':aOptions = (aOptions & ~PCRE_NEWLINE_BITS) | PCRE_NEWLINE_LF; break; // See below.
 			// Above option: Could alternatively have called it "LF" rather than or in addition to "`n", but that
 			// seems slightly less desirable due to potential overlap/conflict with future option letters,
 			// plus the fact that `n should be pretty well known to AutoHotkey users, especially advanced ones
@@ -12546,23 +13103,22 @@ pcre *get_compiled_regex(char *aRegEx, bool &aGetPositionsNotSubstrings, pcre_ex
 			if (pat[1] == '\n') // Even though `r`n is the default, it's recognized as an option for flexibility and intuitiveness.
 			{
 				++pat; // Skip over the second character so that it's not recognized as a separate option by the next iteration.
-				pcre_options = (pcre_options & ~PCRE_NEWLINE_BITS) | PCRE_NEWLINE_CRLF; // Set explicitly in case it was unset by an earlier option. Remember that PCRE_NEWLINE_CRLF is a bitwise combination of PCRE_NEWLINE_LF and CR.
+				aOptions = (aOptions & ~PCRE_NEWLINE_BITS) | PCRE_NEWLINE_CRLF; // Set explicitly in case it was unset by an earlier option. Remember that PCRE_NEWLINE_CRLF is a bitwise combination of PCRE_NEWLINE_LF and CR.
 			}
 			else // For completeness, it's easy to support PCRE_NEWLINE_CR too, though nowadays I think it's quite rare (former Macintosh format).
-				pcre_options = (pcre_options & ~PCRE_NEWLINE_BITS) | PCRE_NEWLINE_CR; // Do it this way because PCRE_NEWLINE_CRLF is a bitwise combination of PCRE_NEWLINE_CR and PCRE_NEWLINE_LF.
+				aOptions = (aOptions & ~PCRE_NEWLINE_BITS) | PCRE_NEWLINE_CR; // Do it this way because PCRE_NEWLINE_CRLF is a bitwise combination of PCRE_NEWLINE_CR and PCRE_NEWLINE_LF.
 			break;
 
 		// Other options (uppercase so that lowercase can be reserved for future/PERL options):
 		case 'P': aGetPositionsNotSubstrings = true;   break;
-		case 'S': do_study = true;                     break;
+		case 'S': aStudy = true;                     break;
 
 		case ' ':  // Allow only spaces and tabs as fillers so that everything else is protected/reserved for
 		case '\t': // future use (such as future PERL options).
 			break;
 
 		case ')': // This character, when not escaped, marks the normal end of the options section.  We know it's not escaped because if it had been, the loop would have stopped at the backslash before getting here.
-			++pat; // Set pat to be the start of the actual RegEx pattern, and leave options set to how they were by any prior iterations above.
-			goto break_both;
+			return pat + 1; // The start of the actual RegEx pattern.  Options are left set to how they were by any prior iterations above.
 
 		default: // Namely the following:
 		//case '\0': No options are present, so ignore any letters that were accidentally recognized and treat entire string as the pattern.
@@ -12580,13 +13136,101 @@ pcre *get_compiled_regex(char *aRegEx, bool &aGetPositionsNotSubstrings, pcre_ex
 			// is extremely rare anyway, so syntax errors of this type do not happen often (and the only harm done
 			// is a misleading error message from PCRE rather than something like "Bad option").  In addition,
 			// omitting it simplifies the code and slightly improves performance.
-			goto break_both;
+			return pat;
 		} // switch(*pat)
 	} // for()
+}
 
-break_both:
-	// Reaching here means that pat has been set to the beginning of the RegEx pattern itself and all options
-	// are set properly.
+
+
+pcre *get_compiled_regex(char *aRegEx, bool &aGetPositionsNotSubstrings, pcre_extra *&aExtra
+	, RegExPrefilter &aPrefilter, ExprTokenType *aResultToken)
+// Returns the compiled RegEx, or NULL on failure.
+// This function is called by things other than built-in functions so it should be kept general-purpose.
+// Upon failure, if aResultToken!=NULL:
+//   - ErrorLevel is set to a descriptive string other than "0".
+//   - *aResultToken is set up to contain an empty string.
+// Upon success, the following output parameters are set based on the options that were specified:
+//    aGetPositionsNotSubstrings
+//    aExtra
+//    aPrefilter (a copy, so that it stays valid even if another thread replaces the cache entry)
+//    (but it doesn't change ErrorLevel on success, not even if aResultToken!=NULL)
+{
+	// While reading from or writing to the cache, don't allow another thread entry.  This is because
+	// that thread (or this one) might write to the cache while the other one is reading/writing, which
+	// could cause loss of data integrity (the hook thread can enter here via #IfWin & SetTitleMatchMode RegEx).
+	// Together, Enter/LeaveCriticalSection reduce performance by only 1.4% in the tightest possible script
+	// loop that hits the first cache entry every time.  So that's the worst case except when there's an actual
+	// collision, in which case performance suffers more because internally, EnterCriticalSection() does a
+	// wait/semaphore operation, which is more costly.
+	// Finally, the code size of all critical-section features together is less than 512 bytes (uncompressed),
+	// so like performance, that's not a concern either.
+	EnterCriticalSection(&g_CriticalRegExCache); // Request ownership of the critical section. If another thread already owns it, this thread will block until the other thread finishes.
+
+	static int sLastInsert, sLastFound = -1; // -1 indicates "cache empty".
+	int insert_pos; // v1.0.45.03: This is used to avoid updating sLastInsert until an insert actually occurs (it might not occur if a compile error occurs in the regex, or something else stops it early).
+
+	// CHECK IF THIS REGEX IS ALREADY IN THE CACHE.
+	if (sLastFound == -1) // Cache is empty, so insert this RegEx at the first position.
+		insert_pos = 0;  // A section further below will change sLastFound to be 0.
+	else
+	{
+		// Search the cache to see if it contains the caller-specified RegEx in compiled form.
+		// First check if the last-found item is a match, since often it will be (such as cases
+		// where a script-loop executes only one RegEx, and also for SetTitleMatchMode RegEx).
+		if (!strcmp(aRegEx, sRegExCache[sLastFound].re_raw)) // Match found (case sensitive).
+			goto match_found; // And no need to update sLastFound because it's already set right.
+
+		// Since above didn't find a match, search outward in both directions from the last-found match.
+		// A bidirectional search is done because consecutively-called regex's tend to be adjacent to each other
+		// in the array, so performance is improved on average (since most of the time when repeating a previously
+		// executed regex, that regex will already be in the cache -- so optimizing the finding behavior is
+		// more important than optimizing the never-found-because-not-cached behavior).
+		bool go_right;
+		int i, item_to_check, left, right;
+		int last_populated_item = (sRegExCache[PCRE_CACHE_SIZE-1].re_compiled) // When the array is full...
+			? PCRE_CACHE_SIZE - 1  // ...all items must be checked except the one already done earlier.
+			: sLastInsert;         // ...else only the items actually populated need to be checked.
+
+		for (go_right = true, left = sLastFound, right = sLastFound, i = 0
+			; i < last_populated_item  // This limits it to exactly the number of items remaining to be checked.
+			; ++i, go_right = !go_right)
+		{
+			if (go_right) // Proceed rightward in the array.
+			{
+				right = (right == last_populated_item) ? 0 : right + 1; // Increment or wrap around back to the left side.
+				item_to_check = right;
+			}
+			else // Proceed leftward.
+			{
+				left = (left == 0) ? last_populated_item : left - 1; // Decrement or wrap around back to the right side.
+				item_to_check = left;
+			}
+			if (!strcmp(aRegEx, sRegExCache[item_to_check].re_raw)) // Match found (case sensitive).
+			{
+				sLastFound = item_to_check;
+				goto match_found;
+			}
+		}
+
+		// Since above didn't goto, no match was found nor is one possible.  So just indicate the insert position
+		// for where this RegEx will be put into the cache.
+		// The following formula is for both cache-full and cache-partially-full.  When the cache is full,
+		// it might not be the best possible formula; but it seems pretty good because it takes a round-robin
+		// approach to overwriting/discarding old cache entries.  A discarded entry might have just been
+		// used -- or even be sLastFound itself -- but on average, this approach seems pretty good because a
+		// script loop that uses 50 unique RegEx's will quickly stabilize in the cache so that all 50 of them
+		// stay compiled/cached until the loop ends.
+		insert_pos = (sLastInsert == PCRE_CACHE_SIZE-1) ? 0 : sLastInsert + 1; // Formula works for both full and partially-full array.
+	}
+	// Since the above didn't goto:
+	// - This RegEx isn't yet in the cache.  So compile it and put it in the cache, then return it to caller.
+	// - Above is responsible for having set insert_pos to the cache position where the new RegEx will be stored.
+
+	int pcre_options;
+	bool do_study;
+	char *pat; // The start of the pattern itself, after any options.
+	pat = RegExParseOptions(aRegEx, pcre_options, aGetPositionsNotSubstrings, do_study);
 
 	const char *error_msg;
 	char error_buf[ERRORLEVEL_SAVED_SIZE];
@@ -12637,7 +13281,7 @@ break_both:
 
 	// ADD THE NEWLY-COMPILED REGEX TO THE CACHE.
 	// An earlier stage has set insert_pos to be the desired insert-position in the cache.
-	pcre_cache_entry &this_entry = sCache[insert_pos]; // For performance and convenience.
+	pcre_cache_entry &this_entry = sRegExCache[insert_pos]; // For performance and convenience.
 	if (this_entry.re_compiled) // An existing cache item is being overwritten, so free it's attributes.
 	{
 		// Free the old cache entry's attributes in preparation for overwriting them with the new one's.
@@ -12650,6 +13294,10 @@ break_both:
 	this_entry.re_compiled = re_compiled;
 	this_entry.extra = aExtra;
 	this_entry.get_positions_not_substrings = aGetPositionsNotSubstrings;
+	this_entry.use_count = 1;
+	this_entry.pattern_offset = (int)(pat - aRegEx);
+	this_entry.prefilter.length = 0; // Starts off in the PCRE-only tier until it proves to be hot.
+	aPrefilter.length = 0;
 	// "this_entry.pcre_options" doesn't exist because it isn't currently needed in the cache.  This is
 	// because the RE's options are implicitly stored inside re_compiled.
 
@@ -12662,11 +13310,18 @@ break_both:
 	return re_compiled; // Indicate success.
 
 match_found: // RegEx was found in the cache at position sLastFound, so return the cached info back to the caller.
-	aGetPositionsNotSubstrings = sCache[sLastFound].get_positions_not_substrings;
-	aExtra = sCache[sLastFound].extra;
+	aGetPositionsNotSubstrings = sRegExCache[sLastFound].get_positions_not_substrings;
+	aExtra = sRegExCache[sLastFound].extra;
+	if (++sRegExCache[sLastFound].use_count == REGEX_HOT_USES) // Promote it to the fast tier if it qualifies.  This is done only once per entry.
+	{
+		pcre_fullinfo(sRegExCache[sLastFound].re_compiled, NULL, PCRE_INFO_OPTIONS, &pcre_options);
+		sRegExCache[sLastFound].prefilter.length = RegExLiteralPrefix(sRegExCache[sLastFound].re_raw + sRegExCache[sLastFound].pattern_offset
+			, pcre_options, sRegExCache[sLastFound].prefilter.prefix, sizeof(sRegExCache[sLastFound].prefilter.prefix));
+	}
+	aPrefilter = sRegExCache[sLastFound].prefilter;
 
 	LeaveCriticalSection(&g_CriticalRegExCache);
-	return sCache[sLastFound].re_compiled; // Indicate success.
+	return sRegExCache[sLastFound].re_compiled; // Indicate success.
 
 error: // Since NULL is returned here, caller should ignore the contents of the output parameters.
 	if (aResultToken)
@@ -12686,10 +13341,11 @@ char *RegExMatch(char *aHaystack, char *aNeedleRegEx)
 {
 	bool get_positions_not_substrings; // Currently ignored.
 	pcre_extra *extra;
+	RegExPrefilter prefilter;
 	pcre *re;
 
 	// Compile the regex or get it from cache.
-	if (   !(re = get_compiled_regex(aNeedleRegEx, get_positions_not_substrings, extra, NULL))   ) // Compiling problem.
+	if (   !(re = get_compiled_regex(aNeedleRegEx, get_positions_not_substrings, extra, prefilter, NULL))   ) // Compiling problem.
 		return NULL; // Our callers just want there to be "no match" in this case.
 
 	// Set up the offset array, which consists of int-pairs containing the start/end offset of each match.
@@ -12699,7 +13355,7 @@ char *RegExMatch(char *aHaystack, char *aNeedleRegEx)
 	int offset[RXM_INT_COUNT];
 
 	// Execute the regex.
-	int captured_pattern_count = pcre_exec(re, extra, aHaystack, (int)strlen(aHaystack), 0, 0, offset, RXM_INT_COUNT);
+	int captured_pattern_count = RegExExec(re, extra, prefilter, aHaystack, (int)strlen(aHaystack), 0, 0, offset, RXM_INT_COUNT);
 	if (captured_pattern_count < 0) // PCRE_ERROR_NOMATCH or some kind of error.
 		return NULL;
 
@@ -12709,8 +13365,208 @@ char *RegExMatch(char *aHaystack, char *aNeedleRegEx)
 
 
 
+struct BoundRegEx
+{
+	pcre *re;
+	pcre_extra *extra;
+	RegExPrefilter prefilter;
+};
+
+BoundRegEx *RegExBind(char *aRegEx)
+// Compiles aRegEx for a caller that will use it for the life of the script, such as an #IfWin criterion
+// that's checked every time a hotkey is pressed.  Unlike get_compiled_regex(), the result isn't put in the
+// cache (which might discard it at any time), so the caller can keep it and skip the cache lookup on each
+// use.  Returns NULL if the RegEx can't be compiled.
+// This function must be kept thread-safe because it may be called (indirectly) by the hook thread.
+{
+	int pcre_options, error_code, error_offset;
+	bool get_positions_not_substrings, do_study; // The former is ignored (see RegExMatch()).
+	const char *error_msg;
+	char *pat = RegExParseOptions(aRegEx, pcre_options, get_positions_not_substrings, do_study);
+	pcre *re;
+	if (   !(re = pcre_compile2(pat, pcre_options, &error_code, &error_msg, &error_offset, NULL))   )
+		return NULL;
+	BoundRegEx *bound;
+	if (   !(bound = (BoundRegEx *)malloc(sizeof(BoundRegEx)))   )
+	{
+		pcre_free(re);
+		return NULL;
+	}
+	bound->re = re;
+	bound->extra = do_study ? pcre_study(re, 0, &error_msg) : NULL;
+	// Since such a RegEx is expected to be used often, it goes straight to the fast tier rather than
+	// having to earn its way there like a cached one:
+	pcre_fullinfo(re, NULL, PCRE_INFO_OPTIONS, &pcre_options);
+	bound->prefilter.length = RegExLiteralPrefix(pat, pcre_options, bound->prefilter.prefix, sizeof(bound->prefilter.prefix));
+	return bound;
+}
+
+
+
+char *RegExMatch(char *aHaystack, BoundRegEx *aRegEx)
+// Same as the other RegExMatch() except that aRegEx was compiled in advance by RegExBind().
+{
+	int offset[RXM_INT_COUNT];
+	if (RegExExec(aRegEx->re, aRegEx->extra, aRegEx->prefilter, aHaystack, (int)strlen(aHaystack), 0, 0, offset, RXM_INT_COUNT) < 0)
+		return NULL;
+	return aHaystack + offset[0];
+}
+
+
+
+class RegExOutput
+// Accumulates RegExReplace()'s result in a chain of blocks, which are joined into a single string only
+// once at the end.  Unlike growing a single buffer with realloc(), nothing already produced is ever
+// copied more than once, and no memory is reserved based on a guess of the final size.  If mFile is
+// non-NULL, each block is instead written to the file whenever it fills, so that the result is never
+// held in memory as a whole.
+{
+	struct Block
+	{
+		Block *mNext;
+		size_t mSize, mUsed;
+		char mData[1]; // Actually mSize bytes.
+	};
+	#define REGEX_OUTPUT_BLOCK_SIZE (64 * 1024)
+	Block *mFirst, *mLast;
+
+	bool AddBlock(size_t aMinSize)
+	{
+		size_t size = aMinSize > REGEX_OUTPUT_BLOCK_SIZE ? aMinSize : REGEX_OUTPUT_BLOCK_SIZE;
+		Block *block = (Block *)malloc(sizeof(Block) + size);
+		if (!block)
+			return false;
+		block->mNext = NULL;
+		block->mSize = size;
+		block->mUsed = 0;
+		if (mLast)
+			mLast->mNext = block;
+		else
+			mFirst = block;
+		mLast = block;
+		return true;
+	}
+
+	bool WriteBlock() // File mode: empties the block by writing it to the file.
+	{
+		if (mLast->mUsed && fwrite(mLast->mData, mLast->mUsed, 1, mFile) != 1)
+			return false;
+		mLast->mUsed = 0;
+		return true;
+	}
+
+public:
+	FILE *mFile;
+	size_t mLength; // The total length of the result so far, including anything already written to mFile.
+
+	RegExOutput(FILE *aFile) : mFirst(NULL), mLast(NULL), mFile(aFile), mLength(0) {}
+	~RegExOutput() { Free(); }
+
+	char *Reserve(size_t aLength)
+	// Returns a pointer to room for aLength contiguous characters at the end of the result, or NULL on
+	// failure.  The caller must then call Commit() with the number it actually used.
+	{
+		if (mLast && mLast->mSize - mLast->mUsed >= aLength)
+			return mLast->mData + mLast->mUsed;
+		if (mFile && mLast)
+		{
+			if (!WriteBlock())
+				return NULL;
+			if (mLast->mSize >= aLength)
+				return mLast->mData;
+			// Otherwise, the block is too small, so replace it with a larger one below.
+			free(mLast);
+			mFirst = mLast = NULL;
+		}
+		return AddBlock(aLength) ? mLast->mData : NULL;
+	}
+
+	void Commit(size_t aLength)
+	{
+		mLast->mUsed += aLength;
+		mLength += aLength;
+	}
+
+	bool Append(char *aBuf, size_t aLength)
+	// Returns false on failure.
+	{
+		if (!aLength)
+			return true;
+		size_t room = mLast ? mLast->mSize - mLast->mUsed : 0;
+		if (aLength > room)
+		{
+			if (mFile)
+			{
+				// Write the block, then write large text directly rather than copying it into the block:
+				if (mLast && !WriteBlock())
+					return false;
+				if (aLength >= REGEX_OUTPUT_BLOCK_SIZE)
+				{
+					mLength += aLength;
+					return fwrite(aBuf, aLength, 1, mFile) == 1;
+				}
+			}
+			else
+			{
+				// Fill the current block, then put the rest into a new block of at least that size:
+				if (room)
+				{
+					memcpy(mLast->mData + mLast->mUsed, aBuf, room);
+					Commit(room);
+					aBuf += room;
+					aLength -= room;
+				}
+				if (!AddBlock(aLength))
+					return false;
+			}
+			if (!mLast && !AddBlock(aLength))
+				return false;
+		}
+		memcpy(mLast->mData + mLast->mUsed, aBuf, aLength);
+		Commit(aLength);
+		return true;
+	}
+
+	char *Join()
+	// Memory mode: returns the result as a single malloc'd, zero-terminated string, or NULL if out of memory.
+	// The blocks are freed as they are copied.
+	{
+		char *result = (char *)malloc(mLength + 1), *dest = result;
+		if (!result)
+			return NULL;
+		for (Block *next; mFirst; mFirst = next)
+		{
+			memcpy(dest, mFirst->mData, mFirst->mUsed);
+			dest += mFirst->mUsed;
+			next = mFirst->mNext;
+			free(mFirst);
+		}
+		mLast = NULL;
+		*dest = '\0';
+		return result;
+	}
+
+	bool Flush()
+	// File mode: writes out whatever remains.  Returns false on failure.
+	{
+		return (!mLast || WriteBlock()) && !fflush(mFile);
+	}
+
+	void Free()
+	{
+		for (Block *next; mFirst; mFirst = next)
+		{
+			next = mFirst->mNext;
+			free(mFirst);
+		}
+		mLast = NULL;
+	}
+};
+
+
+
 void RegExReplace(ExprTokenType &aResultToken, ExprTokenType *aParam[], int aParamCount
-	, pcre *aRE, pcre_extra *aExtra, char *aHaystack, int aHaystackLength, int aStartingOffset
+	, pcre *aRE, pcre_extra *aExtra, RegExPrefilter &aPrefilter, char *aHaystack, int aHaystackLength, int aStartingOffset
 	, int aOffset[], int aNumberOfIntsInOffset)
 {
 	// Set default return value in case of early return.
@@ -12731,9 +13587,9 @@ void RegExReplace(ExprTokenType &aResultToken, ExprTokenType *aParam[], int aPar
 
 	// In PCRE, lengths and such are confined to ints, so there's little reason for using unsigned for anything.
 	int captured_pattern_count, empty_string_is_not_a_match, match_length, ref_num
-		, result_size, new_result_length, haystack_portion_length, second_iteration, substring_name_length
+		, new_result_length, haystack_portion_length, second_iteration, substring_name_length
 		, extra_offset, pcre_options;
-	char *haystack_pos, *match_pos, *src, *src_orig, *dest, *closing_brace, char_after_dollar
+	char *haystack_pos, *match_pos, *src, *src_orig, *dest, *dest_orig, *closing_brace, char_after_dollar
 		, *substring_name_pos, substring_name[33] // In PCRE, "Names consist of up to 32 alphanumeric characters and underscores."
 		, transform;
 
@@ -12741,23 +13597,30 @@ void RegExReplace(ExprTokenType &aResultToken, ExprTokenType *aParam[], int aPar
 	// So if we change "result" to be non-NULL, the caller will take over responsibility for freeing that memory.
 	char *&result = (char *&)aResultToken.circuit_token; // Make an alias to type-cast and for convenience.
 	int &result_length = (int &)aResultToken.buf; // MANDATORY FOR USERS OF CIRCUIT_TOKEN: "buf" is being overloaded to store the length for our caller.
-	result_size = 0;   // And caller has already set "result" to be NULL.  The buffer is allocated only upon
-	result_length = 0; // first use to avoid a potentially massive allocation that might be wasted and cause swapping (not to mention that we'll have better ability to estimate the correct total size after the first replacement is discovered).
-
-	// Below uses a temp variable because realloc() returns NULL on failure but leaves original block allocated.
-	// Note that if it's given a NULL pointer, realloc() does a malloc() instead.
-	char *realloc_temp;
-	#define REGEX_REALLOC(size) \
-	{\
-		result_size = size;\
-		if (   !(realloc_temp = (char *)realloc(result, result_size))   )\
-			goto out_of_mem;\
-		result = realloc_temp;\
-	}
+	result_length = 0; // And caller has already set "result" to be NULL.  It's set only at the end, when the output's blocks are joined.
 
 	// See if a replacement limit was specified.  If not, use the default (-1 means "replace all").
 	int limit = (aParamCount > 4) ? (int)TokenToInt64(*aParam[4]) : -1;
 
+	// If an output file was specified, the result is written to it as it's produced rather than returned.
+	// In that case, the return value is the length of what was written.
+	FILE *output_file = NULL;
+	RegExOutput output(NULL); // Declared prior to any goto.  Its destructor frees whatever wasn't joined.
+	if (aParamCount > 6)
+	{
+		char file_buf[MAX_NUMBER_SIZE];
+		char *output_filespec = TokenToString(*aParam[6], file_buf);
+		if (*output_filespec)
+		{
+			aResultToken.marker = ""; // Set default in case of error, since haystack isn't written anywhere in that case.
+			if (   !(output.mFile = output_file = fopen(output_filespec, "wb"))   ) // Overwrite.  Binary so that the result is written exactly.
+			{
+				g_ErrorLevel->Assign(ERRORLEVEL_ERROR);
+				goto set_count_and_return;
+			}
+		}
+	}
+
 	// aStartingOffset is altered further on in the loop; but for its initial value, the caller has ensured
 	// that it lies within aHaystackLength.  Also, if there are no replacements yet, haystack_pos ignores
 	// aStartingOffset because otherwise, when the first replacement occurs, any part of haystack that lies
@@ -12767,7 +13630,7 @@ void RegExReplace(ExprTokenType &aResultToken, ExprTokenType *aParam[], int aPar
 	{
 		// Execute the expression to find the next match.
 		captured_pattern_count = (limit == 0) ? PCRE_ERROR_NOMATCH // Only when limit is exactly 0 are we done replacing.  All negative values are "replace all".
-			: pcre_exec(aRE, aExtra, aHaystack, (int)aHaystackLength, aStartingOffset
+			: RegExExec(aRE, aExtra, aPrefilter, aHaystack, (int)aHaystackLength, aStartingOffset
 				, empty_string_is_not_a_match, aOffset, aNumberOfIntsInOffset);
 
 		if (captured_pattern_count == PCRE_ERROR_NOMATCH)
@@ -12779,7 +13642,9 @@ void RegExReplace(ExprTokenType &aResultToken, ExprTokenType *aParam[], int aPar
 				// at the same position.  But since we're here, it wasn't able to find such a match.  So just copy
 				// the current character over literally then advance to the next character to resume normal searching.
 				empty_string_is_not_a_match = 0; // Reset so that the next iteration starts off with the normal matching method.
-				result[result_length++] = *haystack_pos; // This can't overflow because the size calculations in a previous iteration reserved 3 bytes: 1 for this character, 1 for the possible LF that follows CR, and 1 for the terminator.
+				if (!output.Append(haystack_pos, 1))
+					goto out_of_mem;
+				++result_length;
 				++aStartingOffset; // Advance to next candidate section of haystack.
 				// v1.0.46.06: This following section was added to avoid finding a match between a CR and LF
 				// when PCRE_NEWLINE_ANY mode is in effect.  The fact that this is the only change for
@@ -12805,7 +13670,9 @@ void RegExReplace(ExprTokenType &aResultToken, ExprTokenType *aParam[], int aPar
 					if (!pcre_fullinfo(aRE, aExtra, PCRE_INFO_OPTIONS, &pcre_options) // Success.
 						&& (pcre_options & PCRE_NEWLINE_ANY))
 					{
-						result[result_length++] = '\n'; // This can't overflow because the size calculations in a previous iteration reserved 3 bytes: 1 for this character, 1 for the possible LF that follows CR, and 1 for the terminator.
+						if (!output.Append("\n", 1))
+							goto out_of_mem;
+						++result_length;
 						++aStartingOffset; // Skip over this LF because it "belongs to" the CR that preceded it.
 					}
 				}
@@ -12813,19 +13680,30 @@ void RegExReplace(ExprTokenType &aResultToken, ExprTokenType *aParam[], int aPar
 			}
 			// Otherwise, there aren't any more matches.  So we're all done except for copying the last part of
 			// haystack into the result (if applicable).
-			if (replacement_count) // And by definition, result!=NULL due in this case to prior iterations.
+			if (replacement_count || output_file) // The output file must receive the haystack even if there were no replacements.
 			{
-				if (haystack_portion_length = aHaystackLength - aStartingOffset) // This is the remaining part of haystack that needs to be copied over as-is.
+				// haystack_pos is aHaystack when there were no replacements (see the top of the loop).
+				if (haystack_portion_length = (int)(aHaystack + aHaystackLength - haystack_pos)) // This is the remaining part of haystack that needs to be copied over as-is.
+				{
+					if (!output.Append(haystack_pos, haystack_portion_length))
+						goto out_of_mem;
+					result_length += haystack_portion_length; // Remember that result_length is actually an output for our caller, so even if for no other reason, it must be kept accurate for that.
+				}
+				if (output_file)
+				{
+					if (!output.Flush())
+						goto out_of_mem;
+					// Since result is still NULL, the caller doesn't use result_length, which the following overwrites:
+					aResultToken.symbol = SYM_INTEGER;
+					aResultToken.value_int64 = output.mLength;
+				}
+				else
 				{
-					new_result_length = result_length + haystack_portion_length;
-					if (new_result_length >= result_size)
-						REGEX_REALLOC(new_result_length + 1); // This will end the loop if an alloc error occurs.
-					memcpy(result + result_length, haystack_pos, haystack_portion_length); // memcpy() usually benches a little faster than strcpy().
-					result_length = new_result_length; // Remember that result_length is actually an output for our caller, so even if for no other reason, it must be kept accurate for that.
+					if (   !(result = output.Join())   )
+						goto out_of_mem;
+					// Set RegExReplace()'s return value to be "result":
+					aResultToken.marker = result;  // Caller will take care of freeing result's memory.
 				}
-				result[result_length] = '\0'; // result!=NULL when replacement_count!=0.  Also, must terminate it unconditionally because other sections usually don't do it.
-				// Set RegExMatch()'s return value to be "result":
-				aResultToken.marker = result;  // Caller will take care of freeing result's memory.
 			}
 			// Section below is obsolete but is retained for its comments.
 			//else // No replacements were actually done, so just return the original string to avoid malloc+memcpy
@@ -12869,30 +13747,18 @@ void RegExReplace(ExprTokenType &aResultToken, ExprTokenType *aParam[], int aPar
 		{
 			if (second_iteration)
 			{
-				// Using the required length calculated by the first iteration, expand/realloc "result" if necessary.
-				if (new_result_length + 3 > result_size) // Must use +3 not +1 in case of empty_string_is_not_a_match (which needs room for up to two extra characters).
-				{
-					// The first expression passed to REGEX_REALLOC is the average length of each replacement so far.
-					// It's more typically more accurate to pass that than the following "length of current
-					// replacement":
-					//    new_result_length - haystack_portion_length - (aOffset[1] - aOffset[0])
-					// Above is the length difference between the current replacement text and what it's
-					// replacing (it's negative when replacement is smaller than what it replaces).
-					REGEX_REALLOC(PredictReplacementSize((new_result_length - aOffset[1]) / replacement_count // See above.
-						, replacement_count, limit, aHaystackLength, new_result_length+2, aOffset[1])); // +2 in case of empty_string_is_not_a_match (which needs room for up to two extra characters).  The function will also do another +1 to convert length to size (for terminator).
-					// The above will return if an alloc error occurs.
-				}
-				//else result_size is not only large enough, but also non-zero.  Other sections rely on it always
-				// being non-zero when replacement_count>0.
-
 				// Before doing the actual replacement and its backreferences, copy over the part of haystack that
 				// appears before the match.
 				if (haystack_portion_length)
 				{
-					memcpy(result + result_length, haystack_pos, haystack_portion_length);
+					if (!output.Append(haystack_pos, haystack_portion_length))
+						goto out_of_mem;
 					result_length += haystack_portion_length;
 				}
-				dest = result + result_length; // Init dest for use by the loops further below.
+				// Using the length calculated by the first iteration, get room for the replacement.  The +1 is
+				// for the terminator that the case-transformation below relies on.
+				if (   !(dest_orig = dest = output.Reserve(new_result_length - result_length + 1))   )
+					goto out_of_mem;
 			}
 			else // i.e. it's the first iteration, so begin calculating the size required.
 				new_result_length = result_length + haystack_portion_length; // Init length to the part of haystack before the match (it must be copied over as literal text).
@@ -13033,6 +13899,7 @@ void RegExReplace(ExprTokenType &aResultToken, ExprTokenType *aParam[], int aPar
 				}
 			} // for() (for each '$')
 		} // for() (a 2-iteration for-loop)
+		output.Commit(dest - dest_orig);
 
 		// If we're here, a match was found.
 		// Technique and comments from pcredemo.c:
@@ -13074,16 +13941,15 @@ void RegExReplace(ExprTokenType &aResultToken, ExprTokenType *aParam[], int aPar
 	// through goto:
 out_of_mem:
 	// Due to extreme rarity and since this is a regex execution error of sorts, use PCRE's own error code.
-	g_ErrorLevel->Assign(PCRE_ERROR_NOMEMORY);
-	if (result)
-	{
-		free(result);  // Since result is probably an non-terminated string (not to mention an incompletely created result), it seems best to free it here to remove it from any further consideration by the caller.
-		result = NULL; // Tell caller that it was freed.
-		// AND LEAVE aResultToken.marker (i.e. the final result) set to aHaystack, because the altered result is
-		// indeterminate and thus discarded.
-	}
+	// This is also reached if writing to the output file failed.
+	g_ErrorLevel->Assign(output_file ? ERRORLEVEL_ERROR : PCRE_ERROR_NOMEMORY);
+	// result is still NULL because it's set only upon success.  The partially built output is freed below
+	// by RegExOutput's destructor.  AND LEAVE aResultToken.marker (i.e. the final result) set to aHaystack,
+	// because the altered result is indeterminate and thus discarded.
 	// Now fall through to below so that count is set even for out-of-memory error.
 set_count_and_return:
+	if (output_file)
+		fclose(output_file);
 	if (output_var_count)
 		output_var_count->Assign(replacement_count); // v1.0.47.05: Must be done last in case output_var_count shares the same memory with haystack, needle, or replacement.
 }
@@ -13099,10 +13965,11 @@ void BIF_RegEx(ExprTokenType &aResultToken, ExprTokenType *aParam[], int aParamC
 
 	bool get_positions_not_substrings;
 	pcre_extra *extra;
+	RegExPrefilter prefilter;
 	pcre *re;
 
 	// COMPILE THE REGEX OR GET IT FROM CACHE.
-	if (   !(re = get_compiled_regex(needle, get_positions_not_substrings, extra, &aResultToken))   ) // Compiling problem.
+	if (   !(re = get_compiled_regex(needle, get_positions_not_substrings, extra, prefilter, &aResultToken))   ) // Compiling problem.
 		return; // It already set ErrorLevel and aResultToken for us. If caller provided an output var/array, it is not changed under these conditions because there's no way of knowing how many subpatterns are in the RegEx, and thus no way of knowing how far to init the array.
 
 	// Since compiling succeeded, get info about other parameters.
@@ -13142,13 +14009,13 @@ void BIF_RegEx(ExprTokenType &aResultToken, ExprTokenType *aParam[], int aParamC
 	if (mode_is_replace) // Handle RegExReplace() completely then return.
 	{
 		RegExReplace(aResultToken, aParam, aParamCount
-			, re, extra, haystack, haystack_length, starting_offset, offset, number_of_ints_in_offset);
+			, re, extra, prefilter, haystack, haystack_length, starting_offset, offset, number_of_ints_in_offset);
 		return;
 	}
 
 	// OTHERWISE, THIS IS RegExMatch() not RegExReplace().
 	// EXECUTE THE REGEX.
-	int captured_pattern_count = pcre_exec(re, extra, haystack, haystack_length, starting_offset, 0, offset, number_of_ints_in_offset);
+	int captured_pattern_count = RegExExec(re, extra, prefilter, haystack, haystack_length, starting_offset, 0, offset, number_of_ints_in_offset);
 
 	// SET THE RETURN VALUE AND ERRORLEVEL BASED ON THE RESULTS OF EXECUTING THE EXPRESSION.
 	if (captured_pattern_count == PCRE_ERROR_NOMATCH)
@@ -0,0 +1,178 @@
+/*
+AutoHotkey
+
+Copyright 2003-2009 Chris Mallett (support@autohotkey.com)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+
+#include "stdafx.h" // pre-compiled headers
+#include "script.h"
+#include "globaldata.h" // for a lot of things
+#include "window.h" // for WindowSnapshotGetCounts() and the checks
+
+// NOTE: This module is separate from script.cpp because it's used only by the /Benchmark switch and
+// thus isn't part of the normal flow of a script.  Compiled scripts don't support that switch.
+
+#ifndef AUTOHOTKEYSC
+
+static LARGE_INTEGER sBenchmarkFreq; // Ticks per second of the performance counter.
+
+static double BenchmarkElapsedMS(LARGE_INTEGER &aStart)
+// Returns the number of milliseconds that have elapsed since aStart was taken from QueryPerformanceCounter().
+{
+	if (!sBenchmarkFreq.QuadPart)
+		QueryPerformanceFrequency(&sBenchmarkFreq);
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	return sBenchmarkFreq.QuadPart ? (now.QuadPart - aStart.QuadPart) * 1000.0 / sBenchmarkFreq.QuadPart : 0.0;
+}
+
+
+
+void Script::BenchmarkReport(char *aKind, char *aName, double aValue)
+// Writes one record to the benchmark file.  The format is intentionally trivial so that a build box
+// can diff or graph the results without any special tools: one record per line, tab-delimited,
+// consisting of kind, name and value (milliseconds for timings, plain counts for everything else).
+{
+	fprintf(mBenchmarkFile, "%s\t%s\t%0.3f\n", aKind, aName, aValue);
+	// Flush every record in case the script terminates itself partway through (e.g. via ExitApp or a
+	// critical runtime error), in which case the records written so far are still worth having:
+	fflush(mBenchmarkFile);
+}
+
+
+
+int Script::RunBenchmarks(LARGE_INTEGER &aLoadStart)
+// Called by WinMain() in place of the usual sequence (CreateWindows, hooks, AutoExecSection and the
+// message loop) when the /Benchmark switch is present.  aLoadStart is the performance counter as of
+// just before WinMain() called LoadFromFile().  The script has already been loaded, so this
+// runs its auto-execute section followed by every label whose name starts with BENCHMARK_LABEL_PREFIX
+// (in the order they appear in the script), timing each one.  No windows, tray icon or hooks are
+// created, so this works on a machine with no interactive desktop (e.g. a build box running Wine).
+// Returns the program's exit code.
+{
+	BenchmarkReport("load", "LoadFromFile", BenchmarkElapsedMS(aLoadStart)); // Must be done first.
+	BenchmarkReport("count", "Lines", mLineCount);
+	BenchmarkReport("count", "Vars", mVarCount + mLazyVarCount);
+	BenchmarkReport("count", "SimpleHeapBlocks", SimpleHeap::GetBlockCount());
+	BenchmarkReport("count", "LineArenaBytes", (double)mLineArenaSize);
+	UINT lib_cache_hits, lib_cache_misses, lib_index_builds;
+	LibCacheGetCounts(lib_cache_hits, lib_cache_misses, lib_index_builds);
+	BenchmarkReport("count", "LibCacheHits", lib_cache_hits);
+	BenchmarkReport("count", "LibCacheMisses", lib_cache_misses);
+	BenchmarkReport("count", "LibIndexBuilds", lib_index_builds);
+	UINT parse_cache_hits, parse_cache_misses;
+	ParseCacheGetCounts(parse_cache_hits, parse_cache_misses);
+	BenchmarkReport("count", "ParseCacheHits", parse_cache_hits);
+	BenchmarkReport("count", "ParseCacheMisses", parse_cache_misses);
+
+	// See AutoExecSection() for comments about the following:
+	if (   !(g_array = (global_struct *)malloc((g_MaxThreadsTotal+TOTAL_ADDITIONAL_THREADS) * sizeof(global_struct)))   )
+		return CRITICAL_ERROR;
+	CopyMemory(g_array, g, sizeof(global_struct));
+	g = g_array;
+
+	// Make the script persistent so that a plain "Exit" (or reaching the end of the auto-execute section)
+	// returns control to us rather than terminating the program:
+	g_persistent = true;
+	mIsReadyToExecute = true;
+	mLastScriptRest = mLastPeekTime = GetTickCount();
+
+	LARGE_INTEGER start;
+	ResultType result = OK;
+	int exit_code = 0;
+
+	++g_nThreads;
+	if (mFirstLine)
+	{
+		mAutoExecSectionIsRunning = true;
+		QueryPerformanceCounter(&start);
+		result = mFirstLine->ExecUntil(UNTIL_RETURN);
+		BenchmarkReport("exec", "AutoExecute", BenchmarkElapsedMS(start));
+		mAutoExecSectionIsRunning = false;
+	}
+	if (result == FAIL || result == CRITICAL_ERROR) // The labels below probably rely on whatever setup failed.
+	{
+		exit_code = CRITICAL_ERROR;
+		goto done;
+	}
+	// Let the auto-execute section establish the defaults (e.g. SetBatchLines) for the labels below,
+	// just as it would for hotkey subroutines:
+	global_clear_state(*g);
+	CopyMemory(&g_default, g, sizeof(global_struct));
+
+	for (Label *label = mFirstLabel; label; label = label->mNextLabel)
+	{
+		if (strnicmp(label->mName, BENCHMARK_LABEL_PREFIX, BENCHMARK_LABEL_PREFIX_LENGTH))
+			continue;
+		CopyMemory(g, &g_default, sizeof(global_struct)); // Each label starts with the same settings.
+		QueryPerformanceCounter(&start);
+		result = label->Execute();
+		BenchmarkReport("label", label->mName, BenchmarkElapsedMS(start));
+		if (result == FAIL || result == CRITICAL_ERROR)
+		{
+			exit_code = CRITICAL_ERROR; // Report the failure via exit code but still run the remaining labels.
+			g_ErrorLevel->Assign(ERRORLEVEL_NONE);
+		}
+	}
+done:
+	--g_nThreads;
+	Line::FileAppendCacheFlush(NULL, true); // Write out any text buffered by #FileAppendBuffer, as TerminateApp() would.
+	BenchmarkReport("count", "SimpleHeapBlocksAtEnd", SimpleHeap::GetBlockCount()); // Runtime growth reflects dynamically created vars and such.
+	BenchmarkReport("count", "DerefBufPeakBytes", (double)Line::sDerefBufPeakSize);
+	UINT image_cache_hits, image_cache_misses;
+	ImageCacheGetCounts(image_cache_hits, image_cache_misses);
+	BenchmarkReport("count", "ImageCacheHits", image_cache_hits);
+	BenchmarkReport("count", "ImageCacheMisses", image_cache_misses);
+	UINT send_cache_hits, send_cache_misses;
+	double send_cache_time_saved;
+	SendCacheGetCounts(send_cache_hits, send_cache_misses, send_cache_time_saved);
+	BenchmarkReport("count", "SendCacheHits", send_cache_hits);
+	BenchmarkReport("count", "SendCacheMisses", send_cache_misses);
+	BenchmarkReport("count", "SendCacheTimeSavedMS", send_cache_time_saved);
+	UINT window_snapshot_hits, window_snapshot_misses;
+	WindowSnapshotGetCounts(window_snapshot_hits, window_snapshot_misses);
+	BenchmarkReport("count", "WindowSnapshotHits", window_snapshot_hits);
+	BenchmarkReport("count", "WindowSnapshotMisses", window_snapshot_misses);
+	// Report each cached RegEx's use count and the tier that executes it.  The name is the tier followed
+	// by the RegEx, with any control characters (such as a `n option) changed to spaces to keep the
+	// record on one line:
+	char name[LINE_SIZE], *regex, *tier, *cp;
+	int use_count;
+	for (int i = 0; (use_count = RegExCacheGetInfo(i, regex, tier)) != -1; ++i)
+	{
+		if (!regex)
+			continue;
+		snprintf(name, sizeof(name), "%s %s", tier, regex);
+		for (cp = name; *cp; ++cp)
+			if ((UCHAR)*cp < ' ')
+				*cp = ' ';
+		BenchmarkReport("regex", name, use_count);
+	}
+	// Run the checks last so that they don't affect any of the records above.  Each record is the number
+	// of cases that failed:
+	int failures;
+	BenchmarkReport("check", "WindowSnapshot", failures = WindowCheckSnapshot());
+	if (failures)
+		exit_code = CRITICAL_ERROR;
+	BenchmarkReport("check", "WindowEventWatch", failures = WindowCheckEventWatch());
+	if (failures)
+		exit_code = CRITICAL_ERROR;
+	BenchmarkReport("check", "WindowCriteria", failures = WindowCheckCriteria());
+	if (failures)
+		exit_code = CRITICAL_ERROR;
+	fclose(mBenchmarkFile);
+	mBenchmarkFile = NULL;
+	return exit_code;
+}
+
+#endif
@@ -42,6 +42,86 @@ GNU General Public License for more details.
 #include "globaldata.h" // for a lot of things
 #include "qmath.h" // For ExpandExpression()
 
+// Arena for the temporary strings of ExpandExpression(), such as the results of concatenation and of
+// function calls that must be kept until the expression is done with them.  Each call to ExpandExpression()
+// notes the arena's position upon entry and restores it upon exit, which frees everything it allocated in
+// one step.  This is safe for nested calls (an expression that calls a function whose body evaluates other
+// expressions) and interrupting threads because those always finish before the expression that started
+// them resumes.  It replaces the former combination of _alloca() for small strings and malloc()/free()
+// for larger ones, so long chains of concatenation no longer cost a malloc() and free() per operator.
+struct ExprArenaBlock
+{
+	ExprArenaBlock *prev; // The block beneath this one.
+	size_t size, used;
+	char data[1]; // The actual size is "size".
+};
+struct ExprArenaMark
+{
+	ExprArenaBlock *block;
+	size_t used;
+};
+#define EXPR_ARENA_BLOCK_SIZE (64 * 1024) // Blocks for larger strings are made just big enough to hold them.
+static ExprArenaBlock *sExprArena = NULL;      // The block currently being allocated from.
+static ExprArenaBlock *sExprArenaSpare = NULL; // A standard-size block kept to avoid thrashing at block boundaries.
+
+
+
+static inline void ExprArenaGetMark(ExprArenaMark &aMark)
+{
+	aMark.block = sExprArena;
+	aMark.used = sExprArena ? sExprArena->used : 0;
+}
+
+
+
+static char *ExprArenaAlloc(size_t aSize)
+// Returns NULL if out of memory.
+{
+	ExprArenaBlock *block = sExprArena;
+	if (!block || block->size - block->used < aSize)
+	{
+		if (aSize <= EXPR_ARENA_BLOCK_SIZE && sExprArenaSpare)
+		{
+			block = sExprArenaSpare;
+			sExprArenaSpare = NULL;
+		}
+		else
+		{
+			size_t size = aSize > EXPR_ARENA_BLOCK_SIZE ? aSize : EXPR_ARENA_BLOCK_SIZE;
+			if (   !(block = (ExprArenaBlock *)malloc(sizeof(ExprArenaBlock) - 1 + size))   )
+				return NULL;
+			block->size = size;
+		}
+		block->used = 0;
+		block->prev = sExprArena;
+		sExprArena = block;
+	}
+	char *mem = block->data + block->used;
+	block->used += aSize;
+	return mem;
+}
+
+
+
+static void ExprArenaReset(ExprArenaMark &aMark)
+// Frees everything allocated since aMark was taken.
+{
+	ExprArenaBlock *block;
+	while (sExprArena != aMark.block)
+	{
+		block = sExprArena;
+		sExprArena = block->prev;
+		if (block->size == EXPR_ARENA_BLOCK_SIZE && !sExprArenaSpare)
+			sExprArenaSpare = block;
+		else
+			free(block); // Blocks for very large strings are not kept.
+	}
+	if (sExprArena)
+		sExprArena->used = aMark.used;
+}
+
+
+
 // __forceinline: Decided against it for this function because alhough it's only called by one caller,
 // testing shows that it wastes stack space (room for its automatic variables would be unconditionally 
 // reserved in the stack of its caller).  Also, the performance benefit of inlining this is too slight.
@@ -70,8 +150,10 @@ char *Line::ExpandExpression(int aArgIndex, ResultType &aResult, char *&aTarget,
 	// The following must be defined early so that mem_count is initialized and the array is guaranteed to be
 	// "in scope" in case of early "goto" (goto substantially boosts performance and reduces code size here).
 	#define MAX_EXPR_MEM_ITEMS 200 // v1.0.47.01: Raised from 100 because a line consisting entirely of concat operators can exceed it.  However, there's probably not much point to going much above MAX_TOKENS/2 because then it would reach the MAX_TOKENS limit first.
-	char *mem[MAX_EXPR_MEM_ITEMS]; // No init necessary.  In most cases, it will never be used.
+	char *mem[MAX_EXPR_MEM_ITEMS]; // No init necessary.  Used only for memory given to us by built-in functions.
 	int mem_count = 0; // The actual number of items in use in the above array.
+	ExprArenaMark arena_mark; // Temporary strings allocated by this layer are freed by restoring the arena to this position.
+	ExprArenaGetMark(arena_mark);
 	char *result_to_return = ""; // By contrast, NULL is used to tell the caller to abort the current thread.  That isn't done for normal syntax errors, just critical conditions such as out-of-memory.
 	Var *output_var = (mActionType == ACT_ASSIGNEXPR) ? OUTPUT_VAR : NULL; // Resolve early because it's similar in usage/scope to the above.  Plus MUST be resolved prior to calling any script-functions since they could change the values in sArgVar[].
 
@@ -95,7 +177,7 @@ char *Line::ExpandExpression(int aArgIndex, ResultType &aResult, char *&aTarget,
 	char right_buf[MAX_NUMBER_SIZE]; // Only needed for holding numbers
 	char *result; // "result" is used for return values and also the final result.
 	VarSizeType result_length;
-	size_t result_size, alloca_usage = 0; // v1.0.45: Track amount of alloca mem to avoid stress on stack from extreme expressions (mostly theoretical).
+	size_t result_size;
 	BOOL done, done_and_have_an_output_var, make_result_persistent, left_branch_is_true
 		, left_was_negative, is_pre_op; // BOOL vs. bool benchmarks slightly faster, and is slightly smaller in code size (or maybe it's cp1's int vs. char that shrunk it).
 	ExprTokenType *circuit_token, *this_postfix, *p_postfix;
@@ -103,16 +185,6 @@ char *Line::ExpandExpression(int aArgIndex, ResultType &aResult, char *&aTarget,
 	VarBkp *var_backup = NULL;  // If needed, it will hold an array of VarBkp objects. v1.0.40.07: Initialized to NULL to facilitate an approach that's more maintainable.
 	int var_backup_count; // The number of items in the above array (when it's non-NULL).
 
-	// v1.0.44.06: EXPR_SMALL_MEM_LIMIT is the means by which _alloca() is used to boost performance a
-	// little by avoiding the overhead of malloc+free for small strings.  The limit should be something
-	// small enough that the chance that even 10 of them would cause stack overflow is vanishingly small
-	// (the program is currently compiled to allow stack to expand anyway).  Even in a worst-case
-	// scenario where an expression is composed entirely of functions and they all need to use this
-	// limit of stack space, there's a practical limit on how many functions you can call in an
-	// expression due to MAX_TOKENS (probably around MAX_TOKENS / 3).
-	#define EXPR_SMALL_MEM_LIMIT 4097 // The maximum size allowed for an item to qualify for alloca.
-	#define EXPR_ALLOCA_LIMIT 40000  // The maximum amount of alloca memory for all items.  v1.0.45: An extra precaution against stack stress in extreme/theoretical cases.
-
 	// For each item in the postfix array: if it's an operand, push it onto stack; if it's an operator or
 	// function call, evaluate it and push its result onto the stack.  SYM_INVALID is the special symbol
 	// that marks the end of the postfix array.
@@ -227,22 +299,10 @@ char *Line::ExpandExpression(int aArgIndex, ResultType &aResult, char *&aTarget,
 						result = target;
 						target += result_size; // Point it to the location where the next string would be written.
 					}
-					else if (result_size < EXPR_SMALL_MEM_LIMIT && alloca_usage < EXPR_ALLOCA_LIMIT) // See comments at EXPR_SMALL_MEM_LIMIT.
+					else if (   !(result = ExprArenaAlloc(result_size))   ) // Need some temporary memory that lasts until the expression is done.
 					{
-						result = (char *)_alloca(result_size);
-						alloca_usage += result_size; // This might put alloca_usage over the limit by as much as EXPR_SMALL_MEM_LIMIT, but that is fine because it's more of a guideline than a limit.
-					}
-					else // Need to create some new persistent memory for our temporary use.
-					{
-						if (mem_count == MAX_EXPR_MEM_ITEMS // No more slots left (should be nearly impossible).
-							|| !(mem[mem_count] = (char *)malloc(result_size)))
-						{
-							LineError(ERR_OUTOFMEM ERR_ABORT, FAIL, this_token.var->mName);
-							goto abort;
-						}
-						// Point result to its new, more persistent location:
-						result = mem[mem_count];
-						++mem_count; // Must be done last.
+						LineError(ERR_OUTOFMEM ERR_ABORT, FAIL, this_token.var->mName);
+						goto abort;
 					}
 					this_token.var->Get(result); // MUST USE "result" TO AVOID OVERWRITING MARKER/VAR UNION.
 					this_token.marker = result;  // Must be done after above because marker and var overlap in union.
@@ -796,30 +856,22 @@ char *Line::ExpandExpression(int aArgIndex, ResultType &aResult, char *&aTarget,
 					this_token.marker = (char *)memcpy(target, result, result_size); // Benches slightly faster than strcpy().
 					target += result_size; // Point it to the location where the next string would be written.
 				}
-				else if (result_size < EXPR_SMALL_MEM_LIMIT && alloca_usage < EXPR_ALLOCA_LIMIT) // See comments at EXPR_SMALL_MEM_LIMIT.
+				else // Need some temporary memory for our use until the expression is done.
 				{
-					this_token.marker = (char *)memcpy(_alloca(result_size), result, result_size); // Benches slightly faster than strcpy().
-					alloca_usage += result_size; // This might put alloca_usage over the limit by as much as EXPR_SMALL_MEM_LIMIT, but that is fine because it's more of a guideline than a limit.
-				}
-				else // Need to create some new persistent memory for our temporary use.
-				{
-					// In real-world scripts the need for additonal memory allocation should be quite
-					// rare because it requires a combination of worst-case situations:
+					// In real-world scripts the need for this should be somewhat rare because it requires a
+					// combination of worst-case situations:
 					// - Called-function's return value is in their new deref buf (rare because return
 					//   values are more often literal numbers, true/false, or variables).
 					// - We still have more functions to call here (which is somewhat atypical).
 					// - There's insufficient room at the end of the deref buf to store the return value
 					//   (unusual because the deref buf expands in block-increments, and also because
 					//   return values are usually small, such as numbers).
-					if (mem_count == MAX_EXPR_MEM_ITEMS // No more slots left (should be nearly impossible).
-						|| !(mem[mem_count] = (char *)malloc(result_size)))
+					if (   !(this_token.marker = ExprArenaAlloc(result_size))   )
 					{
 						LineError(ERR_OUTOFMEM ERR_ABORT, FAIL, func.mName);
 						goto abort;
 					}
-					// Make the token's result the new, more persistent location:
-					this_token.marker = (char *)memcpy(mem[mem_count], result, result_size); // Benches slightly faster than strcpy().
-					++mem_count; // Must be done last.
+					memcpy(this_token.marker, result, result_size); // Benches slightly faster than strcpy().
 				}
 			}
 			else // make_result_persistent==false
@@ -1197,9 +1249,9 @@ char *Line::ExpandExpression(int aArgIndex, ResultType &aResult, char *&aTarget,
 					// simplify the code).
 					right_length = (right.symbol == SYM_VAR) ? right.var->LengthIgnoreBinaryClip() : strlen(right_string);
 					if (sym_assign_var // Since "right" is being appended onto a variable ("left"), an optimization is possible.
-						&& sym_assign_var->AppendIfRoom(right_string, (VarSizeType)right_length)) // But only if the target variable has enough remaining capacity.
+						&& sym_assign_var->AppendWithGrowth(right_string, (VarSizeType)right_length)) // Appends in place, growing the capacity geometrically if needed so that repeated appends are amortized O(1).
 					{
-						// AppendIfRoom() always fails for VAR_CLIPBOARD, so below won't execute for it (which is
+						// AppendWithGrowth() always fails for VAR_CLIPBOARD, so below won't execute for it (which is
 						// good because don't want clipboard to stay as SYM_VAR after the assignment. This is
 						// because it simplifies the code not to have to worry about VAR_CLIPBOARD in BIFs, etc.)
 						this_token.var = sym_assign_var; // Make the result a variable rather than a normal operand so that its
@@ -1235,7 +1287,7 @@ char *Line::ExpandExpression(int aArgIndex, ResultType &aResult, char *&aTarget,
 							// MUST DO THE ABOVE CHECK because the next section further below might free the
 							// destination memory before doing the operation. Thus, if the destination is the
 							// same as one of the sources, freeing it beforehand would obviously be a problem.
-							if (temp_var->AppendIfRoom(right_string, (VarSizeType)right_length))
+							if (temp_var->AppendWithGrowth(right_string, (VarSizeType)right_length))
 							{
 								if (done_and_have_an_output_var) // Fix for v1.0.48: Checking "temp_var == output_var" would not be enough for cases like v := (v := v . "a") . "b"
 									goto normal_end_skip_output_var; // Nothing more to do because it has even taken care of output_var already.
@@ -1247,8 +1299,9 @@ char *Line::ExpandExpression(int aArgIndex, ResultType &aResult, char *&aTarget,
 									goto push_this_token;
 								}
 							}
-							//else no optimizations are possible because: 1) No room; 2) The overlap between the
-							// source and dest requires temporary memory.  So fall through to the slower method.
+							//else no optimizations are possible because: 1) Clipboard, small var, or out of memory;
+							// 2) The overlap between the source and dest requires temporary memory.  So fall through
+							// to the slower method (which also reports any error).
 						}
 						else if (result != right_string) // No overlap between the two sources and dest.
 						{
@@ -1299,21 +1352,10 @@ char *Line::ExpandExpression(int aArgIndex, ResultType &aResult, char *&aTarget,
 						this_token.marker = target;
 						target += result_size;  // Adjust target for potential future use by another concat or function call.
 					}
-					else if (result_size < EXPR_SMALL_MEM_LIMIT && alloca_usage < EXPR_ALLOCA_LIMIT) // See comments at EXPR_SMALL_MEM_LIMIT.
+					else if (   !(this_token.marker = ExprArenaAlloc(result_size))   ) // See the similar section higher above.
 					{
-						this_token.marker = (char *)_alloca(result_size);
-						alloca_usage += result_size; // This might put alloca_usage over the limit by as much as EXPR_SMALL_MEM_LIMIT, but that is fine because it's more of a guideline than a limit.
-					}
-					else // Need to create some new persistent memory for our temporary use.
-					{
-						// See the nearly identical section higher above for comments:
-						if (mem_count == MAX_EXPR_MEM_ITEMS // No more slots left (should be nearly impossible).
-							|| !(this_token.marker = mem[mem_count] = (char *)malloc(result_size)))
-						{
-							LineError(ERR_OUTOFMEM ERR_ABORT);
-							goto abort;
-						}
-						++mem_count;
+						LineError(ERR_OUTOFMEM ERR_ABORT);
+						goto abort;
 					}
 					if (left_length)
 						memcpy(this_token.marker, left_string, left_length);  // Not +1 because don't need the zero terminator.
@@ -1752,6 +1794,7 @@ abnormal_end: // Currently the same as normal_end; it's separate to improve read
 normal_end_skip_output_var:
 	for (i = mem_count; i--;) // Free any temporary memory blocks that were used.  Using reverse order might reduce memory fragmentation a little (depending on implementation of malloc).
 		free(mem[i]);
+	ExprArenaReset(arena_mark);
 
 	return result_to_return;
 
@@ -1833,11 +1876,11 @@ ResultType Line::ExpandArgs(VarSizeType aSpaceNeeded, Var *aArgVar[])
 			// Do a free() and malloc(), which should be far more efficient than realloc(), especially if
 			// there is a large amount of memory involved here (realloc's ability to do an in-place resize
 			// might be unlikely for anything other than small blocks; see compiler's realloc.c):
-			free(sDerefBuf);
 			if (sDerefBufSize > LARGE_DEREF_BUF_SIZE)
 				--sLargeDerefBufs;
+			DerefBufRelease(sDerefBuf, sDerefBufSize);
 		}
-		if (   !(sDerefBuf = (char *)malloc(new_buf_size))   )
+		if (   !(sDerefBuf = DerefBufAcquire(new_buf_size))   )
 		{
 			// Error msg was formerly: "Ran out of memory while attempting to dereference this line's parameters."
 			sDerefBufSize = 0;  // Reset so that it can make another attempt, possibly smaller, next time.
@@ -1846,6 +1889,8 @@ ResultType Line::ExpandArgs(VarSizeType aSpaceNeeded, Var *aArgVar[])
 		sDerefBufSize = new_buf_size;
 		if (sDerefBufSize > LARGE_DEREF_BUF_SIZE)
 			++sLargeDerefBufs;
+		if (sDerefBufPrivatizedSize + sDerefBufSize > sDerefBufPeakSize)
+			sDerefBufPeakSize = sDerefBufPrivatizedSize + sDerefBufSize;
 	}
 
 	// Always init our_buf_marker even if zero iterations, because we want to enforce
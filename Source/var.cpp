@@ -934,6 +934,74 @@ ResultType Var::AppendIfRoom(char *aStr, VarSizeType aLength)
 
 
 
+ResultType Var::AppendWithGrowth(char *aStr, VarSizeType aLength)
+// Same as AppendIfRoom() except that when there isn't enough room, the variable's capacity is grown
+// geometrically (with its contents preserved) so that a long series of appends such as "x .= y" inside
+// a loop costs amortized O(1) per append rather than an O(n) copy each time the capacity runs out.
+// Returns FAIL without displaying anything if the append can't be done this way (e.g. VAR_CLIPBOARD,
+// out of memory or #MaxMem exceeded).  In that case the variable is left unchanged and the caller
+// should fall back to its normal method, which will report the error (if any).
+// Small variables are left to Assign() so that they can keep using SimpleHeap (see its comments).
+{
+	if (AppendIfRoom(aStr, aLength)) // Also handles aLength==0 and the other trivial cases.
+		return OK;
+	// Relies on the fact that aliases can't point to other aliases (enforced by UpdateAlias()):
+	Var &var = *(mType == VAR_ALIAS ? mAliasFor : this);
+	if (var.mType != VAR_NORMAL)
+		return FAIL;
+	VarSizeType var_length = var.LengthIgnoreBinaryClip();
+	size_t space_needed = (size_t)var_length + aLength + 1; // +1 for the zero terminator.
+	if (var.mHowAllocated != ALLOC_MALLOC && space_needed <= MAX_ALLOC_SIMPLE)
+		return FAIL; // Let Assign() put it on SimpleHeap.
+	if (space_needed > g_MaxVarCapacity)
+		return FAIL;
+
+	// Double the capacity, but never by less than MAX_PATH (which is also what Assign() would use as the
+	// minimum for a malloc'd var) and never beyond #MaxMem or the 2 GB sanity limit used by Assign():
+	size_t new_size = (size_t)var.mCapacity * 2;
+	if (new_size < MAX_PATH)
+		new_size = MAX_PATH;
+	if (new_size < space_needed)
+		new_size = space_needed;
+	if (new_size > g_MaxVarCapacity)
+		new_size = g_MaxVarCapacity; // Already verified above to be enough.
+	if (new_size > 2147483647)
+		return FAIL;
+
+	char *new_mem;
+	if (var.mHowAllocated == ALLOC_MALLOC && var.mCapacity)
+	{
+		// aStr might be part of the var's own contents (e.g. x .= x), in which case realloc() would
+		// invalidate it.  So remember its offset and rebase it afterward:
+		size_t str_offset = (aStr >= var.mContents && aStr < var.mContents + var.mCapacity)
+			? aStr - var.mContents : (size_t)-1;
+		if (   !(new_mem = (char *)realloc(var.mContents, new_size))   )
+			return FAIL; // realloc() left the old block intact.
+		if (str_offset != (size_t)-1)
+			aStr = new_mem + str_offset;
+	}
+	else // ALLOC_NONE, ALLOC_SIMPLE, or a malloc'd var whose memory was freed (mCapacity==0).
+	{
+		if (   !(new_mem = (char *)malloc(new_size))   )
+			return FAIL;
+		// The old contents (the empty string or a block on SimpleHeap) stay valid, so aStr is
+		// unaffected even if it overlaps them:
+		memcpy(new_mem, var.mContents, var_length);
+		var.mHowAllocated = ALLOC_MALLOC; // Once malloc'd, a var never goes back to the other modes (see Assign()).
+	}
+	var.mContents = new_mem;
+	var.mCapacity = (VarSizeType)new_size;
+	var.mAttrib &= ~VAR_ATTRIB_CACHE_DISABLED; // The address changed, so any address the script took is no longer valid (see Assign()).
+
+	memcpy(var.mContents + var_length, aStr, aLength); // No overlap is possible now that the destination is beyond the old length.
+	var.mContents[var_length + aLength] = '\0';
+	var.mLength = var_length + aLength;
+	var.mAttrib &= ~VAR_ATTRIB_OFTEN_REMOVED; // See AppendIfRoom().
+	return OK;
+}
+
+
+
 void Var::AcceptNewMem(char *aNewMem, VarSizeType aLength)
 // Caller provides a new malloc'd memory block (currently must be non-NULL).  That block and its
 // contents are directly hung onto this variable in place of its old block, which is freed (except
@@ -1002,6 +1070,67 @@ void Var::SetLengthFromContents()
 
 
 
+// Backups of function variables are stored in a stack of frames rather than one malloc'd array per call.
+// This works because backups are always restored in the reverse order they were made: a recursive call
+// returns before its caller does, and a thread that interrupts another finishes before the interrupted
+// one resumes.  Pushing and popping a frame is typically just an adjustment of sVarBkpBlock->used, so
+// recursion and interruption no longer cost a malloc() and free() per call.
+struct VarBkpBlock
+{
+	VarBkpBlock *prev; // The block beneath this one in the stack.
+	int capacity, used; // Number of items in item[] and the number of those in use.
+	VarBkp item[1];     // The actual size is capacity.
+};
+#define VAR_BKP_BLOCK_MIN_ITEMS 2048 // About 64 KB per block.
+static VarBkpBlock *sVarBkpBlock = NULL; // The topmost block of the stack.
+static VarBkpBlock *sVarBkpSpare = NULL; // The most recently emptied block, kept to avoid thrashing when calls repeatedly cross a block boundary.
+
+
+
+static VarBkp *VarBkpPush(int aCount)
+// Returns a contiguous frame of aCount items, or NULL if out of memory.
+{
+	VarBkpBlock *block = sVarBkpBlock;
+	if (!block || block->used + aCount > block->capacity) // A new block is needed on top of the stack.
+	{
+		if (sVarBkpSpare && sVarBkpSpare->capacity >= aCount)
+		{
+			block = sVarBkpSpare;
+			sVarBkpSpare = NULL;
+		}
+		else
+		{
+			int capacity = aCount > VAR_BKP_BLOCK_MIN_ITEMS ? aCount : VAR_BKP_BLOCK_MIN_ITEMS;
+			if (   !(block = (VarBkpBlock *)malloc(sizeof(VarBkpBlock) + (capacity - 1) * sizeof(VarBkp)))   )
+				return NULL;
+			block->capacity = capacity;
+		}
+		block->used = 0;
+		block->prev = sVarBkpBlock;
+		sVarBkpBlock = block;
+	}
+	VarBkp *frame = block->item + block->used;
+	block->used += aCount;
+	return frame;
+}
+
+
+
+static void VarBkpPop(VarBkp *aFrame)
+// Releases aFrame and anything above it in the stack.  aFrame must have been returned by VarBkpPush().
+{
+	VarBkpBlock *block = sVarBkpBlock;
+	while (aFrame < block->item || aFrame >= block->item + block->capacity) // aFrame is in a lower block, so this block is now empty.
+	{
+		free(sVarBkpSpare); // Keep only one spare to avoid holding onto memory after deep recursion.
+		sVarBkpSpare = block;
+		sVarBkpBlock = block = block->prev; // There is always a prev here, since aFrame had to come from somewhere.
+	}
+	block->used = (int)(aFrame - block->item);
+}
+
+
+
 ResultType Var::BackupFunctionVars(Func &aFunc, VarBkp *&aVarBackup, int &aVarBackupCount)
 // All parameters except the first are output parameters that are set for our caller (though caller
 // is responsible for having initialized aVarBackup to NULL).
@@ -1011,28 +1140,34 @@ ResultType Var::BackupFunctionVars(Func &aFunc, VarBkp *&aVarBackup, int &aVarBa
 	if (   !(aVarBackupCount = aFunc.mVarCount + aFunc.mLazyVarCount)   )  // Nothing needs to be backed up.
 		return OK; // Leave aVarBackup set to NULL as set by the caller.
 
-	// NOTES ABOUT MALLOC(): Apparently, the implementation of malloc() is quite good, at least for small blocks
-	// needed to back up 50 or less variables.  It nearly as fast as alloca(), at least when the system
-	// isn't under load and has the memory to spare without swapping.  Therefore, the attempt to use alloca to
-	// speed up recursive script-functions didn't result in enough of a speed-up (only 1 to 5%) to be worth the
-	// added complexity.
 	// Since Var is not a POD struct (it contains private members, a custom constructor, etc.), the VarBkp
 	// POD struct is used to hold the backup because it's probably better performance than using Var's
 	// constructor to create each backup array element.
-	if (   !(aVarBackup = (VarBkp *)malloc(aVarBackupCount * sizeof(VarBkp)))   ) // Caller will take care of freeing it.
+	if (   !(aVarBackup = VarBkpPush(aVarBackupCount))   ) // FreeAndRestoreFunctionVars() will pop it.
 		return FAIL;
 
-	int i;
+	int i, reserved_count = aVarBackupCount;
 	aVarBackupCount = 0;  // Init only once prior to both loops. aVarBackupCount is being "overloaded" to track the current item in aVarBackup, BUT ALSO its being updated to an actual count in case some statics are omitted from the array.
 
+	// Don't bother backing up statics because they won't need to be restored.  Nor locals that are still
+	// blank and own no memory, which in a recursive function is usually most of them (e.g. those not yet
+	// reached by the interrupted/recursed layer): the new layer would start out that way anyway, and
+	// FreeAndRestoreFunctionVars() leaves them that way again.  A cached number isn't blank even though
+	// its contents might be, hence the check of VAR_ATTRIB_CONTENTS_OUT_OF_DATE.
+	#define VAR_NEEDS_BACKUP(var) (!((var)->mAttrib & VAR_ATTRIB_STATIC) \
+		&& ((var)->mType != VAR_NORMAL || (var)->mCapacity || ((var)->mAttrib & VAR_ATTRIB_CONTENTS_OUT_OF_DATE)))
 	// Note that Backup() does not make the variable empty after backing it up because that is something
 	// that must be done by our caller at a later stage.
 	for (i = 0; i < aFunc.mVarCount; ++i)
-		if (!(aFunc.mVar[i]->mAttrib & VAR_ATTRIB_STATIC)) // Don't bother backing up statics because they won't need to be restored.
+		if (VAR_NEEDS_BACKUP(aFunc.mVar[i]))
 			aFunc.mVar[i]->Backup(aVarBackup[aVarBackupCount++]);
 	for (i = 0; i < aFunc.mLazyVarCount; ++i)
-		if (!(aFunc.mLazyVar[i]->mAttrib & VAR_ATTRIB_STATIC)) // Don't bother backing up statics because they won't need to be restored.
+		if (VAR_NEEDS_BACKUP(aFunc.mLazyVar[i]))
 			aFunc.mLazyVar[i]->Backup(aVarBackup[aVarBackupCount++]);
+	// Give back the part of the frame that wasn't needed.  This frame is the topmost one, and VarBkpPush()
+	// put all of it in the topmost block.  aVarBackup is kept even if nothing was backed up because
+	// callers treat it as the indicator that this is a recursed/interrupted layer.
+	sVarBkpBlock->used -= reserved_count - aVarBackupCount;
 	return OK;
 }
 
@@ -1083,6 +1218,13 @@ void Var::FreeAndRestoreFunctionVars(Func &aFunc, VarBkp *&aVarBackup, int &aVar
 		aFunc.mVar[i]->Free(VAR_ALWAYS_FREE_BUT_EXCLUDE_STATIC, true); // Pass "true" to exclude aliases, since their targets should not be freed (they don't belong to this function).
 	for (i = 0; i < aFunc.mLazyVarCount; ++i)
 		aFunc.mLazyVar[i]->Free(VAR_ALWAYS_FREE_BUT_EXCLUDE_STATIC, true);
+	if (aVarBackup)
+		// A blank ByRef parameter that BackupFunctionVars() skipped might have been made an alias by this
+		// layer, and the restore below won't undo that since it has no backup.  Any that were backed up
+		// get their type restored below anyway.  Statics are never aliases.
+		for (i = 0; i < aFunc.mParamCount; ++i)
+			if (aFunc.mParam[i].is_byref)
+				aFunc.mParam[i].var->ConvertToNonAliasIfNecessary();
 
 	// The freeing (above) MUST be done prior to the restore-from-backup below (otherwise there would be
 	// a memory leak).  Static variables are never backed up and thus do not exist in the aVarBackup array.
@@ -1102,7 +1244,7 @@ void Var::FreeAndRestoreFunctionVars(Func &aFunc, VarBkp *&aVarBackup, int &aVar
 			var.mAttrib = bkp.mAttrib;
 			var.mType = bkp.mType;
 		}
-		free(aVarBackup);
+		VarBkpPop(aVarBackup);
 		aVarBackup = NULL; // Some callers want this reset; it's an indicator of whether the next function call in this expression (if any) will have a backup.
 	}
 }
@@ -389,6 +389,7 @@ public:
 	#define VAR_FREE_IF_LARGE                  4
 	void Free(int aWhenToFree = VAR_ALWAYS_FREE, bool aExcludeAliases = false);
 	ResultType AppendIfRoom(char *aStr, VarSizeType aLength);
+	ResultType AppendWithGrowth(char *aStr, VarSizeType aLength);
 	void AcceptNewMem(char *aNewMem, VarSizeType aLength);
 	void SetLengthFromContents();
 
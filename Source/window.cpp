@@ -410,6 +410,7 @@ HWND WinClose(global_struct &aSettings, char *aTitle, char *aText, int aTimeToWa
 
 HWND WinClose(HWND aWnd, int aTimeToWaitForClose, bool aKillIfHung)
 {
+	WindowSnapshotDiscard(aWnd); // Its HWND may soon be reused by a new window.
 	if (aKillIfHung) // This part is based on the AutoIt3 source.
 		// Update: Another reason not to wait a long time with the below is that WinKill
 		// is normally only used when the target window is suspected of being hung.  It
@@ -532,6 +533,59 @@ HWND WinActive(global_struct &aSettings, char *aTitle, char *aText, char *aExclu
 
 
 
+HWND WinActive(global_struct &aSettings, WindowCriteria &aCriteria)
+// Same as the other WinActive() except that the criteria were parsed in advance (such as for #IfWinActive)
+// and the last found window is never updated.
+// This function must be kept thread-safe because it may be called (indirectly) by hook thread too.
+{
+	HWND target_window;
+	if (aCriteria.mUseForeground)
+	{
+		SET_TARGET_TO_ALLOWABLE_FOREGROUND(aSettings.DetectHiddenWindows)
+		return target_window;
+	}
+	HWND fore_win = GetForegroundWindow();
+	if (!fore_win || !(aSettings.DetectHiddenWindows || IsWindowVisible(fore_win)))
+		return NULL;
+	WindowSearch ws;
+	ws.SetCandidate(fore_win);
+	return (ws.SetCriteria(aSettings, aCriteria) && ws.IsMatch()) ? fore_win : NULL;
+}
+
+
+
+static HWND WinExistFind(global_struct &aSettings, WindowSearch &aSearch)
+// Returns the window that matches the criteria already set in aSearch, or NULL if none.
+// This function must be kept thread-safe because it may be called (indirectly) by hook thread too.
+{
+	if (aSearch.mCriteria & CRITERION_ID) // "ahk_id" will be satisified if that HWND still exists and is valid.
+	{
+		// Explicitly allow HWND_BROADCAST for all commands that use WinExist (which is just about all
+		// window commands), even though it's only valid with ScriptPostSendMessage().
+		// This is because HWND_BROADCAST is probably never used as the HWND for a real window, so there
+		// should be no danger of any reasonable script ever passing that value in as a real target window,
+		// which should thus minimize the chance of a crash due to calling various API functions
+		// with invalid window handles.
+		if (   aSearch.mCriterionHwnd != HWND_BROADCAST // It's not exempt from the other checks on the two lines below.
+			&& (!IsWindow(aSearch.mCriterionHwnd)    // And it's either not a valid window...
+				// ...or the window is not detectible (in v1.0.40.05, child windows are detectible even if hidden):
+				|| !(aSettings.DetectHiddenWindows || IsWindowVisible(aSearch.mCriterionHwnd)
+					|| (GetWindowLong(aSearch.mCriterionHwnd, GWL_STYLE) & WS_CHILD)))   )
+			return NULL;
+
+		// Otherwise, the window is valid and detectible.
+		aSearch.SetCandidate(aSearch.mCriterionHwnd);
+		if (!aSearch.IsMatch()) // Checks if it matches any other criteria: WinTitle, WinText, ExcludeTitle, and anything in the aAlreadyVisited list.
+			return NULL;
+		//else fall through to the line below, since mFoundCount and mFoundParent were set by IsMatch().
+	}
+	else // aWinTitle doesn't start with "ahk_id".  Try to find a matching window.
+		EnumWindows(EnumParentFind, (LPARAM)&aSearch);
+	return aSearch.mFoundParent;
+}
+
+
+
 HWND WinExist(global_struct &aSettings, char *aTitle, char *aText, char *aExcludeTitle, char *aExcludeText
 	, bool aFindLastMatch, bool aUpdateLastUsed, HWND aAlreadyVisited[], int aAlreadyVisitedCount)
 // This function must be kept thread-safe because it may be called (indirectly) by hook thread too.
@@ -564,31 +618,26 @@ HWND WinExist(global_struct &aSettings, char *aTitle, char *aText, char *aExclud
 	ws.mAlreadyVisited = aAlreadyVisited;
 	ws.mAlreadyVisitedCount = aAlreadyVisitedCount;
 
-	if (ws.mCriteria & CRITERION_ID) // "ahk_id" will be satisified if that HWND still exists and is valid.
-	{
-		// Explicitly allow HWND_BROADCAST for all commands that use WinExist (which is just about all
-		// window commands), even though it's only valid with ScriptPostSendMessage().
-		// This is because HWND_BROADCAST is probably never used as the HWND for a real window, so there
-		// should be no danger of any reasonable script ever passing that value in as a real target window,
-		// which should thus minimize the chance of a crash due to calling various API functions
-		// with invalid window handles.
-		if (   ws.mCriterionHwnd != HWND_BROADCAST // It's not exempt from the other checks on the two lines below.
-			&& (!IsWindow(ws.mCriterionHwnd)    // And it's either not a valid window...
-				// ...or the window is not detectible (in v1.0.40.05, child windows are detectible even if hidden):
-				|| !(aSettings.DetectHiddenWindows || IsWindowVisible(ws.mCriterionHwnd)
-					|| (GetWindowLong(ws.mCriterionHwnd, GWL_STYLE) & WS_CHILD)))   )
-			return NULL;
+	UPDATE_AND_RETURN_LAST_USED_WINDOW(WinExistFind(aSettings, ws)) // This also does a "return".
+}
+
 
-		// Otherwise, the window is valid and detectible.
-		ws.SetCandidate(ws.mCriterionHwnd);
-		if (!ws.IsMatch()) // Checks if it matches any other criteria: WinTitle, WinText, ExcludeTitle, and anything in the aAlreadyVisited list.
-			return NULL;
-		//else fall through to the section below, since ws.mFoundCount and ws.mFoundParent were set by ws.IsMatch().
-	}
-	else // aWinTitle doesn't start with "ahk_id".  Try to find a matching window.
-		EnumWindows(EnumParentFind, (LPARAM)&ws);
 
-	UPDATE_AND_RETURN_LAST_USED_WINDOW(ws.mFoundParent) // This also does a "return".
+HWND WinExist(global_struct &aSettings, WindowCriteria &aCriteria)
+// Same as the other WinExist() except that the criteria were parsed in advance (such as for #IfWinExist)
+// and the last found window is never updated.
+// This function must be kept thread-safe because it may be called (indirectly) by hook thread too.
+{
+	HWND target_window;
+	if (aCriteria.mUseForeground)
+	{
+		SET_TARGET_TO_ALLOWABLE_FOREGROUND(aSettings.DetectHiddenWindows)
+		return target_window;
+	}
+	WindowSearch ws;
+	if (!ws.SetCriteria(aSettings, aCriteria)) // No match is possible with these criteria.
+		return NULL;
+	return WinExistFind(aSettings, ws);
 }
 
 
@@ -1478,43 +1527,26 @@ int GetWindowTextTimeout(HWND aWnd, char *aBuf, int aBufSize, UINT aTimeout)
 
 
 
-ResultType WindowSearch::SetCriteria(global_struct &aSettings, char *aTitle, char *aText, char *aExcludeTitle, char *aExcludeText)
-// Returns FAIL if the new criteria can't possibly match a window (due to ahk_id being in invalid
-// window or the specfied ahk_group not existing).  Otherwise, it returns OK.
-// Callers must ensure that aText, aExcludeTitle, and aExcludeText point to buffers whose contents
-// will be available for the entire duration of the search.  In other words, the caller should not
-// call MsgSleep() in a way that would allow another thread to launch and overwrite the contents
-// of the sDeref buffer (which might contain the contents).  Things like mFoundHWND and mFoundCount
-// are not initialized here because sometimes the caller changes the criteria without wanting to
-// reset the search.
+DWORD ParseWinTitle(char *aTitle, char *aTitleBuf, char *aClassBuf, char *aGroupBuf, HWND &aHwnd, DWORD &aPID)
+// Returns which criteria (CRITERION_TITLE, CRITERION_ID, etc.) are specified by the WinTitle aTitle.
+// aTitleBuf and aClassBuf must be of size SEARCH_PHRASE_SIZE and aGroupBuf of size MAX_VAR_NAME_LENGTH+1.
+// Each of those (and aHwnd and aPID) is set only if its criterion is present.  It's up to the caller to
+// validate the ahk_id window and look up the ahk_group.
 // This function must be kept thread-safe because it may be called (indirectly) by hook thread too.
 {
-	// Set any criteria which are not context sensitive.  It doesn't seem necessary to make copies of
-	// mCriterionText, mCriterionExcludeTitle, and mCriterionExcludeText because they're never altered
-	// here, nor does there seem to be a risk that deref buffer's contents will get overwritten
-	// while this set of criteria is in effect because our callers never allow interrupting script-threads
-	// *during* the duration of any one set of criteria.
-	bool exclude_title_became_non_blank = *aExcludeTitle && !*mCriterionExcludeTitle;
-	mCriterionExcludeTitle = aExcludeTitle;
-	mCriterionExcludeTitleLength = strlen(mCriterionExcludeTitle); // Pre-calculated for performance.
-	mCriterionText = aText;
-	mCriterionExcludeText = aExcludeText;
-	mSettings = &aSettings;
-
-	DWORD orig_criteria = mCriteria;
-	char *ahk_flag, *cp, buf[MAX_VAR_NAME_LENGTH + 1];
+	DWORD criteria;
+	char *ahk_flag, *cp;
 	int criteria_count;
 	size_t size;
 
-	for (mCriteria = 0, ahk_flag = aTitle, criteria_count = 0;; ++criteria_count, ahk_flag += 4) // +4 only since an "ahk_" string that isn't qualified may have been found.
+	for (criteria = 0, ahk_flag = aTitle, criteria_count = 0;; ++criteria_count, ahk_flag += 4) // +4 only since an "ahk_" string that isn't qualified may have been found.
 	{
 		if (   !(ahk_flag = strcasestr(ahk_flag, "ahk_"))   ) // No other special strings are present.
 		{
 			if (!criteria_count) // Since no special "ahk_" criteria were present, it is CRITERION_TITLE by default.
 			{
-				mCriteria = CRITERION_TITLE; // In this case, there is only one criterion.
-				strlcpy(mCriterionTitle, aTitle, sizeof(mCriterionTitle));
-				mCriterionTitleLength = strlen(mCriterionTitle); // Pre-calculated for performance.
+				criteria = CRITERION_TITLE; // In this case, there is only one criterion.
+				strlcpy(aTitleBuf, aTitle, SEARCH_PHRASE_SIZE);
 			}
 			break;
 		}
@@ -1532,38 +1564,32 @@ ResultType WindowSearch::SetCriteria(global_struct &aSettings, char *aTitle, cha
 		if (!strnicmp(cp, "id", 2))
 		{
 			cp += 2;
-			mCriteria |= CRITERION_ID;
-			mCriterionHwnd = (HWND)ATOU64(cp);
-			// Note that this can validly be the HWND of a child window; i.e. ahk_id %ChildWindowHwnd% is supported.
-			if (mCriterionHwnd != HWND_BROADCAST && !IsWindow(mCriterionHwnd)) // Checked here once rather than each call to IsMatch().
-			{
-				mCriterionHwnd = NULL;
-				return FAIL; // Inform caller of invalid criteria.  No need to do anything else further below.
-			}
+			criteria |= CRITERION_ID;
+			aHwnd = (HWND)ATOU64(cp);
 		}
 		else if (!strnicmp(cp, "pid", 3))
 		{
 			cp += 3;
-			mCriteria |= CRITERION_PID;
-			mCriterionPID = ATOU(cp);
+			criteria |= CRITERION_PID;
+			aPID = ATOU(cp);
 		}
 		else if (!strnicmp(cp, "class", 5))
 		{
 			cp += 5;
-			mCriteria |= CRITERION_CLASS;
+			criteria |= CRITERION_CLASS;
 			// In the following line, it may have been preferable to skip only zero or one spaces rather than
 			// calling omit_leading_whitespace().  But now this should probably be kept for backward compatibility.
 			// Besides, even if it's possible for a class name to start with a space, a RegEx dot or other symbol
 			// can be used to match it via SetTitleMatchMode RegEx.
-			strlcpy(mCriterionClass, omit_leading_whitespace(cp), sizeof(mCriterionClass)); // Copy all of the remaining string to simplify the below.
-			for (cp = mCriterionClass; cp = strcasestr(cp, "ahk_"); cp += 4)  // Fix for v1.0.47.06: strstr() changed to strcasestr() for consistency with the other sections.
+			strlcpy(aClassBuf, omit_leading_whitespace(cp), SEARCH_PHRASE_SIZE); // Copy all of the remaining string to simplify the below.
+			for (cp = aClassBuf; cp = strcasestr(cp, "ahk_"); cp += 4)  // Fix for v1.0.47.06: strstr() changed to strcasestr() for consistency with the other sections.
 			{
 				// This loop truncates any other criteria from the class criteria.  It's not a complete
 				// solution because it doesn't validate that what comes after the "ahk_" string is a
 				// valid criterion name. But for it not to be and yet also be part of some valid class
 				// name seems far too unlikely to worry about.  It would have to be a legitimate class name
 				// such as "ahk_class SomeClassName ahk_wrong".
-				if (cp == mCriterionClass) // This check prevents underflow in the next check.
+				if (cp == aClassBuf) // This check prevents underflow in the next check.
 				{
 					*cp = '\0';
 					break;
@@ -1581,19 +1607,17 @@ ResultType WindowSearch::SetCriteria(global_struct &aSettings, char *aTitle, cha
 		else if (!strnicmp(cp, "group", 5))
 		{
 			cp += 5;
-			mCriteria |= CRITERION_GROUP;
-			strlcpy(buf, omit_leading_whitespace(cp), sizeof(buf));
-			if (cp = StrChrAny(buf, " \t")) // Group names can't contain spaces, so terminate at the first one to exclude any "ahk_" criteria that come afterward.
+			criteria |= CRITERION_GROUP;
+			strlcpy(aGroupBuf, omit_leading_whitespace(cp), MAX_VAR_NAME_LENGTH + 1);
+			if (cp = StrChrAny(aGroupBuf, " \t")) // Group names can't contain spaces, so terminate at the first one to exclude any "ahk_" criteria that come afterward.
 				*cp = '\0';
-			if (   !(mCriterionGroup = g_script.FindGroup(buf))   )
-				return FAIL; // No such group: Inform caller of invalid criteria.  No need to do anything else further below.
 		}
 		else // It doesn't qualify as a special criteria name even though it starts with "ahk_".
 		{
 			--criteria_count; // Decrement criteria_count to compensate for the loop's increment.
 			continue;
 		}
-		// Since above didn't return or continue, a valid "ahk_" criterion has been discovered.
+		// Since above didn't continue, a valid "ahk_" criterion has been discovered.
 		// If this is the first such criterion, any text that lies to its left should be interpreted
 		// as CRITERION_TITLE.  However, for backward compatibility it seems best to disqualify any title
 		// consisting entirely of whitespace.  This is because some scripts might have a variable containing
@@ -1601,18 +1625,163 @@ ResultType WindowSearch::SetCriteria(global_struct &aSettings, char *aTitle, cha
 		// literal part of the title criterion for flexibilty and backward compatibility).
 		if (!criteria_count && ahk_flag > omit_leading_whitespace(aTitle))
 		{
-			mCriteria |= CRITERION_TITLE;
+			criteria |= CRITERION_TITLE;
 			// Omit exactly one space or tab from the title criterion. That space or tab is the one
 			// required to delimit the special "ahk_" string.  Any other spaces or tabs to the left of
 			// that one are considered literal (for flexibility):
 			size = ahk_flag - aTitle; // This will always be greater than one due to other checks above, which will result in at least one non-whitespace character in the title criterion.
-			if (size > sizeof(mCriterionTitle)) // Prevent overflow.
-				size = sizeof(mCriterionTitle);
-			strlcpy(mCriterionTitle, aTitle, size); // Copy only the eligible substring as the criteria.
-			mCriterionTitleLength = strlen(mCriterionTitle); // Pre-calculated for performance.
+			if (size > SEARCH_PHRASE_SIZE) // Prevent overflow.
+				size = SEARCH_PHRASE_SIZE;
+			strlcpy(aTitleBuf, aTitle, size); // Copy only the eligible substring as the criteria.
+		}
+	}
+	return criteria;
+}
+
+
+
+ResultType WindowCriteria::Compile(char *aTitle, char *aText)
+// Parses the WinTitle aTitle into this object's members.  aTitle and aText must last for the life of
+// the script (e.g. be in SimpleHeap memory).  Returns FAIL if out of memory, or OK otherwise.
+{
+	char title[SEARCH_PHRASE_SIZE], class_name[SEARCH_PHRASE_SIZE], group_name[MAX_VAR_NAME_LENGTH + 1];
+	mCriteria = ParseWinTitle(aTitle, title, class_name, group_name, mHwnd, mPID);
+	mUseForeground = USE_FOREGROUND_WINDOW(aTitle, aText, "", "");
+	mText = aText;
+	mTitle = mClass = mGroupName = "";
+	mGroup = NULL;
+	mTitleRegEx = mClassRegEx = NULL;
+	mRegExBound = false;
+	// SimpleHeap::Malloc() returns "" rather than allocating anything for an empty string.
+	if (   (mCriteria & CRITERION_TITLE) && !(mTitle = SimpleHeap::Malloc(title))
+		|| (mCriteria & CRITERION_CLASS) && !(mClass = SimpleHeap::Malloc(class_name))
+		|| (mCriteria & CRITERION_GROUP) && !(mGroupName = SimpleHeap::Malloc(group_name))   )
+		return FAIL;
+	mTitleLength = strlen(mTitle);
+	return OK;
+}
+
+
+
+WinGroup *WindowCriteria::Group()
+// Returns the ahk_group, or NULL if no such group exists yet.  Once found, it's kept because groups are
+// never deleted.
+// This function must be kept thread-safe because it may be called (indirectly) by hook thread too.
+{
+	if (!mGroup)
+		mGroup = g_script.FindGroup(mGroupName); // Thread-safe (see its comments).
+	return mGroup;
+}
+
+
+
+void WindowCriteria::BindRegEx()
+// Compiles the title and class for SetTitleMatchMode RegEx.  This is done upon first use rather than by
+// Compile() since most scripts never use that mode.  A RegEx that can't be compiled is left NULL and
+// never matches, which is the same as what RegExMatch() does with it.
+// This function must be kept thread-safe because it may be called (indirectly) by hook thread too.
+{
+	EnterCriticalSection(&g_CriticalRegExCache); // Both threads might get here at the same time.
+	if (!mRegExBound)
+	{
+		if (*mTitle)
+			mTitleRegEx = RegExBind(mTitle);
+		if (mCriteria & CRITERION_CLASS)
+			mClassRegEx = RegExBind(mClass);
+		mRegExBound = true; // Only after the above so that the other thread can't use them prematurely.
+	}
+	LeaveCriticalSection(&g_CriticalRegExCache);
+}
+
+
+
+bool WindowCriteria::AttributesMatch(char *aCandidateTitle, char *aCandidateClass, DWORD aCandidatePID, int aTitleMatchMode)
+// Returns true if a window with the given title, class and PID satisfies the title, ahk_class and ahk_pid
+// criteria.  The others (ahk_id, ahk_group and WinText) need the window itself, so they're checked by
+// WindowSearch::IsMatch().  This method compares only strings and numbers, so it doesn't care whether
+// the window exists.  It must give the same results as the corresponding section of IsMatch().
+// This function must be kept thread-safe because it may be called (indirectly) by hook thread too.
+{
+	if (aTitleMatchMode == FIND_REGEX && !mRegExBound)
+		BindRegEx();
+
+	if (*mTitle) // A blank title matches every window, the same as in IsMatch().
+	{
+		switch(aTitleMatchMode)
+		{
+		case FIND_ANYWHERE:
+			if (!strstr(aCandidateTitle, mTitle))
+				return false;
+			break;
+		case FIND_IN_LEADING_PART:
+			if (strncmp(aCandidateTitle, mTitle, mTitleLength))
+				return false;
+			break;
+		case FIND_REGEX:
+			if (!mTitleRegEx || !RegExMatch(aCandidateTitle, mTitleRegEx))
+				return false;
+			break;
+		default: // Exact match.
+			if (strcmp(aCandidateTitle, mTitle))
+				return false;
 		}
 	}
 
+	if (mCriteria & CRITERION_CLASS)
+	{
+		if (aTitleMatchMode == FIND_REGEX)
+		{
+			if (!mClassRegEx || !RegExMatch(aCandidateClass, mClassRegEx))
+				return false;
+		}
+		else // For backward compatibility, all other modes use exact-match for Class.
+			if (strcmp(aCandidateClass, mClass))
+				return false;
+	}
+
+	return !(mCriteria & CRITERION_PID) || aCandidatePID == mPID;
+}
+
+
+
+ResultType WindowSearch::SetCriteria(global_struct &aSettings, char *aTitle, char *aText, char *aExcludeTitle, char *aExcludeText)
+// Returns FAIL if the new criteria can't possibly match a window (due to ahk_id being in invalid
+// window or the specfied ahk_group not existing).  Otherwise, it returns OK.
+// Callers must ensure that aText, aExcludeTitle, and aExcludeText point to buffers whose contents
+// will be available for the entire duration of the search.  In other words, the caller should not
+// call MsgSleep() in a way that would allow another thread to launch and overwrite the contents
+// of the sDeref buffer (which might contain the contents).  Things like mFoundHWND and mFoundCount
+// are not initialized here because sometimes the caller changes the criteria without wanting to
+// reset the search.
+// This function must be kept thread-safe because it may be called (indirectly) by hook thread too.
+{
+	// Set any criteria which are not context sensitive.  It doesn't seem necessary to make copies of
+	// mCriterionText, mCriterionExcludeTitle, and mCriterionExcludeText because they're never altered
+	// here, nor does there seem to be a risk that deref buffer's contents will get overwritten
+	// while this set of criteria is in effect because our callers never allow interrupting script-threads
+	// *during* the duration of any one set of criteria.
+	bool exclude_title_became_non_blank = *aExcludeTitle && !*mCriterionExcludeTitle;
+	mCriterionExcludeTitle = aExcludeTitle;
+	mCriterionExcludeTitleLength = strlen(mCriterionExcludeTitle); // Pre-calculated for performance.
+	mCriterionText = aText;
+	mCriterionExcludeText = aExcludeText;
+	mSettings = &aSettings;
+	mCompiledCriteria = NULL;
+
+	DWORD orig_criteria = mCriteria;
+	char group_name[MAX_VAR_NAME_LENGTH + 1];
+	mCriteria = ParseWinTitle(aTitle, mCriterionTitle, mCriterionClass, group_name, mCriterionHwnd, mCriterionPID);
+	if (mCriteria & CRITERION_TITLE)
+		mCriterionTitleLength = strlen(mCriterionTitle); // Pre-calculated for performance.
+	// Note that ahk_id can validly be the HWND of a child window; i.e. ahk_id %ChildWindowHwnd% is supported.
+	if ((mCriteria & CRITERION_ID) && mCriterionHwnd != HWND_BROADCAST && !IsWindow(mCriterionHwnd)) // Checked here once rather than each call to IsMatch().
+	{
+		mCriterionHwnd = NULL;
+		return FAIL; // Inform caller of invalid criteria.
+	}
+	if ((mCriteria & CRITERION_GROUP) && !(mCriterionGroup = g_script.FindGroup(group_name)))
+		return FAIL; // No such group: Inform caller of invalid criteria.
+
 	// Since this function doesn't change mCandidateParent, there is no need to update the candidate's
 	// attributes unless the type of criterion has changed or if mExcludeTitle became non-blank as
 	// a result of our action above:
@@ -1624,6 +1793,33 @@ ResultType WindowSearch::SetCriteria(global_struct &aSettings, char *aTitle, cha
 
 
 
+ResultType WindowSearch::SetCriteria(global_struct &aSettings, WindowCriteria &aCriteria)
+// Same as the other SetCriteria() except that the criteria were parsed in advance.  aCriteria must
+// remain valid for as long as these criteria are in effect.
+// This function must be kept thread-safe because it may be called (indirectly) by hook thread too.
+{
+	mCriterionExcludeTitle = ""; // WindowCriteria has no ExcludeTitle or ExcludeText.
+	mCriterionExcludeTitleLength = 0;
+	mCriterionText = aCriteria.mText;
+	mCriterionExcludeText = "";
+	mSettings = &aSettings;
+	mCompiledCriteria = &aCriteria; // IsMatch() compares the title and class through this.
+
+	DWORD orig_criteria = mCriteria;
+	mCriteria = aCriteria.mCriteria;
+	mCriterionHwnd = aCriteria.mHwnd;
+	mCriterionPID = aCriteria.mPID;
+	if ((mCriteria & CRITERION_ID) && mCriterionHwnd != HWND_BROADCAST && !IsWindow(mCriterionHwnd)) // The window might have been destroyed since the script was loaded.
+		return FAIL;
+	if ((mCriteria & CRITERION_GROUP) && !(mCriterionGroup = aCriteria.Group()))
+		return FAIL;
+	if (mCriteria != orig_criteria)
+		UpdateCandidateAttributes();
+	return OK;
+}
+
+
+
 void WindowSearch::UpdateCandidateAttributes()
 // This function must be kept thread-safe because it may be called (indirectly) by hook thread too.
 {
@@ -1632,6 +1828,22 @@ void WindowSearch::UpdateCandidateAttributes()
 	// are not yet initialized:
 	if (!mCandidateParent || !mCriteria)
 		return;
+	// Fetch only the attributes the criteria actually compare against:
+	int attributes = (mCriteria & (CRITERION_PID | CRITERION_CLASS))
+		| ((mCriteria & CRITERION_TITLE) || *mCriterionExcludeTitle ? CRITERION_TITLE : 0);
+	if (!attributes)
+		return;
+	WindowSnapshotItem *snapshot;
+	if (snapshot = WindowSnapshotGet(mCandidateParent, attributes)) // #WinCacheTime is in effect and this is the main thread.
+	{
+		if (attributes & CRITERION_TITLE)
+			strlcpy(mCandidateTitle, snapshot->title, sizeof(mCandidateTitle));
+		if (attributes & CRITERION_PID)
+			mCandidatePID = snapshot->pid;
+		if (attributes & CRITERION_CLASS)
+			strcpy(mCandidateClass, snapshot->class_name); // Both are WINDOW_CLASS_SIZE.
+		return;
+	}
 	if ((mCriteria & CRITERION_TITLE) || *mCriterionExcludeTitle) // Need the window's title in both these cases.
 		if (!GetWindowText(mCandidateParent, mCandidateTitle, sizeof(mCandidateTitle)))
 			*mCandidateTitle = '\0'; // Failure or blank title is okay.
@@ -1659,46 +1871,54 @@ HWND WindowSearch::IsMatch(bool aInvert)
 	if (!mCandidateParent || !mCriteria) // Nothing to check, so no match.
 		return NULL;
 
-	if ((mCriteria & CRITERION_TITLE) && *mCriterionTitle) // For performance, avoid the calls below (especially RegEx) when mCriterionTitle is blank (assuming it's even possible for it to be blank under these conditions).
+	if (mCompiledCriteria) // Compare against the title, class and PID that were parsed in advance.
 	{
-		switch(mSettings->TitleMatchMode)
+		if (!mCompiledCriteria->AttributesMatch(mCandidateTitle, mCandidateClass, mCandidatePID, mSettings->TitleMatchMode))
+			return NULL;
+	}
+	else
+	{
+		if ((mCriteria & CRITERION_TITLE) && *mCriterionTitle) // For performance, avoid the calls below (especially RegEx) when mCriterionTitle is blank (assuming it's even possible for it to be blank under these conditions).
 		{
-		case FIND_ANYWHERE:
-			if (!strstr(mCandidateTitle, mCriterionTitle)) // Suitable even if mCriterionTitle is blank, though that's already ruled out above.
-				return NULL;
-			break;
-		case FIND_IN_LEADING_PART:
-			if (strncmp(mCandidateTitle, mCriterionTitle, mCriterionTitleLength)) // Suitable even if mCriterionTitle is blank, though that's already ruled out above. If it were possible, mCriterionTitleLength would be 0 and thus strncmp would yield 0 to indicate "strings are equal".
-				return NULL;
-			break;
-		case FIND_REGEX:
-			if (!RegExMatch(mCandidateTitle, mCriterionTitle))
-				return NULL;
-			break;
-		default: // Exact match.
-			if (strcmp(mCandidateTitle, mCriterionTitle))
-				return NULL;
+			switch(mSettings->TitleMatchMode)
+			{
+			case FIND_ANYWHERE:
+				if (!strstr(mCandidateTitle, mCriterionTitle)) // Suitable even if mCriterionTitle is blank, though that's already ruled out above.
+					return NULL;
+				break;
+			case FIND_IN_LEADING_PART:
+				if (strncmp(mCandidateTitle, mCriterionTitle, mCriterionTitleLength)) // Suitable even if mCriterionTitle is blank, though that's already ruled out above. If it were possible, mCriterionTitleLength would be 0 and thus strncmp would yield 0 to indicate "strings are equal".
+					return NULL;
+				break;
+			case FIND_REGEX:
+				if (!RegExMatch(mCandidateTitle, mCriterionTitle))
+					return NULL;
+				break;
+			default: // Exact match.
+				if (strcmp(mCandidateTitle, mCriterionTitle))
+					return NULL;
+			}
+			// If above didn't return, it's a match so far so continue onward to the other checks.
 		}
-		// If above didn't return, it's a match so far so continue onward to the other checks.
-	}
 
-	if (mCriteria & CRITERION_CLASS) // mCriterionClass is probably always non-blank when CRITERION_CLASS is present (harmless even if it isn't), so *mCriterionClass isn't checked.
-	{
-		if (mSettings->TitleMatchMode == FIND_REGEX)
+		if (mCriteria & CRITERION_CLASS) // mCriterionClass is probably always non-blank when CRITERION_CLASS is present (harmless even if it isn't), so *mCriterionClass isn't checked.
 		{
-			if (!RegExMatch(mCandidateClass, mCriterionClass))
-				return NULL;
+			if (mSettings->TitleMatchMode == FIND_REGEX)
+			{
+				if (!RegExMatch(mCandidateClass, mCriterionClass))
+					return NULL;
+			}
+			else // For backward compatibility, all other modes use exact-match for Class.
+				if (strcmp(mCandidateClass, mCriterionClass)) // Doesn't match the required class name.
+					return NULL;
+			// If nothing above returned, it's a match so far so continue onward to the other checks.
 		}
-		else // For backward compatibility, all other modes use exact-match for Class.
-			if (strcmp(mCandidateClass, mCriterionClass)) // Doesn't match the required class name.
-				return NULL;
-		// If nothing above returned, it's a match so far so continue onward to the other checks.
-	}
 
-	// For the following, mCriterionPID would already be filled in, though it might be an explicitly specified zero.
-	if ((mCriteria & CRITERION_PID) && mCandidatePID != mCriterionPID) // Doesn't match required PID.
-		return NULL;
-	//else it's a match so far, but continue onward in case there are other criteria.
+		// For the following, mCriterionPID would already be filled in, though it might be an explicitly specified zero.
+		if ((mCriteria & CRITERION_PID) && mCandidatePID != mCriterionPID) // Doesn't match required PID.
+			return NULL;
+		//else it's a match so far, but continue onward in case there are other criteria.
+	}
 
 	// The following also handles the fact that mCriterionGroup might be NULL if the specified group
 	// does not exist or was never successfully created:
@@ -1840,3 +2060,585 @@ bool DialogPrep()
 		MsgSleep(-1);
 	return thread_was_critical; // Caller is responsible for using this to later restore g->ThreadIsCritical.
 }
+
+
+
+typedef HWINEVENTHOOK (WINAPI *MySetWinEventHookType)(DWORD, DWORD, HMODULE, WINEVENTPROC, DWORD, DWORD, DWORD);
+typedef BOOL (WINAPI *MyUnhookWinEventType)(HWINEVENTHOOK);
+static MySetWinEventHookType sMySetWinEventHook = (MySetWinEventHookType)GetProcAddress(GetModuleHandle("user32"), "SetWinEventHook");
+static MyUnhookWinEventType sMyUnhookWinEvent = (MyUnhookWinEventType)GetProcAddress(GetModuleHandle("user32"), "UnhookWinEvent");
+// Above will be NULL for Win95 and NT4 prior to SP6.
+#define WINDOW_EVENT_HOOK_COUNT 3
+static HWINEVENTHOOK sWindowEventHook[WINDOW_EVENT_HOOK_COUNT];
+static int sWindowEventUsers = 0; // How many WindowEventWatch objects (plus the window snapshot) are using the above hooks.
+static UINT sWindowEventCount = 0;
+
+// The window snapshot holds the attributes that WindowSearch fetches for each candidate window, so that
+// a script that checks for windows many times per second doesn't fetch the same titles (each of which
+// can require a message to be sent to another process) over and over.  It's enabled by #WinCacheTime,
+// which sets how many milliseconds an item stays valid.  Each item is also discarded upon any window
+// event for its window (e.g. a change of title), and the hooks for those events stay installed once the
+// snapshot is used.  Since those events arrive only when messages are next checked, the commands that
+// change a window (e.g. WinSetTitle) also discard its item directly.  Only the attributes that some search
+// has needed are fetched, so an item may have a title but no class (see WindowSnapshotItem::attributes).
+// The items are kept in a set-associative table: each HWND hashes to a set of WINDOW_SNAPSHOT_WAYS items,
+// any of which it can occupy.  When a new window needs an item, an unused or expired item of its set is
+// taken if there is one, otherwise the least recently used.  Since the latter means the set is full of
+// windows that are still being searched, the table is first doubled in size (up to a limit), so that it
+// grows with the number of windows the script sees rather than having them evict each other.
+#define WINDOW_SNAPSHOT_WAYS 4
+#define WINDOW_SNAPSHOT_MIN_SETS 32    // Must be a power of 2.
+#define WINDOW_SNAPSHOT_MAX_SETS 1024  // 4096 items, which is far more windows than a desktop normally has.
+static WindowSnapshotItem *sWindowSnapshot = NULL; // sWindowSnapshotSets * WINDOW_SNAPSHOT_WAYS items.
+static UINT sWindowSnapshotSets = 0;
+static UINT sWindowSnapshotClock = 0; // Incremented by each use of an item, for WindowSnapshotItem::last_use.
+static UINT sWindowSnapshotHits = 0, sWindowSnapshotMisses = 0; // For the /Benchmark switch.
+static bool sWindowSnapshotStarted = false;
+
+static WindowSnapshotItem *WindowSnapshotSet(HWND aWnd)
+// Returns the first item of the set that aWnd's item must be in.  Caller must ensure the table exists.
+{
+	UINT hash = (UINT)(size_t)aWnd;
+	return sWindowSnapshot + ((hash ^ (hash >> 7)) & (sWindowSnapshotSets - 1)) * WINDOW_SNAPSHOT_WAYS;
+}
+
+
+
+static WindowSnapshotItem *WindowSnapshotFind(HWND aWnd)
+// Returns aWnd's item (which might have expired), or NULL if it has none.
+{
+	if (!sWindowSnapshot)
+		return NULL;
+	WindowSnapshotItem *item = WindowSnapshotSet(aWnd), *set_end = item + WINDOW_SNAPSHOT_WAYS;
+	for (; item < set_end; ++item)
+		if (item->hwnd == aWnd)
+			return item;
+	return NULL;
+}
+
+
+
+static bool WindowSnapshotIsLive(WindowSnapshotItem &aItem, DWORD aNow)
+{
+	return aItem.hwnd && aNow - aItem.time < g_WinCacheTime;
+}
+
+
+
+static WindowSnapshotItem *WindowSnapshotVictim(WindowSnapshotItem *aSet, DWORD aNow)
+// Returns the item of aSet that a new window should take: an unused or expired one if there is one,
+// otherwise the least recently used.
+{
+	WindowSnapshotItem *victim = aSet;
+	for (WindowSnapshotItem *item = aSet; item < aSet + WINDOW_SNAPSHOT_WAYS; ++item)
+	{
+		if (!WindowSnapshotIsLive(*item, aNow))
+			return item;
+		if ((int)(item->last_use - victim->last_use) < 0) // Written this way to tolerate sWindowSnapshotClock wrapping around.
+			victim = item;
+	}
+	return victim;
+}
+
+
+
+static bool WindowSnapshotResize(UINT aSets, DWORD aNow)
+// Moves the live items into a new table of aSets sets, which must be a power of 2 and either the first
+// table or double the current one (so that every live item fits).  Returns false if there isn't enough
+// memory, in which case the table is unchanged.
+{
+	WindowSnapshotItem *new_table = (WindowSnapshotItem *)calloc(aSets * WINDOW_SNAPSHOT_WAYS, sizeof(WindowSnapshotItem));
+	if (!new_table)
+		return false;
+	WindowSnapshotItem *old_table = sWindowSnapshot, *old_end = old_table + sWindowSnapshotSets * WINDOW_SNAPSHOT_WAYS;
+	sWindowSnapshot = new_table;
+	sWindowSnapshotSets = aSets;
+	for (WindowSnapshotItem *item = old_table; item < old_end; ++item)
+	{
+		if (WindowSnapshotIsLive(*item, aNow))
+			*WindowSnapshotVictim(WindowSnapshotSet(item->hwnd), aNow) = *item; // Takes over its title buffer too.
+		else
+			free(item->title);
+	}
+	free(old_table);
+	return true;
+}
+
+
+
+static WindowSnapshotItem *WindowSnapshotAdd(HWND aWnd, DWORD aNow)
+// Returns aWnd's item if it has one (which might have expired), otherwise the item it should take, which
+// the caller must fill in.  Returns NULL if there isn't enough memory for the table.
+{
+	WindowSnapshotItem *item;
+	if (item = WindowSnapshotFind(aWnd))
+		return item;
+	if (!sWindowSnapshot && !WindowSnapshotResize(WINDOW_SNAPSHOT_MIN_SETS, aNow))
+		return NULL;
+	item = WindowSnapshotVictim(WindowSnapshotSet(aWnd), aNow);
+	if (WindowSnapshotIsLive(*item, aNow) && sWindowSnapshotSets < WINDOW_SNAPSHOT_MAX_SETS // The set is full (see comments above).
+		&& WindowSnapshotResize(sWindowSnapshotSets * 2, aNow))
+		item = WindowSnapshotVictim(WindowSnapshotSet(aWnd), aNow);
+	item->hwnd = NULL; // Indicate that it doesn't yet belong to aWnd.
+	return item;
+}
+
+
+
+void WindowSnapshotDiscard(HWND aWnd)
+// Discards aWnd's snapshot (if it has one) so that its attributes are fetched anew by the next search.
+// Only the main thread may call this.
+{
+	WindowSnapshotItem *item;
+	if (item = WindowSnapshotFind(aWnd))
+		item->hwnd = NULL;
+}
+
+
+
+void WindowSnapshotGetCounts(UINT &aHits, UINT &aMisses)
+// Provides the /Benchmark switch with the number of times a search found everything it needed in the
+// snapshot, and the number of times it had to fetch at least one attribute.
+{
+	aHits = sWindowSnapshotHits;
+	aMisses = sWindowSnapshotMisses;
+}
+
+
+
+static void CALLBACK WindowEventProc(HWINEVENTHOOK aHook, DWORD aEvent, HWND aWnd, LONG aObjectID, LONG aChildID
+	, DWORD aEventThread, DWORD aEventTime)
+// Since the hooks are out-of-context, this is called by our thread's message pump (e.g. MsgSleep()).
+// Only events for windows are counted, not those for carets, scroll bars and other objects.
+{
+	if (aWnd && aObjectID == OBJID_WINDOW && aChildID == CHILDID_SELF)
+	{
+		++sWindowEventCount;
+		WindowSnapshotDiscard(aWnd); // Its attributes might have changed.
+	}
+}
+
+
+
+UINT GetWindowEventCount()
+{
+	return sWindowEventCount;
+}
+
+
+
+static bool WindowEventsStart()
+// Installs the hooks unless another user already has.  Returns false if they can't be installed, in which
+// case the caller must not call WindowEventsStop().
+{
+	if (!sMySetWinEventHook || !sMyUnhookWinEvent)
+		return false;
+	if (!sWindowEventUsers)
+	{
+		// The ranges omit frequent events that don't affect which windows match, such as
+		// EVENT_OBJECT_LOCATIONCHANGE (which falls between EVENT_OBJECT_HIDE and EVENT_OBJECT_NAMECHANGE).
+		// Events from our own process are included because a script can wait for one of its own windows.
+		static DWORD sEventRange[WINDOW_EVENT_HOOK_COUNT][2] = {{EVENT_SYSTEM_FOREGROUND, EVENT_SYSTEM_FOREGROUND}
+			, {EVENT_OBJECT_CREATE, EVENT_OBJECT_HIDE}, {EVENT_OBJECT_NAMECHANGE, EVENT_OBJECT_NAMECHANGE}};
+		int i;
+		for (i = 0; i < WINDOW_EVENT_HOOK_COUNT; ++i)
+			if (   !(sWindowEventHook[i] = sMySetWinEventHook(sEventRange[i][0], sEventRange[i][1], NULL
+				, WindowEventProc, 0, 0, WINEVENT_OUTOFCONTEXT))   )
+				break;
+		if (i < WINDOW_EVENT_HOOK_COUNT) // One of them failed, so remove the others.
+		{
+			while (i > 0)
+				sMyUnhookWinEvent(sWindowEventHook[--i]);
+			return false;
+		}
+	}
+	++sWindowEventUsers;
+	return true;
+}
+
+
+
+static void WindowEventsStop()
+// Removes the hooks if the caller is the last to use them.
+{
+	if (!--sWindowEventUsers)
+		for (int i = 0; i < WINDOW_EVENT_HOOK_COUNT; ++i)
+			sMyUnhookWinEvent(sWindowEventHook[i]);
+}
+
+
+
+WindowEventWatch::WindowEventWatch(bool aUseEvents)
+	: mUsesEvents(aUseEvents && WindowEventsStart()), mChecked(false)
+// If the hooks can't be installed, every check is considered due.
+{
+}
+
+
+
+WindowEventWatch::~WindowEventWatch()
+{
+	if (mUsesEvents)
+		WindowEventsStop();
+}
+
+
+
+bool WindowEventWatch::IsCheckDue(UINT aEventCount, DWORD aNow)
+// Returns true if the caller should search for its window now, in which case this is recorded as the most
+// recent check.  aEventCount is the current number of window events (GetWindowEventCount() except when
+// the caller supplies its own events) and aNow is the current tick count.  The first check is always due.
+{
+	if (mUsesEvents && mChecked && aEventCount == mEventCount && aNow - mLastCheck < WINDOW_EVENT_POLL_INTERVAL)
+		return false;
+	// Record the count as it was before the check, so that an event raised during the check causes another:
+	mChecked = true;
+	mEventCount = aEventCount;
+	mLastCheck = aNow;
+	return true;
+}
+
+
+
+bool WindowEventWatch::CriteriaAreEventDriven(char *aTitle, char *aText, char *aExcludeText)
+// Returns true if window events are enough to detect a change in which windows match the criteria.
+// That isn't so for WinText and ExcludeText because controls such as Edit don't raise an event when their
+// text changes, nor for ahk_group because a group's definitions can have WinText.
+{
+	return !*aText && !*aExcludeText && !strcasestr(aTitle, "ahk_group");
+}
+
+
+
+static bool WindowSnapshotSetTitle(WindowSnapshotItem &aItem, char *aTitle)
+// Copies aTitle into aItem, enlarging its buffer if needed.  Returns false if there isn't enough memory.
+{
+	size_t title_size = strlen(aTitle) + 1;
+	if (title_size > aItem.title_capacity)
+	{
+		free(aItem.title);
+		if (   !(aItem.title = (char *)malloc(title_size))   )
+		{
+			aItem.title_capacity = 0;
+			return false;
+		}
+		aItem.title_capacity = title_size;
+	}
+	memcpy(aItem.title, aTitle, title_size);
+	return true;
+}
+
+
+
+WindowSnapshotItem *WindowSnapshotGet(HWND aWnd, int aAttributes)
+// Returns aWnd's snapshot with at least aAttributes (a combination of CRITERION_TITLE, CRITERION_CLASS and
+// CRITERION_PID) filled in.  Attributes are fetched only if the snapshot lacks them or #WinCacheTime's time
+// has elapsed since it was taken.  Returns NULL if the snapshot is disabled, if the caller isn't the main
+// thread (the hook thread uses WindowSearch too), or if there isn't enough memory.
+{
+	if (!g_WinCacheTime || GetCurrentThreadId() != g_MainThreadID)
+		return NULL;
+	if (!sWindowSnapshotStarted) // First use, so start receiving the events that discard items.
+	{
+		WindowEventsStart(); // If this fails, items are discarded only when #WinCacheTime's time elapses.
+		sWindowSnapshotStarted = true;
+	}
+	DWORD now = GetTickCount();
+	WindowSnapshotItem *item_ptr;
+	if (   !(item_ptr = WindowSnapshotAdd(aWnd, now))   )
+		return NULL;
+	WindowSnapshotItem &item = *item_ptr;
+	if (item.hwnd != aWnd || now - item.time >= g_WinCacheTime) // Start a new snapshot.
+	{
+		item.hwnd = aWnd;
+		item.time = now;
+		item.attributes = 0;
+	}
+	item.last_use = ++sWindowSnapshotClock;
+	int missing = aAttributes & ~item.attributes;
+	if (missing)
+		++sWindowSnapshotMisses;
+	else
+		++sWindowSnapshotHits;
+	if (missing & CRITERION_TITLE)
+	{
+		char title[WINDOW_TEXT_SIZE];
+		if (!GetWindowText(aWnd, title, sizeof(title)))
+			*title = '\0'; // Failure or blank title is okay.
+		if (!WindowSnapshotSetTitle(item, title))
+		{
+			item.hwnd = NULL;
+			return NULL;
+		}
+	}
+	if (missing & CRITERION_CLASS)
+		if (!GetClassName(aWnd, item.class_name, sizeof(item.class_name)))
+			*item.class_name = '\0';
+	if (missing & CRITERION_PID)
+		GetWindowThreadProcessId(aWnd, &item.pid);
+	item.attributes |= missing;
+	return &item;
+}
+
+
+
+WindowSnapshotItem *WindowSnapshotPut(HWND aWnd, char *aTitle, char *aClass, DWORD aPID, DWORD aTime)
+// Stores the specified attributes as aWnd's snapshot, taken at tick count aTime, so that searches use
+// them rather than fetching them until #WinCacheTime's time elapses or the item is discarded.  This is
+// how the /Benchmark checks give made-up windows to WindowSearch (see WindowCheckSnapshot()).  Returns
+// NULL if there isn't enough memory.  Only the main thread may call this.
+{
+	WindowSnapshotItem *item_ptr;
+	if (   !(item_ptr = WindowSnapshotAdd(aWnd, GetTickCount()))   )
+		return NULL;
+	WindowSnapshotItem &item = *item_ptr;
+	if (!WindowSnapshotSetTitle(item, aTitle))
+	{
+		item.hwnd = NULL;
+		return NULL;
+	}
+	strlcpy(item.class_name, aClass, sizeof(item.class_name));
+	item.pid = aPID;
+	item.time = aTime;
+	item.last_use = ++sWindowSnapshotClock;
+	item.attributes = CRITERION_TITLE | CRITERION_CLASS | CRITERION_PID;
+	item.hwnd = aWnd;
+	return &item;
+}
+
+
+
+#ifndef AUTOHOTKEYSC
+///////////////////////////////////////////////////////////////////////////
+// Checks run by the /Benchmark switch after the script's labels (see Script::RunBenchmarks()).  Each
+// returns the number of cases that failed, describing each on stdout.  They search made-up windows whose
+// attributes are put into the window snapshot, so they need no desktop.
+///////////////////////////////////////////////////////////////////////////
+
+static bool WindowCheckIsMatch(HWND aWnd, char *aWinTitle, TitleMatchModes aTitleMatchMode, bool aCompiled)
+// Returns whether aWnd matches aWinTitle, using either WindowCriteria (as #IfWin does) or the WinTitle
+// string itself (as most commands do).  aWinTitle must last for the life of the script.
+{
+	global_struct settings;
+	CopyMemory(&settings, g, sizeof(global_struct));
+	settings.TitleMatchMode = aTitleMatchMode;
+	WindowSearch ws;
+	WindowCriteria criteria;
+	if (aCompiled)
+	{
+		if (!criteria.Compile(aWinTitle, "") || !ws.SetCriteria(settings, criteria))
+			return false;
+	}
+	else
+		if (!ws.SetCriteria(settings, aWinTitle, "", "", ""))
+			return false;
+	ws.SetCandidate(aWnd);
+	return ws.IsMatch() != NULL;
+}
+
+
+
+int WindowCheckSnapshot()
+// Checks that WindowSearch::IsMatch() compares against the attributes put into the snapshot (the made-up
+// window has no attributes of its own, so it couldn't match otherwise) and that a discarded item isn't
+// used.  Also checks that the snapshot keeps far more windows than its initial size without them evicting
+// each other.
+{
+	static struct {char *win_title; TitleMatchModes mode; bool is_match;} sCase[] = {
+		  {"Check Window", FIND_EXACT, true}
+		, {"Check", FIND_EXACT, false}
+		, {"Check", FIND_IN_LEADING_PART, true}
+		, {"Window", FIND_ANYWHERE, true}
+		, {"^Check W.+$", FIND_REGEX, true}
+		, {"ahk_class AhkCheckClass", FIND_EXACT, true}
+		, {"ahk_class Other", FIND_EXACT, false}
+		, {"ahk_pid 4242", FIND_EXACT, true}
+		, {"ahk_pid 4243", FIND_EXACT, false}
+		, {"Check Window ahk_class AhkCheckClass ahk_pid 4242", FIND_EXACT, true}
+		, {"Check Window ahk_class AhkCheckClass ahk_pid 4243", FIND_EXACT, false}
+	};
+	DWORD orig_win_cache_time = g_WinCacheTime;
+	g_WinCacheTime = 60000; // The maximum #WinCacheTime, so that nothing expires during the checks.
+	HWND wnd = (HWND)(size_t)0x7FFF0010; // A made-up HWND; see below for why it doesn't matter if it's real.
+	int failures = 0, i, compiled;
+	if (!WindowSnapshotPut(wnd, "Check Window", "AhkCheckClass", 4242, GetTickCount()))
+	{
+		printf("WindowCheckSnapshot: out of memory\n");
+		++failures;
+	}
+	else
+	{
+		for (i = 0; i < (int)(sizeof(sCase) / sizeof(sCase[0])); ++i)
+			for (compiled = 0; compiled < 2; ++compiled)
+				if (WindowCheckIsMatch(wnd, sCase[i].win_title, sCase[i].mode, compiled != 0) != sCase[i].is_match)
+				{
+					printf("WindowCheckSnapshot: \"%s\" (mode %d%s) should %smatch\n", sCase[i].win_title
+						, sCase[i].mode, compiled ? ", compiled" : "", sCase[i].is_match ? "" : "not ");
+					++failures;
+				}
+		// Once discarded, the attributes are fetched from the HWND itself.  Even if it happens to be a real
+		// window, it won't have this title:
+		WindowSnapshotDiscard(wnd);
+		if (WindowCheckIsMatch(wnd, "Check Window", FIND_EXACT, false))
+		{
+			printf("WindowCheckSnapshot: a discarded item was used\n");
+			++failures;
+		}
+	}
+	WindowSnapshotDiscard(wnd); // Don't leave an item for the made-up window.
+
+	#define WINDOW_CHECK_MANY 1000
+	char title[64];
+	for (i = 0; i < WINDOW_CHECK_MANY; ++i)
+	{
+		snprintf(title, sizeof(title), "Check Window %d", i);
+		WindowSnapshotPut((HWND)(size_t)(0x7FFF1000 + i * 4), title, "AhkCheckClass", 4242, GetTickCount());
+	}
+	for (i = 0; i < WINDOW_CHECK_MANY; ++i)
+	{
+		snprintf(title, sizeof(title), "Check Window %d", i);
+		if (!WindowCheckIsMatch((HWND)(size_t)(0x7FFF1000 + i * 4), title, FIND_EXACT, false)) // Only the non-compiled criteria can use a temporary title.
+		{
+			printf("WindowCheckSnapshot: window %d of %d was evicted\n", i + 1, WINDOW_CHECK_MANY);
+			++failures;
+			break; // The others probably were too.
+		}
+	}
+	for (i = 0; i < WINDOW_CHECK_MANY; ++i)
+		WindowSnapshotDiscard((HWND)(size_t)(0x7FFF1000 + i * 4));
+
+	g_WinCacheTime = orig_win_cache_time;
+	return failures;
+}
+
+
+
+int WindowCheckEventWatch()
+// Checks WindowEventWatch::IsCheckDue() with made-up event counts and tick counts: the first check, no
+// events, an event arriving, the WINDOW_EVENT_POLL_INTERVAL fallback, the tick count wrapping around,
+// and a watch without events (e.g. the hooks couldn't be installed), for which every check is due.
+// Each case that has is_first set begins a new watch.
+{
+	static struct {bool is_first, uses_events; UINT event_count; DWORD now; bool is_due; char *description;} sCase[] = {
+		  {true, true, 7, 1000, true, "first check"}
+		, {false, true, 7, 1100, false, "no events"}
+		, {false, true, 8, 1150, true, "an event arrived"}
+		, {false, true, 8, 1200, false, "no events since the event"}
+		, {false, true, 8, 1150 + WINDOW_EVENT_POLL_INTERVAL - 1, false, "no events, just before the poll interval"}
+		, {false, true, 8, 1150 + WINDOW_EVENT_POLL_INTERVAL, true, "no events, poll interval elapsed"}
+		, {false, true, 8, 1150 + WINDOW_EVENT_POLL_INTERVAL + 50, false, "no events since the poll"}
+		, {true, true, 0, 0xFFFFFF00, true, "first check, near the tick count limit"}
+		, {false, true, 0, 0x00000010, false, "no events, tick count wrapped around"}
+		, {false, true, 0, 0xFFFFFF00 + WINDOW_EVENT_POLL_INTERVAL, true, "poll interval elapsed across the wrap"}
+		, {true, false, 3, 1000, true, "without events, first check"}
+		, {false, false, 3, 1001, true, "without events, no events"}
+		, {false, false, 3, 1001, true, "without events, same tick count"}
+	};
+	int failures = 0, case_count = (int)(sizeof(sCase) / sizeof(sCase[0]));
+	for (int i = 0; i < case_count;)
+	{
+		WindowEventWatch watch(false); // Not true, which would install the hooks.
+		watch.mUsesEvents = sCase[i].uses_events; // As though the hooks were installed.
+		do
+		{
+			if (watch.IsCheckDue(sCase[i].event_count, sCase[i].now) != sCase[i].is_due)
+			{
+				printf("WindowCheckEventWatch: %s (events %u, tick %u) should %sbe due\n", sCase[i].description
+					, sCase[i].event_count, sCase[i].now, sCase[i].is_due ? "" : "not ");
+				++failures;
+			}
+		} while (++i < case_count && !sCase[i].is_first);
+		watch.mUsesEvents = false; // So that its destructor doesn't remove hooks that it didn't install.
+	}
+	return failures;
+}
+
+
+
+int WindowCheckCriteria()
+// Checks that WinTitles parsed in advance by ParseWinTitle() (via WindowCriteria::Compile()) and matched
+// by WindowCriteria::AttributesMatch() give the same results as the older path in which
+// WindowSearch::SetCriteria() parses the string and IsMatch() compares it.  Each WinTitle is tried
+// against each candidate in each title match mode.  The candidate is the desktop window, whose attributes
+// are replaced via the window snapshot, because ahk_id must be a real window.
+{
+	HWND desktop = GetDesktopWindow();
+	char id_title[64];
+	snprintf(id_title, sizeof(id_title), "ahk_class Notepad ahk_id %u", (UINT)(size_t)desktop);
+	struct {char *win_title; DWORD criteria; char *title, *class_name;} win_title[] = {
+		  {"Untitled - Notepad ahk_class Notepad ahk_pid 4242", CRITERION_TITLE|CRITERION_CLASS|CRITERION_PID, "Untitled - Notepad", "Notepad"}
+		, {"   ahk_class Notepad", CRITERION_CLASS, "", "Notepad"} // A title of only whitespace is ignored.
+		, {SimpleHeap::Malloc(id_title), CRITERION_CLASS|CRITERION_ID, "", "Notepad"} // The class stops before ahk_id.
+		, {"i)^untitled ahk_class i)^note", CRITERION_TITLE|CRITERION_CLASS, "i)^untitled", "i)^note"} // RegEx options.
+		, {"Untitled ahk_foo ahk_pid 4242", CRITERION_TITLE|CRITERION_PID, "Untitled ahk_foo", ""} // Not a criterion, so part of the title.
+	};
+	static struct {char *title, *class_name; DWORD pid;} sCandidate[] = {
+		  {"Untitled - Notepad", "Notepad", 4242}
+		, {"Untitled - Notepad", "Notepad", 4243}
+		, {"Untitled - Notepad", "NotepadX", 4242}
+		, {"untitled - notepad", "notepad", 4242}
+		, {"Untitled ahk_foo", "Notepad", 4242}
+		, {"Other", "Notepad", 4242}
+		, {"", "Notepad", 4242}
+	};
+	static TitleMatchModes sMode[] = {FIND_IN_LEADING_PART, FIND_ANYWHERE, FIND_EXACT, FIND_REGEX};
+	DWORD orig_win_cache_time = g_WinCacheTime;
+	g_WinCacheTime = 60000; // See WindowCheckSnapshot().
+	global_struct settings;
+	CopyMemory(&settings, g, sizeof(global_struct));
+	WindowSearch ws;
+	WindowCriteria criteria;
+	bool old_match, compiled_match, attributes_match;
+	int failures = 0, w, c, m;
+	for (w = 0; w < (int)(sizeof(win_title) / sizeof(win_title[0])); ++w)
+	{
+		if (!ws.SetCriteria(settings, win_title[w].win_title, "", "", "") || !criteria.Compile(win_title[w].win_title, ""))
+		{
+			printf("WindowCheckCriteria: \"%s\" was rejected\n", win_title[w].win_title);
+			++failures;
+			continue;
+		}
+		if (ws.mCriteria != win_title[w].criteria || criteria.mCriteria != win_title[w].criteria
+			|| (criteria.mCriteria & CRITERION_TITLE) && (strcmp(ws.mCriterionTitle, win_title[w].title) || strcmp(criteria.mTitle, win_title[w].title))
+			|| (criteria.mCriteria & CRITERION_CLASS) && (strcmp(ws.mCriterionClass, win_title[w].class_name) || strcmp(criteria.mClass, win_title[w].class_name)))
+		{
+			printf("WindowCheckCriteria: \"%s\" was parsed incorrectly\n", win_title[w].win_title);
+			++failures;
+			continue;
+		}
+		for (c = 0; c < (int)(sizeof(sCandidate) / sizeof(sCandidate[0])); ++c)
+		{
+			if (!WindowSnapshotPut(desktop, sCandidate[c].title, sCandidate[c].class_name, sCandidate[c].pid, GetTickCount()))
+			{
+				printf("WindowCheckCriteria: out of memory\n");
+				++failures;
+				break;
+			}
+			for (m = 0; m < (int)(sizeof(sMode) / sizeof(sMode[0])); ++m)
+			{
+				old_match = WindowCheckIsMatch(desktop, win_title[w].win_title, sMode[m], false);
+				compiled_match = WindowCheckIsMatch(desktop, win_title[w].win_title, sMode[m], true);
+				attributes_match = criteria.AttributesMatch(sCandidate[c].title, sCandidate[c].class_name, sCandidate[c].pid, sMode[m]);
+				if (compiled_match != old_match || attributes_match != old_match)
+				{
+					printf("WindowCheckCriteria: \"%s\" vs. \"%s\" ahk_class %s ahk_pid %u (mode %d): IsMatch %d, compiled %d, AttributesMatch %d\n"
+						, win_title[w].win_title, sCandidate[c].title, sCandidate[c].class_name, sCandidate[c].pid, sMode[m]
+						, old_match, compiled_match, attributes_match);
+					++failures;
+				}
+			}
+		}
+	}
+	// The first candidate is what the first WinTitle describes, so make sure at least that matches (otherwise
+	// the checks above might pass only because nothing matches at all):
+	WindowSnapshotPut(desktop, sCandidate[0].title, sCandidate[0].class_name, sCandidate[0].pid, GetTickCount());
+	if (!WindowCheckIsMatch(desktop, win_title[0].win_title, FIND_EXACT, false))
+	{
+		printf("WindowCheckCriteria: \"%s\" should match\n", win_title[0].win_title);
+		++failures;
+	}
+	WindowSnapshotDiscard(desktop); // Let the real attributes be fetched if the script searches for it.
+	g_WinCacheTime = orig_win_cache_time;
+	return failures;
+}
+#endif
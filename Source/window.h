@@ -77,6 +77,40 @@ inline bool IsTextMatch(char *aHaystack, char *aNeedle)
 #define CRITERION_CLASS 0x08
 #define CRITERION_GROUP 0x10
 
+DWORD ParseWinTitle(char *aTitle, char *aTitleBuf, char *aClassBuf, char *aGroupBuf, HWND &aHwnd, DWORD &aPID);
+
+class WindowCriteria
+// A WinTitle and WinText that have been parsed in advance, so that the hook thread doesn't have to call
+// WindowSearch::SetCriteria() to parse them all over again every time an #IfWin hotkey or hotstring is
+// pressed.  Instances live in SimpleHeap memory for the life of the script, which is also where the
+// strings are, so there is no constructor or destructor: Compile() initializes everything.
+// Other than Compile(), all methods must be kept thread-safe since they're called by the hook thread.
+{
+public:
+	DWORD mCriteria;      // The same as WindowSearch::mCriteria.
+	bool mUseForeground;  // Whether the title is "A", meaning the active window.
+	char *mTitle;         // The CRITERION_TITLE part of WinTitle.
+	size_t mTitleLength;  // Length of the above.
+	char *mClass;         // For "ahk_class".
+	char *mGroupName;     // For "ahk_group".
+	WinGroup *mGroup;     // NULL until the group exists (it might not be created until a GroupAdd is run).
+	char *mText;          // WinText.
+	HWND mHwnd;           // For "ahk_id".
+	DWORD mPID;           // For "ahk_pid".
+	// For SetTitleMatchMode RegEx, which isn't known to be in effect until the script runs.  So they're
+	// compiled upon first use rather than by Compile():
+	BoundRegEx *mTitleRegEx, *mClassRegEx;
+	volatile bool mRegExBound;
+
+	ResultType Compile(char *aTitle, char *aText);
+	WinGroup *Group();
+	bool AttributesMatch(char *aCandidateTitle, char *aCandidateClass, DWORD aCandidatePID, int aTitleMatchMode);
+private:
+	void BindRegEx();
+};
+
+
+
 class WindowSearch
 {
 	// One of the reasons for having this class is to avoid fetching PID, Class, and Window Text
@@ -99,6 +133,7 @@ public:
 	HWND mCriterionHwnd;                      // For "ahk_id".
 	DWORD mCriterionPID;                      // For "ahk_pid".
 	WinGroup *mCriterionGroup;                // For "ahk_group".
+	WindowCriteria *mCompiledCriteria;        // Non-NULL if the above came from a WindowCriteria, whose title and class are used instead.
 
 	bool mFindLastMatch; // Whether to keep searching even after a match is found, so that last one is found.
 	int mFoundCount;     // Accumulates how many matches have been found (either 0 or 1 unless mFindLastMatch==true).
@@ -129,6 +164,7 @@ public:
 	}
 
 	ResultType SetCriteria(global_struct &aSettings, char *aTitle, char *aText, char *aExcludeTitle, char *aExcludeText);
+	ResultType SetCriteria(global_struct &aSettings, WindowCriteria &aCriteria);
 	void UpdateCandidateAttributes();
 	HWND IsMatch(bool aInvert = false);
 
@@ -136,6 +172,7 @@ public:
 		// For performance and code size, only the most essential members are initialized.
 		// The others do not require it or are intialized by SetCriteria() or SetCandidate().
 		: mCriteria(0), mCriterionExcludeTitle("") // ExcludeTitle is referenced often, so should be initialized.
+		, mCompiledCriteria(NULL)
 		, mFoundCount(0), mFoundParent(NULL) // Must be initialized here since none of the member functions is allowed to do it.
 		, mFoundChild(NULL) // ControlExist() relies upon this.
 		, mCandidateParent(NULL)
@@ -150,6 +187,62 @@ public:
 
 
 
+// WinWait and its relatives use the following to search for their window only after some window has been
+// created, destroyed, shown, hidden, retitled or activated, rather than every time they wake up.  The
+// events are received via SetWinEventHook(), which is installed only while at least one watch exists
+// (or once the window snapshot has been used; see below).
+// If it can't be installed (e.g. Win95), or if the criteria might be affected by something that doesn't
+// raise such an event (such as the text of an Edit control), every check is considered due, which is the
+// same as the old polling.  Even with events, a check is done every WINDOW_EVENT_POLL_INTERVAL in case
+// a window changed without raising an event.
+#define WINDOW_EVENT_POLL_INTERVAL 500
+UINT GetWindowEventCount();
+
+class WindowEventWatch
+{
+	bool mUsesEvents;  // False if every check is due (see above).
+	bool mChecked;     // Whether at least one check has been done.
+	UINT mEventCount;  // The window event count as of the most recent check.
+	DWORD mLastCheck;  // The tick count of the most recent check.
+
+public:
+	WindowEventWatch(bool aUseEvents);
+	~WindowEventWatch();
+	bool IsCheckDue() {return IsCheckDue(GetWindowEventCount(), GetTickCount());}
+	bool IsCheckDue(UINT aEventCount, DWORD aNow);
+	static bool CriteriaAreEventDriven(char *aTitle, char *aText, char *aExcludeText);
+#ifndef AUTOHOTKEYSC
+	friend int WindowCheckEventWatch(); // So that it can check the event-driven mode without installing the hooks.
+#endif
+};
+
+
+
+// The window snapshot (see window.cpp), which is used by WindowSearch when #WinCacheTime is in effect.
+struct WindowSnapshotItem
+{
+	HWND hwnd; // NULL if this item is unused or has been discarded.
+	DWORD time; // The tick count at which the first of the attributes below was fetched.
+	int attributes; // Which of CRITERION_TITLE, CRITERION_CLASS and CRITERION_PID have been fetched.
+	UINT last_use;  // When the item was last used, for choosing which item to reuse (see window.cpp).
+	DWORD pid;
+	char *title;
+	size_t title_capacity;
+	char class_name[WINDOW_CLASS_SIZE];
+};
+WindowSnapshotItem *WindowSnapshotGet(HWND aWnd, int aAttributes);
+WindowSnapshotItem *WindowSnapshotPut(HWND aWnd, char *aTitle, char *aClass, DWORD aPID, DWORD aTime);
+void WindowSnapshotDiscard(HWND aWnd);
+void WindowSnapshotGetCounts(UINT &aHits, UINT &aMisses);
+#ifndef AUTOHOTKEYSC
+// Run by the /Benchmark switch:
+int WindowCheckSnapshot();
+int WindowCheckEventWatch();
+int WindowCheckCriteria();
+#endif
+
+
+
 struct control_list_type
 {
 	// For something this simple, a macro is probably a lot less overhead that making this struct
@@ -225,10 +318,12 @@ HWND WinClose(HWND aWnd, int aTimeToWaitForClose = DEFAULT_WINCLOSE_WAIT, bool a
 
 HWND WinActive(global_struct &aSettings, char *aTitle, char *aText, char *aExcludeTitle, char *aExcludeText
 	, bool aUpdateLastUsed = false);
+HWND WinActive(global_struct &aSettings, WindowCriteria &aCriteria);
 
 HWND WinExist(global_struct &aSettings, char *aTitle, char *aText, char *aExcludeTitle, char *aExcludeText
 	, bool aFindLastMatch = false, bool aUpdateLastUsed = false
 	, HWND aAlreadyVisited[] = NULL, int aAlreadyVisitedCount = 0);
+HWND WinExist(global_struct &aSettings, WindowCriteria &aCriteria);
 
 HWND GetValidLastUsedWindow(global_struct &aSettings);
 